@@ -0,0 +1,142 @@
+/*
+ * pcapng.c - encode PPP packets as pcapng blocks.
+ *
+ * A file starts with a section header block and an interface
+ * description block (pcapng_header), followed by one enhanced packet
+ * block per packet (pcapng_packet).  Everything is in host byte
+ * order, which the byte-order magic in the section header tells
+ * readers about; timestamps are in microseconds, the pcapng default.
+ */
+
+#include <string.h>
+#include "pcapng.h"
+
+#define BT_SHB		0x0a0d0d0a	/* section header block */
+#define BT_IDB		0x00000001	/* interface description block */
+#define BT_EPB		0x00000006	/* enhanced packet block */
+#define BYTE_ORDER_MAGIC	0x1a2b3c4d
+
+#define OPT_ENDOFOPT	0
+#define OPT_SHB_USERAPPL 4
+#define OPT_IF_NAME	2
+
+static unsigned char *
+put32(unsigned char *p, unsigned int v)
+{
+    memcpy(p, &v, 4);
+    return p + 4;
+}
+
+static unsigned char *
+put16(unsigned char *p, unsigned short v)
+{
+    memcpy(p, &v, 2);
+    return p + 2;
+}
+
+/*
+ * put_opt - put a string option, padded to a multiple of 4 bytes.
+ */
+static unsigned char *
+put_opt(unsigned char *p, int code, const char *s)
+{
+    int n;
+
+    n = strlen(s);
+    if (n > PCAPNG_MAXSTR)
+	n = PCAPNG_MAXSTR;
+    p = put16(p, code);
+    p = put16(p, n);
+    memcpy(p, s, n);
+    memset(p + n, 0, (-n) & 3);
+    return p + ((n + 3) & ~3);
+}
+
+/*
+ * end_block - finish a block which started at b and whose contents
+ * end at p, by filling in its length at both ends.
+ */
+static unsigned char *
+end_block(unsigned char *b, unsigned char *p)
+{
+    unsigned int len = p - b + 4;
+
+    put32(b + 4, len);
+    return put32(p, len);
+}
+
+/*
+ * pcapng_header - put the section header and interface description
+ * blocks for a file at buf, which must have PCAPNG_HDR_MAX bytes of
+ * room.  appl and ifname may be NULL.  Returns the length.
+ */
+int
+pcapng_header(unsigned char *buf, const char *appl, const char *ifname,
+	      int snaplen)
+{
+    unsigned char *b, *p;
+
+    b = buf;
+    p = put32(b, BT_SHB);
+    p += 4;
+    p = put32(p, BYTE_ORDER_MAGIC);
+    p = put16(p, 1);			/* version 1.0 */
+    p = put16(p, 0);
+    p = put32(p, 0xffffffff);		/* section length unknown */
+    p = put32(p, 0xffffffff);
+    if (appl != NULL) {
+	p = put_opt(p, OPT_SHB_USERAPPL, appl);
+	p = put32(p, OPT_ENDOFOPT);
+    }
+    p = end_block(b, p);
+
+    b = p;
+    p = put32(b, BT_IDB);
+    p += 4;
+    p = put16(p, PCAPNG_LINKTYPE_PPP_WITH_DIR);
+    p = put16(p, 0);
+    p = put32(p, snaplen);
+    if (ifname != NULL && ifname[0] != 0) {
+	p = put_opt(p, OPT_IF_NAME, ifname);
+	p = put32(p, OPT_ENDOFOPT);
+    }
+    p = end_block(b, p);
+
+    return p - buf;
+}
+
+/*
+ * pcapng_packet - put an enhanced packet block for the len-byte packet
+ * at p, sent or received at *tv, at buf.  At most snaplen bytes
+ * (counting the direction byte) are kept.  buf must have
+ * PCAPNG_PKT_SPACE(len) bytes of room.  Returns the length.
+ */
+int
+pcapng_packet(unsigned char *buf, const struct timeval *tv, int sent,
+	      const unsigned char *p, int len, int snaplen)
+{
+    unsigned char *q;
+    unsigned long long ts;
+    int caplen;
+
+    caplen = len + 1;
+    if (caplen > snaplen)
+	caplen = snaplen;
+    ts = (unsigned long long) tv->tv_sec * 1000000 + tv->tv_usec;
+
+    q = put32(buf, BT_EPB);
+    q += 4;
+    q = put32(q, 0);			/* interface 0 */
+    q = put32(q, ts >> 32);
+    q = put32(q, ts);
+    q = put32(q, caplen);
+    q = put32(q, len + 1);
+    *q = sent? 1: 0;
+    if (caplen > 1)
+	memcpy(q + 1, p, caplen - 1);
+    memset(q + caplen, 0, (-caplen) & 3);
+    q += (caplen + 3) & ~3;
+    q = end_block(buf, q);
+
+    return q - buf;
+}
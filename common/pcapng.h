@@ -0,0 +1,34 @@
+/*
+ * pcapng.h - definitions for writing PPP packets in pcapng format.
+ *
+ * This is shared by pppdump, which can convert record files, and the
+ * capture plugin for pppd, which saves packets as they go past.  Only
+ * the encoding is done here; the callers do their own buffering and
+ * file handling.
+ */
+
+#ifndef PCAPNG_H
+#define PCAPNG_H
+
+#include <sys/time.h>
+
+/*
+ * Packets are written with the pcap link type for PPP with a
+ * direction byte in front: 0 for received, 1 for sent, followed by
+ * the address, control and protocol fields and the data (no FCS).
+ */
+#define PCAPNG_LINKTYPE_PPP_WITH_DIR	204
+
+#define PCAPNG_SNAPLEN	65535		/* default capture length */
+#define PCAPNG_HDR_MAX	512		/* space needed by pcapng_header */
+#define PCAPNG_MAXSTR	128		/* longest name put in the header */
+
+/* space needed by pcapng_packet for a packet of n bytes */
+#define PCAPNG_PKT_SPACE(n)	(28 + (((n) + 1 + 3) & ~3) + 4)
+
+int pcapng_header(unsigned char *buf, const char *appl, const char *ifname,
+		  int snaplen);
+int pcapng_packet(unsigned char *buf, const struct timeval *tv, int sent,
+		  const unsigned char *p, int len, int snaplen);
+
+#endif /* PCAPNG_H */
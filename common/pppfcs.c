@@ -0,0 +1,238 @@
+/*
+ * pppfcs.c - compute the PPP frame check sequences (RFC 1662).
+ *
+ * Both FCS sizes use slicing-by-8: table k holds the FCS contribution
+ * of a byte followed by k zero bytes, so 8 bytes are folded in with 8
+ * independent lookups instead of 8 dependent ones.  The tables are
+ * built from the polynomials by pppfcs_init.
+ *
+ * On x86-64 with gcc, the 32-bit FCS of long blocks is computed with
+ * carry-less multiplies (PCLMULQDQ) folding 64 bytes at a time, when
+ * the CPU has them.  This is the method from Intel's "Fast CRC
+ * Computation for Generic Polynomials Using PCLMULQDQ Instruction";
+ * the FCS-32 is the same CRC as Ethernet's.  It isn't used in the
+ * kernel, where the vector registers aren't ours to use.
+ */
+
+#include <sys/types.h>
+#include <net/ppp_defs.h>
+#include "pppfcs.h"
+
+#if defined(__GNUC__) && defined(__x86_64__) \
+    && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)) \
+    && !defined(_KERNEL) && !defined(KERNEL) && !defined(__KERNEL__)
+#define PPPFCS_CLMUL	1
+#include <wmmintrin.h>
+#include <smmintrin.h>
+#endif
+
+#define FCS16_POLY	0x8408		/* x^16 + x^12 + x^5 + 1, reversed */
+#define FCS32_POLY	0xedb88320	/* the Ethernet CRC, reversed */
+
+u_int16_t pppfcs16_tab[8][256];
+static u_int32_t pppfcs32_tab[8][256];
+static int pppfcs_ready;
+
+#ifdef PPPFCS_CLMUL
+static int use_clmul;
+static u_int32_t fcs32_clmul __P((u_int32_t, const u_char *, int));
+#endif
+
+/*
+ * pppfcs_init - build the tables.  Harmless if called again, or by two
+ * threads at once, since the same values get written.
+ */
+void
+pppfcs_init()
+{
+    int i, j, k;
+    u_int v16;
+    u_int32_t v32;
+
+    if (pppfcs_ready)
+	return;
+    for (i = 0; i < 256; ++i) {
+	v16 = i;
+	v32 = i;
+	for (j = 0; j < 8; ++j) {
+	    v16 = (v16 & 1)? (v16 >> 1) ^ FCS16_POLY: v16 >> 1;
+	    v32 = (v32 & 1)? (v32 >> 1) ^ FCS32_POLY: v32 >> 1;
+	}
+	pppfcs16_tab[0][i] = v16;
+	pppfcs32_tab[0][i] = v32;
+    }
+    for (i = 0; i < 256; ++i) {
+	v16 = pppfcs16_tab[0][i];
+	v32 = pppfcs32_tab[0][i];
+	for (k = 1; k < 8; ++k) {
+	    v16 = (v16 >> 8) ^ pppfcs16_tab[0][v16 & 0xff];
+	    v32 = (v32 >> 8) ^ pppfcs32_tab[0][v32 & 0xff];
+	    pppfcs16_tab[k][i] = v16;
+	    pppfcs32_tab[k][i] = v32;
+	}
+    }
+
+#ifdef PPPFCS_CLMUL
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1")) {
+	/* check it against the tables before trusting it */
+	u_char buf[256];
+
+	for (i = 0; i < sizeof(buf); ++i)
+	    buf[i] = i * 167 + 13;
+	pppfcs_ready = 1;
+	v32 = pppfcs32(PPP_INITFCS32, buf, sizeof(buf));
+	use_clmul = fcs32_clmul(PPP_INITFCS32, buf, sizeof(buf)) == v32;
+    }
+#endif
+    pppfcs_ready = 1;
+}
+
+/*
+ * pppfcs16 - fold len bytes at p into fcs; the same as applying
+ * PPP_FCS16 to each byte in turn.
+ */
+u_int16_t
+pppfcs16(fcs, p, len)
+    u_int fcs;
+    const u_char *p;
+    int len;
+{
+    if (!pppfcs_ready)
+	pppfcs_init();
+    for (; len >= 8; len -= 8, p += 8) {
+	fcs ^= p[0] | (p[1] << 8);
+	fcs = pppfcs16_tab[7][fcs & 0xff] ^ pppfcs16_tab[6][fcs >> 8]
+	    ^ pppfcs16_tab[5][p[2]] ^ pppfcs16_tab[4][p[3]]
+	    ^ pppfcs16_tab[3][p[4]] ^ pppfcs16_tab[2][p[5]]
+	    ^ pppfcs16_tab[1][p[6]] ^ pppfcs16_tab[0][p[7]];
+    }
+    while (--len >= 0)
+	fcs = PPP_FCS16(fcs, *p++);
+    return fcs;
+}
+
+/*
+ * pppfcs32 - fold len bytes at p into fcs.
+ */
+u_int32_t
+pppfcs32(fcs, p, len)
+    u_int32_t fcs;
+    const u_char *p;
+    int len;
+{
+    if (!pppfcs_ready)
+	pppfcs_init();
+#ifdef PPPFCS_CLMUL
+    if (use_clmul && len >= 64) {
+	int n = len & ~15;
+
+	fcs = fcs32_clmul(fcs, p, n);
+	p += n;
+	len -= n;
+    }
+#endif
+    for (; len >= 8; len -= 8, p += 8) {
+	fcs ^= p[0] | (p[1] << 8) | (p[2] << 16) | ((u_int32_t) p[3] << 24);
+	fcs = pppfcs32_tab[7][fcs & 0xff] ^ pppfcs32_tab[6][(fcs >> 8) & 0xff]
+	    ^ pppfcs32_tab[5][(fcs >> 16) & 0xff] ^ pppfcs32_tab[4][fcs >> 24]
+	    ^ pppfcs32_tab[3][p[4]] ^ pppfcs32_tab[2][p[5]]
+	    ^ pppfcs32_tab[1][p[6]] ^ pppfcs32_tab[0][p[7]];
+    }
+    while (--len >= 0)
+	fcs = (fcs >> 8) ^ pppfcs32_tab[0][(fcs ^ *p++) & 0xff];
+    return fcs;
+}
+
+#ifdef PPPFCS_CLMUL
+/*
+ * fcs32_clmul - fold len bytes at p into fcs, where len is at least 64
+ * and a multiple of 16.  Four 128-bit lanes are folded forward 512
+ * bits at a time, then into one lane, which is reduced to 32 bits
+ * with a Barrett reduction.  The constants are powers of x modulo
+ * the (bit-reflected) polynomial, from the paper.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static u_int32_t
+fcs32_clmul(u_int32_t fcs, const u_char *p, int len)
+{
+    static const unsigned long long __attribute__((aligned(16)))
+	k1k2[2] = { 0x0154442bd4ULL, 0x01c6e41596ULL },
+	k3k4[2] = { 0x01751997d0ULL, 0x00ccaa009eULL },
+	k5k0[2] = { 0x0163cd6124ULL, 0 },
+	poly[2] = { 0x01db710641ULL, 0x01f7011641ULL };
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+    x1 = _mm_loadu_si128((const __m128i *) (p + 0x00));
+    x2 = _mm_loadu_si128((const __m128i *) (p + 0x10));
+    x3 = _mm_loadu_si128((const __m128i *) (p + 0x20));
+    x4 = _mm_loadu_si128((const __m128i *) (p + 0x30));
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(fcs));
+    x0 = _mm_load_si128((const __m128i *) k1k2);
+    p += 64;
+    len -= 64;
+
+    while (len >= 64) {
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+	x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+	x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+	x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+	x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+			   _mm_loadu_si128((const __m128i *) (p + 0x00)));
+	x2 = _mm_xor_si128(_mm_xor_si128(x2, x6),
+			   _mm_loadu_si128((const __m128i *) (p + 0x10)));
+	x3 = _mm_xor_si128(_mm_xor_si128(x3, x7),
+			   _mm_loadu_si128((const __m128i *) (p + 0x20)));
+	x4 = _mm_xor_si128(_mm_xor_si128(x4, x8),
+			   _mm_loadu_si128((const __m128i *) (p + 0x30)));
+	p += 64;
+	len -= 64;
+    }
+
+    /* fold the four lanes into one */
+    x0 = _mm_load_si128((const __m128i *) k3k4);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    /* and any 16-byte blocks left */
+    while (len >= 16) {
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x5),
+			   _mm_loadu_si128((const __m128i *) p));
+	p += 16;
+	len -= 16;
+    }
+
+    /* 128 bits down to 64 */
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    x0 = _mm_loadl_epi64((const __m128i *) k5k0);
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    /* Barrett reduction to 32 bits */
+    x0 = _mm_load_si128((const __m128i *) poly);
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return _mm_extract_epi32(x1, 1);
+}
+#endif /* PPPFCS_CLMUL */
@@ -0,0 +1,32 @@
+/*
+ * pppfcs.h - the PPP frame check sequences (RFC 1662), 16 and 32 bits.
+ *
+ * Shared by pppd, pppdump and the STREAMS modules.  <net/ppp_defs.h>
+ * (or "ppp_defs.h") must be included first.
+ *
+ * pppfcs16 and pppfcs32 fold a block of bytes into a running FCS, so
+ * a frame can be checked in pieces: start with PPP_INITFCS (or
+ * PPP_INITFCS32), and after the whole frame including its FCS, the
+ * result is PPP_GOODFCS (PPP_GOODFCS32) if it was received correctly.
+ * PPP_FCS16 steps the 16-bit FCS one byte at a time, for loops which
+ * handle a byte at a time anyway.  pppfcs_init must be called before
+ * PPP_FCS16 is used; the functions call it themselves if need be.
+ */
+
+#ifndef PPPFCS_H
+#define PPPFCS_H
+
+#define PPP_INITFCS32	0xffffffff	/* Initial FCS-32 value */
+#define PPP_GOODFCS32	0xdebb20e3	/* Good final FCS-32 value */
+#define PPP_FCS32LEN	4		/* octets for FCS-32 */
+
+extern u_int16_t pppfcs16_tab[8][256];
+
+#define PPP_FCS16(fcs, c) \
+	(((fcs) >> 8) ^ pppfcs16_tab[0][((fcs) ^ (c)) & 0xff])
+
+void pppfcs_init __P((void));
+u_int16_t pppfcs16 __P((u_int fcs, const u_char *p, int len));
+u_int32_t pppfcs32 __P((u_int32_t fcs, const u_char *p, int len));
+
+#endif /* PPPFCS_H */
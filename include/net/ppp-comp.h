@@ -89,6 +89,10 @@ struct compressor {
 	void	(*incomp) __P((void *state, PACKETPTR mp));
 	/* Return decompression statistics */
 	void	(*decomp_stat) __P((void *state, struct compstat *stats));
+
+	/* Add a packet being sent uncompressed to the compressor's
+	   history, as incomp will at the other end (may be NULL) */
+	void	(*comp_incomp) __P((void *state, PACKETPTR mp));
 };
 #endif /* PACKETPTR */
 
@@ -154,6 +154,24 @@ struct vjstat {
     unsigned int vjs_tossed;	/* inbound packets tossed because of error */
 };
 
+/*
+ * Per-slot statistics for the VJ compressor (PPPIO_GETVJSLOTS returns
+ * one of these for each transmit slot).
+ */
+struct vjslotstat {
+    unsigned int vjss_hits;	/* packets which found this slot's state */
+    unsigned int vjss_misses;	/* times slot taken for a new conversation */
+};
+
+/*
+ * Packets sent without going through the compressor because recent
+ * packets of the same protocol didn't compress (PPPIO_GETBYPSTAT).
+ */
+struct bypstat {
+    unsigned int byp_bytes;	/* bytes bypassed */
+    unsigned int byp_packets;	/* packets bypassed */
+};
+
 struct ppp_stats {
     struct pppstat p;		/* basic PPP statistics */
     struct vjstat vj;		/* VJ header compression statistics */
@@ -57,6 +57,8 @@
 #define PPPIO_GIDLE	_PPPIO(147)	/* get time since last data pkt */
 #define PPPIO_PASSFILT	_PPPIO(148)	/* set filter for packets to pass */
 #define PPPIO_ACTIVEFILT _PPPIO(149)	/* set filter for "link active" pkts */
+#define PPPIO_GETVJSLOTS _PPPIO(150)	/* get per-slot VJ statistics */
+#define PPPIO_GETBYPSTAT _PPPIO(151)	/* get compression bypass stats */
 
 /*
  * Values for PPPIO_CFLAGS
@@ -25,8 +25,10 @@
 #ifndef _VJCOMPRESS_H_
 #define _VJCOMPRESS_H_
 
-#define MAX_STATES 16		/* must be > 2 and < 256 */
+#define MAX_STATES 256		/* must be > 2 and <= 256 */
 #define MAX_HDR	   128
+#define VJ_NSTATES 16		/* states kept in struct vjcompress itself */
+#define VJ_HASHBITS 5		/* log2 of xmit hash buckets for those */
 
 /*
  * Compressed packet format:
@@ -101,9 +103,15 @@
  */
 struct cstate {
     struct cstate *cs_next;	/* next most recently used state (xmit only) */
+    struct cstate *cs_prev;	/* next least recently used (xmit only) */
+    struct cstate *cs_hnext;	/* next in hash chain (xmit only) */
     u_short cs_hlen;		/* size of hdr (receive only) */
     u_char cs_id;		/* connection # associated with this state */
-    u_char cs_filler;
+    u_char cs_hashed;		/* on a hash chain (xmit only) */
+#ifndef VJ_NO_STATS
+    u_int32_t cs_hits;		/* packets which found this state */
+    u_int32_t cs_misses;	/* times taken for a new conversation */
+#endif
     union {
 	char csu_hdr[MAX_HDR];
 	struct ip csu_ip;	/* ip/tcp hdr from most recent packet */
@@ -114,23 +122,36 @@ struct cstate {
 
 /*
  * all the state data for one serial line (we need one of these per line).
+ * Up to VJ_NSTATES states each way live in the structure; more than
+ * that are allocated by vj_compress_init and freed by vj_compress_free.
  */
 struct vjcompress {
     struct cstate *last_cs;	/* most recently used tstate */
     u_char last_recv;		/* last rcvd conn. id */
     u_char last_xmit;		/* last sent conn. id */
     u_short flags;
+    u_short xslots;		/* number of xmit states in use */
+    u_short rslots;		/* number of rcv states in use */
+    u_short hashbits;		/* log2 of number of hash buckets */
 #ifndef VJ_NO_STATS
     struct vjstat stats;
 #endif
-    struct cstate tstate[MAX_STATES];	/* xmit connection states */
-    struct cstate rstate[MAX_STATES];	/* receive connection states */
+    struct cstate **hash;	/* xmit states by addresses & ports */
+    struct cstate *tstate;	/* xmit connection states */
+    struct cstate *rstate;	/* receive connection states */
+    char *space;		/* allocated for the above, or NULL */
+    u_int spacelen;
+    struct cstate *hash0[1 << VJ_HASHBITS];
+    struct cstate tstate0[VJ_NSTATES];
+    struct cstate rstate0[VJ_NSTATES];
 };
 
 /* flag values */
 #define VJF_TOSS 1		/* tossing rcvd frames because of input err */
 
-extern void  vj_compress_init __P((struct vjcompress *comp, int max_state));
+extern int   vj_compress_init __P((struct vjcompress *comp, int max_xstate,
+				int max_rstate));
+extern void  vj_compress_free __P((struct vjcompress *comp));
 extern u_int vj_compress_tcp __P((struct ip *ip, u_int mlen,
 				struct vjcompress *comp, int compress_cid_flag,
 				u_char **vjhdrp));
@@ -53,17 +53,9 @@
 #include <net/ppp_defs.h>
 #include "ppp_mod.h"
 
-#ifdef SVR4
-#include <sys/byteorder.h>
-#ifndef _BIG_ENDIAN
-#define BSD_LITTLE_ENDIAN
-#endif
-#endif
-
 #ifdef __osf__
 #undef FIRST
 #undef LAST
-#define BSD_LITTLE_ENDIAN
 #endif
 
 #ifdef SOL2
@@ -95,6 +87,13 @@
  *	    things up, this makes it more likely that the transmitter
  *	    and receiver will agree when the dictionary is cleared when
  *	    compression is not going well.
+ *
+ *  The dictionary itself is private to each end, so its layout is
+ *  not part of the protocol.  (prefix,suffix) pairs are found through
+ *  a hash table with about 1.3 entries per code, probed linearly, so
+ *  a lookup usually touches a single cache line.  Codes are mapped
+ *  back to their (prefix,suffix) through a separate table indexed by
+ *  code, which is what the decompressor walks.
  */
 
 /*
@@ -103,7 +102,6 @@
 struct bsd_db {
     int	    totlen;			/* length of this structure */
     u_int   hsize;			/* size of the hash table */
-    u_char  hshift;			/* used in hash function */
     u_char  n_bits;			/* current bits/code */
     u_char  maxbits;
     u_char  debug;
@@ -124,25 +122,18 @@ struct bsd_db {
     u_int   uncomp_bytes;		/* uncompressed bytes */
     u_int   comp_count;			/* compressed packets */
     u_int   comp_bytes;			/* compressed bytes */
-    u_short *lens;			/* array of lengths of codes */
-    struct bsd_dict {
-	union {				/* hash value */
-	    u_int32_t	fcode;
-	    struct {
-#ifdef BSD_LITTLE_ENDIAN
-		u_short prefix;		/* preceding code */
-		u_char	suffix;		/* last character of new code */
-		u_char	pad;
-#else
-		u_char	pad;
-		u_char	suffix;		/* last character of new code */
-		u_short prefix;		/* preceding code */
-#endif
-	    } hs;
-	} f;
-	u_short codem1;			/* output of hash table -1 */
-	u_short cptr;			/* map code to hash table entry */
-    } dict[1];
+    struct bsd_hent {			/* (prefix,suffix) -> code */
+	u_int32_t fcode;		/* BSD_KEY(prefix,suffix) */
+	u_short	codem1;			/* output of hash table -1 */
+	u_short	pad;
+    } *hash;
+    struct bsd_code {			/* code -> (prefix,suffix) */
+	u_short	prefix;			/* preceding code */
+	u_char	suffix;			/* last character of this code */
+	u_char	pad;
+	u_short	hslot;			/* hash table entry for this code */
+	u_short	len;			/* length of string */
+    } codes[1];
 };
 
 #define BSD_OVHD	2		/* BSD compress overhead/packet */
@@ -180,6 +171,7 @@ struct compressor ppp_bsd_compress = {
     bsd_decompress,		/* decompress */
     bsd_incomp,			/* incomp */
     bsd_comp_stats,		/* decomp_stat */
+    NULL,			/* comp_incomp */
 };
 
 /*
@@ -193,10 +185,11 @@ struct compressor ppp_bsd_compress = {
 #define MAXCODE(b)	((1 << (b)) - 1)
 #define BADCODEM1	MAXCODE(BSD_MAX_BITS)
 
-#define BSD_HASH(prefix,suffix,hshift)	((((u_int32_t)(suffix)) << (hshift)) \
-					 ^ (u_int32_t)(prefix))
 #define BSD_KEY(prefix,suffix)		((((u_int32_t)(suffix)) << 16) \
 					 + (u_int32_t)(prefix))
+/* scale the top 16 bits of the product to 0..hsize-1 (hsize < 65536) */
+#define BSD_HASH(fcode,hsize)		((((u_int32_t)((fcode) * 0x9e3779b1U) \
+					   >> 16) * (hsize)) >> 16)
 
 #define CHECK_GAP	10000		/* Ratio check interval */
 
@@ -323,7 +316,7 @@ bsd_alloc(options, opt_len, decomp)
     int opt_len, decomp;
 {
     int bits;
-    u_int newlen, hsize, hshift, maxmaxcode;
+    u_int newlen, hsize, maxmaxcode;
     struct bsd_db *db;
 
     if (opt_len != 3 || options[0] != CI_BSD_COMPRESS || options[1] != 3
@@ -331,36 +324,18 @@ bsd_alloc(options, opt_len, decomp)
 	return NULL;
 
     bits = BSD_NBITS(options[2]);
-    switch (bits) {
-    case 9:			/* needs 82152 for both directions */
-    case 10:			/* needs 84144 */
-    case 11:			/* needs 88240 */
-    case 12:			/* needs 96432 */
-	hsize = 5003;
-	hshift = 4;
-	break;
-    case 13:			/* needs 176784 */
-	hsize = 9001;
-	hshift = 5;
-	break;
-    case 14:			/* needs 353744 */
-	hsize = 18013;
-	hshift = 6;
-	break;
-    case 15:			/* needs 691440 */
-	hsize = 35023;
-	hshift = 7;
-	break;
-    case 16:			/* needs 1366160--far too much, */
-	/* hsize = 69001; */	/* and 69001 is too big for cptr */
-	/* hshift = 8; */	/* in struct bsd_db */
-	/* break; */
-    default:
-	return NULL;
-    }
+    if (bits < BSD_MIN_BITS || bits > BSD_MAX_BITS)
+	return NULL;		/* 16 would need 1.2MB per direction */
 
+    /*
+     * The hash table has about 1.3 entries per code, so it is at most
+     * 77% full.  It is allocated separately from the codes, so that
+     * neither allocation is large: at 15 bits they are 262232 and
+     * 340776 bytes, and at 9 bits 4184 and 5312.
+     */
     maxmaxcode = MAXCODE(bits);
-    newlen = sizeof(*db) + (hsize-1) * (sizeof(db->dict[0]));
+    hsize = maxmaxcode * 13 / 10;
+    newlen = sizeof(*db) + maxmaxcode * sizeof(db->codes[0]);
 #ifdef __osf__
     db = (struct bsd_db *) ALLOC_SLEEP(newlen);
 #else
@@ -368,25 +343,19 @@ bsd_alloc(options, opt_len, decomp)
 #endif
     if (!db)
 	return NULL;
-    bzero(db, sizeof(*db) - sizeof(db->dict));
-
-    if (!decomp) {
-	db->lens = NULL;
-    } else {
+    bzero(db, sizeof(*db) - sizeof(db->codes));
 #ifdef __osf__
-	db->lens = (u_short *) ALLOC_SLEEP((maxmaxcode+1) * sizeof(db->lens[0]));
+    db->hash = (struct bsd_hent *) ALLOC_SLEEP(hsize * sizeof(db->hash[0]));
 #else
-	db->lens = (u_short *) ALLOC_NOSLEEP((maxmaxcode+1) * sizeof(db->lens[0]));
+    db->hash = (struct bsd_hent *) ALLOC_NOSLEEP(hsize * sizeof(db->hash[0]));
 #endif
-	if (!db->lens) {
-	    FREE(db, newlen);
-	    return NULL;
-	}
+    if (!db->hash) {
+	FREE(db, newlen);
+	return NULL;
     }
 
     db->totlen = newlen;
     db->hsize = hsize;
-    db->hshift = hshift;
     db->maxmaxcode = maxmaxcode;
     db->maxbits = bits;
 
@@ -399,8 +368,7 @@ bsd_free(state)
 {
     struct bsd_db *db = (struct bsd_db *) state;
 
-    if (db->lens)
-	FREE(db->lens, (db->maxmaxcode+1) * sizeof(db->lens[0]));
+    FREE(db->hash, db->hsize * sizeof(db->hash[0]));
     FREE(db, db->totlen);
 }
 
@@ -434,20 +402,16 @@ bsd_init(db, options, opt_len, unit, hdrlen, mru, debug, decomp)
     if (opt_len < CILEN_BSD_COMPRESS
 	|| options[0] != CI_BSD_COMPRESS || options[1] != CILEN_BSD_COMPRESS
 	|| BSD_VERSION(options[2]) != BSD_CURRENT_VERSION
-	|| BSD_NBITS(options[2]) != db->maxbits
-	|| decomp && db->lens == NULL)
+	|| BSD_NBITS(options[2]) != db->maxbits)
 	return 0;
 
-    if (decomp) {
-	i = LAST+1;
-	while (i != 0)
-	    db->lens[--i] = 1;
-    }
+    bzero(db->codes, (db->maxmaxcode + 1) * sizeof(db->codes[0]));
+    i = LAST+1;
+    while (i != 0)
+	db->codes[--i].len = 1;
     i = db->hsize;
-    while (i != 0) {
-	db->dict[--i].codem1 = BADCODEM1;
-	db->dict[i].cptr = 0;
-    }
+    while (i != 0)
+	db->hash[--i].codem1 = BADCODEM1;
 
     db->unit = unit;
     db->hdrlen = hdrlen;
@@ -497,14 +461,14 @@ bsd_compress(state, mretp, mp, slen, maxolen)
     int maxolen;		/* max compressed length */
 {
     struct bsd_db *db = (struct bsd_db *) state;
-    int hshift = db->hshift;
+    u_int hsize = db->hsize;
     u_int max_ent = db->max_ent;
     u_int n_bits = db->n_bits;
     u_int bitno = 32;
     u_int32_t accm = 0, fcode;
-    struct bsd_dict *dictp;
+    struct bsd_hent *hp;
     u_char c;
-    int hval, disp, ent, ilen;
+    int hval, ent, ilen;
     mblk_t *np, *mret;
     u_char *rptr, *wptr;
     u_char *cp_end;
@@ -527,14 +491,38 @@ bsd_compress(state, mretp, mp, slen, maxolen)
     ++olen;						\
 }
 
+/*
+ * Codes are at most 15 bits, so the top half of accm always has
+ * room for another one; flush it 16 bits at a time.
+ */
+#define PUTWORD(v) {					\
+    if (wptr && cp_end - wptr > 2) {			\
+	wptr[0] = (v) >> 8;				\
+	wptr[1] = (v);					\
+	wptr += 2;					\
+	olen += 2;					\
+    } else {						\
+	PUTBYTE((v) >> 8);				\
+	PUTBYTE(v);					\
+    }							\
+}
+
 #define OUTPUT(ent) {					\
     bitno -= n_bits;					\
     accm |= ((ent) << bitno);				\
-    do {						\
+    if (bitno <= 16) {					\
+	PUTWORD(accm >> 16);				\
+	accm <<= 16;					\
+	bitno += 16;					\
+    }							\
+}
+
+#define FLUSH() {					\
+    while (bitno <= 24) {				\
 	PUTBYTE(accm >> 24);				\
 	accm <<= 8;					\
 	bitno += 8;					\
-    } while (bitno <= 24);				\
+    }							\
 }
 
     /*
@@ -615,28 +603,19 @@ bsd_compress(state, mretp, mp, slen, maxolen)
 	slen--;
 	c = *rptr++;
 	fcode = BSD_KEY(ent, c);
-	hval = BSD_HASH(ent, c, hshift);
-	dictp = &db->dict[hval];
-
-	/* Validate and then check the entry. */
-	if (dictp->codem1 >= max_ent)
-	    goto nomatch;
-	if (dictp->f.fcode == fcode) {
-	    ent = dictp->codem1+1;
-	    continue;	/* found (prefix,suffix) */
-	}
+	hval = BSD_HASH(fcode, hsize);
 
-	/* continue probing until a match or invalid entry */
-	disp = (hval == 0) ? 1 : hval;
-	do {
-	    hval += disp;
-	    if (hval >= db->hsize)
-		hval -= db->hsize;
-	    dictp = &db->dict[hval];
-	    if (dictp->codem1 >= max_ent)
+	/* probe until a match or an invalid entry */
+	for (;;) {
+	    hp = &db->hash[hval];
+	    if (hp->codem1 >= max_ent)
 		goto nomatch;
-	} while (dictp->f.fcode != fcode);
-	ent = dictp->codem1 + 1;	/* finally found (prefix,suffix) */
+	    if (hp->fcode == fcode)
+		break;
+	    if (++hval == hsize)
+		hval = 0;
+	}
+	ent = hp->codem1 + 1;	/* found (prefix,suffix) */
 	continue;
 
     nomatch:
@@ -644,7 +623,7 @@ bsd_compress(state, mretp, mp, slen, maxolen)
 
 	/* code -> hashtable */
 	if (max_ent < db->maxmaxcode) {
-	    struct bsd_dict *dictp2;
+	    struct bsd_code *cp;
 	    /* expand code size if needed */
 	    if (max_ent >= MAXCODE(n_bits))
 		db->n_bits = ++n_bits;
@@ -652,12 +631,12 @@ bsd_compress(state, mretp, mp, slen, maxolen)
 	    /* Invalidate old hash table entry using
 	     * this code, and then take it over.
 	     */
-	    dictp2 = &db->dict[max_ent+1];
-	    if (db->dict[dictp2->cptr].codem1 == max_ent)
-		db->dict[dictp2->cptr].codem1 = BADCODEM1;
-	    dictp2->cptr = hval;
-	    dictp->codem1 = max_ent;
-	    dictp->f.fcode = fcode;
+	    cp = &db->codes[max_ent+1];
+	    if (db->hash[cp->hslot].codem1 == max_ent)
+		db->hash[cp->hslot].codem1 = BADCODEM1;
+	    cp->hslot = hval;
+	    hp->codem1 = max_ent;
+	    hp->fcode = fcode;
 
 	    db->max_ent = ++max_ent;
 	}
@@ -665,13 +644,16 @@ bsd_compress(state, mretp, mp, slen, maxolen)
     }
 
     OUTPUT(ent);		/* output the last code */
+    FLUSH();
     db->bytes_out += olen;
     db->in_count += ilen;
     if (bitno < 32)
 	++db->bytes_out;	/* count complete bytes */
 
-    if (bsd_check(db))
+    if (bsd_check(db)) {
 	OUTPUT(CLEAR);		/* do not count the CLEAR */
+	FLUSH();
+    }
 
     /*
      * Pad dribble bits of last code with ones.
@@ -707,7 +689,9 @@ bsd_compress(state, mretp, mp, slen, maxolen)
 
     *mretp = mret;
     return olen + PPP_HDRLEN + BSD_OVHD;
+#undef FLUSH
 #undef OUTPUT
+#undef PUTWORD
 #undef PUTBYTE
 }
 
@@ -722,13 +706,13 @@ bsd_incomp(state, dmsg)
     mblk_t *dmsg;
 {
     struct bsd_db *db = (struct bsd_db *) state;
-    u_int hshift = db->hshift;
+    u_int hsize = db->hsize;
     u_int max_ent = db->max_ent;
     u_int n_bits = db->n_bits;
-    struct bsd_dict *dictp;
+    struct bsd_hent *hp;
     u_int32_t fcode;
     u_char c;
-    long hval, disp;
+    u_int hval;
     int slen, ilen;
     u_int bitno = 7;
     u_char *rptr;
@@ -761,36 +745,27 @@ bsd_incomp(state, dmsg)
 	do {
 	    c = *rptr++;
 	    fcode = BSD_KEY(ent, c);
-	    hval = BSD_HASH(ent, c, hshift);
-	    dictp = &db->dict[hval];
+	    hval = BSD_HASH(fcode, hsize);
 
-	    /* validate and then check the entry */
-	    if (dictp->codem1 >= max_ent)
-		goto nomatch;
-	    if (dictp->f.fcode == fcode) {
-		ent = dictp->codem1+1;
-		continue;   /* found (prefix,suffix) */
-	    }
-
-	    /* continue probing until a match or invalid entry */
-	    disp = (hval == 0) ? 1 : hval;
-	    do {
-		hval += disp;
-		if (hval >= db->hsize)
-		    hval -= db->hsize;
-		dictp = &db->dict[hval];
-		if (dictp->codem1 >= max_ent)
+	    /* probe until a match or an invalid entry */
+	    for (;;) {
+		hp = &db->hash[hval];
+		if (hp->codem1 >= max_ent)
 		    goto nomatch;
-	    } while (dictp->f.fcode != fcode);
-	    ent = dictp->codem1+1;
-	    continue;	/* finally found (prefix,suffix) */
+		if (hp->fcode == fcode)
+		    break;
+		if (++hval == hsize)
+		    hval = 0;
+	    }
+	    ent = hp->codem1+1;
+	    continue;	/* found (prefix,suffix) */
 
 	nomatch:		/* output (count) the prefix */
 	    bitno += n_bits;
 
 	    /* code -> hashtable */
 	    if (max_ent < db->maxmaxcode) {
-		struct bsd_dict *dictp2;
+		struct bsd_code *cp;
 		/* expand code size if needed */
 		if (max_ent >= MAXCODE(n_bits))
 		    db->n_bits = ++n_bits;
@@ -798,15 +773,17 @@ bsd_incomp(state, dmsg)
 		/* Invalidate previous hash table entry
 		 * assigned this code, and then take it over.
 		 */
-		dictp2 = &db->dict[max_ent+1];
-		if (db->dict[dictp2->cptr].codem1 == max_ent)
-		    db->dict[dictp2->cptr].codem1 = BADCODEM1;
-		dictp2->cptr = hval;
-		dictp->codem1 = max_ent;
-		dictp->f.fcode = fcode;
+		cp = &db->codes[max_ent+1];
+		if (db->hash[cp->hslot].codem1 == max_ent)
+		    db->hash[cp->hslot].codem1 = BADCODEM1;
+		cp->hslot = hval;
+		cp->prefix = ent;
+		cp->suffix = c;
+		cp->len = db->codes[ent].len + 1;
+		hp->codem1 = max_ent;
+		hp->fcode = fcode;
 
 		db->max_ent = ++max_ent;
-		db->lens[max_ent] = db->lens[ent]+1;
 	    }
 	    ent = c;
 	} while (--slen != 0);
@@ -856,7 +833,7 @@ bsd_decompress(state, cmsg, dmpp)
     u_int bitno = 32;		/* 1st valid bit in accm */
     u_int n_bits = db->n_bits;
     u_int tgtbitno = 32-n_bits;	/* bitno when we have a code */
-    struct bsd_dict *dictp;
+    struct bsd_code *cp;
     int explen, i, seq, len;
     u_int incode, oldcode, finchar;
     u_char *p, *rptr, *wptr;
@@ -984,7 +961,7 @@ bsd_decompress(state, cmsg, dmpp)
 	    extra = 0;
 	}
 
-	codelen = db->lens[finchar];
+	codelen = db->codes[finchar].len;
 	explen += codelen + extra;
 	if (explen > db->mru + 1) {
 	    freemsg(dmsg);
@@ -1013,27 +990,27 @@ bsd_decompress(state, cmsg, dmpp)
 	}
 	p = (wptr += codelen);
 	while (finchar > LAST) {
-	    dictp = &db->dict[db->dict[finchar].cptr];
+	    cp = &db->codes[finchar];
 #ifdef DEBUG
 	    --codelen;
 	    if (codelen <= 0) {
 		freemsg(dmsg);
 		printf("bsd_decomp%d: fell off end of chain ", db->unit);
 		printf("0x%x at 0x%x by 0x%x, max_ent=0x%x\n",
-		       incode, finchar, db->dict[finchar].cptr, max_ent);
+		       incode, finchar, cp->prefix, max_ent);
 		return DECOMP_FATALERROR;
 	    }
-	    if (dictp->codem1 != finchar-1) {
+	    if (db->hash[cp->hslot].codem1 != finchar-1) {
 		freemsg(dmsg);
 		printf("bsd_decomp%d: bad code chain 0x%x finchar=0x%x ",
 		       db->unit, incode, finchar);
-		printf("oldcode=0x%x cptr=0x%x codem1=0x%x\n", oldcode,
-		       db->dict[finchar].cptr, dictp->codem1);
+		printf("oldcode=0x%x hslot=0x%x codem1=0x%x\n", oldcode,
+		       cp->hslot, db->hash[cp->hslot].codem1);
 		return DECOMP_FATALERROR;
 	    }
 #endif
-	    *--p = dictp->f.hs.suffix;
-	    finchar = dictp->f.hs.prefix;
+	    *--p = cp->suffix;
+	    finchar = cp->prefix;
 	}
 	*--p = finchar;
 
@@ -1054,39 +1031,35 @@ bsd_decompress(state, cmsg, dmpp)
 	 * with uncompressed packets.
 	 */
 	if (oldcode != CLEAR && max_ent < db->maxmaxcode) {
-	    struct bsd_dict *dictp2;
+	    struct bsd_hent *hp;
 	    u_int32_t fcode;
-	    int hval, disp;
+	    u_int hval;
 
 	    fcode = BSD_KEY(oldcode,finchar);
-	    hval = BSD_HASH(oldcode,finchar,db->hshift);
-	    dictp = &db->dict[hval];
+	    hval = BSD_HASH(fcode,db->hsize);
 
 	    /* look for a free hash table entry */
-	    if (dictp->codem1 < max_ent) {
-		disp = (hval == 0) ? 1 : hval;
-		do {
-		    hval += disp;
-		    if (hval >= db->hsize)
-			hval -= db->hsize;
-		    dictp = &db->dict[hval];
-		} while (dictp->codem1 < max_ent);
-	    }
+	    while (db->hash[hval].codem1 < max_ent)
+		if (++hval == db->hsize)
+		    hval = 0;
+	    hp = &db->hash[hval];
 
 	    /*
 	     * Invalidate previous hash table entry
 	     * assigned this code, and then take it over
 	     */
-	    dictp2 = &db->dict[max_ent+1];
-	    if (db->dict[dictp2->cptr].codem1 == max_ent) {
-		db->dict[dictp2->cptr].codem1 = BADCODEM1;
+	    cp = &db->codes[max_ent+1];
+	    if (db->hash[cp->hslot].codem1 == max_ent) {
+		db->hash[cp->hslot].codem1 = BADCODEM1;
 	    }
-	    dictp2->cptr = hval;
-	    dictp->codem1 = max_ent;
-	    dictp->f.fcode = fcode;
+	    cp->hslot = hval;
+	    cp->prefix = oldcode;
+	    cp->suffix = finchar;
+	    cp->len = db->codes[oldcode].len + 1;
+	    hp->codem1 = max_ent;
+	    hp->fcode = fcode;
 
 	    db->max_ent = ++max_ent;
-	    db->lens[max_ent] = db->lens[oldcode]+1;
 
 	    /* Expand code size if needed. */
 	    if (max_ent >= MAXCODE(n_bits) && max_ent < db->maxmaxcode) {
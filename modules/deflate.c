@@ -74,6 +74,8 @@ struct deflate_state {
     int		hdrlen;
     int		mru;
     int		debug;
+    int		stored;		/* deflate set to level 0 by z_comp_incomp */
+    u_int	mem;		/* bytes of zlib memory held */
     z_stream	strm;
     struct compstat stats;
 };
@@ -99,6 +101,7 @@ static int	z_decompress __P((void *state, mblk_t *cmp,
 static void	z_comp_reset __P((void *state));
 static void	z_decomp_reset __P((void *state));
 static void	z_comp_stats __P((void *state, struct compstat *stats));
+static void	z_comp_incomp __P((void *state, mblk_t *mp));
 
 /*
  * Procedures exported to ppp_comp.c.
@@ -118,6 +121,7 @@ struct compressor ppp_deflate = {
     z_decompress,		/* decompress */
     z_incomp,			/* incomp */
     z_comp_stats,		/* decomp_stat */
+    z_comp_incomp,		/* comp_incomp */
 };
 
 struct compressor ppp_deflate_draft = {
@@ -135,12 +139,23 @@ struct compressor ppp_deflate_draft = {
     z_decompress,		/* decompress */
     z_incomp,			/* incomp */
     z_comp_stats,		/* decomp_stat */
+    z_comp_incomp,		/* comp_incomp */
 };
 
 #define DECOMP_CHUNK	512
 
 /*
  * Space allocation and freeing routines for use by zlib routines.
+ *
+ * Freed chunks are kept on free lists, one per chunk size, so that
+ * links which renegotiate Deflate, or come up as others go down,
+ * reuse them instead of going back to the kernel allocator.  zlib
+ * asks for the same few sizes for a given window size, so exact
+ * sizes do well.  The deflate_states themselves come from the same
+ * lists.  At most deflate_pool_max bytes are kept (a compressor with
+ * a 32k window uses about 260k, a decompressor about 33k).  The
+ * opaque pointer zlib passes us is the deflate_state, which keeps
+ * count of how much memory it has.
  */
 struct zchunk {
     u_int	size;
@@ -149,43 +164,182 @@ struct zchunk {
 
 #define GUARD_MAGIC	0x77a6011a
 
+/* a free chunk keeps the free list link where its data goes */
+#define ZNEXT(z)	(*(struct zchunk **) ((z) + 1))
+
+#define Z_NCLASS	16		/* number of chunk sizes kept */
+
+u_int deflate_pool_max = 4 * 1024 * 1024; /* most bytes on the free lists */
+
+struct zclass {
+    u_int	size;		/* size of chunks, 0 if class unused */
+    struct zchunk *free;	/* free chunks of that size */
+};
+
+static struct zclass z_classes[Z_NCLASS];
+static u_int z_pool_bytes;	/* bytes on the free lists */
+static u_int z_pool_hits;	/* allocations from the free lists */
+static u_int z_pool_misses;	/* allocations from the kernel */
+
+#ifdef SOL2
+/* ppp_comp is D_MTQPAIR, so links can allocate at the same time */
+static kmutex_t z_pool_lock;
+#define Z_POOL_LOCK	mutex_enter(&z_pool_lock)
+#define Z_POOL_UNLOCK	mutex_exit(&z_pool_lock)
+#else
+#define Z_POOL_LOCK
+#define Z_POOL_UNLOCK
+#endif
+
+static struct zchunk *z_get __P((u_int size, int canwait));
+static void z_put __P((struct zchunk *z));
+static struct deflate_state *z_state_alloc __P((int canwait));
+static void z_state_free __P((struct deflate_state *state));
+
+static struct zchunk *
+z_get(size, canwait)
+    u_int size;
+    int canwait;
+{
+    struct zchunk *z = NULL;
+    struct zclass *zc;
+
+    Z_POOL_LOCK;
+    for (zc = z_classes; zc < &z_classes[Z_NCLASS] && zc->size != 0; ++zc) {
+	if (zc->size == size) {
+	    if ((z = zc->free) != NULL) {
+		zc->free = ZNEXT(z);
+		z_pool_bytes -= size;
+		++z_pool_hits;
+	    }
+	    break;
+	}
+    }
+    if (z == NULL)
+	++z_pool_misses;
+    Z_POOL_UNLOCK;
+
+    if (z == NULL) {
+	if (canwait)
+	    z = (struct zchunk *) ALLOC_SLEEP(size);
+	else
+	    z = (struct zchunk *) ALLOC_NOSLEEP(size);
+	if (z == NULL)
+	    return NULL;
+	z->size = size;
+    }
+    z->guard = GUARD_MAGIC;
+    return z;
+}
+
+static void
+z_put(z)
+    struct zchunk *z;
+{
+    struct zclass *zc;
+
+    Z_POOL_LOCK;
+    if (z_pool_bytes + z->size <= deflate_pool_max) {
+	for (zc = z_classes; zc < &z_classes[Z_NCLASS]; ++zc) {
+	    if (zc->size == 0)
+		zc->size = z->size;
+	    if (zc->size == z->size) {
+		z->guard = 0;
+		ZNEXT(z) = zc->free;
+		zc->free = z;
+		z_pool_bytes += z->size;
+		Z_POOL_UNLOCK;
+		return;
+	    }
+	}
+    }
+    Z_POOL_UNLOCK;
+    FREE(z, z->size);
+}
+
+static struct deflate_state *
+z_state_alloc(canwait)
+    int canwait;
+{
+    struct zchunk *z;
+
+    z = z_get(sizeof(struct zchunk) + sizeof(struct deflate_state), canwait);
+    if (z == NULL)
+	return NULL;
+    return (struct deflate_state *) (z + 1);
+}
+
+static void
+z_state_free(state)
+    struct deflate_state *state;
+{
+    z_put(((struct zchunk *) state) - 1);
+}
+
+/*
+ * z_pool_drain - give the free lists back to the kernel, when the
+ * module is unloaded.
+ */
+void
+z_pool_drain()
+{
+    struct zclass *zc;
+    struct zchunk *z;
+
+    Z_POOL_LOCK;
+    for (zc = z_classes; zc < &z_classes[Z_NCLASS]; ++zc) {
+	while ((z = zc->free) != NULL) {
+	    zc->free = ZNEXT(z);
+	    FREE(z, z->size);
+	}
+	zc->size = 0;
+    }
+    z_pool_bytes = 0;
+    Z_POOL_UNLOCK;
+}
+
 static void *
-z_alloc_init(notused, items, size)
-    void *notused;
+z_alloc_init(arg, items, size)
+    void *arg;
     u_int items, size;
 {
+    struct deflate_state *state = (struct deflate_state *) arg;
     struct zchunk *z;
 
     size = items * size + sizeof(struct zchunk);
 #ifdef __osf__
-    z = (struct zchunk *) ALLOC_SLEEP(size);
+    z = z_get(size, 1);
 #else
-    z = (struct zchunk *) ALLOC_NOSLEEP(size);
+    z = z_get(size, 0);
 #endif
-    z->size = size;
-    z->guard = GUARD_MAGIC;
+    if (z == NULL)
+	return NULL;
+    state->mem += size;
     return (void *) (z + 1);
 }
 
 static void *
-z_alloc(notused, items, size)
-    void *notused;
+z_alloc(arg, items, size)
+    void *arg;
     u_int items, size;
 {
+    struct deflate_state *state = (struct deflate_state *) arg;
     struct zchunk *z;
 
     size = items * size + sizeof(struct zchunk);
-    z = (struct zchunk *) ALLOC_NOSLEEP(size);
-    z->size = size;
-    z->guard = GUARD_MAGIC;
+    z = z_get(size, 0);
+    if (z == NULL)
+	return NULL;
+    state->mem += size;
     return (void *) (z + 1);
 }
 
 static void
-z_free(notused, ptr)
-    void *notused;
+z_free(arg, ptr)
+    void *arg;
     void *ptr;
 {
+    struct deflate_state *state = (struct deflate_state *) arg;
     struct zchunk *z = ((struct zchunk *) ptr) - 1;
 
     if (z->guard != GUARD_MAGIC) {
@@ -193,7 +347,8 @@ z_free(notused, ptr)
 	       z, z->size, z->guard);
 	return;
     }
-    FREE(z, z->size);
+    state->mem -= z->size;
+    z_put(z);
 }
 
 /*
@@ -223,25 +378,28 @@ z_comp_alloc(options, opt_len)
 
 
 #ifdef __osf__
-    state = (struct deflate_state *) ALLOC_SLEEP(sizeof(*state));
+    state = z_state_alloc(1);
 #else
-    state = (struct deflate_state *) ALLOC_NOSLEEP(sizeof(*state));
+    state = z_state_alloc(0);
 #endif
 
     if (state == NULL)
 	return NULL;
 
+    state->mem = 0;
     state->strm.next_in = NULL;
+    state->strm.opaque = (voidpf) state;
     state->strm.zalloc = (alloc_func) z_alloc_init;
     state->strm.zfree = (free_func) z_free;
     if (deflateInit2(&state->strm, Z_DEFAULT_COMPRESSION, DEFLATE_METHOD_VAL,
 		     -w_size, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
-	FREE(state, sizeof(*state));
+	z_state_free(state);
 	return NULL;
     }
 
     state->strm.zalloc = (alloc_func) z_alloc;
     state->w_size = w_size;
+    state->stored = 0;
     bzero(&state->stats, sizeof(state->stats));
     return (void *) state;
 }
@@ -253,7 +411,7 @@ z_comp_free(arg)
     struct deflate_state *state = (struct deflate_state *) arg;
 
     deflateEnd(&state->strm);
-    FREE(state, sizeof(*state));
+    z_state_free(state);
 }
 
 static int
@@ -278,6 +436,8 @@ z_comp_init(arg, options, opt_len, unit, hdrlen, debug)
     state->debug = debug;
 
     deflateReset(&state->strm);
+    if (debug)
+	printf("z_comp_init%d: %u bytes of zlib memory\n", unit, state->mem);
 
     return 1;
 }
@@ -318,6 +478,14 @@ z_compress(arg, mret, mp, orig_len, maxolen)
     if (proto > 0x3fff || proto == 0xfd || proto == 0xfb)
 	return orig_len;
 
+    if (state->stored) {
+	/* back to compressing after z_comp_incomp */
+	state->strm.next_out = NULL;
+	state->strm.avail_out = 1000000;
+	deflateParams(&state->strm, Z_DEFAULT_COMPRESSION, Z_DEFAULT_STRATEGY);
+	state->stored = 0;
+    }
+
     /* Allocate one mblk initially. */
     if (maxolen > orig_len)
 	maxolen = orig_len;
@@ -433,6 +601,80 @@ z_compress(arg, mret, mp, orig_len, maxolen)
     return olen;
 }
 
+/*
+ * Add a packet which is being sent uncompressed, without having been
+ * through z_compress, to the compressor's history, so that it stays
+ * the same as the peer's after its z_incomp.  The data go through
+ * deflate at level 0, which copies them into the window and puts out
+ * stored blocks (thrown away here) without searching for matches.
+ * That is safe for the same reason as sending a packet uncompressed
+ * when z_compress made it bigger: every packet ends with a
+ * Z_PACKET_FLUSH, so nothing carries over into the next one.  For
+ * the same reason, the flush deflateParams does when changing level
+ * finds nothing to do.
+ */
+static void
+z_comp_incomp(arg, mp)
+    void *arg;
+    mblk_t *mp;
+{
+    struct deflate_state *state = (struct deflate_state *) arg;
+    u_char *rptr;
+    int proto, len, r, flush;
+
+    rptr = mp->b_rptr;
+    if (rptr + PPP_HDRLEN > mp->b_wptr) {
+	if (!pullupmsg(mp, PPP_HDRLEN))
+	    return;
+	rptr = mp->b_rptr;
+    }
+    proto = PPP_PROTOCOL(rptr);
+    if (proto > 0x3fff || proto == 0xfd || proto == 0xfb)
+	return;
+
+    ++state->seqno;
+    state->strm.next_out = NULL;
+    state->strm.avail_out = 1000000;
+    if (!state->stored) {
+	deflateParams(&state->strm, 0, Z_DEFAULT_STRATEGY);
+	state->stored = 1;
+    }
+
+    len = mp->b_wptr - rptr;
+    rptr += (proto > 0xff)? 2: 3;	/* skip 1st proto byte if 0 */
+    state->strm.next_in = rptr;
+    state->strm.avail_in = mp->b_wptr - rptr;
+    mp = mp->b_cont;
+    flush = (mp == NULL)? Z_PACKET_FLUSH: Z_NO_FLUSH;
+    for (;;) {
+	r = deflate(&state->strm, flush);
+	if (r != Z_OK) {
+	    printf("z_comp_incomp: deflate returned %d (%s)\n",
+		   r, (state->strm.msg? state->strm.msg: ""));
+	    break;
+	}
+	if (flush != Z_NO_FLUSH && state->strm.avail_out != 0)
+	    break;		/* all done */
+	if (state->strm.avail_in == 0 && mp != NULL) {
+	    state->strm.next_in = mp->b_rptr;
+	    state->strm.avail_in = mp->b_wptr - mp->b_rptr;
+	    len += state->strm.avail_in;
+	    mp = mp->b_cont;
+	    if (mp == NULL)
+		flush = Z_PACKET_FLUSH;
+	}
+	if (state->strm.avail_out == 0) {
+	    state->strm.next_out = NULL;
+	    state->strm.avail_out = 1000000;
+	}
+    }
+
+    state->stats.inc_bytes += len;
+    state->stats.inc_packets++;
+    state->stats.unc_bytes += len;
+    state->stats.unc_packets++;
+}
+
 static void
 z_comp_stats(arg, stats)
     void *arg;
@@ -478,18 +720,20 @@ z_decomp_alloc(options, opt_len)
 	return NULL;
 
 #ifdef __osf__
-    state = (struct deflate_state *) ALLOC_SLEEP(sizeof(*state));
+    state = z_state_alloc(1);
 #else
-    state = (struct deflate_state *) ALLOC_NOSLEEP(sizeof(*state));
+    state = z_state_alloc(0);
 #endif
     if (state == NULL)
 	return NULL;
 
+    state->mem = 0;
     state->strm.next_out = NULL;
+    state->strm.opaque = (voidpf) state;
     state->strm.zalloc = (alloc_func) z_alloc_init;
     state->strm.zfree = (free_func) z_free;
     if (inflateInit2(&state->strm, -w_size) != Z_OK) {
-	FREE(state, sizeof(*state));
+	z_state_free(state);
 	return NULL;
     }
 
@@ -506,7 +750,7 @@ z_decomp_free(arg)
     struct deflate_state *state = (struct deflate_state *) arg;
 
     inflateEnd(&state->strm);
-    FREE(state, sizeof(*state));
+    z_state_free(state);
 }
 
 static int
@@ -532,6 +776,8 @@ z_decomp_init(arg, options, opt_len, unit, hdrlen, mru, debug)
     state->mru = mru;
 
     inflateReset(&state->strm);
+    if (debug)
+	printf("z_decomp_init%d: %u bytes of zlib memory\n", unit, state->mem);
 
     return 1;
 }
@@ -82,6 +82,7 @@
 #include <net/ppp_defs.h>
 #include <net/pppio.h>
 #include "ppp_mod.h"
+#include "../common/pppfcs.h"
 
 /*
  * Right now, mutex is only enabled for Solaris 2.x
@@ -112,6 +113,7 @@ static int ahdlc_rput __P((queue_t *, mblk_t *));
 static void ahdlc_encode __P((queue_t *, mblk_t *));
 static void ahdlc_decode __P((queue_t *, mblk_t *));
 static int msg_byte __P((mblk_t *, unsigned int));
+static int ahdlc_clean_run __P((uchar_t *, uchar_t *, u_int32_t *));
 
 #if defined(SOL2)
 /*
@@ -201,44 +203,6 @@ typedef struct ahdlc_state {
  */
 #define RCV_FLAGS	(RCV_B7_1|RCV_B7_0|RCV_ODDP|RCV_EVNP)
 
-/*
- * FCS lookup table as calculated by genfcstab.
- */
-static u_short fcstab[256] = {
-	0x0000,	0x1189,	0x2312,	0x329b,	0x4624,	0x57ad,	0x6536,	0x74bf,
-	0x8c48,	0x9dc1,	0xaf5a,	0xbed3,	0xca6c,	0xdbe5,	0xe97e,	0xf8f7,
-	0x1081,	0x0108,	0x3393,	0x221a,	0x56a5,	0x472c,	0x75b7,	0x643e,
-	0x9cc9,	0x8d40,	0xbfdb,	0xae52,	0xdaed,	0xcb64,	0xf9ff,	0xe876,
-	0x2102,	0x308b,	0x0210,	0x1399,	0x6726,	0x76af,	0x4434,	0x55bd,
-	0xad4a,	0xbcc3,	0x8e58,	0x9fd1,	0xeb6e,	0xfae7,	0xc87c,	0xd9f5,
-	0x3183,	0x200a,	0x1291,	0x0318,	0x77a7,	0x662e,	0x54b5,	0x453c,
-	0xbdcb,	0xac42,	0x9ed9,	0x8f50,	0xfbef,	0xea66,	0xd8fd,	0xc974,
-	0x4204,	0x538d,	0x6116,	0x709f,	0x0420,	0x15a9,	0x2732,	0x36bb,
-	0xce4c,	0xdfc5,	0xed5e,	0xfcd7,	0x8868,	0x99e1,	0xab7a,	0xbaf3,
-	0x5285,	0x430c,	0x7197,	0x601e,	0x14a1,	0x0528,	0x37b3,	0x263a,
-	0xdecd,	0xcf44,	0xfddf,	0xec56,	0x98e9,	0x8960,	0xbbfb,	0xaa72,
-	0x6306,	0x728f,	0x4014,	0x519d,	0x2522,	0x34ab,	0x0630,	0x17b9,
-	0xef4e,	0xfec7,	0xcc5c,	0xddd5,	0xa96a,	0xb8e3,	0x8a78,	0x9bf1,
-	0x7387,	0x620e,	0x5095,	0x411c,	0x35a3,	0x242a,	0x16b1,	0x0738,
-	0xffcf,	0xee46,	0xdcdd,	0xcd54,	0xb9eb,	0xa862,	0x9af9,	0x8b70,
-	0x8408,	0x9581,	0xa71a,	0xb693,	0xc22c,	0xd3a5,	0xe13e,	0xf0b7,
-	0x0840,	0x19c9,	0x2b52,	0x3adb,	0x4e64,	0x5fed,	0x6d76,	0x7cff,
-	0x9489,	0x8500,	0xb79b,	0xa612,	0xd2ad,	0xc324,	0xf1bf,	0xe036,
-	0x18c1,	0x0948,	0x3bd3,	0x2a5a,	0x5ee5,	0x4f6c,	0x7df7,	0x6c7e,
-	0xa50a,	0xb483,	0x8618,	0x9791,	0xe32e,	0xf2a7,	0xc03c,	0xd1b5,
-	0x2942,	0x38cb,	0x0a50,	0x1bd9,	0x6f66,	0x7eef,	0x4c74,	0x5dfd,
-	0xb58b,	0xa402,	0x9699,	0x8710,	0xf3af,	0xe226,	0xd0bd,	0xc134,
-	0x39c3,	0x284a,	0x1ad1,	0x0b58,	0x7fe7,	0x6e6e,	0x5cf5,	0x4d7c,
-	0xc60c,	0xd785,	0xe51e,	0xf497,	0x8028,	0x91a1,	0xa33a,	0xb2b3,
-	0x4a44,	0x5bcd,	0x6956,	0x78df,	0x0c60,	0x1de9,	0x2f72,	0x3efb,
-	0xd68d,	0xc704,	0xf59f,	0xe416,	0x90a9,	0x8120,	0xb3bb,	0xa232,
-	0x5ac5,	0x4b4c,	0x79d7,	0x685e,	0x1ce1,	0x0d68,	0x3ff3,	0x2e7a,
-	0xe70e,	0xf687,	0xc41c,	0xd595,	0xa12a,	0xb0a3,	0x8238,	0x93b1,
-	0x6b46,	0x7acf,	0x4854,	0x59dd,	0x2d62,	0x3ceb,	0x0e70,	0x1ff9,
-	0xf78f,	0xe606,	0xd49d,	0xc514,	0xb1ab,	0xa022,	0x92b9,	0x8330,
-	0x7bc7,	0x6a4e,	0x58d5,	0x495c,	0x3de3,	0x2c6a,	0x1ef1,	0x0f78
-};
-
 static u_int32_t paritytab[8] =
 {
 	0x96696996, 0x69969669, 0x69969669, 0x96696996,
@@ -266,6 +230,8 @@ MOD_OPEN(ahdlc_open)
 	return 0;
     }
 
+    pppfcs_init();
+
     state = (ahdlc_state_t *) ALLOC_NOSLEEP(sizeof(ahdlc_state_t));
     if (state == 0)
 	OPEN_ERROR(ENOSR);
@@ -571,6 +537,49 @@ ahdlc_rput(q, mp)
  */
 #define IN_TX_MAP(c, m)	((m)[(c) >> 5] & (1 << ((c) & 0x1f)))
 
+/*
+ * Word-at-a-time byte tests: HAS_BYTE is non-zero if any byte of the
+ * 32-bit word w equals b, HAS_LESS if any byte is less than n (n <= 0x80).
+ */
+#define ONES32		0x01010101
+#define HIGHS32		0x80808080
+#define HAS_LESS(w, n)	(((w) - ONES32 * (n)) & ~(w) & HIGHS32)
+#define HAS_BYTE(w, b)	HAS_LESS((w) ^ (ONES32 * (b)), 1)
+
+/*
+ * Return the number of bytes from dp (up to ep) that are not in the
+ * 256-bit map m and so can be copied as they are.  When the map is
+ * the usual one - some control characters plus 0x7d and 0x7e - whole
+ * aligned words are checked at once and only words that might hold
+ * a mapped byte are looked at a byte at a time.
+ */
+static int
+ahdlc_clean_run(dp, ep, m)
+    uchar_t	*dp, *ep;
+    u_int32_t	*m;
+{
+    uchar_t	*sp = dp;
+    u_int32_t	w;
+
+    if (m[1] == 0 && m[2] == 0 && m[3] == 0x60000000 &&
+	(m[4] | m[5] | m[6] | m[7]) == 0) {
+	while (dp < ep && ((uintpointer_t) dp & (sizeof(w) - 1)) != 0) {
+	    if (IN_TX_MAP(*dp, m))
+		return dp - sp;
+	    ++dp;
+	}
+	for (; ep - dp >= sizeof(w); dp += sizeof(w)) {
+	    w = *(u_int32_t *) dp;
+	    if (HAS_BYTE(w, PPP_FLAG) || HAS_BYTE(w, PPP_ESCAPE) ||
+		(m[0] != 0 && HAS_LESS(w, 0x20)))
+		break;
+	}
+    }
+    while (dp < ep && !IN_TX_MAP(*dp, m))
+	++dp;
+    return dp - sp;
+}
+
 static void
 ahdlc_encode(q, mp)
     queue_t	*q;
@@ -582,7 +591,7 @@ ahdlc_encode(q, mp)
     size_t		outmp_len;
     mblk_t		*outmp, *tmp;
     uchar_t		*dp, fcs_val;
-    int			is_lcp, code;
+    int			is_lcp, code, n;
 #if defined(SOL2)
     clock_t		lbolt;
 #endif /* SOL2 */
@@ -661,14 +670,23 @@ ahdlc_encode(q, mp)
      */
     for (tmp = mp; tmp; tmp = tmp->b_cont) {
 	if (tmp->b_datap->db_type == M_DATA) {
+	    /*
+	     * Copy runs of bytes that need no escaping in one go,
+	     * then escape the byte that ended the run.
+	     */
 	    for (dp = tmp->b_rptr; dp < tmp->b_wptr; dp++) {
-		fcs = PPP_FCS(fcs, *dp);
-		if (IN_TX_MAP(*dp, xaccm)) {
-		    *outmp->b_wptr++ = PPP_ESCAPE;
-		    *outmp->b_wptr++ = *dp ^ PPP_TRANS;
-		} else {
-		    *outmp->b_wptr++ = *dp;
+		n = ahdlc_clean_run(dp, tmp->b_wptr, xaccm);
+		if (n > 0) {
+		    fcs = pppfcs16(fcs, dp, n);
+		    bcopy((caddr_t)dp, (caddr_t)outmp->b_wptr, n);
+		    outmp->b_wptr += n;
+		    dp += n;
+		    if (dp >= tmp->b_wptr)
+			break;
 		}
+		fcs = PPP_FCS16(fcs, *dp);
+		*outmp->b_wptr++ = PPP_ESCAPE;
+		*outmp->b_wptr++ = *dp ^ PPP_TRANS;
 	    }
 	} else {
 	    continue;	/* skip if db_type is something other than M_DATA */
@@ -729,6 +747,8 @@ ahdlc_decode(q, mp)
     ahdlc_state_t   *state;
     mblk_t	    *om;
     uchar_t	    *dp;
+    u_int32_t	    rmap[8];
+    int		    n, room;
 
     state = (ahdlc_state_t *) q->q_ptr;
 
@@ -738,9 +758,40 @@ ahdlc_decode(q, mp)
 
     state->stats.ppp_ibytes += msgdsize(mp);
 
+    /*
+     * Bytes that end a run of plain data: flag, escape, and the
+     * control characters in the receive ACCM.
+     */
+    bzero((caddr_t)rmap, sizeof(rmap));
+    rmap[0] = state->raccm;
+    rmap[3] = 0x60000000;
+
     for (; mp != 0; om = mp->b_cont, freeb(mp), mp = om)
     for (dp = mp->b_rptr; dp < mp->b_wptr; dp++) {
 
+	/*
+	 * Inside a frame, once all of the 8-bit and parity flags have
+	 * been seen, plain data can be copied straight into the receive
+	 * buffer.  The byte that ends the run goes through the normal
+	 * path below.
+	 */
+	if (state->rx_buf != 0 &&
+	    (state->flags & (IFLUSH | ESCAPED | RCV_FLAGS)) == RCV_FLAGS) {
+	    n = ahdlc_clean_run(dp, mp->b_wptr, rmap);
+	    room = state->rx_buf_size -
+		(state->rx_buf->b_wptr - state->rx_buf->b_rptr);
+	    if (n > room)
+		n = room;
+	    if (n > 0) {
+		state->infcs = pppfcs16(state->infcs, dp, n);
+		bcopy((caddr_t)dp, (caddr_t)state->rx_buf->b_wptr, n);
+		state->rx_buf->b_wptr += n;
+		dp += n;
+		if (dp >= mp->b_wptr)
+		    break;
+	    }
+	}
+
 	/*
 	 * This should detect the lack of 8-bit communication channel
 	 * which is necessary for PPP to work. In addition, it also
@@ -844,7 +895,7 @@ ahdlc_decode(q, mp)
 	 * and grab the next incoming one
 	 */
 	if (msgdsize(state->rx_buf) < state->rx_buf_size) {
-	    state->infcs = PPP_FCS(state->infcs, *dp);
+	    state->infcs = PPP_FCS16(state->infcs, *dp);
 	    *state->rx_buf->b_wptr++ = *dp;
 	} else {
 	    DPRINT2("ppp%d: frame too long (%d)\n",
@@ -66,10 +66,20 @@ typedef u_long  n_long;
 #include <net/ppp_defs.h>
 #include <net/vjcompress.h>
 
+#if defined(SVR4) || defined(SUNOS4) || defined(__osf__) || defined(AIX4)
+#include "ppp_mod.h"		/* for ALLOC_NOSLEEP and FREE */
+#else
+#include <stdlib.h>
+#define ALLOC_NOSLEEP(n)	malloc(n)
+#define FREE(p, n)		free(p)
+#endif
+
 #ifndef VJ_NO_STATS
 #define INCR(counter) ++comp->stats.counter
+#define CSINCR(cs, counter) ++(cs)->counter
 #else
 #define INCR(counter)
+#define CSINCR(cs, counter)
 #endif
 
 #define BCMP(p1, p2, n) bcmp((char *)(p1), (char *)(p2), (int)(n))
@@ -88,27 +98,161 @@ typedef u_long  n_long;
 #define getth_off(base)	((base).th_off)
 #endif
 
-void
-vj_compress_init(comp, max_state)
+/*
+ * Transmit states are found by hashing the addresses and ports (the
+ * first word of the TCP header), so that finding a state doesn't get
+ * slower with more slots.
+ */
+#define VJ_HASH(comp, src, dst, ports) \
+	vj_hash((u_int32_t)(src), (u_int32_t)(dst), (u_int32_t)(ports), \
+		(comp)->hashbits)
+#define CS_HASH(comp, cs) VJ_HASH(comp, (cs)->cs_ip.ip_src.s_addr, \
+				  (cs)->cs_ip.ip_dst.s_addr, \
+				  ((int *)&(cs)->cs_ip)[getip_hl((cs)->cs_ip)])
+
+static u_int vj_hash __P((u_int32_t, u_int32_t, u_int32_t, u_int));
+static void vj_unhash __P((struct vjcompress *, struct cstate *));
+
+/*
+ * Fibonacci hashing, taking the top bits of the product.  The words
+ * are mixed in one at a time rather than xor'ed together first, since
+ * addresses and ports often go up in step (e.g. behind a NAT), and
+ * would cancel out.
+ */
+static u_int
+vj_hash(src, dst, ports, bits)
+    u_int32_t src, dst, ports;
+    u_int bits;
+{
+    register u_int32_t h;
+
+    h = src * 0x9e3779b1;
+    h = (h ^ dst) * 0x9e3779b1;
+    h = (h ^ ports) * 0x9e3779b1;
+    return h >> (32 - bits);
+}
+
+/*
+ * Take a transmit state off its hash chain.
+ */
+static void
+vj_unhash(comp, cs)
     struct vjcompress *comp;
-    int max_state;
+    struct cstate *cs;
 {
-    register u_int i;
-    register struct cstate *tstate = comp->tstate;
+    register struct cstate **csp;
+
+    for (csp = &comp->hash[CS_HASH(comp, cs)]; *csp != NULL;
+	 csp = &(*csp)->cs_hnext) {
+	if (*csp == cs) {
+	    *csp = cs->cs_hnext;
+	    break;
+	}
+    }
+    cs->cs_hnext = NULL;
+    cs->cs_hashed = 0;
+}
 
-    if (max_state == -1)
-	max_state = MAX_STATES - 1;
+/*
+ * Set up for max_xstate + 1 transmit and max_rstate + 1 receive
+ * states; a negative count means the default of VJ_NSTATES.  comp
+ * must have been zeroed before it is first set up.  If there is no
+ * memory for more than VJ_NSTATES states, we set up with that many
+ * and return -1.
+ */
+int
+vj_compress_init(comp, max_xstate, max_rstate)
+    struct vjcompress *comp;
+    int max_xstate, max_rstate;
+{
+    register u_int i;
+    register struct cstate *tstate;
+    u_int hashbits, len;
+    char *p;
+    int ret = 0;
+
+    if (max_xstate < 0)
+	max_xstate = VJ_NSTATES - 1;
+    else if (max_xstate >= MAX_STATES)
+	max_xstate = MAX_STATES - 1;
+    if (max_rstate < 0)
+	max_rstate = VJ_NSTATES - 1;
+    else if (max_rstate >= MAX_STATES)
+	max_rstate = MAX_STATES - 1;
+    vj_compress_free(comp);
     bzero((char *)comp, sizeof(*comp));
-    for (i = max_state; i > 0; --i) {
+
+    /* about two hash buckets for each transmit state */
+    for (hashbits = VJ_HASHBITS; (1 << hashbits) < 2 * (max_xstate + 1);
+	 ++hashbits)
+	;
+    len = 0;
+    if (max_xstate >= VJ_NSTATES)
+	len += (max_xstate + 1) * sizeof(struct cstate)
+	    + (sizeof(struct cstate *) << hashbits);
+    if (max_rstate >= VJ_NSTATES)
+	len += (max_rstate + 1) * sizeof(struct cstate);
+    if (len != 0) {
+	comp->space = (char *) ALLOC_NOSLEEP(len);
+	if (comp->space == NULL) {
+	    if (max_xstate >= VJ_NSTATES)
+		max_xstate = VJ_NSTATES - 1;
+	    if (max_rstate >= VJ_NSTATES)
+		max_rstate = VJ_NSTATES - 1;
+	    hashbits = VJ_HASHBITS;
+	    ret = -1;
+	} else {
+	    bzero(comp->space, len);
+	    comp->spacelen = len;
+	}
+    }
+    p = comp->space;
+    if (max_xstate >= VJ_NSTATES) {
+	comp->tstate = (struct cstate *) p;
+	p += (max_xstate + 1) * sizeof(struct cstate);
+    } else
+	comp->tstate = comp->tstate0;
+    if (max_rstate >= VJ_NSTATES) {
+	comp->rstate = (struct cstate *) p;
+	p += (max_rstate + 1) * sizeof(struct cstate);
+    } else
+	comp->rstate = comp->rstate0;
+    if (max_xstate >= VJ_NSTATES)
+	comp->hash = (struct cstate **) p;
+    else
+	comp->hash = comp->hash0;
+    comp->hashbits = hashbits;
+    comp->rslots = max_rstate + 1;
+
+    tstate = comp->tstate;
+    for (i = max_xstate; i > 0; --i) {
 	tstate[i].cs_id = i;
 	tstate[i].cs_next = &tstate[i - 1];
+	tstate[i - 1].cs_prev = &tstate[i];
     }
-    tstate[0].cs_next = &tstate[max_state];
+    tstate[0].cs_next = &tstate[max_xstate];
+    tstate[max_xstate].cs_prev = &tstate[0];
     tstate[0].cs_id = 0;
     comp->last_cs = &tstate[0];
+    comp->xslots = max_xstate + 1;
     comp->last_recv = 255;
     comp->last_xmit = 255;
     comp->flags = VJF_TOSS;
+    return ret;
+}
+
+/*
+ * Free what vj_compress_init allocated.
+ */
+void
+vj_compress_free(comp)
+    struct vjcompress *comp;
+{
+    if (comp->space != NULL) {
+	FREE(comp->space, comp->spacelen);
+	comp->space = NULL;
+	comp->spacelen = 0;
+    }
 }
 
 
@@ -178,6 +322,7 @@ vj_compress_tcp(ip, mlen, comp, compress_cid, vjhdrp)
 {
     register struct cstate *cs = comp->last_cs->cs_next;
     register u_int hlen = getip_hl(*ip);
+    register u_int h;
     register struct tcphdr *oth;
     register struct tcphdr *th;
     register u_int deltaS, deltaA;
@@ -209,28 +354,27 @@ vj_compress_tcp(ip, mlen, comp, compress_cid, vjhdrp)
 	ip->ip_dst.s_addr != cs->cs_ip.ip_dst.s_addr ||
 	*(int *)th != ((int *)&cs->cs_ip)[getip_hl(cs->cs_ip)]) {
 	/*
-	 * Wasn't the first -- search for it.
+	 * Wasn't the first -- look it up.
 	 *
-	 * States are kept in a circularly linked list with
-	 * last_cs pointing to the end of the list.  The
-	 * list is kept in lru order by moving a state to the
-	 * head of the list whenever it is referenced.  Since
-	 * the list is short and, empirically, the connection
-	 * we want is almost always near the front, we locate
-	 * states via linear search.  If we don't find a state
-	 * for the datagram, the oldest state is (re-)used.
+	 * States are kept in a circular, doubly linked list with
+	 * last_cs pointing to the end of the list.  The list is
+	 * kept in lru order by moving a state to the head of the
+	 * list whenever it is referenced.  States in use are also
+	 * on a hash chain, which is how we find them.  If we don't
+	 * find a state for the datagram, the oldest state is
+	 * (re-)used.
 	 */
-	register struct cstate *lcs;
 	register struct cstate *lastcs = comp->last_cs;
 
-	do {
-	    lcs = cs; cs = cs->cs_next;
+	cs = comp->hash[VJ_HASH(comp, ip->ip_src.s_addr, ip->ip_dst.s_addr,
+				*(int *)th)];
+	for (; cs != NULL; cs = cs->cs_hnext) {
 	    INCR(vjs_searches);
 	    if (ip->ip_src.s_addr == cs->cs_ip.ip_src.s_addr
 		&& ip->ip_dst.s_addr == cs->cs_ip.ip_dst.s_addr
 		&& *(int *)th == ((int *)&cs->cs_ip)[getip_hl(cs->cs_ip)])
 		goto found;
-	} while (cs != lastcs);
+	}
 
 	/*
 	 * Didn't find it -- re-use oldest cstate.  Send an
@@ -238,14 +382,21 @@ vj_compress_tcp(ip, mlen, comp, compress_cid, vjhdrp)
 	 * connection number we're using for this conversation.
 	 * Note that since the state list is circular, the oldest
 	 * state points to the newest and we only need to set
-	 * last_cs to update the lru linkage.
+	 * last_cs to update the lru linkage.  The state goes on
+	 * its new hash chain once its header has been replaced.
+	 * The lru list is rotated even if the packet then turns
+	 * out to be too short, as it always has been.
 	 */
 	INCR(vjs_misses);
-	comp->last_cs = lcs;
+	cs = lastcs;
+	comp->last_cs = cs->cs_prev;
 	hlen += getth_off(*th);
 	hlen <<= 2;
 	if (hlen > mlen)
 	    return (TYPE_IP);
+	if (cs->cs_hashed)
+	    vj_unhash(comp, cs);
+	CSINCR(cs, cs_misses);
 	goto uncompressed;
 
     found:
@@ -253,13 +404,17 @@ vj_compress_tcp(ip, mlen, comp, compress_cid, vjhdrp)
 	 * Found it -- move to the front on the connection list.
 	 */
 	if (cs == lastcs)
-	    comp->last_cs = lcs;
+	    comp->last_cs = cs->cs_prev;
 	else {
-	    lcs->cs_next = cs->cs_next;
+	    cs->cs_prev->cs_next = cs->cs_next;
+	    cs->cs_next->cs_prev = cs->cs_prev;
 	    cs->cs_next = lastcs->cs_next;
+	    cs->cs_prev = lastcs;
+	    lastcs->cs_next->cs_prev = cs;
 	    lastcs->cs_next = cs;
 	}
     }
+    CSINCR(cs, cs_hits);
 
     /*
      * Make sure that only what we expect to change changed. The first
@@ -414,6 +569,12 @@ vj_compress_tcp(ip, mlen, comp, compress_cid, vjhdrp)
      */
  uncompressed:
     BCOPY(ip, &cs->cs_ip, hlen);
+    if (!cs->cs_hashed) {
+	h = CS_HASH(comp, cs);
+	cs->cs_hnext = comp->hash[h];
+	comp->hash[h] = cs;
+	cs->cs_hashed = 1;
+    }
     ip->ip_p = cs->cs_id;
     comp->last_xmit = cs->cs_id;
     return (TYPE_UNCOMPRESSED_TCP);
@@ -445,7 +606,7 @@ vj_uncompress_uncomp(buf, buflen, comp)
 
     ip = (struct ip *) buf;
     hlen = getip_hl(*ip) << 2;
-    if (ip->ip_p >= MAX_STATES
+    if (ip->ip_p >= comp->rslots
 	|| hlen + sizeof(struct tcphdr) > buflen
 	|| (hlen += getth_off(*((struct tcphdr *)&((char *)ip)[hlen])) << 2)
 	    > buflen
@@ -493,7 +654,7 @@ vj_uncompress_tcp(buf, buflen, total_len, comp, hdrp, hlenp)
     if (changes & NEW_C) {
 	/* Make sure the state index is in range, then grab the state.
 	 * If we have a good state index, clear the 'discard' flag. */
-	if (*cp >= MAX_STATES)
+	if (*cp >= comp->rslots)
 	    goto bad;
 
 	comp->flags &=~ VJF_TOSS;
@@ -149,10 +149,10 @@ static struct wordlist *permitted_numbers;
 static struct wordlist *extra_options;
 
 /* Number of network protocols which we have opened. */
-static int num_np_open;
+static int num_np_open[NUM_PPP];
 
 /* Number of network protocols which have come up. */
-static int num_np_up;
+static int num_np_up[NUM_PPP];
 
 /* Set if we got the contents of passwd[] from the pap-secrets file. */
 static int passwd_from_file;
@@ -171,6 +171,10 @@ int (*pap_auth_hook) __P((char *user, char *passwd, char **msgp,
 			  struct wordlist **paddrs,
 			  struct wordlist **popts)) = NULL;
 
+/* The unit whose peer pap_auth_hook or chap_verify_hook is checking;
+   a hook that returns AUTH_PENDING reports the result for this unit. */
+int auth_hook_unit;
+
 /* Hook for a plugin to know about the PAP user logout */
 void (*pap_logout_hook) __P((void)) = NULL;
 
@@ -211,9 +215,9 @@ enum script_state {
     s_up
 };
 
-static enum script_state auth_state = s_down;
-static enum script_state auth_script_state = s_down;
-static pid_t auth_script_pid = 0;
+static enum script_state auth_state[NUM_PPP];
+static enum script_state auth_script_state[NUM_PPP];
+static pid_t auth_script_pid[NUM_PPP];
 
 /*
  * Option variables.
@@ -259,7 +263,7 @@ static int  scan_authfile __P((FILE *, char *, char *, char *,
 			       struct wordlist **, struct wordlist **,
 			       char *, int));
 static void free_wordlist __P((struct wordlist *));
-static void auth_script __P((char *));
+static void auth_script __P((int, char *));
 static void auth_script_done __P((void *));
 static void set_allowed_addrs __P((int, struct wordlist *, struct wordlist *));
 static int  some_ip_ok __P((struct wordlist *));
@@ -591,7 +595,7 @@ void start_link(unit)
     status = EXIT_NEGOTIATION_FAILED;
     new_phase(PHASE_ESTABLISH);
 
-    lcp_lowerup(0);
+    lcp_lowerup(unit);
     return;
 
  disconnect:
@@ -650,7 +654,7 @@ link_terminated(unit)
 	fd_ppp = -1;
     }
     if (!hungup)
-	lcp_lowerdown(0);
+	lcp_lowerdown(unit);
     if (!doing_multilink && !demand)
 	script_unsetenv("IFNAME");
 
@@ -683,13 +687,13 @@ void
 link_down(unit)
     int unit;
 {
-    if (auth_state != s_down) {
-	notify(link_down_notifier, 0);
-	auth_state = s_down;
-	if (auth_script_state == s_up && auth_script_pid == 0) {
+    if (auth_state[unit] != s_down) {
+	notify(link_down_notifier, unit);
+	auth_state[unit] = s_down;
+	if (auth_script_state[unit] == s_up && auth_script_pid[unit] == 0) {
 	    update_link_stats(unit);
-	    auth_script_state = s_down;
-	    auth_script(_PATH_AUTHDOWN);
+	    auth_script_state[unit] = s_down;
+	    auth_script(unit, _PATH_AUTHDOWN);
 	}
     }
     if (!doing_multilink) {
@@ -714,8 +718,8 @@ void upper_layers_down(int unit)
         if (protp->protocol < 0xC000 && protp->close != NULL)
 	    (*protp->close)(unit, "LCP down");
     }
-    num_np_open = 0;
-    num_np_up = 0;
+    num_np_open[unit] = 0;
+    num_np_up[unit] = 0;
 }
 
 /*
@@ -817,11 +821,11 @@ network_phase(unit)
      * If the peer had to authenticate, run the auth-up script now.
      */
     if (go->neg_chap || go->neg_upap || go->neg_eap) {
-	notify(auth_up_notifier, 0);
-	auth_state = s_up;
-	if (auth_script_state == s_down && auth_script_pid == 0) {
-	    auth_script_state = s_up;
-	    auth_script(_PATH_AUTHUP);
+	notify(auth_up_notifier, unit);
+	auth_state[unit] = s_up;
+	if (auth_script_state[unit] == s_down && auth_script_pid[unit] == 0) {
+	    auth_script_state[unit] = s_up;
+	    auth_script(unit, _PATH_AUTHUP);
 	}
     }
 
@@ -877,7 +881,7 @@ start_networks(unit)
     for (i = 0; (protp = protocols[i]) != NULL; ++i)
 	if ((protp->protocol == PPP_ECP || protp->protocol == PPP_CCP)
 	    && protp->enabled_flag && protp->open != NULL)
-	    (*protp->open)(0);
+	    (*protp->open)(unit);
 
     /*
      * Bring up other network protocols iff encryption is not required.
@@ -902,13 +906,13 @@ continue_networks(unit)
 	if (protp->protocol < 0xC000
 	    && protp->protocol != PPP_CCP && protp->protocol != PPP_ECP
 	    && protp->enabled_flag && protp->open != NULL) {
-	    (*protp->open)(0);
-	    ++num_np_open;
+	    (*protp->open)(unit);
+	    ++num_np_open[unit];
 	}
 
-    if (num_np_open == 0)
+    if (num_np_open[unit] == 0)
 	/* nothing to do */
-	lcp_close(0, "No network protocols running");
+	lcp_close(unit, "No network protocols running");
 }
 
 /*
@@ -1069,7 +1073,7 @@ np_up(unit, proto)
 {
     int tlim;
 
-    if (num_np_up == 0) {
+    if (num_np_up[unit] == 0) {
 	/*
 	 * At this point we consider that the link has come up successfully.
 	 */
@@ -1082,18 +1086,18 @@ np_up(unit, proto)
 	else
 	    tlim = idle_time_limit;
 	if (tlim > 0)
-	    TIMEOUT(check_idle, NULL, tlim);
+	    TIMEOUT(check_idle, &lcp_fsm[unit], tlim);
 
 	/*
 	 * Set a timeout to close the connection once the maximum
 	 * connect time has expired.
 	 */
 	if (maxconnect > 0)
-	    TIMEOUT(connect_time_expired, 0, maxconnect);
+	    TIMEOUT(connect_time_expired, &lcp_fsm[unit], maxconnect);
 
 #ifdef MAXOCTETS
 	if (maxoctets > 0)
-	    TIMEOUT(check_maxoctets, NULL, maxoctets_timeout);
+	    TIMEOUT(check_maxoctets, &lcp_fsm[unit], maxoctets_timeout);
 #endif
 
 	/*
@@ -1102,7 +1106,7 @@ np_up(unit, proto)
 	if (updetach && !nodetach)
 	    detach();
     }
-    ++num_np_up;
+    ++num_np_up[unit];
 }
 
 /*
@@ -1112,11 +1116,11 @@ void
 np_down(unit, proto)
     int unit, proto;
 {
-    if (--num_np_up == 0) {
-	UNTIMEOUT(check_idle, NULL);
-	UNTIMEOUT(connect_time_expired, NULL);
+    if (--num_np_up[unit] == 0) {
+	UNTIMEOUT(check_idle, &lcp_fsm[unit]);
+	UNTIMEOUT(connect_time_expired, &lcp_fsm[unit]);
 #ifdef MAXOCTETS
-	UNTIMEOUT(check_maxoctets, NULL);
+	UNTIMEOUT(check_maxoctets, &lcp_fsm[unit]);
 #endif	
 	new_phase(PHASE_NETWORK);
     }
@@ -1129,9 +1133,9 @@ void
 np_finished(unit, proto)
     int unit, proto;
 {
-    if (--num_np_open <= 0) {
+    if (--num_np_open[unit] <= 0) {
 	/* no further use for the link: shut up shop. */
-	lcp_close(0, "No network protocols running");
+	lcp_close(unit, "No network protocols running");
     }
 }
 
@@ -1140,9 +1144,10 @@ static void
 check_maxoctets(arg)
     void *arg;
 {
+    int unit = ((fsm *) arg)->unit;
     unsigned int used;
 
-    update_link_stats(ifunit);
+    update_link_stats(unit);
     link_stats_valid=0;
     
     switch(maxoctets_dir) {
@@ -1163,10 +1168,10 @@ check_maxoctets(arg)
     if (used > maxoctets) {
 	notice("Traffic limit reached. Limit: %u Used: %u", maxoctets, used);
 	status = EXIT_TRAFFIC_LIMIT;
-	lcp_close(0, "Traffic limit");
+	lcp_close(unit, "Traffic limit");
 	need_holdoff = 0;
     } else {
-        TIMEOUT(check_maxoctets, NULL, maxoctets_timeout);
+        TIMEOUT(check_maxoctets, arg, maxoctets_timeout);
     }
 }
 #endif
@@ -1179,11 +1184,12 @@ static void
 check_idle(arg)
     void *arg;
 {
+    int unit = ((fsm *) arg)->unit;
     struct ppp_idle idle;
     time_t itime;
     int tlim;
 
-    if (!get_idle_time(0, &idle))
+    if (!get_idle_time(unit, &idle))
 	return;
     if (idle_time_hook != 0) {
 	tlim = idle_time_hook(&idle);
@@ -1195,10 +1201,10 @@ check_idle(arg)
 	/* link is idle: shut it down. */
 	notice("Terminating connection due to lack of activity.");
 	status = EXIT_IDLE_TIMEOUT;
-	lcp_close(0, "Link inactive");
+	lcp_close(unit, "Link inactive");
 	need_holdoff = 0;
     } else {
-	TIMEOUT(check_idle, NULL, tlim);
+	TIMEOUT(check_idle, arg, tlim);
     }
 }
 
@@ -1211,7 +1217,7 @@ connect_time_expired(arg)
 {
     info("Connect time expired");
     status = EXIT_CONNECT_TIME;
-    lcp_close(0, "Connect time expired");	/* Close connection */
+    lcp_close(((fsm *) arg)->unit, "Connect time expired");
 }
 
 /*
@@ -1360,6 +1366,7 @@ auth_reset(unit)
  *	UPAP_AUTHNAK: Authentication failed.
  *	UPAP_AUTHACK: Authentication succeeded.
  * In either case, msg points to an appropriate message.
+ *	0: A plugin will report the result via pap_auth_complete.
  */
 int
 check_passwd(unit, auser, userlen, apasswd, passwdlen, msg)
@@ -1391,7 +1398,13 @@ check_passwd(unit, auser, userlen, apasswd, passwdlen, msg)
      * Check if a plugin wants to handle this.
      */
     if (pap_auth_hook) {
+	auth_hook_unit = unit;
 	ret = (*pap_auth_hook)(user, passwd, msg, &addrs, &opts);
+	if (ret == AUTH_PENDING) {
+	    /* the plugin will call pap_auth_complete */
+	    BZERO(passwd, sizeof(passwd));
+	    return 0;
+	}
 	if (ret >= 0) {
 	    /* note: set_allowed_addrs() saves opts (but not addrs):
 	       don't free it! */
@@ -1484,6 +1497,30 @@ check_passwd(unit, auser, userlen, apasswd, passwdlen, msg)
     return ret;
 }
 
+/*
+ * pap_auth_complete - called by a plugin whose pap_auth_hook returned
+ * AUTH_PENDING, once it knows whether the peer's username and
+ * password are acceptable.  addrs and opts are as for pap_auth_hook.
+ */
+void
+pap_auth_complete(unit, ok, msg, addrs, opts)
+    int unit;
+    int ok;
+    char *msg;
+    struct wordlist *addrs, *opts;
+{
+    /* note: set_allowed_addrs() saves opts (but not addrs): don't free it! */
+    if (ok)
+	set_allowed_addrs(unit, addrs, opts);
+    else if (opts != 0)
+	free_wordlist(opts);
+    if (addrs != 0)
+	free_wordlist(addrs);
+    if (msg == NULL)
+	msg = "";
+    upap_verify_complete(unit, ok? UPAP_AUTHACK: UPAP_AUTHNAK, msg);
+}
+
 /*
  * null_login - Check if a username of "" and a password of "" are
  * acceptable, and iff so, set the list of acceptable IP addresses
@@ -2098,6 +2135,280 @@ check_access(f, filename)
 }
 
 
+/*
+ * Secrets files are parsed once into an index, kept until the file
+ * changes (different inode, size or modification time), so that the
+ * several lookups made for each authentication don't each have to read
+ * the whole file.  Each entry is one line: client, server, secret and
+ * any further words.  The entries are hashed on their client and server
+ * words, "*" included, so a lookup probes for the exact pair, then the
+ * client with a wildcard server, and so on, which finds the same entry
+ * as scanning the file for the best match would.
+ */
+struct secret_entry {
+    char *client;
+    char *server;
+    char *secret;
+    char **words;		/* addresses and options */
+    int nwords;
+    int flag;			/* NONWILD_CLIENT, NONWILD_SERVER */
+    struct secret_entry *next;	/* in file order */
+    struct secret_entry *hash_next;
+};
+
+struct secrets_file {
+    char *filename;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    struct secret_entry *entries;
+    struct secret_entry **hash;
+    unsigned int hash_mask;
+    struct secrets_file *next;
+};
+
+static struct secrets_file *secrets_files;
+
+static unsigned int
+secret_hash(client, server)
+    char *client, *server;
+{
+    unsigned int h = 0;
+
+    while (*client)
+	h = h * 31 + (unsigned char) *client++;
+    h = h * 31 + '\n';
+    while (*server)
+	h = h * 31 + (unsigned char) *server++;
+    return h;
+}
+
+/*
+ * free_secrets - free the index of a secrets file.
+ */
+static void
+free_secrets(sf)
+    struct secrets_file *sf;
+{
+    struct secret_entry *se;
+
+    while ((se = sf->entries) != NULL) {
+	sf->entries = se->next;
+	BZERO(se->secret, strlen(se->secret));
+	free(se);
+    }
+    free(sf->hash);
+    sf->hash = NULL;
+}
+
+/*
+ * add_secret - make an index entry from the words of one line.
+ */
+static struct secret_entry *
+add_secret(sf, words, nwords, len)
+    struct secrets_file *sf;
+    char **words;
+    int nwords, len;
+{
+    struct secret_entry *se;
+    char *p;
+    int i;
+
+    se = (struct secret_entry *) malloc(sizeof(*se)
+		+ (nwords - 3) * sizeof(char *) + len);
+    if (se == NULL)
+	novm("secrets index");
+    se->words = (char **) (se + 1);
+    p = (char *) (se->words + nwords - 3);
+    for (i = 0; i < nwords; ++i) {
+	strcpy(p, words[i]);
+	words[i] = p;
+	p += strlen(p) + 1;
+    }
+    se->client = words[0];
+    se->server = words[1];
+    se->secret = words[2];
+    for (i = 3; i < nwords; ++i)
+	se->words[i-3] = words[i];
+    se->nwords = nwords - 3;
+    se->flag = (ISWILD(se->client)? 0: NONWILD_CLIENT)
+	| (ISWILD(se->server)? 0: NONWILD_SERVER);
+    se->next = NULL;
+    se->hash_next = NULL;
+    return se;
+}
+
+/*
+ * load_secrets - return the index for the secrets file open on f,
+ * (re)reading the file if we haven't seen this version of it.
+ */
+static struct secrets_file *
+load_secrets(f, filename)
+    FILE *f;
+    char *filename;
+{
+    struct secrets_file *sf;
+    struct secret_entry *se, **tail, **tails;
+    struct stat sbuf;
+    char word[MAXWORDLEN];
+    char *lbuf, **words;
+    int *woff;
+    int lsize, llen, nwords, maxwords, newline, got, n, i;
+    unsigned int h;
+
+    if (fstat(fileno(f), &sbuf) < 0)
+	return NULL;
+    for (sf = secrets_files; sf != NULL; sf = sf->next)
+	if (strcmp(sf->filename, filename) == 0)
+	    break;
+    if (sf != NULL) {
+	if (sf->dev == sbuf.st_dev && sf->ino == sbuf.st_ino
+	    && sf->size == sbuf.st_size && sf->mtime == sbuf.st_mtime)
+	    return sf;
+	free_secrets(sf);
+    } else {
+	sf = (struct secrets_file *) malloc(sizeof(*sf));
+	if (sf == NULL || (sf->filename = strdup(filename)) == NULL)
+	    novm("secrets index");
+	sf->entries = NULL;
+	sf->hash = NULL;
+	sf->next = secrets_files;
+	secrets_files = sf;
+    }
+    sf->dev = sbuf.st_dev;
+    sf->ino = sbuf.st_ino;
+    sf->size = sbuf.st_size;
+    sf->mtime = sbuf.st_mtime;
+
+    /*
+     * Read the file a line at a time.  The words of the current
+     * line are kept one after another in lbuf.
+     */
+    lsize = 1024;
+    maxwords = 16;
+    lbuf = malloc(lsize);
+    words = (char **) malloc(maxwords * sizeof(char *));
+    woff = (int *) malloc(maxwords * sizeof(int));
+    if (lbuf == NULL || words == NULL || woff == NULL)
+	novm("secrets index");
+    tail = &sf->entries;
+    n = 0;
+    rewind(f);
+    llen = nwords = 0;
+    newline = 1;
+    for (;;) {
+	got = getword(f, word, &newline, filename);
+	if (!got || (newline && nwords > 0)) {
+	    /* end of a line; lines without a secret are ignored */
+	    if (nwords >= 3) {
+		for (i = 0; i < nwords; ++i)
+		    words[i] = lbuf + woff[i];
+		*tail = add_secret(sf, words, nwords, llen);
+		tail = &(*tail)->next;
+		++n;
+	    }
+	    BZERO(lbuf, llen);
+	    llen = nwords = 0;
+	    if (!got)
+		break;
+	}
+	if (nwords >= maxwords) {
+	    maxwords *= 2;
+	    words = (char **) realloc(words, maxwords * sizeof(char *));
+	    woff = (int *) realloc(woff, maxwords * sizeof(int));
+	    if (words == NULL || woff == NULL)
+		novm("secrets index");
+	}
+	i = strlen(word) + 1;
+	while (llen + i > lsize) {
+	    lsize *= 2;
+	    lbuf = realloc(lbuf, lsize);
+	    if (lbuf == NULL)
+		novm("secrets index");
+	}
+	/* store offsets, as lbuf may move */
+	woff[nwords++] = llen;
+	memcpy(lbuf + llen, word, i);
+	llen += i;
+    }
+    BZERO(word, sizeof(word));
+    free(lbuf);
+    free(words);
+    free(woff);
+
+    for (h = 1; h < n; h <<= 1)
+	;
+    sf->hash_mask = h - 1;
+    sf->hash = (struct secret_entry **) calloc(h, sizeof(*sf->hash));
+    if (sf->hash == NULL)
+	novm("secrets index");
+    /* append to the chains, so they are in file order */
+    tails = (struct secret_entry **) malloc(h * sizeof(*tails));
+    if (tails == NULL)
+	novm("secrets index");
+    for (se = sf->entries; se != NULL; se = se->next) {
+	h = secret_hash(se->client, se->server) & sf->hash_mask;
+	if (sf->hash[h] == NULL)
+	    sf->hash[h] = se;
+	else
+	    tails[h]->hash_next = se;
+	tails[h] = se;
+    }
+    free(tails);
+    return sf;
+}
+
+/*
+ * secret_usable - check whether an entry can be used, and if so, get
+ * its secret into lsecret (if not NULL), reading it from a file for
+ * the @/pathname syntax.
+ */
+static int
+secret_usable(se, lsecret, flags)
+    struct secret_entry *se;
+    char *lsecret;
+    int flags;
+{
+    char *cp;
+    FILE *sf;
+    char atfile[MAXWORDLEN];
+    char word[MAXWORDLEN];
+    int xxx;
+
+    /*
+     * SRP-SHA1 authenticator should never be reading secrets from
+     * a file.  (Authenticatee may, though.)
+     */
+    if (flags && ((cp = strchr(se->secret, ':')) == NULL ||
+	strchr(cp + 1, ':') == NULL))
+	return 0;
+
+    if (lsecret != NULL) {
+	/*
+	 * Special syntax: @/pathname means read secret from file.
+	 */
+	if (se->secret[0] == '@' && se->secret[1] == '/') {
+	    strlcpy(atfile, se->secret+1, sizeof(atfile));
+	    if ((sf = fopen(atfile, "r")) == NULL) {
+		warn("can't open indirect secret file %s", atfile);
+		return 0;
+	    }
+	    check_access(sf, atfile);
+	    if (!getword(sf, word, &xxx, atfile)) {
+		warn("no secret in indirect secret file %s", atfile);
+		fclose(sf);
+		return 0;
+	    }
+	    fclose(sf);
+	    strlcpy(lsecret, word, MAXWORDLEN);
+	    BZERO(word, sizeof(word));
+	} else
+	    strlcpy(lsecret, se->secret, MAXWORDLEN);
+    }
+    return 1;
+}
+
 /*
  * scan_authfile - Scan an authorization file for a secret suitable
  * for authenticating `client' on `server'.  The return value is -1
@@ -2111,6 +2422,8 @@ check_access(f, filename)
  * We assume secret is NULL or points to MAXWORDLEN bytes of space.
  * Flags are non-zero if we need two colons in the secret in order to
  * match.
+ * If more than one line matches, the one with the most non-wildcard
+ * names wins, and the first of those in the file.
  */
 static int
 scan_authfile(f, client, server, secret, addrs, opts, filename, flags)
@@ -2123,133 +2436,96 @@ scan_authfile(f, client, server, secret, addrs, opts, filename, flags)
     char *filename;
     int flags;
 {
-    int newline, xxx;
-    int got_flag, best_flag;
-    FILE *sf;
-    struct wordlist *ap, *addr_list, *alist, **app;
-    char word[MAXWORDLEN];
-    char atfile[MAXWORDLEN];
+    struct secrets_file *sf;
+    struct secret_entry *se, *best;
+    struct wordlist *ap, *addr_list, **app;
     char lsecret[MAXWORDLEN];
-    char *cp;
+    char *keys[4][2];
+    int i, nkeys;
 
     if (addrs != NULL)
 	*addrs = NULL;
     if (opts != NULL)
 	*opts = NULL;
-    addr_list = NULL;
-    if (!getword(f, word, &newline, filename))
-	return -1;		/* file is empty??? */
-    newline = 1;
-    best_flag = -1;
-    for (;;) {
-	/*
-	 * Skip until we find a word at the start of a line.
-	 */
-	while (!newline && getword(f, word, &newline, filename))
-	    ;
-	if (!newline)
-	    break;		/* got to end of file */
+    if ((sf = load_secrets(f, filename)) == NULL)
+	return -1;
 
+    best = NULL;
+    if (client != NULL && server != NULL) {
 	/*
-	 * Got a client - check if it's a match or a wildcard.
+	 * Try the possible (client, server) pairs in order of
+	 * precedence; within each, take the first usable line.
 	 */
-	got_flag = 0;
-	if (client != NULL && strcmp(word, client) != 0 && !ISWILD(word)) {
-	    newline = 0;
-	    continue;
+	nkeys = 0;
+	keys[nkeys][0] = client;	/* NONWILD_CLIENT|NONWILD_SERVER */
+	keys[nkeys++][1] = server;
+	if (!ISWILD(server)) {
+	    keys[nkeys][0] = client;	/* NONWILD_CLIENT */
+	    keys[nkeys++][1] = "*";
 	}
-	if (!ISWILD(word))
-	    got_flag = NONWILD_CLIENT;
-
-	/*
-	 * Now get a server and check if it matches.
-	 */
-	if (!getword(f, word, &newline, filename))
-	    break;
-	if (newline)
-	    continue;
-	if (!ISWILD(word)) {
-	    if (server != NULL && strcmp(word, server) != 0)
-		continue;
-	    got_flag |= NONWILD_SERVER;
+	if (!ISWILD(client)) {
+	    keys[nkeys][0] = "*";	/* NONWILD_SERVER */
+	    keys[nkeys++][1] = server;
+	    if (!ISWILD(server)) {
+		keys[nkeys][0] = "*";	/* wildcards for both */
+		keys[nkeys++][1] = "*";
+	    }
 	}
-
-	/*
-	 * Got some sort of a match - see if it's better than what
-	 * we have already.
-	 */
-	if (got_flag <= best_flag)
-	    continue;
-
-	/*
-	 * Get the secret.
-	 */
-	if (!getword(f, word, &newline, filename))
-	    break;
-	if (newline)
-	    continue;
-
-	/*
-	 * SRP-SHA1 authenticator should never be reading secrets from
-	 * a file.  (Authenticatee may, though.)
-	 */
-	if (flags && ((cp = strchr(word, ':')) == NULL ||
-	    strchr(cp + 1, ':') == NULL))
-	    continue;
-
-	if (secret != NULL) {
-	    /*
-	     * Special syntax: @/pathname means read secret from file.
-	     */
-	    if (word[0] == '@' && word[1] == '/') {
-		strlcpy(atfile, word+1, sizeof(atfile));
-		if ((sf = fopen(atfile, "r")) == NULL) {
-		    warn("can't open indirect secret file %s", atfile);
-		    continue;
-		}
-		check_access(sf, atfile);
-		if (!getword(sf, word, &xxx, atfile)) {
-		    warn("no secret in indirect secret file %s", atfile);
-		    fclose(sf);
-		    continue;
+	for (i = 0; i < nkeys && best == NULL; ++i) {
+	    se = sf->hash[secret_hash(keys[i][0], keys[i][1]) & sf->hash_mask];
+	    for (; se != NULL; se = se->hash_next) {
+		if (strcmp(se->client, keys[i][0]) == 0
+		    && strcmp(se->server, keys[i][1]) == 0
+		    && secret_usable(se, (secret != NULL? lsecret: NULL), flags)) {
+		    best = se;
+		    break;
 		}
-		fclose(sf);
 	    }
-	    strlcpy(lsecret, word, sizeof(lsecret));
 	}
-
+    } else {
 	/*
-	 * Now read address authorization info and make a wordlist.
+	 * Any client or any server will do: look at every line.
 	 */
-	app = &alist;
-	for (;;) {
-	    if (!getword(f, word, &newline, filename) || newline)
-		break;
-	    ap = (struct wordlist *)
-		    malloc(sizeof(struct wordlist) + strlen(word) + 1);
-	    if (ap == NULL)
-		novm("authorized addresses");
-	    ap->word = (char *) (ap + 1);
-	    strcpy(ap->word, word);
-	    *app = ap;
-	    app = &ap->next;
+	for (se = sf->entries; se != NULL; se = se->next) {
+	    if (client != NULL && strcmp(se->client, client) != 0
+		&& !ISWILD(se->client))
+		continue;
+	    if (server != NULL && !ISWILD(se->server)
+		&& strcmp(se->server, server) != 0)
+		continue;
+	    if (best != NULL && se->flag <= best->flag)
+		continue;
+	    if (!secret_usable(se, (secret != NULL? lsecret: NULL), flags))
+		continue;
+	    best = se;
 	}
-	*app = NULL;
+    }
+    if (best == NULL)
+	return -1;
 
-	/*
-	 * This is the best so far; remember it.
-	 */
-	best_flag = got_flag;
-	if (addr_list)
-	    free_wordlist(addr_list);
-	addr_list = alist;
-	if (secret != NULL)
-	    strlcpy(secret, lsecret, MAXWORDLEN);
-
-	if (!newline)
-	    break;
+    if (secret != NULL) {
+	strlcpy(secret, lsecret, MAXWORDLEN);
+	BZERO(lsecret, sizeof(lsecret));
     }
 
+    /*
+     * Make wordlists of the address authorization info and the
+     * options, which follow a "--" word.
+     */
+    addr_list = NULL;
+    app = &addr_list;
+    for (i = 0; i < best->nwords; ++i) {
+	ap = (struct wordlist *)
+		malloc(sizeof(struct wordlist) + strlen(best->words[i]) + 1);
+	if (ap == NULL)
+	    novm("authorized addresses");
+	ap->word = (char *) (ap + 1);
+	strcpy(ap->word, best->words[i]);
+	*app = ap;
+	app = &ap->next;
+    }
+    *app = NULL;
+
     /* scan for a -- word indicating the start of options */
     for (app = &addr_list; (ap = *app) != NULL; app = &ap->next)
 	if (strcmp(ap->word, "--") == 0)
@@ -2269,7 +2545,7 @@ scan_authfile(f, client, server, secret, addrs, opts, filename, flags)
     else if (addr_list != NULL)
 	free_wordlist(addr_list);
 
-    return best_flag;
+    return best->flag;
 }
 
 /*
@@ -2310,18 +2586,20 @@ static void
 auth_script_done(arg)
     void *arg;
 {
-    auth_script_pid = 0;
-    switch (auth_script_state) {
+    int unit = ((fsm *) arg)->unit;
+
+    auth_script_pid[unit] = 0;
+    switch (auth_script_state[unit]) {
     case s_up:
-	if (auth_state == s_down) {
-	    auth_script_state = s_down;
-	    auth_script(_PATH_AUTHDOWN);
+	if (auth_state[unit] == s_down) {
+	    auth_script_state[unit] = s_down;
+	    auth_script(unit, _PATH_AUTHDOWN);
 	}
 	break;
     case s_down:
-	if (auth_state == s_up) {
-	    auth_script_state = s_up;
-	    auth_script(_PATH_AUTHUP);
+	if (auth_state[unit] == s_up) {
+	    auth_script_state[unit] = s_up;
+	    auth_script(unit, _PATH_AUTHUP);
 	}
 	break;
     }
@@ -2332,7 +2610,8 @@ auth_script_done(arg)
  * interface-name peer-name real-user tty speed
  */
 static void
-auth_script(script)
+auth_script(unit, script)
+    int unit;
     char *script;
 {
     char strspeed[32];
@@ -2357,5 +2636,6 @@ auth_script(script)
     argv[5] = strspeed;
     argv[6] = NULL;
 
-    auth_script_pid = run_program(script, argv, 0, auth_script_done, NULL, 0);
+    auth_script_pid[unit] = run_program(script, argv, 0, auth_script_done,
+					&lcp_fsm[unit], 0);
 }
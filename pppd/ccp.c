@@ -363,21 +363,21 @@ ccp_init(unit)
     memset(&ccp_allowoptions[unit], 0, sizeof(ccp_options));
     memset(&ccp_hisoptions[unit],   0, sizeof(ccp_options));
 
-    ccp_wantoptions[0].deflate = 1;
-    ccp_wantoptions[0].deflate_size = DEFLATE_MAX_SIZE;
-    ccp_wantoptions[0].deflate_correct = 1;
-    ccp_wantoptions[0].deflate_draft = 1;
-    ccp_allowoptions[0].deflate = 1;
-    ccp_allowoptions[0].deflate_size = DEFLATE_MAX_SIZE;
-    ccp_allowoptions[0].deflate_correct = 1;
-    ccp_allowoptions[0].deflate_draft = 1;
-
-    ccp_wantoptions[0].bsd_compress = 1;
-    ccp_wantoptions[0].bsd_bits = BSD_MAX_BITS;
-    ccp_allowoptions[0].bsd_compress = 1;
-    ccp_allowoptions[0].bsd_bits = BSD_MAX_BITS;
-
-    ccp_allowoptions[0].predictor_1 = 1;
+    ccp_wantoptions[unit].deflate = 1;
+    ccp_wantoptions[unit].deflate_size = DEFLATE_MAX_SIZE;
+    ccp_wantoptions[unit].deflate_correct = 1;
+    ccp_wantoptions[unit].deflate_draft = 1;
+    ccp_allowoptions[unit].deflate = 1;
+    ccp_allowoptions[unit].deflate_size = DEFLATE_MAX_SIZE;
+    ccp_allowoptions[unit].deflate_correct = 1;
+    ccp_allowoptions[unit].deflate_draft = 1;
+
+    ccp_wantoptions[unit].bsd_compress = 1;
+    ccp_wantoptions[unit].bsd_bits = BSD_MAX_BITS;
+    ccp_allowoptions[unit].bsd_compress = 1;
+    ccp_allowoptions[unit].bsd_bits = BSD_MAX_BITS;
+
+    ccp_allowoptions[unit].predictor_1 = 1;
 }
 
 /*
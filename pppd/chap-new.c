@@ -76,11 +76,12 @@ static option_t chap_option_list[] = {
  * Internal state.
  */
 static struct chap_client_state {
+	int unit;
 	int flags;
 	char *name;
 	struct chap_digest_type *digest;
 	unsigned char priv[64];		/* private area for digest's use */
-} client;
+} client[NUM_PPP];
 
 /*
  * These limits apply to challenge and response packets we send.
@@ -90,6 +91,7 @@ static struct chap_client_state {
 #define RESP_MAX_PKTLEN	(PPP_HDRLEN + CHAP_HDRLEN + 4 + MAX_RESPONSE_LEN + MAXNAMELEN)
 
 static struct chap_server_state {
+	int unit;
 	int flags;
 	int id;
 	char *name;
@@ -98,7 +100,9 @@ static struct chap_server_state {
 	int challenge_pktlen;
 	unsigned char challenge[CHAL_MAX_PKTLEN];
 	char message[256];
-} server;
+	int verify_id;			/* response being checked by a plugin */
+	char verify_name[MAXNAMELEN+1];
+} server[NUM_PPP];
 
 /* Values for flags in chap_client_state and chap_server_state */
 #define LOWERUP			1
@@ -107,6 +111,7 @@ static struct chap_server_state {
 #define AUTH_FAILED		8
 #define TIMEOUT_PENDING		0x10
 #define CHALLENGE_VALID		0x20
+#define VERIFY_PENDING		0x40
 
 /*
  * Prototypes.
@@ -118,6 +123,8 @@ static void chap_timeout(void *arg);
 static void chap_generate_challenge(struct chap_server_state *ss);
 static void chap_handle_response(struct chap_server_state *ss, int code,
 		unsigned char *pkt, int len);
+static void chap_send_result(struct chap_server_state *ss, int id,
+		char *name);
 static int chap_verify_response(char *name, char *ourname, int id,
 		struct chap_digest_type *digest,
 		unsigned char *challenge, unsigned char *response,
@@ -140,13 +147,18 @@ static struct chap_digest_type *chap_digests;
 static void
 chap_init(int unit)
 {
-	memset(&client, 0, sizeof(client));
-	memset(&server, 0, sizeof(server));
-
-	chap_md5_init();
+	memset(&client[unit], 0, sizeof(client[unit]));
+	memset(&server[unit], 0, sizeof(server[unit]));
+	client[unit].unit = unit;
+	server[unit].unit = unit;
+
+	/* the digest types are shared by all units */
+	if (chap_digests == NULL) {
+		chap_md5_init();
 #ifdef CHAPMS
-	chapms_init();
+		chapms_init();
 #endif
+	}
 }
 
 /*
@@ -165,8 +177,8 @@ chap_register_digest(struct chap_digest_type *dp)
 static void
 chap_lowerup(int unit)
 {
-	struct chap_client_state *cs = &client;
-	struct chap_server_state *ss = &server;
+	struct chap_client_state *cs = &client[unit];
+	struct chap_server_state *ss = &server[unit];
 
 	cs->flags |= LOWERUP;
 	ss->flags |= LOWERUP;
@@ -177,8 +189,8 @@ chap_lowerup(int unit)
 static void
 chap_lowerdown(int unit)
 {
-	struct chap_client_state *cs = &client;
-	struct chap_server_state *ss = &server;
+	struct chap_client_state *cs = &client[unit];
+	struct chap_server_state *ss = &server[unit];
 
 	cs->flags = 0;
 	if (ss->flags & TIMEOUT_PENDING)
@@ -194,7 +206,7 @@ chap_lowerdown(int unit)
 void
 chap_auth_peer(int unit, char *our_name, int digest_code)
 {
-	struct chap_server_state *ss = &server;
+	struct chap_server_state *ss = &server[unit];
 	struct chap_digest_type *dp;
 
 	if (ss->flags & AUTH_STARTED) {
@@ -224,7 +236,7 @@ chap_auth_peer(int unit, char *our_name, int digest_code)
 void
 chap_auth_with_peer(int unit, char *our_name, int digest_code)
 {
-	struct chap_client_state *cs = &client;
+	struct chap_client_state *cs = &client[unit];
 	struct chap_digest_type *dp;
 
 	if (cs->flags & AUTH_STARTED) {
@@ -261,11 +273,11 @@ chap_timeout(void *arg)
 	} else if (ss->challenge_xmits >= chap_max_transmits) {
 		ss->flags &= ~CHALLENGE_VALID;
 		ss->flags |= AUTH_DONE | AUTH_FAILED;
-		auth_peer_fail(0, PPP_CHAP);
+		auth_peer_fail(ss->unit, PPP_CHAP);
 		return;
 	}
 
-	output(0, ss->challenge, ss->challenge_pktlen);
+	output(ss->unit, ss->challenge, ss->challenge_pktlen);
 	++ss->challenge_xmits;
 	ss->flags |= TIMEOUT_PENDING;
 	TIMEOUT(chap_timeout, arg, chap_timeout_time);
@@ -306,8 +318,8 @@ static void
 chap_handle_response(struct chap_server_state *ss, int id,
 		     unsigned char *pkt, int len)
 {
-	int response_len, ok, mlen;
-	unsigned char *response, *p;
+	int response_len, ok;
+	unsigned char *response;
 	char *name = NULL;	/* initialized to shut gcc up */
 	int (*verifier)(char *, char *, int, struct chap_digest_type *,
 		unsigned char *, unsigned char *, char *, int);
@@ -317,6 +329,8 @@ chap_handle_response(struct chap_server_state *ss, int id,
 		return;
 	if (id != ss->challenge[PPP_HDRLEN+1] || len < 2)
 		return;
+	if (ss->flags & VERIFY_PENDING)
+		return;		/* still checking the previous response */
 	if (ss->flags & CHALLENGE_VALID) {
 		response = pkt;
 		GETCHAR(response_len, pkt);
@@ -338,13 +352,22 @@ chap_handle_response(struct chap_server_state *ss, int id,
 			name = rname;
 		}
 
-		if (chap_verify_hook)
+		if (chap_verify_hook) {
 			verifier = chap_verify_hook;
-		else
+			auth_hook_unit = ss->unit;
+		} else
 			verifier = chap_verify_response;
 		ok = (*verifier)(name, ss->name, id, ss->digest,
 				 ss->challenge + PPP_HDRLEN + CHAP_HDRLEN,
 				 response, ss->message, sizeof(ss->message));
+		if (ok == AUTH_PENDING) {
+			/* the plugin will call chap_verify_complete */
+			ss->flags |= VERIFY_PENDING;
+			ss->verify_id = id;
+			strlcpy(ss->verify_name, name,
+				sizeof(ss->verify_name));
+			return;
+		}
 		if (!ok || !auth_number()) {
 			ss->flags |= AUTH_FAILED;
 			warn("Peer %q failed CHAP authentication", name);
@@ -352,6 +375,42 @@ chap_handle_response(struct chap_server_state *ss, int id,
 	} else if ((ss->flags & AUTH_DONE) == 0)
 		return;
 
+	chap_send_result(ss, id, name);
+}
+
+/*
+ * chap_verify_complete - called by a plugin whose chap_verify_hook
+ * returned AUTH_PENDING, once it knows whether the response was OK.
+ * If message is not NULL, it replaces the message sent to the peer.
+ */
+void
+chap_verify_complete(int unit, int ok, char *message)
+{
+	struct chap_server_state *ss = &server[unit];
+
+	if ((ss->flags & VERIFY_PENDING) == 0)
+		return;		/* link went down meanwhile */
+	ss->flags &= ~VERIFY_PENDING;
+
+	if (message != NULL)
+		strlcpy(ss->message, message, sizeof(ss->message));
+	if (!ok || !auth_number()) {
+		ss->flags |= AUTH_FAILED;
+		warn("Peer %q failed CHAP authentication", ss->verify_name);
+	}
+	chap_send_result(ss, ss->verify_id, ss->verify_name);
+}
+
+/*
+ * chap_send_result - send a success or failure packet in reply to
+ * a response, and update our state.
+ */
+static void
+chap_send_result(struct chap_server_state *ss, int id, char *name)
+{
+	unsigned char *p;
+	int mlen, len;
+
 	/* send the response */
 	p = outpacket_buf;
 	MAKEHEADER(p, PPP_CHAP);
@@ -363,7 +422,7 @@ chap_handle_response(struct chap_server_state *ss, int id,
 	p[3] = len;
 	if (mlen > 0)
 		memcpy(p + CHAP_HDRLEN, ss->message, mlen);
-	output(0, outpacket_buf, PPP_HDRLEN + len);
+	output(ss->unit, outpacket_buf, PPP_HDRLEN + len);
 
 	if (ss->flags & CHALLENGE_VALID) {
 		ss->flags &= ~CHALLENGE_VALID;
@@ -384,10 +443,10 @@ chap_handle_response(struct chap_server_state *ss, int id,
 		    }
 		}
 		if (ss->flags & AUTH_FAILED) {
-			auth_peer_fail(0, PPP_CHAP);
+			auth_peer_fail(ss->unit, PPP_CHAP);
 		} else {
 			if ((ss->flags & AUTH_DONE) == 0)
-				auth_peer_success(0, PPP_CHAP,
+				auth_peer_success(ss->unit, PPP_CHAP,
 						  ss->digest->code,
 						  name, strlen(name));
 			if (chap_rechallenge_time) {
@@ -457,7 +516,7 @@ chap_respond(struct chap_client_state *cs, int id,
 		strlcpy(rname, remote_name, sizeof(rname));
 
 	/* get secret for authenticating ourselves with the specified host */
-	if (!get_secret(0, cs->name, rname, secret, &secret_len, 0)) {
+	if (!get_secret(cs->unit, cs->name, rname, secret, &secret_len, 0)) {
 		secret_len = 0;	/* assume null secret if can't find one */
 		warn("No CHAP secret found for authenticating us to %q", rname);
 	}
@@ -481,7 +540,7 @@ chap_respond(struct chap_client_state *cs, int id,
 	p[2] = len >> 8;
 	p[3] = len;
 
-	output(0, response, PPP_HDRLEN + len);
+	output(cs->unit, response, PPP_HDRLEN + len);
 }
 
 static void
@@ -515,19 +574,19 @@ chap_handle_status(struct chap_client_state *cs, int code, int id,
 			info("%s", msg);
 	}
 	if (code == CHAP_SUCCESS)
-		auth_withpeer_success(0, PPP_CHAP, cs->digest->code);
+		auth_withpeer_success(cs->unit, PPP_CHAP, cs->digest->code);
 	else {
 		cs->flags |= AUTH_FAILED;
 		error("CHAP authentication failed");
-		auth_withpeer_fail(0, PPP_CHAP);
+		auth_withpeer_fail(cs->unit, PPP_CHAP);
 	}
 }
 
 static void
 chap_input(int unit, unsigned char *pkt, int pktlen)
 {
-	struct chap_client_state *cs = &client;
-	struct chap_server_state *ss = &server;
+	struct chap_client_state *cs = &client[unit];
+	struct chap_server_state *ss = &server[unit];
 	unsigned char code, id;
 	int len;
 
@@ -557,8 +616,8 @@ chap_input(int unit, unsigned char *pkt, int pktlen)
 static void
 chap_protrej(int unit)
 {
-	struct chap_client_state *cs = &client;
-	struct chap_server_state *ss = &server;
+	struct chap_client_state *cs = &client[unit];
+	struct chap_server_state *ss = &server[unit];
 
 	if (ss->flags & TIMEOUT_PENDING) {
 		ss->flags &= ~TIMEOUT_PENDING;
@@ -566,12 +625,12 @@ chap_protrej(int unit)
 	}
 	if (ss->flags & AUTH_STARTED) {
 		ss->flags = 0;
-		auth_peer_fail(0, PPP_CHAP);
+		auth_peer_fail(ss->unit, PPP_CHAP);
 	}
 	if ((cs->flags & (AUTH_STARTED|AUTH_DONE)) == AUTH_STARTED) {
 		cs->flags &= ~AUTH_STARTED;
 		error("CHAP authentication failed due to protocol-reject");
-		auth_withpeer_fail(0, PPP_CHAP);
+		auth_withpeer_fail(cs->unit, PPP_CHAP);
 	}
 }
 
@@ -117,6 +117,9 @@ extern int (*chap_verify_hook)(char *name, char *ourname, int id,
 			unsigned char *challenge, unsigned char *response,
 			char *message, int message_space);
 
+/* Called by a plugin whose chap_verify_hook returned AUTH_PENDING */
+extern void chap_verify_complete(int unit, int ok, char *message);
+
 /* Called by digest code to register a digest type */
 extern void chap_register_digest(struct chap_digest_type *);
 
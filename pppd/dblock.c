@@ -0,0 +1,216 @@
+/*
+ * dblock.c - locking the ppp database, globally or per key.
+ *
+ * Copyright (c) 1984-2000 Carnegie Mellon University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The name "Carnegie Mellon University" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For permission or any legal
+ *    details, please contact
+ *      Office of Technology Transfer
+ *      Carnegie Mellon University
+ *      5000 Forbes Avenue
+ *      Pittsburgh, PA  15213-3890
+ *      (412) 268-4387, fax: (412) 268-7395
+ *      tech-transfer@andrew.cmu.edu
+ *
+ * 4. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by Computing Services
+ *     at Carnegie Mellon University (http://www.cmu.edu/computing/)."
+ *
+ * CARNEGIE MELLON UNIVERSITY DISCLAIMS ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY BE LIABLE
+ * FOR ANY SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Copyright (c) 1999-2004 Paul Mackerras. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * 3. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by Paul Mackerras
+ *     <paulus@samba.org>".
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/types.h>
+
+#include "pppd.h"
+
+#ifdef USE_TDB
+#include "tdb.h"
+
+extern TDB_CONTEXT *pppdb;
+static TDB_CONTEXT *lockdb;	/* holds no data, only used by lock_db_key */
+#define LOCKDB_HASH_SIZE 1021	/* enough that few bundles share a lock */
+#endif
+
+unsigned link_db_lock_waits;	/* times we waited for a pppdb lock */
+
+/*
+ * open_lock_db - open the database that lock_db_key takes its locks
+ * in.  Returns 0 if it can't be opened, in which case lock_db_key
+ * uses the single lock that lock_db takes.
+ */
+int
+open_lock_db(path)
+    char *path;
+{
+#ifdef USE_TDB
+    lockdb = tdb_open(path, LOCKDB_HASH_SIZE, 0, O_RDWR|O_CREAT, 0644);
+    return lockdb != NULL;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * close_lock_db - close the lock database, e.g. in a child process.
+ */
+void
+close_lock_db()
+{
+#ifdef USE_TDB
+    if (lockdb != NULL)
+	tdb_close(lockdb);
+    lockdb = NULL;
+#endif
+}
+
+/*
+ * Any arbitrary string used as a key for locking the database.
+ * It doesn't matter what it is as long as all pppds use the same string.
+ */
+#define PPPD_LOCK_KEY	"pppd lock"
+
+#ifdef USE_TDB
+/*
+ * db_chainlock - lock the hash chain for key in db, counting the
+ * times we find another pppd already holding it.
+ */
+static void
+db_chainlock(db, key)
+    TDB_CONTEXT *db;
+    char *key;
+{
+	TDB_DATA k;
+
+	k.dptr = key;
+	k.dsize = strlen(key);
+	if (tdb_chainlock_nonblock(db, k) != 0) {
+		++link_db_lock_waits;
+		tdb_chainlock(db, k);
+	}
+}
+
+static void
+db_chainunlock(db, key)
+    TDB_CONTEXT *db;
+    char *key;
+{
+	TDB_DATA k;
+
+	k.dptr = key;
+	k.dsize = strlen(key);
+	tdb_chainunlock(db, k);
+}
+#endif
+
+/*
+ * lock_db - get an exclusive lock on the TDB database.
+ * Used to ensure atomicity of various lookup/modify operations.
+ */
+void lock_db()
+{
+#ifdef USE_TDB
+	db_chainlock(pppdb, PPPD_LOCK_KEY);
+#endif
+}
+
+/*
+ * unlock_db - remove the exclusive lock obtained by lock_db.
+ * Any pending change to our entry is written out first, so that
+ * the next pppd to take the lock sees it.
+ */
+void unlock_db()
+{
+#ifdef USE_TDB
+	flush_db_entry();
+	db_chainunlock(pppdb, PPPD_LOCK_KEY);
+#endif
+}
+
+/*
+ * lock_db_key - get an exclusive lock that only conflicts with
+ * other pppds locking the same key (e.g. joining the same multilink
+ * bundle), so that unrelated operations on the database can go
+ * ahead at the same time.
+ *
+ * The lock is a chain lock in a separate database that holds no
+ * records.  A chain lock in pppdb itself could not be held while
+ * reading and writing other records: two pppds each holding one
+ * chain and storing a record on the other's would deadlock.
+ * Without that database we fall back to the global lock_db().
+ */
+void lock_db_key(key)
+    char *key;
+{
+#ifdef USE_TDB
+	if (lockdb == NULL)
+		lock_db();
+	else
+		db_chainlock(lockdb, key);
+#endif
+}
+
+/*
+ * unlock_db_key - remove the lock obtained by lock_db_key.
+ */
+void unlock_db_key(key)
+    char *key;
+{
+#ifdef USE_TDB
+	if (lockdb == NULL) {
+		unlock_db();
+		return;
+	}
+	flush_db_entry();
+	db_chainunlock(lockdb, key);
+#endif
+}
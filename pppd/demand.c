@@ -51,6 +51,7 @@
 #include "fsm.h"
 #include "ipcp.h"
 #include "lcp.h"
+#include "../common/pppfcs.h"
 
 static const char rcsid[] = RCSID;
 
@@ -59,18 +60,54 @@ int framelen;
 int framemax;
 int escape_flag;
 int flush_flag;
-int fcs;
 
-struct packet {
-    int length;
-    struct packet *next;
-    unsigned char data[1];
+/*
+ * Frames received on the loopback while the link is being brought up
+ * are kept in a fixed-size ring, allocated by demand_conf.  Each frame
+ * is stored contiguously behind a struct pend_hdr; a frame which
+ * doesn't fit before the end of the ring goes at the start instead,
+ * and the gap left behind is marked with a PEND_PAD header (or left
+ * unmarked if it is too small to hold one).  The frames for each
+ * network protocol are also chained together in arrival order, so that
+ * demand_rexmit only visits the frames it is going to send.  A frame
+ * which has been sent is marked by zeroing its protocol, and its space
+ * is reclaimed once it reaches the head of the ring.
+ */
+struct pend_hdr {
+    int length;			/* frame length, or PEND_PAD */
+    int proto;			/* PPP protocol, or 0 once sent */
+    int next;			/* offset of next frame of this protocol */
+    time_t queued;		/* time when the frame was queued */
 };
 
-struct packet *pend_q;
-struct packet *pend_qtail;
+#define PEND_PAD	(-1)
+#define PEND_ROUND(n)	(((n) + sizeof(long) - 1) & ~(sizeof(long) - 1))
+#define PEND_SPACE(len)	((int) PEND_ROUND(sizeof(struct pend_hdr) + (len)))
+
+#define PEND_NPROTO	8	/* max # protocols with frames queued */
+
+static struct pend_list {
+    int proto;
+    int first;			/* offset of oldest frame, or -1 */
+    int last;			/* offset of newest frame, or -1 */
+} pend_lists[PEND_NPROTO];
+
+static unsigned char *pend_buf;	/* the ring itself */
+static int pend_size;		/* size of pend_buf */
+static int pend_head;		/* offset of the oldest frame */
+static int pend_tail;		/* offset at which to put the next frame */
+static int pend_used;		/* bytes in use, including padding */
+static int pend_dropped;	/* frames dropped for lack of space or age */
+static int pend_dropped_bytes;
+
+#define pend_frame(off)	((struct pend_hdr *) (pend_buf + (off)))
 
 static int active_packet __P((unsigned char *, int));
+static void pend_reset __P((void));
+static struct pend_list *pend_list_for __P((int, int));
+static void pend_trim __P((time_t));
+static int pend_alloc __P((int));
+static void pend_report __P((void));
 
 /*
  * demand_conf - configure the interface for doing dial-on-demand.
@@ -89,10 +126,15 @@ demand_conf()
     if (frame == NULL)
 	novm("demand frame");
     framelen = 0;
-    pend_q = NULL;
     escape_flag = 0;
     flush_flag = 0;
-    fcs = PPP_INITFCS;
+
+    /* the pending queue must be able to hold at least one frame */
+    pend_size = MAX(demand_queue_size, PEND_SPACE(framemax));
+    pend_buf = malloc(pend_size);
+    if (pend_buf == NULL)
+	novm("demand pending queue");
+    pend_reset();
 
     netif_set_mtu(0, MIN(lcp_allowoptions[0].mru, PPP_MRU));
     if (ppp_send_config(0, PPP_MRU, (u_int32_t) 0, 0, 0) < 0
@@ -135,7 +177,6 @@ demand_block()
 void
 demand_discard()
 {
-    struct packet *pkt, *nextpkt;
     int i;
     struct protent *protp;
 
@@ -145,15 +186,11 @@ demand_discard()
     get_loop_output();
 
     /* discard all saved packets */
-    for (pkt = pend_q; pkt != NULL; pkt = nextpkt) {
-	nextpkt = pkt->next;
-	free(pkt);
-    }
-    pend_q = NULL;
+    pend_report();
+    pend_reset();
     framelen = 0;
     flush_flag = 0;
     escape_flag = 0;
-    fcs = PPP_INITFCS;
 }
 
 /*
@@ -170,44 +207,6 @@ demand_unblock()
 	    sifnpmode(0, protp->protocol & ~0x8000, NPMODE_PASS);
 }
 
-/*
- * FCS lookup table as calculated by genfcstab.
- */
-static u_short fcstab[256] = {
-	0x0000,	0x1189,	0x2312,	0x329b,	0x4624,	0x57ad,	0x6536,	0x74bf,
-	0x8c48,	0x9dc1,	0xaf5a,	0xbed3,	0xca6c,	0xdbe5,	0xe97e,	0xf8f7,
-	0x1081,	0x0108,	0x3393,	0x221a,	0x56a5,	0x472c,	0x75b7,	0x643e,
-	0x9cc9,	0x8d40,	0xbfdb,	0xae52,	0xdaed,	0xcb64,	0xf9ff,	0xe876,
-	0x2102,	0x308b,	0x0210,	0x1399,	0x6726,	0x76af,	0x4434,	0x55bd,
-	0xad4a,	0xbcc3,	0x8e58,	0x9fd1,	0xeb6e,	0xfae7,	0xc87c,	0xd9f5,
-	0x3183,	0x200a,	0x1291,	0x0318,	0x77a7,	0x662e,	0x54b5,	0x453c,
-	0xbdcb,	0xac42,	0x9ed9,	0x8f50,	0xfbef,	0xea66,	0xd8fd,	0xc974,
-	0x4204,	0x538d,	0x6116,	0x709f,	0x0420,	0x15a9,	0x2732,	0x36bb,
-	0xce4c,	0xdfc5,	0xed5e,	0xfcd7,	0x8868,	0x99e1,	0xab7a,	0xbaf3,
-	0x5285,	0x430c,	0x7197,	0x601e,	0x14a1,	0x0528,	0x37b3,	0x263a,
-	0xdecd,	0xcf44,	0xfddf,	0xec56,	0x98e9,	0x8960,	0xbbfb,	0xaa72,
-	0x6306,	0x728f,	0x4014,	0x519d,	0x2522,	0x34ab,	0x0630,	0x17b9,
-	0xef4e,	0xfec7,	0xcc5c,	0xddd5,	0xa96a,	0xb8e3,	0x8a78,	0x9bf1,
-	0x7387,	0x620e,	0x5095,	0x411c,	0x35a3,	0x242a,	0x16b1,	0x0738,
-	0xffcf,	0xee46,	0xdcdd,	0xcd54,	0xb9eb,	0xa862,	0x9af9,	0x8b70,
-	0x8408,	0x9581,	0xa71a,	0xb693,	0xc22c,	0xd3a5,	0xe13e,	0xf0b7,
-	0x0840,	0x19c9,	0x2b52,	0x3adb,	0x4e64,	0x5fed,	0x6d76,	0x7cff,
-	0x9489,	0x8500,	0xb79b,	0xa612,	0xd2ad,	0xc324,	0xf1bf,	0xe036,
-	0x18c1,	0x0948,	0x3bd3,	0x2a5a,	0x5ee5,	0x4f6c,	0x7df7,	0x6c7e,
-	0xa50a,	0xb483,	0x8618,	0x9791,	0xe32e,	0xf2a7,	0xc03c,	0xd1b5,
-	0x2942,	0x38cb,	0x0a50,	0x1bd9,	0x6f66,	0x7eef,	0x4c74,	0x5dfd,
-	0xb58b,	0xa402,	0x9699,	0x8710,	0xf3af,	0xe226,	0xd0bd,	0xc134,
-	0x39c3,	0x284a,	0x1ad1,	0x0b58,	0x7fe7,	0x6e6e,	0x5cf5,	0x4d7c,
-	0xc60c,	0xd785,	0xe51e,	0xf497,	0x8028,	0x91a1,	0xa33a,	0xb2b3,
-	0x4a44,	0x5bcd,	0x6956,	0x78df,	0x0c60,	0x1de9,	0x2f72,	0x3efb,
-	0xd68d,	0xc704,	0xf59f,	0xe416,	0x90a9,	0x8120,	0xb3bb,	0xa232,
-	0x5ac5,	0x4b4c,	0x79d7,	0x685e,	0x1ce1,	0x0d68,	0x3ff3,	0x2e7a,
-	0xe70e,	0xf687,	0xc41c,	0xd595,	0xa12a,	0xb0a3,	0x8238,	0x93b1,
-	0x6b46,	0x7acf,	0x4854,	0x59dd,	0x2d62,	0x3ceb,	0x0e70,	0x1ff9,
-	0xf78f,	0xe606,	0xd49d,	0xc514,	0xb1ab,	0xa022,	0x92b9,	0x8330,
-	0x7bc7,	0x6a4e,	0x58d5,	0x495c,	0x3de3,	0x2c6a,	0x1ef1,	0x0f78
-};
-
 /*
  * loop_chars - process characters received from the loopback.
  * Calls loop_frame when a complete frame has been accumulated.
@@ -225,7 +224,9 @@ loop_chars(p, n)
 	c = *p++;
 	if (c == PPP_FLAG) {
 	    if (!escape_flag && !flush_flag
-		&& framelen > 2 && fcs == PPP_GOODFCS) {
+		&& framelen > 2
+		&& pppfcs16(PPP_INITFCS, (u_char *) frame, framelen)
+		   == PPP_GOODFCS) {
 		framelen -= 2;
 		if (loop_frame((unsigned char *)frame, framelen))
 		    rv = 1;
@@ -233,7 +234,6 @@ loop_chars(p, n)
 	    framelen = 0;
 	    flush_flag = 0;
 	    escape_flag = 0;
-	    fcs = PPP_INITFCS;
 	    continue;
 	}
 	if (flush_flag)
@@ -250,7 +250,6 @@ loop_chars(p, n)
 	    continue;
 	}
 	frame[framelen++] = c;
-	fcs = PPP_FCS(fcs, c);
     }
     return rv;
 }
@@ -270,7 +269,10 @@ loop_frame(frame, len)
     unsigned char *frame;
     int len;
 {
-    struct packet *pkt;
+    struct pend_list *pl;
+    struct pend_hdr *h;
+    struct timeval now;
+    int off;
 
     /* dbglog("from loop: %P", frame, len); */
     if (len < PPP_HDRLEN)
@@ -280,17 +282,25 @@ loop_frame(frame, len)
     if (!active_packet(frame, len))
 	return 0;
 
-    pkt = (struct packet *) malloc(sizeof(struct packet) + len);
-    if (pkt != NULL) {
-	pkt->length = len;
-	pkt->next = NULL;
-	memcpy(pkt->data, frame, len);
-	if (pend_q == NULL)
-	    pend_q = pkt;
-	else
-	    pend_qtail->next = pkt;
-	pend_qtail = pkt;
+    get_time(&now);
+    pend_trim(now.tv_sec);
+    if ((pl = pend_list_for(PPP_PROTOCOL(frame), 1)) == NULL
+	|| (off = pend_alloc(len)) < 0) {
+	++pend_dropped;
+	pend_dropped_bytes += len;
+	return 1;
     }
+    h = pend_frame(off);
+    h->length = len;
+    h->proto = PPP_PROTOCOL(frame);
+    h->next = -1;
+    h->queued = now.tv_sec;
+    memcpy(h + 1, frame, len);
+    if (pl->last >= 0)
+	pend_frame(pl->last)->next = off;
+    else
+	pl->first = off;
+    pl->last = off;
     return 1;
 }
 
@@ -302,27 +312,146 @@ void
 demand_rexmit(proto)
     int proto;
 {
-    struct packet *pkt, *prev, *nextpkt;
-
-    prev = NULL;
-    pkt = pend_q;
-    pend_q = NULL;
-    for (; pkt != NULL; pkt = nextpkt) {
-	nextpkt = pkt->next;
-	if (PPP_PROTOCOL(pkt->data) == proto) {
-	    output(0, pkt->data, pkt->length);
-	    free(pkt);
-	} else {
-	    if (prev == NULL)
-		pend_q = pkt;
-	    else
-		prev->next = pkt;
-	    prev = pkt;
+    struct pend_list *pl;
+    struct pend_hdr *h;
+    struct timeval now;
+    int off;
+
+    if ((pl = pend_list_for(proto, 0)) == NULL)
+	return;
+    get_time(&now);
+    for (off = pl->first; off >= 0; off = h->next) {
+	h = pend_frame(off);
+	if (demand_queue_age == 0 || now.tv_sec - h->queued <= demand_queue_age)
+	    output(0, (unsigned char *)(h + 1), h->length);
+	else {
+	    ++pend_dropped;
+	    pend_dropped_bytes += h->length;
 	}
+	h->proto = 0;
     }
-    pend_qtail = prev;
-    if (prev != NULL)
-	prev->next = NULL;
+    pl->first = pl->last = -1;
+    pend_trim(now.tv_sec);
+    pend_report();
+}
+
+/*
+ * pend_reset - empty the pending queue.
+ */
+static void
+pend_reset()
+{
+    int i;
+
+    for (i = 0; i < PEND_NPROTO; ++i)
+	pend_lists[i].first = pend_lists[i].last = -1;
+    pend_head = pend_tail = pend_used = 0;
+}
+
+/*
+ * pend_list_for - find the chain of queued frames for a protocol.
+ * If there isn't one and `create' is set, take an unused one.
+ */
+static struct pend_list *
+pend_list_for(proto, create)
+    int proto, create;
+{
+    struct pend_list *pl, *freepl;
+
+    freepl = NULL;
+    for (pl = pend_lists; pl < pend_lists + PEND_NPROTO; ++pl) {
+	if (pl->proto == proto)
+	    return pl;
+	if (pl->first < 0 && freepl == NULL)
+	    freepl = pl;
+    }
+    if (!create || freepl == NULL)
+	return NULL;
+    freepl->proto = proto;
+    return freepl;
+}
+
+/*
+ * pend_trim - reclaim the space of sent frames at the head of the
+ * ring, and drop any frames queued more than demand_queue_age
+ * seconds before `now'.  Since frames are queued in order, the
+ * frame at the head is always the oldest one of its protocol.
+ */
+static void
+pend_trim(now)
+    time_t now;
+{
+    struct pend_hdr *h;
+    struct pend_list *pl;
+    int n;
+
+    while (pend_used > 0) {
+	h = pend_frame(pend_head);
+	if (pend_size - pend_head < sizeof(struct pend_hdr)
+	    || h->length == PEND_PAD) {
+	    pend_used -= pend_size - pend_head;
+	    pend_head = 0;
+	    continue;
+	}
+	if (h->proto != 0) {
+	    if (demand_queue_age == 0 || now - h->queued <= demand_queue_age)
+		break;
+	    pl = pend_list_for(h->proto, 0);
+	    if ((pl->first = h->next) < 0)
+		pl->last = -1;
+	    ++pend_dropped;
+	    pend_dropped_bytes += h->length;
+	}
+	n = PEND_SPACE(h->length);
+	pend_head += n;
+	pend_used -= n;
+    }
+    if (pend_used == 0)
+	pend_head = pend_tail = 0;
+}
+
+/*
+ * pend_alloc - find room in the ring for a frame of `len' bytes.
+ * Returns the offset of the space, or -1 if the ring is too full.
+ */
+static int
+pend_alloc(len)
+    int len;
+{
+    int need, off;
+
+    need = PEND_SPACE(len);
+    if (pend_used > 0 && pend_tail <= pend_head) {
+	/* the free space is all between the tail and the head */
+	if (pend_head - pend_tail < need)
+	    return -1;
+    } else if (pend_size - pend_tail < need) {
+	/* not enough room at the end, start again at the beginning */
+	if (pend_head < need)
+	    return -1;
+	if (pend_size - pend_tail >= sizeof(struct pend_hdr))
+	    pend_frame(pend_tail)->length = PEND_PAD;
+	pend_used += pend_size - pend_tail;
+	pend_tail = 0;
+    }
+    off = pend_tail;
+    pend_tail += need;
+    pend_used += need;
+    return off;
+}
+
+/*
+ * pend_report - log how many frames we have had to drop from
+ * the pending queue since the last report.
+ */
+static void
+pend_report()
+{
+    if (pend_dropped == 0)
+	return;
+    info("Dropped %d queued packets (%d bytes) while bringing link up",
+	 pend_dropped, pend_dropped_bytes);
+    pend_dropped = pend_dropped_bytes = 0;
 }
 
 /*
@@ -91,8 +91,8 @@ struct notifier *ip_down_notifier = NULL;
 static int default_route_set[NUM_PPP];	/* Have set up a default route */
 static int proxy_arp_set[NUM_PPP];	/* Have created proxy arp entry */
 static bool usepeerdns;			/* Ask peer for DNS addrs */
-static int ipcp_is_up;			/* have called np_up() */
-static int ipcp_is_open;		/* haven't called np_finished() */
+static int ipcp_is_up[NUM_PPP];		/* have called np_up() */
+static int ipcp_is_open[NUM_PPP];	/* haven't called np_finished() */
 static bool ask_for_local;		/* request our address from peer */
 static char vj_value[8];		/* string form of vj option value */
 static char netmask_str[20];		/* string form of netmask value */
@@ -272,7 +272,7 @@ struct protent ipcp_protent = {
 };
 
 static void ipcp_clear_addrs __P((int, u_int32_t, u_int32_t));
-static void ipcp_script __P((char *, int));	/* Run an up/down script */
+static void ipcp_script __P((int, char *, int));	/* Run an up/down script */
 static void ipcp_script_done __P((void *));
 
 /*
@@ -295,8 +295,8 @@ static void ipcp_script_done __P((void *));
 static enum script_state {
     s_down,
     s_up,
-} ipcp_script_state;
-static pid_t ipcp_script_pid;
+} ipcp_script_state[NUM_PPP];
+static pid_t ipcp_script_pid[NUM_PPP];
 
 /*
  * Make a string representation of a network IP address.
@@ -326,8 +326,9 @@ setvjslots(argv)
 
     if (!int_option(*argv, &value))
 	return 0;
-    if (value < 2 || value > 16) {
-	option_error("vj-max-slots value must be between 2 and 16");
+    if (value < 2 || value > VJ_MAX_SLOTS) {
+	option_error("vj-max-slots value must be between 2 and %d",
+		     VJ_MAX_SLOTS);
 	return 0;
     }
     ipcp_wantoptions [0].maxslotindex =
@@ -619,7 +620,7 @@ ipcp_open(unit)
     int unit;
 {
     fsm_open(&ipcp_fsm[unit]);
-    ipcp_is_open = 1;
+    ipcp_is_open[unit] = 1;
 }
 
 
@@ -1755,7 +1756,7 @@ ip_demand_conf(u)
     }
     if (!sifaddr(u, wo->ouraddr, wo->hisaddr, GetMask(wo->ouraddr)))
 	return 0;
-    ipcp_script(_PATH_IPPREUP, 1);
+    ipcp_script(u, _PATH_IPPREUP, 1);
     if (!sifup(u))
 	return 0;
     if (!sifnpmode(u, PPP_IP, NPMODE_QUEUE))
@@ -1840,7 +1841,8 @@ ipcp_up(f)
     }
 
     /* set tcp compression */
-    sifvjcomp(f->unit, ho->neg_vj, ho->cflag, ho->maxslotindex);
+    sifvjcomp(f->unit, ho->neg_vj, ho->cflag, ho->maxslotindex,
+	      go->neg_vj? go->maxslotindex: MAX_STATES - 1);
 
     /*
      * If we are doing dial-on-demand, the interface is already
@@ -1902,7 +1904,7 @@ ipcp_up(f)
 #endif
 
 	/* run the pre-up script, if any, and wait for it to finish */
-	ipcp_script(_PATH_IPPREUP, 1);
+	ipcp_script(f->unit, _PATH_IPPREUP, 1);
 
 	/* bring the interface up for IP */
 	if (!sifup(f->unit)) {
@@ -1946,9 +1948,9 @@ ipcp_up(f)
     reset_link_stats(f->unit);
 
     np_up(f->unit, PPP_IP);
-    ipcp_is_up = 1;
+    ipcp_is_up[f->unit] = 1;
 
-    notify(ip_up_notifier, 0);
+    notify(ip_up_notifier, f->unit);
     if (ip_up_hook)
 	ip_up_hook();
 
@@ -1956,9 +1958,10 @@ ipcp_up(f)
      * Execute the ip-up script, like this:
      *	/etc/ppp/ip-up interface tty speed local-IP remote-IP
      */
-    if (ipcp_script_state == s_down && ipcp_script_pid == 0) {
-	ipcp_script_state = s_up;
-	ipcp_script(_PATH_IPUP, 0);
+    if (ipcp_script_state[f->unit] == s_down
+	&& ipcp_script_pid[f->unit] == 0) {
+	ipcp_script_state[f->unit] = s_up;
+	ipcp_script(f->unit, _PATH_IPUP, 0);
     }
 }
 
@@ -1979,14 +1982,14 @@ ipcp_down(f)
     /* XXX more correct: we must get the stats before running the notifiers,
      * at least for the radius plugin */
     update_link_stats(f->unit);
-    notify(ip_down_notifier, 0);
+    notify(ip_down_notifier, f->unit);
     if (ip_down_hook)
 	ip_down_hook();
-    if (ipcp_is_up) {
-	ipcp_is_up = 0;
+    if (ipcp_is_up[f->unit]) {
+	ipcp_is_up[f->unit] = 0;
 	np_down(f->unit, PPP_IP);
     }
-    sifvjcomp(f->unit, 0, 0, 0);
+    sifvjcomp(f->unit, 0, 0, 0, 0);
 
     print_link_stats(); /* _after_ running the notifiers and ip_down_hook(),
 			 * because print_link_stats() sets link_stats_valid
@@ -2006,9 +2009,10 @@ ipcp_down(f)
     }
 
     /* Execute the ip-down script */
-    if (ipcp_script_state == s_up && ipcp_script_pid == 0) {
-	ipcp_script_state = s_down;
-	ipcp_script(_PATH_IPDOWN, 0);
+    if (ipcp_script_state[f->unit] == s_up
+	&& ipcp_script_pid[f->unit] == 0) {
+	ipcp_script_state[f->unit] = s_down;
+	ipcp_script(f->unit, _PATH_IPDOWN, 0);
     }
 }
 
@@ -2042,8 +2046,8 @@ static void
 ipcp_finished(f)
     fsm *f;
 {
-	if (ipcp_is_open) {
-		ipcp_is_open = 0;
+	if (ipcp_is_open[f->unit]) {
+		ipcp_is_open[f->unit] = 0;
 		np_finished(f->unit, PPP_IP);
 	}
 }
@@ -2057,18 +2061,20 @@ static void
 ipcp_script_done(arg)
     void *arg;
 {
-    ipcp_script_pid = 0;
-    switch (ipcp_script_state) {
+    fsm *f = (fsm *) arg;
+
+    ipcp_script_pid[f->unit] = 0;
+    switch (ipcp_script_state[f->unit]) {
     case s_up:
-	if (ipcp_fsm[0].state != OPENED) {
-	    ipcp_script_state = s_down;
-	    ipcp_script(_PATH_IPDOWN, 0);
+	if (f->state != OPENED) {
+	    ipcp_script_state[f->unit] = s_down;
+	    ipcp_script(f->unit, _PATH_IPDOWN, 0);
 	}
 	break;
     case s_down:
-	if (ipcp_fsm[0].state == OPENED) {
-	    ipcp_script_state = s_up;
-	    ipcp_script(_PATH_IPUP, 0);
+	if (f->state == OPENED) {
+	    ipcp_script_state[f->unit] = s_up;
+	    ipcp_script(f->unit, _PATH_IPUP, 0);
 	}
 	break;
     }
@@ -2080,7 +2086,8 @@ ipcp_script_done(arg)
  * interface-name tty-name speed local-IP remote-IP.
  */
 static void
-ipcp_script(script, wait)
+ipcp_script(unit, script, wait)
+    int unit;
     char *script;
     int wait;
 {
@@ -2088,8 +2095,8 @@ ipcp_script(script, wait)
     char *argv[8];
 
     slprintf(strspeed, sizeof(strspeed), "%d", baud_rate);
-    slprintf(strlocal, sizeof(strlocal), "%I", ipcp_gotoptions[0].ouraddr);
-    slprintf(strremote, sizeof(strremote), "%I", ipcp_hisoptions[0].hisaddr);
+    slprintf(strlocal, sizeof(strlocal), "%I", ipcp_gotoptions[unit].ouraddr);
+    slprintf(strremote, sizeof(strremote), "%I", ipcp_hisoptions[unit].hisaddr);
 
     argv[0] = script;
     argv[1] = ifname;
@@ -2102,8 +2109,8 @@ ipcp_script(script, wait)
     if (wait)
 	run_program(script, argv, 0, NULL, NULL, 1);
     else
-	ipcp_script_pid = run_program(script, argv, 0, ipcp_script_done,
-				      NULL, 0);
+	ipcp_script_pid[unit] = run_program(script, argv, 0, ipcp_script_done,
+					    &ipcp_fsm[unit], 0);
 }
 
 /*
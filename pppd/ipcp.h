@@ -55,6 +55,11 @@
 #define CI_MS_WINS2	132	/* Secondary WINS value */
 
 #define MAX_STATES 16		/* from slcompress.h */
+#ifdef __linux__
+#define VJ_MAX_SLOTS 255	/* most slots the kernel's slhc_init accepts */
+#else
+#define VJ_MAX_SLOTS 256	/* most slots the protocol allows */
+#endif
 
 #define IPCP_VJMODE_OLD 1	/* "old" mode (option # = 0x0037) */
 #define IPCP_VJMODE_RFC1172 2	/* "old-rfc"mode (option # = 0x002d) */
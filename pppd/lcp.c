@@ -193,9 +193,9 @@ lcp_options lcp_gotoptions[NUM_PPP];	/* Options that peer ack'd */
 lcp_options lcp_allowoptions[NUM_PPP];	/* Options we allow peer to request */
 lcp_options lcp_hisoptions[NUM_PPP];	/* Options that we ack'd */
 
-static int lcp_echos_pending = 0;	/* Number of outstanding echo msgs */
-static int lcp_echo_number   = 0;	/* ID number of next echo frame */
-static int lcp_echo_timer_running = 0;  /* set if a timer is running */
+static int lcp_echos_pending[NUM_PPP];	/* Number of outstanding echo msgs */
+static int lcp_echo_number[NUM_PPP];	/* ID number of next echo frame */
+static int lcp_echo_timer_running[NUM_PPP]; /* set if a timer is running */
 
 static u_char nak_buffer[PPP_MRU];	/* where we construct a nak packet */
 
@@ -2239,7 +2239,7 @@ void LcpLinkFailure (f)
     fsm *f;
 {
     if (f->state == OPENED) {
-	info("No response to %d echo-requests", lcp_echos_pending);
+	info("No response to %d echo-requests", lcp_echos_pending[f->unit]);
         notice("Serial link appears to be disconnected.");
 	status = EXIT_PEER_DEAD;
 	lcp_close(f->unit, "Peer not responding");
@@ -2261,10 +2261,10 @@ LcpEchoCheck (f)
     /*
      * Start the timer for the next interval.
      */
-    if (lcp_echo_timer_running)
+    if (lcp_echo_timer_running[f->unit])
 	warn("assertion lcp_echo_timer_running==0 failed");
     TIMEOUT (LcpEchoTimeout, f, lcp_echo_interval);
-    lcp_echo_timer_running = 1;
+    lcp_echo_timer_running[f->unit] = 1;
 }
 
 /*
@@ -2275,9 +2275,11 @@ static void
 LcpEchoTimeout (arg)
     void *arg;
 {
-    if (lcp_echo_timer_running != 0) {
-        lcp_echo_timer_running = 0;
-        LcpEchoCheck ((fsm *) arg);
+    fsm *f = (fsm *) arg;
+
+    if (lcp_echo_timer_running[f->unit] != 0) {
+        lcp_echo_timer_running[f->unit] = 0;
+        LcpEchoCheck (f);
     }
 }
 
@@ -2307,7 +2309,7 @@ lcp_received_echo_reply (f, id, inp, len)
     }
 
     /* Reset the number of outstanding echo frames */
-    lcp_echos_pending = 0;
+    lcp_echos_pending[f->unit] = 0;
 }
 
 /*
@@ -2325,9 +2327,9 @@ LcpSendEchoRequest (f)
      * Detect the failure of the peer at this point.
      */
     if (lcp_echo_fails != 0) {
-        if (lcp_echos_pending >= lcp_echo_fails) {
+        if (lcp_echos_pending[f->unit] >= lcp_echo_fails) {
             LcpLinkFailure(f);
-	    lcp_echos_pending = 0;
+	    lcp_echos_pending[f->unit] = 0;
 	}
     }
 
@@ -2338,8 +2340,9 @@ LcpSendEchoRequest (f)
         lcp_magic = lcp_gotoptions[f->unit].magicnumber;
 	pktp = pkt;
 	PUTLONG(lcp_magic, pktp);
-        fsm_sdata(f, ECHOREQ, lcp_echo_number++ & 0xFF, pkt, pktp - pkt);
-	++lcp_echos_pending;
+        fsm_sdata(f, ECHOREQ, lcp_echo_number[f->unit]++ & 0xFF, pkt,
+		  pktp - pkt);
+	++lcp_echos_pending[f->unit];
     }
 }
 
@@ -2354,9 +2357,9 @@ lcp_echo_lowerup (unit)
     fsm *f = &lcp_fsm[unit];
 
     /* Clear the parameters for generating echo frames */
-    lcp_echos_pending      = 0;
-    lcp_echo_number        = 0;
-    lcp_echo_timer_running = 0;
+    lcp_echos_pending[unit]      = 0;
+    lcp_echo_number[unit]        = 0;
+    lcp_echo_timer_running[unit] = 0;
   
     /* If a timeout interval is specified then start the timer */
     if (lcp_echo_interval != 0)
@@ -2373,8 +2376,8 @@ lcp_echo_lowerdown (unit)
 {
     fsm *f = &lcp_fsm[unit];
 
-    if (lcp_echo_timer_running != 0) {
+    if (lcp_echo_timer_running[unit] != 0) {
         UNTIMEOUT (LcpEchoTimeout, f);
-        lcp_echo_timer_running = 0;
+        lcp_echo_timer_running[unit] = 0;
     }
 }
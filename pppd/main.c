@@ -205,6 +205,37 @@ static struct pppd_stats old_link_stats;
 struct pppd_stats link_stats;
 unsigned link_connect_time;
 int link_stats_valid;
+unsigned link_db_writes;	/* pppdb stores/deletes this session */
+
+#ifdef USE_TDB
+static int db_dirty;		/* script_env changed since last tdb_store */
+#endif
+
+/*
+ * Link-level state for each unit.  pppd works on one unit at a time,
+ * and phase, ifunit, ifname, the peer's names, devfd, fd_ppp, hungup
+ * and the link statistics above are those of cur_unit; select_unit
+ * puts them away here and fetches another unit's.  Timeouts and fd
+ * callbacks are run on the unit that was current when they were set.
+ */
+static struct unit_link {
+    int		phase;
+    int		ifunit;
+    char	ifname[32];
+    char	peer_authname[MAXNAMELEN];
+    char	remote_name[MAXNAMELEN];
+    int		devfd;
+    int		fd_ppp;
+    int		hungup;
+    struct timeval start_time;
+    struct pppd_stats old_link_stats;
+    struct pppd_stats link_stats;
+    unsigned	link_connect_time;
+    int		link_stats_valid;
+    int		input;		/* wait_input found its channel ready */
+} units[NUM_PPP];
+
+int cur_unit;			/* unit whose link state is current */
 
 int error_count;
 
@@ -232,9 +263,11 @@ static void setup_signals __P((void));
 static void create_pidfile __P((int pid));
 static void create_linkpidfile __P((int pid));
 static void cleanup __P((void));
-static void get_input __P((void));
-static void calltimeout __P((void));
-static struct timeval *timeleft __P((struct timeval *));
+static void get_input __P((int));
+static void get_units_input __P((void));
+static void init_units __P((void));
+static void copy_fsm_options __P((fsm *, fsm *));
+static void close_units __P((char *));
 static void kill_my_pg __P((int));
 static void hup __P((int));
 static void term __P((int));
@@ -347,10 +380,11 @@ main(argc, argv)
     magic_init();
 
     /*
-     * Initialize each protocol.
+     * Initialize each protocol, for each unit.
      */
     for (i = 0; (protp = protocols[i]) != NULL; ++i)
-        (*protp->init)(0);
+	for (t = 0; t < NUM_PPP; ++t)
+	    (*protp->init)(t);
 
     /*
      * Initialize the default channel.
@@ -434,12 +468,20 @@ main(argc, argv)
      * Initialize system-dependent stuff.
      */
     sys_init();
+    init_units();
 
 #ifdef USE_TDB
-    pppdb = tdb_open(_PATH_PPPDB, 0, 0, O_RDWR|O_CREAT, 0644);
+    pppdb = tdb_open(_PATH_PPPDB, db_hash_size, 0, O_RDWR|O_CREAT, 0644);
     if (pppdb != NULL) {
 	slprintf(db_key, sizeof(db_key), "pppd%d", getpid());
 	update_db_entry();
+	if (debug) {
+	    struct tdb_chainstats st;
+
+	    if (tdb_chainstats(pppdb, &st) == 0)
+		dbglog("%s: %u records on %u chains (%u empty), longest %u",
+		       _PATH_PPPDB, st.records, st.chains, st.empty, st.longest);
+	}
     } else {
 	warn("Warning: couldn't open ppp database %s", _PATH_PPPDB);
 	if (multilink) {
@@ -447,6 +489,9 @@ main(argc, argv)
 	    multilink = 0;
 	}
     }
+    if (multilink && !open_lock_db(_PATH_PPPDB_LOCKS))
+	warn("Warning: couldn't open %s, using a single lock for all bundles",
+	     _PATH_PPPDB_LOCKS);
 #endif
 
     /*
@@ -531,6 +576,8 @@ main(argc, argv)
 	}
 
 	gettimeofday(&start_time, NULL);
+	link_db_writes = 0;
+	link_db_lock_waits = 0;
 	script_unsetenv("CONNECT_TIME");
 	script_unsetenv("BYTES_SENT");
 	script_unsetenv("BYTES_RCVD");
@@ -539,9 +586,9 @@ main(argc, argv)
 	start_link(0);
 	while (phase != PHASE_DEAD) {
 	    handle_events();
-	    get_input();
+	    get_input(0);
 	    if (kill_link)
-		lcp_close(0, "User request");
+		close_units("User request");
 	    if (asked_to_quit) {
 		bundle_terminating = 1;
 		if (phase == PHASE_MASTER)
@@ -608,6 +655,9 @@ handle_events()
 {
     struct timeval timo;
 
+    /* write out the script_setenv changes from the last time round */
+    flush_db_entry();
+
     kill_link = open_ccp_flag = 0;
     if (sigsetjmp(sigjmp, 1) == 0) {
 	sigprocmask(SIG_BLOCK, &signals_handled, NULL);
@@ -620,6 +670,8 @@ handle_events()
 	}
     }
     waiting = 0;
+    run_fd_callbacks();
+    get_units_input();
     calltimeout();
     if (got_sighup) {
 	info("Hangup (SIGHUP)");
@@ -1017,10 +1069,12 @@ protocol_name(proto)
 }
 
 /*
- * get_input - called when incoming data is available.
+ * get_input - called when incoming data is available on the channel
+ * of unit, which must be the current unit.
  */
 static void
-get_input()
+get_input(unit)
+    int unit;
 {
     int len, i;
     u_char *p;
@@ -1042,8 +1096,8 @@ get_input()
 	notice("Modem hangup");
 	hungup = 1;
 	status = EXIT_HANGUP;
-	lcp_lowerdown(0);	/* serial link is no longer available */
-	link_terminated(0);
+	lcp_lowerdown(unit);	/* serial link is no longer available */
+	link_terminated(unit);
 	return;
     }
 
@@ -1062,7 +1116,7 @@ get_input()
     /*
      * Toss all non-LCP packets unless LCP is OPEN.
      */
-    if (protocol != PPP_LCP && lcp_fsm[0].state != OPENED) {
+    if (protocol != PPP_LCP && lcp_fsm[unit].state != OPENED) {
 	dbglog("Discarded non-LCP packet when LCP not open");
 	return;
     }
@@ -1085,12 +1139,12 @@ get_input()
      */
     for (i = 0; (protp = protocols[i]) != NULL; ++i) {
 	if (protp->protocol == protocol && protp->enabled_flag) {
-	    (*protp->input)(0, p, len);
+	    (*protp->input)(unit, p, len);
 	    return;
 	}
         if (protocol == (protp->protocol & ~0x8000) && protp->enabled_flag
 	    && protp->datainput != NULL) {
-	    (*protp->datainput)(0, p, len);
+	    (*protp->datainput)(unit, p, len);
 	    return;
 	}
     }
@@ -1102,7 +1156,39 @@ get_input()
 	else
 	    warn("Unsupported protocol 0x%x received", protocol);
     }
-    lcp_sprotrej(0, p - PPP_HDRLEN, len + PPP_HDRLEN);
+    lcp_sprotrej(unit, p - PPP_HDRLEN, len + PPP_HDRLEN);
+}
+
+/*
+ * get_units_input - read a packet from the channel of each unit other
+ * than 0 that wait_input found ready, and pass it to that unit's
+ * protocols.  Unit 0's channel is read by the main loop.
+ */
+static void
+get_units_input()
+{
+    int unit, prev = cur_unit;
+
+    for (unit = 1; unit < NUM_PPP; ++unit) {
+	if (!units[unit].input)
+	    continue;
+	units[unit].input = 0;
+	select_unit(unit);
+	if (phase != PHASE_DEAD)
+	    get_input(unit);
+    }
+    select_unit(prev);
+}
+
+/*
+ * unit_input_ready - note that a channel fd added by unit is readable.
+ */
+void
+unit_input_ready(unit)
+    int unit;
+{
+    if (unit >= 0 && unit < NUM_PPP)
+	units[unit].input = 1;
 }
 
 /*
@@ -1154,12 +1240,165 @@ void
 new_phase(p)
     int p;
 {
+    flush_db_entry();
     phase = p;
     if (new_phase_hook)
 	(*new_phase_hook)(p);
     notify(phasechange, p);
 }
 
+/*
+ * select_unit - put away the link state of the current unit and make
+ * unit the current one.
+ */
+void
+select_unit(unit)
+    int unit;
+{
+    struct unit_link *ul;
+
+    if (unit == cur_unit || unit < 0 || unit >= NUM_PPP)
+	return;
+    ul = &units[cur_unit];
+    ul->phase = phase;
+    ul->ifunit = ifunit;
+    strlcpy(ul->ifname, ifname, sizeof(ul->ifname));
+    strlcpy(ul->peer_authname, peer_authname, sizeof(ul->peer_authname));
+    strlcpy(ul->remote_name, remote_name, sizeof(ul->remote_name));
+    ul->devfd = devfd;
+    ul->fd_ppp = fd_ppp;
+    ul->hungup = hungup;
+    ul->start_time = start_time;
+    ul->old_link_stats = old_link_stats;
+    ul->link_stats = link_stats;
+    ul->link_connect_time = link_connect_time;
+    ul->link_stats_valid = link_stats_valid;
+
+    sys_select_unit(cur_unit, unit);
+    cur_unit = unit;
+
+    ul = &units[unit];
+    phase = ul->phase;
+    ifunit = ul->ifunit;
+    strlcpy(ifname, ul->ifname, sizeof(ul->ifname));
+    strlcpy(peer_authname, ul->peer_authname, sizeof(ul->peer_authname));
+    strlcpy(remote_name, ul->remote_name, sizeof(ul->remote_name));
+    devfd = ul->devfd;
+    fd_ppp = ul->fd_ppp;
+    hungup = ul->hungup;
+    start_time = ul->start_time;
+    old_link_stats = ul->old_link_stats;
+    link_stats = ul->link_stats;
+    link_connect_time = ul->link_connect_time;
+    link_stats_valid = ul->link_stats_valid;
+}
+
+/*
+ * init_units - set up the units other than 0 with no link, and with
+ * the protocol options and timers that were given for unit 0.
+ */
+static void
+init_units()
+{
+    int unit;
+
+    for (unit = 1; unit < NUM_PPP; ++unit) {
+	units[unit].phase = PHASE_DEAD;
+	units[unit].ifunit = -1;
+	units[unit].devfd = -1;
+	units[unit].fd_ppp = -1;
+	strlcpy(units[unit].remote_name, remote_name,
+		sizeof(units[unit].remote_name));
+
+	lcp_wantoptions[unit] = lcp_wantoptions[0];
+	lcp_allowoptions[unit] = lcp_allowoptions[0];
+	copy_fsm_options(&lcp_fsm[unit], &lcp_fsm[0]);
+	ipcp_wantoptions[unit] = ipcp_wantoptions[0];
+	ipcp_allowoptions[unit] = ipcp_allowoptions[0];
+	copy_fsm_options(&ipcp_fsm[unit], &ipcp_fsm[0]);
+	ccp_wantoptions[unit] = ccp_wantoptions[0];
+	ccp_allowoptions[unit] = ccp_allowoptions[0];
+	copy_fsm_options(&ccp_fsm[unit], &ccp_fsm[0]);
+#ifdef INET6
+	ipv6cp_wantoptions[unit] = ipv6cp_wantoptions[0];
+	ipv6cp_allowoptions[unit] = ipv6cp_allowoptions[0];
+	copy_fsm_options(&ipv6cp_fsm[unit], &ipv6cp_fsm[0]);
+#endif
+#ifdef IPX_CHANGE
+	ipxcp_wantoptions[unit] = ipxcp_wantoptions[0];
+	ipxcp_allowoptions[unit] = ipxcp_allowoptions[0];
+	copy_fsm_options(&ipxcp_fsm[unit], &ipxcp_fsm[0]);
+#endif
+	upap[unit].us_timeouttime = upap[0].us_timeouttime;
+	upap[unit].us_maxtransmits = upap[0].us_maxtransmits;
+	upap[unit].us_reqtimeout = upap[0].us_reqtimeout;
+	eap_states[unit].es_client.ea_timeout =
+	    eap_states[0].es_client.ea_timeout;
+	eap_states[unit].es_client.ea_maxrequests =
+	    eap_states[0].es_client.ea_maxrequests;
+	eap_states[unit].es_server.ea_timeout =
+	    eap_states[0].es_server.ea_timeout;
+	eap_states[unit].es_server.ea_maxrequests =
+	    eap_states[0].es_server.ea_maxrequests;
+    }
+}
+
+/*
+ * copy_fsm_options - give to the retransmission options of from.
+ */
+static void
+copy_fsm_options(to, from)
+    fsm *to, *from;
+{
+    to->timeouttime = from->timeouttime;
+    to->maxconfreqtransmits = from->maxconfreqtransmits;
+    to->maxtermtransmits = from->maxtermtransmits;
+    to->maxnakloops = from->maxnakloops;
+}
+
+/*
+ * open_unit - start a link on unit, alongside unit 0's, using the
+ * next connection that the_channel->connect gives us.  This is for
+ * channels that carry many sessions, such as a PPPoE or L2TP access
+ * concentrator.  Returns -1 if unit is out of range or has a link.
+ */
+int
+open_unit(unit)
+    int unit;
+{
+    int prev = cur_unit;
+
+    if (unit <= 0 || unit >= NUM_PPP)
+	return -1;
+    select_unit(unit);
+    if (phase != PHASE_DEAD) {
+	select_unit(prev);
+	return -1;
+    }
+    lcp_open(unit);
+    start_link(unit);
+    select_unit(prev);
+    return 0;
+}
+
+/*
+ * close_units - close the link on unit 0 and on every other unit
+ * that has one.
+ */
+static void
+close_units(reason)
+    char *reason;
+{
+    int unit, prev = cur_unit;
+
+    for (unit = 0; unit < NUM_PPP; ++unit) {
+	select_unit(unit);
+	if (unit == 0 || phase != PHASE_DEAD)
+	    lcp_close(unit, reason);
+    }
+    select_unit(prev);
+}
+
 /*
  * die - clean up state and exit with the specified status.
  */
@@ -1182,10 +1421,15 @@ die(status)
 static void
 cleanup()
 {
-    sys_cleanup();
-
-    if (fd_ppp >= 0)
-	the_channel->disestablish_ppp(devfd);
+    int unit;
+
+    /* finish on unit 0, for the channel cleanup and pid files */
+    for (unit = NUM_PPP - 1; unit >= 0; --unit) {
+	select_unit(unit);
+	sys_cleanup();
+	if (fd_ppp >= 0)
+	    the_channel->disestablish_ppp(devfd);
+    }
     if (the_channel->cleanup)
 	(*the_channel->cleanup)();
     remove_pidfiles();
@@ -1208,6 +1452,11 @@ print_link_stats()
        info("Connect time %d.%d minutes.", t/10, t%10);
        info("Sent %u bytes, received %u bytes.",
 	    link_stats.bytes_out, link_stats.bytes_in);
+#ifdef USE_TDB
+       if (pppdb != NULL)
+	   dbglog("Made %u updates to the ppp database, waited %u times"
+		  " for a lock on it.", link_db_writes, link_db_lock_waits);
+#endif
        link_stats_valid = 0;
     }
 }
@@ -1254,127 +1503,6 @@ update_link_stats(u)
 }
 
 
-struct	callout {
-    struct timeval	c_time;		/* time at which to call routine */
-    void		*c_arg;		/* argument to routine */
-    void		(*c_func) __P((void *)); /* routine */
-    struct		callout *c_next;
-};
-
-static struct callout *callout = NULL;	/* Callout list */
-static struct timeval timenow;		/* Current time */
-
-/*
- * timeout - Schedule a timeout.
- */
-void
-timeout(func, arg, secs, usecs)
-    void (*func) __P((void *));
-    void *arg;
-    int secs, usecs;
-{
-    struct callout *newp, *p, **pp;
-
-    /*
-     * Allocate timeout.
-     */
-    if ((newp = (struct callout *) malloc(sizeof(struct callout))) == NULL)
-	fatal("Out of memory in timeout()!");
-    newp->c_arg = arg;
-    newp->c_func = func;
-    gettimeofday(&timenow, NULL);
-    newp->c_time.tv_sec = timenow.tv_sec + secs;
-    newp->c_time.tv_usec = timenow.tv_usec + usecs;
-    if (newp->c_time.tv_usec >= 1000000) {
-	newp->c_time.tv_sec += newp->c_time.tv_usec / 1000000;
-	newp->c_time.tv_usec %= 1000000;
-    }
-
-    /*
-     * Find correct place and link it in.
-     */
-    for (pp = &callout; (p = *pp); pp = &p->c_next)
-	if (newp->c_time.tv_sec < p->c_time.tv_sec
-	    || (newp->c_time.tv_sec == p->c_time.tv_sec
-		&& newp->c_time.tv_usec < p->c_time.tv_usec))
-	    break;
-    newp->c_next = p;
-    *pp = newp;
-}
-
-
-/*
- * untimeout - Unschedule a timeout.
- */
-void
-untimeout(func, arg)
-    void (*func) __P((void *));
-    void *arg;
-{
-    struct callout **copp, *freep;
-
-    /*
-     * Find first matching timeout and remove it from the list.
-     */
-    for (copp = &callout; (freep = *copp); copp = &freep->c_next)
-	if (freep->c_func == func && freep->c_arg == arg) {
-	    *copp = freep->c_next;
-	    free((char *) freep);
-	    break;
-	}
-}
-
-
-/*
- * calltimeout - Call any timeout routines which are now due.
- */
-static void
-calltimeout()
-{
-    struct callout *p;
-
-    while (callout != NULL) {
-	p = callout;
-
-	if (gettimeofday(&timenow, NULL) < 0)
-	    fatal("Failed to get time of day: %m");
-	if (!(p->c_time.tv_sec < timenow.tv_sec
-	      || (p->c_time.tv_sec == timenow.tv_sec
-		  && p->c_time.tv_usec <= timenow.tv_usec)))
-	    break;		/* no, it's not time yet */
-
-	callout = p->c_next;
-	(*p->c_func)(p->c_arg);
-
-	free((char *) p);
-    }
-}
-
-
-/*
- * timeleft - return the length of time until the next timeout is due.
- */
-static struct timeval *
-timeleft(tvp)
-    struct timeval *tvp;
-{
-    if (callout == NULL)
-	return NULL;
-
-    gettimeofday(&timenow, NULL);
-    tvp->tv_sec = callout->c_time.tv_sec - timenow.tv_sec;
-    tvp->tv_usec = callout->c_time.tv_usec - timenow.tv_usec;
-    if (tvp->tv_usec < 0) {
-	tvp->tv_usec += 1000000;
-	tvp->tv_sec -= 1;
-    }
-    if (tvp->tv_sec < 0)
-	tvp->tv_sec = tvp->tv_usec = 0;
-
-    return tvp;
-}
-
-
 /*
  * kill_my_pg - send a signal to our process group, and ignore it ourselves.
  * We assume that sig is currently blocked.
@@ -1572,6 +1700,7 @@ safe_fork(int infd, int outfd, int errfd)
 	sys_close();
 #ifdef USE_TDB
 	tdb_close(pppdb);
+	close_lock_db();
 #endif
 
 	/* make sure infd, outfd and errfd won't get tromped on below */
@@ -2046,7 +2175,7 @@ script_setenv(var, value, iskey)
 		if (pppdb != NULL) {
 		    if (iskey)
 			add_db_key(newstring);
-		    update_db_entry();
+		    db_dirty = 1;
 		}
 #endif
 		return;
@@ -2070,7 +2199,7 @@ script_setenv(var, value, iskey)
     if (pppdb != NULL) {
 	if (iskey)
 	    add_db_key(newstring);
-	update_db_entry();
+	db_dirty = 1;
     }
 #endif
 }
@@ -2101,42 +2230,25 @@ script_unsetenv(var)
     }
 #ifdef USE_TDB
     if (pppdb != NULL)
-	update_db_entry();
+	db_dirty = 1;
 #endif
 }
 
 /*
- * Any arbitrary string used as a key for locking the database.
- * It doesn't matter what it is as long as all pppds use the same string.
- */
-#define PPPD_LOCK_KEY	"pppd lock"
-
-/*
- * lock_db - get an exclusive lock on the TDB database.
- * Used to ensure atomicity of various lookup/modify operations.
+ * flush_db_entry - write out our database entry if script_setenv or
+ * script_unsetenv has changed it since it was last written.  Changes
+ * are gathered up and written once per trip around the event loop,
+ * at phase changes and before the database lock is released, rather
+ * than once per variable.
  */
-void lock_db()
-{
-#ifdef USE_TDB
-	TDB_DATA key;
-
-	key.dptr = PPPD_LOCK_KEY;
-	key.dsize = strlen(key.dptr);
-	tdb_chainlock(pppdb, key);
-#endif
-}
-
-/*
- * unlock_db - remove the exclusive lock obtained by lock_db.
- */
-void unlock_db()
+void
+flush_db_entry()
 {
 #ifdef USE_TDB
-	TDB_DATA key;
-
-	key.dptr = PPPD_LOCK_KEY;
-	key.dsize = strlen(key.dptr);
-	tdb_chainunlock(pppdb, key);
+    if (pppdb != NULL && db_dirty) {
+	db_dirty = 0;
+	update_db_entry();
+    }
 #endif
 }
 
@@ -2169,6 +2281,7 @@ update_db_entry()
     dbuf.dsize = vlen;
     if (tdb_store(pppdb, key, dbuf, TDB_REPLACE))
 	error("tdb_store failed: %s", tdb_errorstr(pppdb));
+    ++link_db_writes;
 
     if (vbuf)
         free(vbuf);
@@ -2190,6 +2303,7 @@ add_db_key(str)
     dbuf.dsize = strlen(db_key);
     if (tdb_store(pppdb, key, dbuf, TDB_REPLACE))
 	error("tdb_store key failed: %s", tdb_errorstr(pppdb));
+    ++link_db_writes;
 }
 
 /*
@@ -2204,6 +2318,7 @@ delete_db_key(str)
     key.dptr = (char *) str;
     key.dsize = strlen(str);
     tdb_delete(pppdb, key);
+    ++link_db_writes;
 }
 
 /*
@@ -2216,6 +2331,7 @@ cleanup_db()
     int i;
     char *p;
 
+    db_dirty = 0;
     key.dptr = db_key;
     key.dsize = strlen(db_key);
     tdb_delete(pppdb, key);
@@ -122,6 +122,9 @@ char	*domain;		/* domain name set by domain option */
 int	child_wait = 5;		/* # seconds to wait for children at exit */
 struct userenv *userenv_list;	/* user environment variables */
 int	dfl_route_metric = -1;	/* metric of the default route to set over the PPP link */
+int	db_hash_size = 4099;	/* # hash chains for a new ppp database */
+int	demand_queue_size = 262144; /* bytes of frames to queue while dialling */
+int	demand_queue_age = 0;	/* drop queued frames older than this (secs) */
 
 #ifdef MAXOCTETS
 unsigned int  maxoctets = 0;    /* default - no limit */
@@ -242,6 +245,12 @@ option_t general_options[] = {
 
     { "demand", o_bool, &demand,
       "Dial on demand", OPT_INITONLY | 1, &persist },
+    { "demand-queue-size", o_int, &demand_queue_size,
+      "Set max bytes of packets to queue while bringing the link up",
+      OPT_PRIO | OPT_INITONLY },
+    { "demand-queue-age", o_int, &demand_queue_age,
+      "Set max seconds to hold queued packets while bringing the link up",
+      OPT_PRIO },
 
     { "--version", o_special_noarg, (void *)showversion,
       "Show version number" },
@@ -304,6 +313,10 @@ option_t general_options[] = {
       "Metric to use for the default route (Linux only; -1 for default behavior)",
       OPT_PRIV|OPT_LLIMIT|OPT_INITONLY, NULL, 0, -1 },
 
+    { "db-hash-size", o_int, &db_hash_size,
+      "Number of hash chains to create the ppp database with",
+      OPT_PRIV|OPT_LLIMIT|OPT_INITONLY, NULL, 0, 1 },
+
 #ifdef HAVE_MULTILINK
     { "multilink", o_bool, &multilink,
       "Enable multilink operation", OPT_PRIO | 1 },
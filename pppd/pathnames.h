@@ -47,11 +47,14 @@
 
 #ifdef __STDC__
 #define _PATH_PPPDB	_ROOT_PATH _PATH_VARRUN "pppd2.tdb"
+#define _PATH_PPPDB_LOCKS _ROOT_PATH _PATH_VARRUN "pppd2-locks.tdb"
 #else /* __STDC__ */
 #ifdef HAVE_PATHS_H
 #define _PATH_PPPDB	"/var/run/pppd2.tdb"
+#define _PATH_PPPDB_LOCKS "/var/run/pppd2-locks.tdb"
 #else
 #define _PATH_PPPDB	"/etc/ppp/pppd2.tdb"
+#define _PATH_PPPDB_LOCKS "/etc/ppp/pppd2-locks.tdb"
 #endif
 #endif /* __STDC__ */
 
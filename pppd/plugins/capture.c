@@ -0,0 +1,240 @@
+/*
+ * capture.c - pppd plugin to save the packets pppd sends and receives
+ * in pcapng format, for reading with tcpdump, wireshark and the like.
+ *
+ * Usage:
+ *	plugin capture.so capture-file /var/log/ppp0.pcapng
+ *	    [capture-limit bytes] [capture-files n] [capture-snaplen n]
+ *
+ * Packets are collected in memory and written out when the buffer
+ * fills, once a second, and when pppd exits.  With capture-limit,
+ * the files use at most that many bytes: with capture-files n > 1,
+ * the file is rotated (to file.1, file.2, ... file.n-1) when it has
+ * used its share of the limit, otherwise saving stops when the limit
+ * is reached.
+ *
+ * Only the packets which go through pppd are seen: the control
+ * protocols, and data packets while pppd is handling them itself
+ * (e.g. with demand dialling before the link is up).
+ *
+ * The capture file will contain any passwords sent with PAP, so it is
+ * created readable only by root.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include "pppd.h"
+#include "pcapng.h"
+
+char pppd_version[] = VERSION;
+
+#define CAPTURE_BUFSIZE	65536
+
+static char capture_file[MAXPATHLEN];
+static int capture_limit;		/* bytes, 0 = no limit */
+static int capture_files = 1;
+static int capture_snaplen = PCAPNG_SNAPLEN;
+
+static option_t options[] = {
+    { "capture-file", o_string, capture_file,
+      "Save packets to this file in pcapng format",
+      OPT_PRIO | OPT_PRIV | OPT_STATIC, NULL, MAXPATHLEN },
+    { "capture-limit", o_int, &capture_limit,
+      "Most bytes to use for saved packets",
+      OPT_PRIO | OPT_LLIMIT, NULL, 0, 0 },
+    { "capture-files", o_int, &capture_files,
+      "Number of files to rotate saved packets through",
+      OPT_PRIO | OPT_LIMITS, NULL, 100, 1 },
+    { "capture-snaplen", o_int, &capture_snaplen,
+      "Most bytes of each packet to save",
+      OPT_PRIO | OPT_LIMITS, NULL, PCAPNG_SNAPLEN, 16 },
+    { NULL }
+};
+
+static int cap_fd = -1;
+static unsigned char *cap_buf;		/* packets not written out yet;
+					   room for one more past
+					   CAPTURE_BUFSIZE */
+static int cap_len;
+static long cap_size;			/* bytes in the current file */
+static int cap_stopped;			/* limit reached, or error */
+static int cap_timer;			/* flush timer is running */
+
+static void (*old_snoop_recv_hook) __P((unsigned char *p, int len));
+static void (*old_snoop_send_hook) __P((unsigned char *p, int len));
+
+/*
+ * cap_flush - write out what's in the buffer.
+ */
+static void
+cap_flush(void)
+{
+    unsigned char *p = cap_buf;
+    int n;
+
+    while (cap_len > 0) {
+	n = write(cap_fd, p, cap_len);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    error("capture: error writing %s: %m", capture_file);
+	    cap_stopped = 1;
+	    cap_len = 0;
+	    return;
+	}
+	p += n;
+	cap_len -= n;
+    }
+}
+
+static void
+cap_close(void)
+{
+    if (cap_fd < 0)
+	return;
+    cap_flush();
+    close(cap_fd);
+    cap_fd = -1;
+}
+
+/*
+ * cap_open - start a new capture file.
+ */
+static int
+cap_open(void)
+{
+    cap_fd = open(capture_file, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (cap_fd < 0) {
+	error("capture: can't create %s: %m", capture_file);
+	cap_stopped = 1;
+	return 0;
+    }
+    if (cap_buf == NULL
+	&& (cap_buf = malloc(CAPTURE_BUFSIZE
+			     + PCAPNG_PKT_SPACE(PCAPNG_SNAPLEN))) == NULL) {
+	error("capture: no memory for buffer");
+	close(cap_fd);
+	cap_fd = -1;
+	cap_stopped = 1;
+	return 0;
+    }
+    cap_len = pcapng_header(cap_buf, "pppd " VERSION, ifname,
+			    capture_snaplen);
+    cap_size = cap_len;
+    return 1;
+}
+
+/*
+ * cap_rotate - move the current file to file.1, file.1 to file.2 and
+ * so on, dropping the oldest, and start a new one.
+ */
+static int
+cap_rotate(void)
+{
+    char old[MAXPATHLEN+8], new[MAXPATHLEN+8];
+    int i;
+
+    cap_close();
+    for (i = capture_files - 1; i > 0; --i) {
+	if (i > 1)
+	    slprintf(old, sizeof(old), "%s.%d", capture_file, i - 1);
+	else
+	    strlcpy(old, capture_file, sizeof(old));
+	slprintf(new, sizeof(new), "%s.%d", capture_file, i);
+	if (rename(old, new) < 0 && errno != ENOENT)
+	    warn("capture: can't rename %s to %s: %m", old, new);
+    }
+    return cap_open();
+}
+
+static void
+cap_flush_timer(void *arg)
+{
+    cap_timer = 0;
+    if (cap_fd >= 0)
+	cap_flush();
+}
+
+static void
+cap_exit(void *arg, int val)
+{
+    if (cap_timer)
+	untimeout(cap_flush_timer, NULL);
+    cap_timer = 0;
+    cap_close();
+}
+
+/*
+ * cap_packet - save a packet.
+ */
+static void
+cap_packet(unsigned char *p, int len, int sent)
+{
+    struct timeval tv;
+    int n;
+
+    if (capture_file[0] == 0 || cap_stopped)
+	return;
+    if (cap_fd < 0 && !cap_open())
+	return;
+
+    n = len < capture_snaplen? len: capture_snaplen;
+    n = PCAPNG_PKT_SPACE(n);
+    if (capture_limit > 0
+	&& cap_size + n > capture_limit / capture_files) {
+	if (capture_files == 1) {
+	    notice("capture: %s has reached %d bytes, not saving any more",
+		   capture_file, capture_limit);
+	    cap_stopped = 1;
+	    cap_close();
+	    return;
+	}
+	if (!cap_rotate())
+	    return;
+    }
+    if (cap_len + n > CAPTURE_BUFSIZE) {
+	cap_flush();
+	if (cap_stopped)
+	    return;
+    }
+
+    gettimeofday(&tv, NULL);
+    n = pcapng_packet(cap_buf + cap_len, &tv, sent, p, len, capture_snaplen);
+    cap_len += n;
+    cap_size += n;
+    if (!cap_timer) {
+	timeout(cap_flush_timer, NULL, 1, 0);
+	cap_timer = 1;
+    }
+}
+
+static void
+cap_snoop_recv(unsigned char *p, int len)
+{
+    if (old_snoop_recv_hook != NULL)
+	(*old_snoop_recv_hook)(p, len);
+    cap_packet(p, len, 0);
+}
+
+static void
+cap_snoop_send(unsigned char *p, int len)
+{
+    if (old_snoop_send_hook != NULL)
+	(*old_snoop_send_hook)(p, len);
+    cap_packet(p, len, 1);
+}
+
+void
+plugin_init(void)
+{
+    add_options(options);
+    old_snoop_recv_hook = snoop_recv_hook;
+    old_snoop_send_hook = snoop_send_hook;
+    snoop_recv_hook = cap_snoop_recv;
+    snoop_send_hook = cap_snoop_send;
+    add_notifier(&exitnotify, cap_exit, NULL);
+}
@@ -88,62 +88,23 @@ static unsigned char rc_guess_seqnbr(void)
  *
  * Purpose: generate a sequence number
  *
+ * Remarks: this used to be kept in the seqfile, locked with flock(),
+ *	    so that all processes on the host used different numbers.
+ *	    Since every process now sends from its own sockets, the
+ *	    identifier only has to be unique among our own outstanding
+ *	    requests, which rc_send_server checks; this just supplies
+ *	    the starting point.
+ *
  */
 
 unsigned char rc_get_seqnbr(void)
 {
-	FILE *sf;
-	int tries = 1;
-	int seq_nbr, pos;
-	char *seqfile = rc_conf_str("seqfile");
-
-	if ((sf = fopen(seqfile, "a+")) == NULL)
-	{
-		error("rc_get_seqnbr: couldn't open sequence file %s: %s", seqfile, strerror(errno));
-		/* well, so guess a sequence number */
-		return rc_guess_seqnbr();
-	}
-
-	while (do_lock_exclusive(fileno(sf))!= 0)
-	{
-		if (errno != EWOULDBLOCK) {
-			error("rc_get_seqnbr: flock failure: %s: %s", seqfile, strerror(errno));
-			fclose(sf);
-			return rc_guess_seqnbr();
-		}
-		tries++;
-		if (tries <= 10)
-			rc_mdelay(500);
-		else
-			break;
-	}
-
-	if (tries > 10) {
-		error("rc_get_seqnbr: couldn't get lock after %d tries: %s", tries-1, seqfile);
-		fclose(sf);
-		return rc_guess_seqnbr();
-	}
+	static int seq_nbr = -1;
 
-	pos = ftell(sf);
-	rewind(sf);
-	if (fscanf(sf, "%d", &seq_nbr) != 1) {
-		if (pos != ftell(sf)) {
-			/* file was not empty */
-			error("rc_get_seqnbr: fscanf failure: %s", seqfile);
-		}
+	if (seq_nbr < 0)
 		seq_nbr = rc_guess_seqnbr();
-	}
-
-	rewind(sf);
-	ftruncate(fileno(sf),0);
-	fprintf(sf,"%d\n", (seq_nbr+1) & UCHAR_MAX);
-
-	fflush(sf); /* fflush because a process may read it between the do_unlock and fclose */
-
-	if (do_unlock(fileno(sf)) != 0)
-		error("rc_get_seqnbr: couldn't release lock on %s: %s", seqfile, strerror(errno));
-
-	fclose(sf);
+	else
+		seq_nbr = (seq_nbr + 1) & UCHAR_MAX;
 
 	return (unsigned char)seq_nbr;
 }
@@ -404,6 +365,201 @@ int rc_acct_proxy(VALUE_PAIR *send)
 	return result;
 }
 
+/*
+ * Asynchronous requests.
+ *
+ * These do the same as rc_auth_using_server and rc_acct_using_server,
+ * including failing over to the next server on a timeout, but return
+ * as soon as the first request has been sent.  The result is passed
+ * to done(result, received, msg, arg) from pppd's main loop; done must
+ * free the received pairs.  The send pairs are freed once the request
+ * completes, so the caller must not touch them after a successful call.
+ */
+
+struct rc_async_ctx {
+	SERVER		*server;	/* servers to try, in order */
+	int		index;		/* which one we're trying */
+	int		code;		/* PW_ACCESS_REQUEST etc. */
+	int		timeout;
+	int		retries;
+	SEND_DATA	data;
+	REQUEST_INFO	*info;
+	VALUE_PAIR	*adt_vp;	/* Acct-Delay-Time, for accounting */
+	time_t		start_time;
+	RC_DONE		*done;
+	void		*arg;
+};
+
+static void rc_async_done(int, SEND_DATA *, char *, void *);
+
+/*
+ * Function: rc_async_next
+ *
+ * Purpose: send the request to the current server, or the first one
+ *	    after it that we can send to.
+ *
+ */
+
+static int rc_async_next(struct rc_async_ctx *ctx)
+{
+	UINT4 dtime;
+
+	for (; ctx->index < ctx->server->max; ctx->index++)
+	{
+		rc_buildreq(&ctx->data, ctx->code,
+			    ctx->server->name[ctx->index],
+			    ctx->server->port[ctx->index],
+			    ctx->timeout, ctx->retries);
+
+		if (ctx->adt_vp != NULL) {
+			dtime = time(NULL) - ctx->start_time;
+			rc_avpair_assign(ctx->adt_vp, &dtime, 0);
+		}
+
+		if (rc_send_server_async(&ctx->data, ctx->info,
+					 rc_async_done, ctx) == OK_RC)
+			return (OK_RC);
+	}
+	return (ERROR_RC);
+}
+
+/*
+ * Function: rc_async_done
+ *
+ * Purpose: called when a request to one server completes; try the
+ *	    next server or report the result.
+ *
+ */
+
+static void rc_async_done(int result, SEND_DATA *data, char *msg, void *arg)
+{
+	struct rc_async_ctx *ctx = arg;
+
+	if (result != OK_RC && result != BADRESP_RC) {
+		rc_avpair_free(data->receive_pairs);
+		data->receive_pairs = NULL;
+		ctx->index++;
+		if (rc_async_next(ctx) == OK_RC)
+			return;
+	}
+
+	if (ctx->done)
+		(*ctx->done)(result, data->receive_pairs, msg, ctx->arg);
+	else
+		rc_avpair_free(data->receive_pairs);
+
+	rc_avpair_free(ctx->data.send_pairs);
+	free(ctx);
+}
+
+/*
+ * Function: rc_async_start
+ *
+ * Purpose: common code for rc_auth_async and rc_acct_async.
+ *
+ */
+
+static int rc_async_start(SERVER *server, int code, UINT4 client_port,
+			  VALUE_PAIR *send, REQUEST_INFO *info,
+			  RC_DONE *done, void *arg)
+{
+	struct rc_async_ctx *ctx;
+	UINT4		dtime;
+
+	if (server == NULL)
+		return (ERROR_RC);
+
+	ctx = (struct rc_async_ctx *) malloc(sizeof(struct rc_async_ctx));
+	if (ctx == NULL) {
+		error("rc_async_start: out of memory");
+		return (ERROR_RC);
+	}
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->server = server;
+	ctx->code = code;
+	ctx->timeout = rc_conf_int("radius_timeout");
+	ctx->retries = rc_conf_int("radius_retries");
+	ctx->info = info;
+	ctx->done = done;
+	ctx->arg = arg;
+	ctx->data.send_pairs = send;
+	ctx->data.receive_pairs = NULL;
+
+	/*
+	 * Fill in NAS-IP-Address or NAS-Identifier, and NAS-Port
+	 */
+
+	if (rc_get_nas_id(&(ctx->data.send_pairs)) == ERROR_RC
+	    || rc_avpair_add(&(ctx->data.send_pairs), PW_NAS_PORT,
+			     &client_port, 0, VENDOR_NONE) == NULL) {
+		free(ctx);
+		return (ERROR_RC);
+	}
+
+	/*
+	 * Fill in Acct-Delay-Time
+	 */
+
+	if (code == PW_ACCOUNTING_REQUEST) {
+		dtime = 0;
+		ctx->adt_vp = rc_avpair_add(&(ctx->data.send_pairs),
+					    PW_ACCT_DELAY_TIME, &dtime, 0,
+					    VENDOR_NONE);
+		if (ctx->adt_vp == NULL) {
+			free(ctx);
+			return (ERROR_RC);
+		}
+		ctx->start_time = time(NULL);
+	}
+
+	if (rc_async_next(ctx) != OK_RC) {
+		free(ctx);
+		return (ERROR_RC);
+	}
+	return (OK_RC);
+}
+
+/*
+ * Function: rc_auth_async
+ *
+ * Purpose: start an authentication request for port id client_port
+ *	    with the value_pairs send.  If authserver is NULL, the
+ *	    servers from the config file are used.
+ *
+ * Returns: OK_RC if the request was sent, in which case done will be
+ *	    called with the result; ERROR_RC otherwise.
+ *
+ */
+
+int rc_auth_async(SERVER *authserver, UINT4 client_port, VALUE_PAIR *send,
+		  REQUEST_INFO *info, RC_DONE *done, void *arg)
+{
+	if (authserver == NULL)
+		authserver = rc_conf_srv("authserver");
+	return rc_async_start(authserver, PW_ACCESS_REQUEST, client_port,
+			      send, info, done, arg);
+}
+
+/*
+ * Function: rc_acct_async
+ *
+ * Purpose: start an accounting request for port id client_port with
+ *	    the value_pairs send.  If acctserver is NULL, the servers
+ *	    from the config file are used.  done may be NULL.
+ *
+ * Remarks: NAS-Identifier/NAS-IP-Address, NAS-Port and Acct-Delay-Time get
+ *	    filled in by this function, the rest has to be supplied.
+ */
+
+int rc_acct_async(SERVER *acctserver, UINT4 client_port, VALUE_PAIR *send,
+		  RC_DONE *done, void *arg)
+{
+	if (acctserver == NULL)
+		acctserver = rc_conf_srv("acctserver");
+	return rc_async_start(acctserver, PW_ACCOUNTING_REQUEST, client_port,
+			      send, NULL, done, arg);
+}
+
 /*
  * Function: rc_check
  *
@@ -374,11 +374,6 @@ static int test_config(char *filename)
 		error("%s: login_tries <= 0 is illegal", filename);
 		return (-1);
 	}
-	if (rc_conf_str("seqfile") == NULL)
-	{
-		error("%s: seqfile not specified", filename);
-		return (-1);
-	}
 	if (rc_conf_int("login_timeout") <= 0)
 	{
 		error("%s: login_timeout <= 0 is illegal", filename);
@@ -439,39 +434,155 @@ static int find_match (UINT4 *ip_addr, char *hostname)
 }
 
 /*
- * Function: rc_find_server
+ * Servers table.
  *
- * Purpose: search a server in the servers file
+ * The servers file is parsed into a hash table keyed by server
+ * address, with every host name resolved while loading, so finding
+ * the secret for a request needs no file or DNS access.  Server names
+ * given to rc_find_server are resolved once and remembered too.  The
+ * table is reloaded when the file's modification time or size changes
+ * (checked at most every SERVERS_CHECK_INTERVAL seconds) or after
+ * rc_servers_changed has been called, e.g. on SIGHUP.
+ */
+
+#define SERVERS_HASH_SIZE	64
+#define SERVERS_HASH(addr)	((UINT4) ((addr) * 2654435761U) >> 26)
+#define SERVERS_CHECK_INTERVAL	5	/* seconds */
+
+struct server_secret {
+	UINT4		addr;
+	char		secret[MAX_SECRET_LENGTH + 1];
+	struct server_secret *next;
+};
+
+struct server_name {
+	UINT4		addr;
+	struct server_name *next;
+	char		name[1];	/* actually longer */
+};
+
+static struct server_secret *servers_table[SERVERS_HASH_SIZE];
+static struct server_name *server_names;
+static int servers_loaded;
+static volatile int servers_stale;
+static time_t servers_mtime;
+static off_t servers_size;
+static time_t servers_checked;
+
+/*
+ * Function: rc_servers_changed
+ *
+ * Purpose: make the next rc_find_server reload the servers file and
+ *	    resolve the server names again.  Safe to call from a signal
+ *	    handler.
+ *
+ */
+
+void rc_servers_changed (void)
+{
+	servers_stale = 1;
+}
+
+/*
+ * Function: rc_servers_add
+ *
+ * Purpose: add the addresses of hostname to the servers table, unless
+ *	    an earlier line already gave them a secret.
+ *
+ */
+
+static void rc_servers_add (char *hostname, char *secret)
+{
+	struct server_secret *ent;
+	struct hostent *hp;
+	UINT4		addrs[16];
+	int		i, n;
+
+	n = 0;
+	if (rc_good_ipaddr (hostname) == 0)
+	{
+		addrs[n++] = ntohl (inet_addr (hostname));
+	}
+	else if ((hp = gethostbyname (hostname)) != NULL)
+	{
+		for (; n < 16 && hp->h_addr_list[n] != NULL; ++n)
+			addrs[n] = ntohl (*(UINT4 *) hp->h_addr_list[n]);
+	}
+
+	for (i = 0; i < n; ++i)
+	{
+		for (ent = servers_table[SERVERS_HASH (addrs[i])]; ent != NULL;
+		     ent = ent->next)
+			if (ent->addr == addrs[i])
+				break;
+		if (ent != NULL)
+			continue;
+		if ((ent = malloc (sizeof (*ent))) == NULL)
+		{
+			novm ("rc_servers_add");
+			return;
+		}
+		ent->addr = addrs[i];
+		strcpy (ent->secret, secret);
+		ent->next = servers_table[SERVERS_HASH (addrs[i])];
+		servers_table[SERVERS_HASH (addrs[i])] = ent;
+	}
+}
+
+/*
+ * Function: rc_servers_load
+ *
+ * Purpose: (re)read the servers file into the servers table.
  *
  * Returns: 0 on success, -1 on failure
  *
  */
 
-int rc_find_server (char *server_name, UINT4 *ip_addr, char *secret)
+static int rc_servers_load (void)
 {
-	UINT4	myipaddr = 0;
-	int             len;
-	int             result;
+	struct server_secret *ent;
+	struct server_name *sn;
+	struct stat	st;
+	UINT4		myipaddr;
+	int             len, i;
 	FILE           *clientfd;
 	char           *h;
 	char           *s;
 	char           *host2;
 	char            buffer[128];
 	char            hostnm[AUTH_ID_LEN + 1];
+	char            secret[MAX_SECRET_LENGTH + 1];
 
-	/* Get the IP address of the authentication server */
-	if ((*ip_addr = rc_get_ipaddr (server_name)) == (UINT4) 0)
-		return (-1);
+	for (i = 0; i < SERVERS_HASH_SIZE; ++i)
+	{
+		while ((ent = servers_table[i]) != NULL)
+		{
+			servers_table[i] = ent->next;
+			memset (ent->secret, '\0', sizeof (ent->secret));
+			free (ent);
+		}
+	}
+	while ((sn = server_names) != NULL)
+	{
+		server_names = sn->next;
+		free (sn);
+	}
+	servers_loaded = 0;
+	servers_stale = 0;
 
 	if ((clientfd = fopen (rc_conf_str("servers"), "r")) == (FILE *) NULL)
 	{
 		error("rc_find_server: couldn't open file: %m: %s", rc_conf_str("servers"));
 		return (-1);
 	}
+	if (fstat (fileno (clientfd), &st) == 0)
+	{
+		servers_mtime = st.st_mtime;
+		servers_size = st.st_size;
+	}
 
 	myipaddr = rc_own_ipaddress();
 
-	result = 0;
 	while (fgets (buffer, sizeof (buffer), clientfd) != (char *) NULL)
 	{
 		if (*buffer == '#')
@@ -503,11 +614,7 @@ int rc_find_server (char *server_name, UINT4 *ip_addr, char *secret)
 
 		if (!strchr (hostnm, '/')) /* If single name form */
 		{
-			if (find_match (ip_addr, hostnm) == 0)
-			{
-				result++;
-				break;
-			}
+			rc_servers_add (hostnm, secret);
 		}
 		else /* <name1>/<name2> "paired" form */
 		{
@@ -515,30 +622,116 @@ int rc_find_server (char *server_name, UINT4 *ip_addr, char *secret)
 			if (find_match (&myipaddr, hostnm) == 0)
 			{	     /* If we're the 1st name, target is 2nd */
 				host2 = strtok (NULL, " ");
-				if (find_match (ip_addr, host2) == 0)
-				{
-					result++;
-					break;
-				}
+				if (host2 != NULL)
+					rc_servers_add (host2, secret);
 			}
 			else	/* If we were 2nd name, target is 1st name */
 			{
-				if (find_match (ip_addr, hostnm) == 0)
-				{
-					result++;
-					break;
-				}
+				rc_servers_add (hostnm, secret);
 			}
 		}
 	}
 	fclose (clientfd);
-	if (result == 0)
+	memset (buffer, '\0', sizeof (buffer));
+	memset (secret, '\0', sizeof (secret));
+
+	servers_loaded = 1;
+	return (0);
+}
+
+/*
+ * Function: rc_servers_check
+ *
+ * Purpose: make sure the servers table is loaded and up to date.
+ *
+ * Returns: 0 on success, -1 on failure
+ *
+ */
+
+static int rc_servers_check (void)
+{
+	struct stat	st;
+	time_t		now;
+
+	if (servers_loaded && !servers_stale)
 	{
-		memset (buffer, '\0', sizeof (buffer));
-		memset (secret, '\0', sizeof (secret));
-		error("rc_find_server: couldn't find RADIUS server %s in %s",
-		      server_name, rc_conf_str("servers"));
+		now = time (NULL);
+		if (now - servers_checked < SERVERS_CHECK_INTERVAL
+		    && now >= servers_checked)
+			return (0);
+		servers_checked = now;
+		if (stat (rc_conf_str("servers"), &st) == 0
+		    && st.st_mtime == servers_mtime && st.st_size == servers_size)
+			return (0);
+	}
+	servers_checked = time (NULL);
+	return rc_servers_load ();
+}
+
+/*
+ * Function: rc_server_ipaddr
+ *
+ * Purpose: get the address of a server by name, resolving it only
+ *	    the first time.
+ *
+ * Returns: the address, or 0 if it couldn't be resolved.
+ *
+ */
+
+static UINT4 rc_server_ipaddr (char *server_name)
+{
+	struct server_name *sn;
+	UINT4		addr;
+
+	for (sn = server_names; sn != NULL; sn = sn->next)
+		if (strcmp (sn->name, server_name) == 0)
+			return (sn->addr);
+
+	if ((addr = rc_get_ipaddr (server_name)) == (UINT4) 0)
+		return (0);
+
+	sn = malloc (sizeof (*sn) + strlen (server_name));
+	if (sn != NULL)
+	{
+		strcpy (sn->name, server_name);
+		sn->addr = addr;
+		sn->next = server_names;
+		server_names = sn;
+	}
+	return (addr);
+}
+
+/*
+ * Function: rc_find_server
+ *
+ * Purpose: search a server in the servers file
+ *
+ * Returns: 0 on success, -1 on failure
+ *
+ */
+
+int rc_find_server (char *server_name, UINT4 *ip_addr, char *secret)
+{
+	struct server_secret *ent;
+
+	if (rc_servers_check () < 0)
 		return (-1);
+
+	/* Get the IP address of the authentication server */
+	if ((*ip_addr = rc_server_ipaddr (server_name)) == (UINT4) 0)
+		return (-1);
+
+	for (ent = servers_table[SERVERS_HASH (*ip_addr)]; ent != NULL;
+	     ent = ent->next)
+	{
+		if (ent->addr == *ip_addr)
+		{
+			strcpy (secret, ent->secret);
+			return 0;
+		}
 	}
-	return 0;
+
+	error("rc_find_server: couldn't find RADIUS server %s in %s",
+	      server_name, rc_conf_str("servers"));
+	return (-1);
 }
@@ -18,22 +18,571 @@
 
 #include <includes.h>
 #include <radiusclient.h>
+#include <sys/mman.h>
 
 static DICT_ATTR *dictionary_attributes = NULL;
 static DICT_VALUE *dictionary_values = NULL;
 static VENDOR_DICT *vendor_dictionaries = NULL;
 
+/*
+ * Hash tables over the lists above, so that encoding and decoding a
+ * packet doesn't walk the whole dictionary for every attribute.
+ * Entries go on the front of each chain like they do on the lists,
+ * so the most recent definition is still the one found.
+ */
+#define DICT_HASH_SIZE	512		/* must be a power of 2 */
+#define DICT_HASH(h)	((h) & (DICT_HASH_SIZE - 1))
+
+static DICT_ATTR *attr_by_code[DICT_HASH_SIZE];
+static DICT_ATTR *attr_by_name[DICT_HASH_SIZE];
+static DICT_VALUE *value_by_attr[DICT_HASH_SIZE];
+static DICT_VALUE *value_by_name[DICT_HASH_SIZE];
+
+/*
+ * Function: rc_dict_hash
+ *
+ * Purpose: hash a name, ignoring case if fold is set.
+ *
+ */
+
+static unsigned int rc_dict_hash (char *name, int fold)
+{
+	unsigned int	h = 0;
+	int		c;
+
+	while ((c = (unsigned char) *name++) != 0)
+		h = h * 31 + (fold ? tolower (c) : c);
+	return h;
+}
+
+#define ATTR_CODE_HASH(vendor, value) \
+	DICT_HASH((unsigned int) (vendor) * 2654435761U + (unsigned int) (value))
+#define VALUE_HASH(attrname, value) \
+	DICT_HASH(rc_dict_hash ((attrname), 0) + (unsigned int) (value) * 2654435761U)
+
+/*
+ * Function: rc_dict_hash_attr
+ *
+ * Purpose: add a new attribute to the hash tables.
+ *
+ */
+
+static void rc_dict_hash_attr (DICT_ATTR *attr)
+{
+	unsigned int	h;
+
+	h = ATTR_CODE_HASH (attr->vendorcode, attr->value);
+	attr->hash_next = attr_by_code[h];
+	attr_by_code[h] = attr;
+
+	h = DICT_HASH (rc_dict_hash (attr->name, 1));
+	attr->name_next = attr_by_name[h];
+	attr_by_name[h] = attr;
+}
+
+/*
+ * Function: rc_dict_hash_value
+ *
+ * Purpose: add a new value to the hash tables.
+ *
+ */
+
+static void rc_dict_hash_value (DICT_VALUE *dval)
+{
+	unsigned int	h;
+
+	h = VALUE_HASH (dval->attrname, dval->value);
+	dval->hash_next = value_by_attr[h];
+	value_by_attr[h] = dval;
+
+	h = DICT_HASH (rc_dict_hash (dval->name, 1));
+	dval->name_next = value_by_name[h];
+	value_by_name[h] = dval;
+}
+
+/*
+ * Precompiled dictionary image.
+ *
+ * If dictionary_image is set in the config file, the parsed dictionary
+ * is written there as a flat image with its hash tables, using offsets
+ * rather than pointers, and later processes mmap it read-only instead
+ * of parsing the text files again, so they all share one copy.  The
+ * image lists the source files with their modification times and
+ * sizes, and is ignored (and rewritten) if any of them has changed.
+ * The lookup functions return pointers into the image; their next and
+ * hash chain pointers are NULL.
+ */
+
+#define DICT_IMAGE_MAGIC	0x52434449	/* "RCDI" */
+#define DICT_IMAGE_VERSION	1
+
+struct dict_image_file {
+	char		path[PATH_MAX];
+	long long	mtime;
+	long long	size;
+};
+
+struct dict_image {
+	UINT4		magic;
+	UINT4		version;
+	UINT4		length;		/* of the whole image */
+	UINT4		hash_size;	/* DICT_HASH_SIZE */
+	UINT4		attr_size;	/* sizeof(DICT_ATTR) etc. */
+	UINT4		value_size;
+	UINT4		vendor_size;
+	UINT4		nfiles;
+	UINT4		nattrs;
+	UINT4		nvalues;
+	UINT4		nvendors;
+	/* offsets from the start of the image */
+	UINT4		files;		/* struct dict_image_file[nfiles] */
+	UINT4		attrs;		/* DICT_ATTR[nattrs] */
+	UINT4		values;		/* DICT_VALUE[nvalues] */
+	UINT4		vendors;	/* VENDOR_DICT[nvendors] */
+	/* hash chains: index + 1 of the first/next entry, 0 at the end */
+	UINT4		attr_by_code;	/* UINT4[DICT_HASH_SIZE] */
+	UINT4		attr_by_name;
+	UINT4		value_by_attr;
+	UINT4		value_by_name;
+	UINT4		attr_code_next;	/* UINT4[nattrs] */
+	UINT4		attr_name_next;
+	UINT4		value_attr_next;	/* UINT4[nvalues] */
+	UINT4		value_name_next;
+};
+
+static struct dict_image *dict_image = NULL;	/* mapped image, if any */
+
+#define IMG_PTR(off)	((char *) dict_image + (off))
+#define IMG_U4(off, i)	(((UINT4 *) IMG_PTR(off))[i])
+#define IMG_ATTR(i)	((DICT_ATTR *) IMG_PTR(dict_image->attrs) + (i))
+#define IMG_VALUE(i)	((DICT_VALUE *) IMG_PTR(dict_image->values) + (i))
+#define IMG_VENDOR(i)	((VENDOR_DICT *) IMG_PTR(dict_image->vendors) + (i))
+
+/* Source files read by rc_dict_parse, for the image */
+static struct dict_image_file *dict_files = NULL;
+static int dict_nfiles = 0;
+
+static int rc_dict_parse (char *);
+
+/*
+ * Function: rc_dict_note_file
+ *
+ * Purpose: remember a source file of the dictionary.
+ *
+ */
+
+static void rc_dict_note_file (char *filename, FILE *fp)
+{
+	struct dict_image_file *f;
+	struct stat	st;
+
+	if (fstat (fileno (fp), &st) < 0 || strlen (filename) >= PATH_MAX)
+		return;
+	f = (struct dict_image_file *)
+		realloc (dict_files, (dict_nfiles + 1) * sizeof (*f));
+	if (f == NULL)
+		return;
+	dict_files = f;
+	f += dict_nfiles++;
+	memset (f, 0, sizeof (*f));
+	strcpy (f->path, filename);
+	f->mtime = st.st_mtime;
+	f->size = st.st_size;
+}
+
+/*
+ * Function: rc_dict_free_files
+ *
+ * Purpose: forget the source files once the image has been written.
+ *
+ */
+
+static void rc_dict_free_files (void)
+{
+	free (dict_files);
+	dict_files = NULL;
+	dict_nfiles = 0;
+}
+
+/*
+ * Function: rc_dict_image_array
+ *
+ * Purpose: check that an array of n items of the given size at offset
+ *	    off lies within an image of len bytes and is aligned.
+ *
+ */
+
+static int rc_dict_image_array (UINT4 off, UINT4 n, UINT4 size, UINT4 len,
+				UINT4 align)
+{
+	if (off % align != 0 || off > len)
+		return (0);
+	return (n <= (len - off) / size);
+}
+
+/*
+ * Function: rc_dict_image_chains
+ *
+ * Purpose: check a set of hash chains over n entries.  Each entry
+ *	    links to one written before it, so every chain ends.
+ *
+ */
+
+static int rc_dict_image_chains (struct dict_image *img, UINT4 heads,
+				 UINT4 next, UINT4 n)
+{
+	UINT4		i;
+
+	for (i = 0; i < DICT_HASH_SIZE; ++i)
+		if (((UINT4 *) ((char *) img + heads))[i] > n)
+			return (0);
+	for (i = 0; i < n; ++i)
+		if (((UINT4 *) ((char *) img + next))[i] > i)
+			return (0);
+	return (1);
+}
+
+#define STR_OK(s)	(memchr ((s), '\0', sizeof (s)) != NULL)
+#define PTR_ALIGN	sizeof (void *)	/* the entries hold pointers */
+
+/*
+ * Function: rc_dict_image_check
+ *
+ * Purpose: check that everything in an image of len bytes is within
+ *	    it: the arrays, the hash chain indices and the strings.
+ *
+ * Returns: 1 if the image is sound, 0 if not.
+ *
+ */
+
+static int rc_dict_image_check (struct dict_image *img, UINT4 len)
+{
+	struct dict_image_file *f;
+	DICT_ATTR	*attr;
+	DICT_VALUE	*dval;
+	VENDOR_DICT	*vdict;
+	UINT4		i;
+
+	if (img->nfiles == 0
+	    || !rc_dict_image_array (img->files, img->nfiles, sizeof (*f),
+				     len, PTR_ALIGN)
+	    || !rc_dict_image_array (img->attrs, img->nattrs, sizeof (DICT_ATTR),
+				     len, PTR_ALIGN)
+	    || !rc_dict_image_array (img->values, img->nvalues,
+				     sizeof (DICT_VALUE), len, PTR_ALIGN)
+	    || !rc_dict_image_array (img->vendors, img->nvendors,
+				     sizeof (VENDOR_DICT), len, PTR_ALIGN)
+	    || !rc_dict_image_array (img->attr_by_code, DICT_HASH_SIZE, 4, len, 4)
+	    || !rc_dict_image_array (img->attr_by_name, DICT_HASH_SIZE, 4, len, 4)
+	    || !rc_dict_image_array (img->value_by_attr, DICT_HASH_SIZE, 4, len, 4)
+	    || !rc_dict_image_array (img->value_by_name, DICT_HASH_SIZE, 4, len, 4)
+	    || !rc_dict_image_array (img->attr_code_next, img->nattrs, 4, len, 4)
+	    || !rc_dict_image_array (img->attr_name_next, img->nattrs, 4, len, 4)
+	    || !rc_dict_image_array (img->value_attr_next, img->nvalues, 4, len, 4)
+	    || !rc_dict_image_array (img->value_name_next, img->nvalues, 4, len, 4))
+		return (0);
+
+	if (!rc_dict_image_chains (img, img->attr_by_code, img->attr_code_next,
+				   img->nattrs)
+	    || !rc_dict_image_chains (img, img->attr_by_name, img->attr_name_next,
+				      img->nattrs)
+	    || !rc_dict_image_chains (img, img->value_by_attr,
+				      img->value_attr_next, img->nvalues)
+	    || !rc_dict_image_chains (img, img->value_by_name,
+				      img->value_name_next, img->nvalues))
+		return (0);
+
+	f = (struct dict_image_file *) ((char *) img + img->files);
+	for (i = 0; i < img->nfiles; ++i)
+		if (!STR_OK (f[i].path))
+			return (0);
+	attr = (DICT_ATTR *) ((char *) img + img->attrs);
+	for (i = 0; i < img->nattrs; ++i)
+		if (!STR_OK (attr[i].name))
+			return (0);
+	dval = (DICT_VALUE *) ((char *) img + img->values);
+	for (i = 0; i < img->nvalues; ++i)
+		if (!STR_OK (dval[i].attrname) || !STR_OK (dval[i].name))
+			return (0);
+	vdict = (VENDOR_DICT *) ((char *) img + img->vendors);
+	for (i = 0; i < img->nvendors; ++i)
+		if (!STR_OK (vdict[i].vendorname))
+			return (0);
+	return (1);
+}
+
+/*
+ * Function: rc_dict_image_load
+ *
+ * Purpose: map a dictionary image, if it is valid and up to date
+ *	    with respect to the source files.
+ *
+ * Returns: 0 if the image is now in use, -1 otherwise.
+ *
+ */
+
+static int rc_dict_image_load (char *filename, char *imagename)
+{
+	struct dict_image *img;
+	struct dict_image_file *f;
+	struct stat	st;
+	void		*p;
+	int		fd, i;
+	UINT4		len;
+
+	if ((fd = open (imagename, O_RDONLY)) < 0)
+		return (-1);
+	if (fstat (fd, &st) < 0 || st.st_size < sizeof (struct dict_image))
+	{
+		close (fd);
+		return (-1);
+	}
+	p = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close (fd);
+	if (p == MAP_FAILED)
+		return (-1);
+	img = (struct dict_image *) p;
+	len = st.st_size;
+
+	/* check it was written by this version for this architecture */
+	if (img->magic != DICT_IMAGE_MAGIC || img->version != DICT_IMAGE_VERSION
+	    || img->length != len || img->hash_size != DICT_HASH_SIZE
+	    || img->attr_size != sizeof (DICT_ATTR)
+	    || img->value_size != sizeof (DICT_VALUE)
+	    || img->vendor_size != sizeof (VENDOR_DICT))
+		goto bad;
+	if (!rc_dict_image_check (img, len))
+	{
+		error("rc_read_dictionary: %s is corrupt, reading %s instead",
+		      imagename, filename);
+		goto bad;
+	}
+
+	/* check it was made from these files, and they haven't changed */
+	f = (struct dict_image_file *) ((char *) img + img->files);
+	if (strncmp (f->path, filename, PATH_MAX) != 0)
+		goto bad;
+	for (i = 0; i < img->nfiles; ++i, ++f)
+	{
+		if (stat (f->path, &st) < 0 || st.st_mtime != f->mtime
+		    || st.st_size != f->size)
+		{
+			dbglog("rc_read_dictionary: %s is out of date", imagename);
+			goto bad;
+		}
+	}
+
+	dict_image = img;
+	return (0);
+
+ bad:
+	munmap (p, len);
+	return (-1);
+}
+
+/*
+ * Function: rc_dict_image_write
+ *
+ * Purpose: write the dictionary we have just parsed out as an image.
+ *
+ */
+
+static void rc_dict_image_write (char *imagename)
+{
+	struct dict_image *img;
+	DICT_ATTR	**alist;
+	DICT_VALUE	**vlist;
+	DICT_ATTR	*attr;
+	DICT_VALUE	*dval;
+	VENDOR_DICT	*vdict;
+	char		*buf, *tmpname;
+	UINT4		nattrs, nvalues, nvendors, len, off, h, i, n;
+	int		fd;
+
+	nattrs = nvalues = nvendors = 0;
+	for (attr = dictionary_attributes; attr != NULL; attr = attr->next)
+		++nattrs;
+	for (vdict = vendor_dictionaries; vdict != NULL; vdict = vdict->next)
+	{
+		++nvendors;
+		for (attr = vdict->attributes; attr != NULL; attr = attr->next)
+			++nattrs;
+	}
+	for (dval = dictionary_values; dval != NULL; dval = dval->next)
+		++nvalues;
+
+	off = (sizeof (struct dict_image) + 7) & ~7;
+	len = off + dict_nfiles * sizeof (struct dict_image_file)
+		+ nattrs * sizeof (DICT_ATTR) + nvalues * sizeof (DICT_VALUE)
+		+ nvendors * sizeof (VENDOR_DICT)
+		+ 4 * DICT_HASH_SIZE * sizeof (UINT4)
+		+ 2 * (nattrs + nvalues) * sizeof (UINT4);
+
+	buf = calloc (1, len);
+	alist = malloc ((nattrs + 1) * sizeof (DICT_ATTR *));
+	vlist = malloc ((nvalues + 1) * sizeof (DICT_VALUE *));
+	tmpname = malloc (strlen (imagename) + 16);
+	if (buf == NULL || alist == NULL || vlist == NULL || tmpname == NULL)
+		goto out;
+
+	img = (struct dict_image *) buf;
+	img->magic = DICT_IMAGE_MAGIC;
+	img->version = DICT_IMAGE_VERSION;
+	img->length = len;
+	img->hash_size = DICT_HASH_SIZE;
+	img->attr_size = sizeof (DICT_ATTR);
+	img->value_size = sizeof (DICT_VALUE);
+	img->vendor_size = sizeof (VENDOR_DICT);
+	img->nfiles = dict_nfiles;
+	img->nattrs = nattrs;
+	img->nvalues = nvalues;
+	img->nvendors = nvendors;
+
+	img->files = off;
+	memcpy (buf + off, dict_files, dict_nfiles * sizeof (struct dict_image_file));
+	off += dict_nfiles * sizeof (struct dict_image_file);
+	img->attrs = off;
+	off += nattrs * sizeof (DICT_ATTR);
+	img->values = off;
+	off += nvalues * sizeof (DICT_VALUE);
+	img->vendors = off;
+	off += nvendors * sizeof (VENDOR_DICT);
+	img->attr_by_code = off;
+	off += DICT_HASH_SIZE * sizeof (UINT4);
+	img->attr_by_name = off;
+	off += DICT_HASH_SIZE * sizeof (UINT4);
+	img->value_by_attr = off;
+	off += DICT_HASH_SIZE * sizeof (UINT4);
+	img->value_by_name = off;
+	off += DICT_HASH_SIZE * sizeof (UINT4);
+	img->attr_code_next = off;
+	off += nattrs * sizeof (UINT4);
+	img->attr_name_next = off;
+	off += nattrs * sizeof (UINT4);
+	img->value_attr_next = off;
+	off += nvalues * sizeof (UINT4);
+	img->value_name_next = off;
+
+	/*
+	 * The lists have the newest entry first.  Put the entries in the
+	 * image oldest first, and push each one on the front of its hash
+	 * chains, so the chains come out in the same order as ours.
+	 */
+	n = 0;
+	for (vdict = vendor_dictionaries, i = 0; vdict != NULL; vdict = vdict->next)
+	{
+		VENDOR_DICT *v = (VENDOR_DICT *) (buf + img->vendors) + nvendors - ++i;
+
+		*v = *vdict;
+		v->attributes = NULL;
+		v->next = NULL;
+		for (attr = vdict->attributes; attr != NULL; attr = attr->next)
+			alist[n++] = attr;
+	}
+	for (attr = dictionary_attributes; attr != NULL; attr = attr->next)
+		alist[n++] = attr;
+	for (i = 0; i < nattrs; ++i)
+	{
+		DICT_ATTR *a = (DICT_ATTR *) (buf + img->attrs) + i;
+
+		*a = *alist[nattrs - 1 - i];
+		a->next = a->hash_next = a->name_next = NULL;
+
+		h = ATTR_CODE_HASH (a->vendorcode, a->value);
+		((UINT4 *) (buf + img->attr_code_next))[i] =
+			((UINT4 *) (buf + img->attr_by_code))[h];
+		((UINT4 *) (buf + img->attr_by_code))[h] = i + 1;
+
+		h = DICT_HASH (rc_dict_hash (a->name, 1));
+		((UINT4 *) (buf + img->attr_name_next))[i] =
+			((UINT4 *) (buf + img->attr_by_name))[h];
+		((UINT4 *) (buf + img->attr_by_name))[h] = i + 1;
+	}
+
+	n = 0;
+	for (dval = dictionary_values; dval != NULL; dval = dval->next)
+		vlist[n++] = dval;
+	for (i = 0; i < nvalues; ++i)
+	{
+		DICT_VALUE *v = (DICT_VALUE *) (buf + img->values) + i;
+
+		*v = *vlist[nvalues - 1 - i];
+		v->next = v->hash_next = v->name_next = NULL;
+
+		h = VALUE_HASH (v->attrname, v->value);
+		((UINT4 *) (buf + img->value_attr_next))[i] =
+			((UINT4 *) (buf + img->value_by_attr))[h];
+		((UINT4 *) (buf + img->value_by_attr))[h] = i + 1;
+
+		h = DICT_HASH (rc_dict_hash (v->name, 1));
+		((UINT4 *) (buf + img->value_name_next))[i] =
+			((UINT4 *) (buf + img->value_by_name))[h];
+		((UINT4 *) (buf + img->value_by_name))[h] = i + 1;
+	}
+
+	/* write it under a temporary name, then rename it into place */
+	sprintf (tmpname, "%s.%d", imagename, (int) getpid ());
+	if ((fd = open (tmpname, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+	{
+		error("rc_read_dictionary: couldn't create %s: %s", tmpname,
+		      strerror (errno));
+		goto out;
+	}
+	if (write (fd, buf, len) != len || close (fd) < 0
+	    || rename (tmpname, imagename) < 0)
+	{
+		error("rc_read_dictionary: couldn't write %s: %s", imagename,
+		      strerror (errno));
+		unlink (tmpname);
+	}
+
+ out:
+	free (tmpname);
+	free (vlist);
+	free (alist);
+	free (buf);
+}
+
 /*
  * Function: rc_read_dictionary
  *
- * Purpose: Initialize the dictionary.  Read all ATTRIBUTES into
+ * Purpose: Initialize the dictionary, from the precompiled image if
+ *	    there is an up to date one, otherwise from the text files.
+ *
+ */
+
+int rc_read_dictionary (char *filename)
+{
+	char		*image = rc_conf_str ("dictionary_image");
+
+	if (image != NULL && *image != '\0'
+	    && rc_dict_image_load (filename, image) == 0)
+		return (0);
+
+	dict_nfiles = 0;
+	if (rc_dict_parse (filename) != 0)
+	{
+		rc_dict_free_files ();
+		return (-1);
+	}
+
+	if (image != NULL && *image != '\0')
+		rc_dict_image_write (image);
+	rc_dict_free_files ();
+	return (0);
+}
+
+/*
+ * Function: rc_dict_parse
+ *
+ * Purpose: Parse a text dictionary.  Read all ATTRIBUTES into
  *	    the dictionary_attributes list.  Read all VALUES into
  *	    the dictionary_values list.  Construct VENDOR dictionaries
  *          as required.
  *
  */
 
-int rc_read_dictionary (char *filename)
+static int rc_dict_parse (char *filename)
 {
 	FILE           *dictfd;
 	char            dummystr[AUTH_ID_LEN];
@@ -57,6 +606,7 @@ int rc_read_dictionary (char *filename)
 				filename, strerror(errno));
 		return (-1);
 	}
+	rc_dict_note_file (filename, dictfd);
 
 	line_no = 0;
 	retcode = 0;
@@ -204,6 +754,7 @@ int rc_read_dictionary (char *filename)
 			    attr->next = dictionary_attributes;
 			    dictionary_attributes = attr;
 			}
+			rc_dict_hash_attr (attr);
 		}
 		else if (strncmp (buffer, "VALUE", 5) == 0)
 		{
@@ -261,6 +812,7 @@ int rc_read_dictionary (char *filename)
 			/* Insert it into the list */
 			dval->next = dictionary_values;
 			dictionary_values = dval;
+			rc_dict_hash_value (dval);
 		}
 		else if (strncmp (buffer, "INCLUDE", 7) == 0)
 		{
@@ -272,7 +824,7 @@ int rc_read_dictionary (char *filename)
 				retcode = -1;
 				break;
 			}
-			if (rc_read_dictionary(namestr) == -1)
+			if (rc_dict_parse(namestr) == -1)
 			{
 				retcode = -1;
 				break;
@@ -295,28 +847,24 @@ int rc_read_dictionary (char *filename)
 DICT_ATTR *rc_dict_getattr (int attribute, int vendor)
 {
 	DICT_ATTR      *attr;
-	VENDOR_DICT    *dict;
+	UINT4		i, h = ATTR_CODE_HASH (vendor, attribute);
 
-	if (vendor == VENDOR_NONE) {
-	    attr = dictionary_attributes;
-	    while (attr != (DICT_ATTR *) NULL) {
-		if (attr->value == attribute) {
+	if (dict_image) {
+	    for (i = IMG_U4(dict_image->attr_by_code, h); i != 0;
+		 i = IMG_U4(dict_image->attr_code_next, i - 1)) {
+		attr = IMG_ATTR(i - 1);
+		if (attr->value == attribute && attr->vendorcode == vendor)
 		    return (attr);
-		}
-		attr = attr->next;
-	    }
-	} else {
-	    dict = rc_dict_getvendor(vendor);
-	    if (!dict) {
-		return NULL;
 	    }
-	    attr = dict->attributes;
-	    while (attr) {
-		if (attr->value == attribute) {
-		    return attr;
-		}
-		attr = attr->next;
+	    return NULL;
+	}
+
+	attr = attr_by_code[h];
+	while (attr != (DICT_ATTR *) NULL) {
+	    if (attr->value == attribute && attr->vendorcode == vendor) {
+		return (attr);
 	    }
+	    attr = attr->hash_next;
 	}
 	return NULL;
 }
@@ -325,38 +873,44 @@ DICT_ATTR *rc_dict_getattr (int attribute, int vendor)
  * Function: rc_dict_findattr
  *
  * Purpose: Return the full attribute structure based on the
- *	    attribute name.
+ *	    attribute name.  Standard attributes take precedence over
+ *	    vendor-specific ones.
  *
  */
 
 DICT_ATTR *rc_dict_findattr (char *attrname)
 {
 	DICT_ATTR      *attr;
-	VENDOR_DICT    *dict;
+	DICT_ATTR      *vattr = NULL;
+	UINT4		i, h = DICT_HASH (rc_dict_hash (attrname, 1));
 
-	attr = dictionary_attributes;
-	while (attr != (DICT_ATTR *) NULL)
-	{
-		if (strcasecmp (attr->name, attrname) == 0)
-		{
+	if (dict_image) {
+	    for (i = IMG_U4(dict_image->attr_by_name, h); i != 0;
+		 i = IMG_U4(dict_image->attr_name_next, i - 1)) {
+		attr = IMG_ATTR(i - 1);
+		if (strcasecmp (attr->name, attrname) == 0) {
+		    if (attr->vendorcode == VENDOR_NONE)
 			return (attr);
+		    if (vattr == NULL)
+			vattr = attr;
 		}
-		attr = attr->next;
+	    }
+	    return (vattr);
 	}
 
-	/* Search vendor-specific dictionaries */
-	dict = vendor_dictionaries;
-	while (dict) {
-	    attr = dict->attributes;
-	    while (attr) {
-		if (strcasecmp (attr->name, attrname) == 0) {
-		    return (attr);
+	attr = attr_by_name[h];
+	while (attr != (DICT_ATTR *) NULL)
+	{
+		if (strcasecmp (attr->name, attrname) == 0)
+		{
+			if (attr->vendorcode == VENDOR_NONE)
+				return (attr);
+			if (vattr == NULL)
+				vattr = attr;
 		}
-		attr = attr->next;
-	    }
-	    dict = dict->next;
+		attr = attr->name_next;
 	}
-	return ((DICT_ATTR *) NULL);
+	return (vattr);
 }
 
 
@@ -371,15 +925,26 @@ DICT_ATTR *rc_dict_findattr (char *attrname)
 DICT_VALUE *rc_dict_findval (char *valname)
 {
 	DICT_VALUE     *val;
+	UINT4		i, h = DICT_HASH (rc_dict_hash (valname, 1));
 
-	val = dictionary_values;
+	if (dict_image) {
+	    for (i = IMG_U4(dict_image->value_by_name, h); i != 0;
+		 i = IMG_U4(dict_image->value_name_next, i - 1)) {
+		val = IMG_VALUE(i - 1);
+		if (strcasecmp (val->name, valname) == 0)
+		    return (val);
+	    }
+	    return NULL;
+	}
+
+	val = value_by_name[h];
 	while (val != (DICT_VALUE *) NULL)
 	{
 		if (strcasecmp (val->name, valname) == 0)
 		{
 			return (val);
 		}
-		val = val->next;
+		val = val->name_next;
 	}
 	return ((DICT_VALUE *) NULL);
 }
@@ -395,16 +960,27 @@ DICT_VALUE *rc_dict_findval (char *valname)
 DICT_VALUE * rc_dict_getval (UINT4 value, char *attrname)
 {
 	DICT_VALUE     *val;
+	UINT4		i, h = VALUE_HASH (attrname, value);
+
+	if (dict_image) {
+	    for (i = IMG_U4(dict_image->value_by_attr, h); i != 0;
+		 i = IMG_U4(dict_image->value_attr_next, i - 1)) {
+		val = IMG_VALUE(i - 1);
+		if (val->value == value && strcmp (val->attrname, attrname) == 0)
+		    return (val);
+	    }
+	    return NULL;
+	}
 
-	val = dictionary_values;
+	val = value_by_attr[h];
 	while (val != (DICT_VALUE *) NULL)
 	{
-		if (strcmp (val->attrname, attrname) == 0 &&
-				val->value == value)
+		if (val->value == value &&
+				strcmp (val->attrname, attrname) == 0)
 		{
 			return (val);
 		}
-		val = val->next;
+		val = val->hash_next;
 	}
 	return ((DICT_VALUE *) NULL);
 }
@@ -418,6 +994,15 @@ DICT_VALUE * rc_dict_getval (UINT4 value, char *attrname)
 VENDOR_DICT * rc_dict_findvendor (char *vendorname)
 {
     VENDOR_DICT *dict;
+    UINT4 i;
+
+    if (dict_image) {
+	/* newest last in the image */
+	for (i = dict_image->nvendors; i > 0; --i)
+	    if (!strcmp(vendorname, IMG_VENDOR(i - 1)->vendorname))
+		return IMG_VENDOR(i - 1);
+	return NULL;
+    }
 
     dict = vendor_dictionaries;
     while (dict) {
@@ -438,6 +1023,14 @@ VENDOR_DICT * rc_dict_findvendor (char *vendorname)
 VENDOR_DICT * rc_dict_getvendor (int id)
 {
     VENDOR_DICT *dict;
+    UINT4 i;
+
+    if (dict_image) {
+	for (i = dict_image->nvendors; i > 0; --i)
+	    if (id == IMG_VENDOR(i - 1)->vendorcode)
+		return IMG_VENDOR(i - 1);
+	return NULL;
+    }
 
     dict = vendor_dictionaries;
     while (dict) {
@@ -48,8 +48,9 @@ static OPTION config_options[] = {
 {"acctserver",		OT_SRV, ST_UNDEF, &acctserver},
 {"servers",		OT_STR, ST_UNDEF, NULL},
 {"dictionary",		OT_STR, ST_UNDEF, NULL},
+{"dictionary_image",	OT_STR, ST_UNDEF, NULL},
 {"login_radius",	OT_STR, ST_UNDEF, "/usr/sbin/login.radius"},
-{"seqfile",		OT_STR, ST_UNDEF, NULL},
+{"seqfile",		OT_STR, ST_UNDEF, NULL},	/* no longer used */
 {"mapfile",		OT_STR, ST_UNDEF, NULL},
 {"default_realm",	OT_STR, ST_UNDEF, NULL},
 {"radius_timeout",	OT_INT, ST_UNDEF, NULL},
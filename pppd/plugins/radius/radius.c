@@ -38,6 +38,7 @@ static char const RCSID[] =
 #include "fsm.h"
 #include "ipcp.h"
 #include <syslog.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/time.h>
 #include <string.h>
@@ -92,6 +93,17 @@ static int radius_init(char *msg);
 static int get_client_port(char *ifname);
 static int radius_allowed_address(u_int32_t addr);
 static void radius_acct_interim(void *);
+static void radius_pap_done(int result, VALUE_PAIR *received, char *msg,
+			    void *arg);
+static void radius_chap_done(int result, VALUE_PAIR *received, char *msg,
+			     void *arg);
+static void radius_acct_start_done(int result, VALUE_PAIR *received,
+				   char *msg, void *arg);
+static void radius_acct_done(int result, VALUE_PAIR *received, char *msg,
+			     void *arg);
+static void radius_exit(void *opaque, int arg);
+static void radius_link_down(void *opaque, int unit);
+static void radius_signal(void *opaque, int sig);
 #ifdef MPPE
 static int radius_setmppekeys(VALUE_PAIR *vp, REQUEST_INFO *req_info,
 			      unsigned char *);
@@ -136,6 +148,28 @@ void (*radius_pre_auth_hook)(char const *user,
 
 static struct radius_state rstate;
 
+/*
+ * What we need to finish off an authentication request once the
+ * server has answered, one per unit.  gen is bumped when the unit
+ * starts another authentication or its link goes down; a request
+ * made before then has gone stale and its answer is ignored.
+ */
+static struct radius_pending {
+    unsigned int gen;
+    struct chap_digest_type *digest;
+    unsigned char challenge[MAX_CHALLENGE_LEN + 1];
+    REQUEST_INFO req_info;	/* for decoding MPPE keys */
+    char msg[BUF_LEN];		/* PAP message / error message */
+    char message[256];		/* message for the CHAP success packet */
+} rpending[NUM_PPP];
+
+/* Identifies an authentication request to radius_pap_done and
+   radius_chap_done */
+struct radius_ticket {
+    int unit;
+    unsigned int gen;
+};
+
 char pppd_version[] = VERSION;
 
 /**********************************************************************
@@ -161,8 +195,12 @@ plugin_init(void)
 
     add_notifier(&ip_up_notifier, radius_ip_up, NULL);
     add_notifier(&ip_down_notifier, radius_ip_down, NULL);
+    add_notifier(&exitnotify, radius_exit, NULL);
+    add_notifier(&link_down_notifier, radius_link_down, NULL);
+    add_notifier(&sigreceived, radius_signal, NULL);
 
     memset(&rstate, 0, sizeof(rstate));
+    memset(rpending, 0, sizeof(rpending));
 
     strlcpy(rstate.config_file, "/etc/radiusclient/radiusclient.conf",
 	    sizeof(rstate.config_file));
@@ -227,6 +265,67 @@ radius_choose_ip(u_int32_t *addrp)
     }
 }
 
+/**********************************************************************
+* %FUNCTION: radius_new_ticket
+* %ARGUMENTS:
+*  unit -- the unit whose peer is being authenticated
+* %RETURNS:
+*  A ticket for the request, or NULL if out of memory
+* %DESCRIPTION:
+*  Starts a new authentication request for unit, making any request
+*  still outstanding for it stale.
+***********************************************************************/
+static struct radius_ticket *
+radius_new_ticket(int unit)
+{
+    struct radius_ticket *t;
+
+    t = malloc(sizeof(*t));
+    if (t == NULL) {
+	error("RADIUS: out of memory");
+	return NULL;
+    }
+    t->unit = unit;
+    t->gen = ++rpending[unit].gen;
+    return t;
+}
+
+/**********************************************************************
+* %FUNCTION: radius_ticket_stale
+* %ARGUMENTS:
+*  t -- the ticket passed to radius_pap_done or radius_chap_done
+* %RETURNS:
+*  1 if the request was cancelled, 0 if pppd is still waiting for it
+* %DESCRIPTION:
+*  Checks whether the answer to a request should be passed on to pppd.
+***********************************************************************/
+static int
+radius_ticket_stale(struct radius_ticket *t)
+{
+    if (t->gen == rpending[t->unit].gen)
+	return 0;
+    dbglog("RADIUS: ignoring answer to a cancelled request for unit %d",
+	   t->unit);
+    return 1;
+}
+
+/**********************************************************************
+* %FUNCTION: radius_link_down
+* %ARGUMENTS:
+*  opaque -- not used
+*  unit -- the unit whose link went down
+* %RETURNS:
+*  Nothing
+* %DESCRIPTION:
+*  Cancels any authentication request outstanding for unit.
+***********************************************************************/
+static void
+radius_link_down(void *opaque, int unit)
+{
+    if (unit >= 0 && unit < NUM_PPP)
+	++rpending[unit].gen;
+}
+
 /**********************************************************************
 * %FUNCTION: radius_pap_auth
 * %ARGUMENTS:
@@ -236,9 +335,10 @@ radius_choose_ip(u_int32_t *addrp)
 *  paddrs -- set to a list of possible peer IP addresses
 *  popts -- set to a list of additional pppd options
 * %RETURNS:
-*  1 if we can authenticate, -1 if we cannot.
+*  AUTH_PENDING if the request was sent, 0 if it could not be.
 * %DESCRIPTION:
-* Performs PAP authentication using RADIUS
+* Performs PAP authentication using RADIUS.  The result is passed to
+* pppd by radius_pap_done when the server answers.
 ***********************************************************************/
 static int
 radius_pap_auth(char *user,
@@ -247,10 +347,12 @@ radius_pap_auth(char *user,
 		struct wordlist **paddrs,
 		struct wordlist **popts)
 {
-    VALUE_PAIR *send, *received;
+    VALUE_PAIR *send;
     UINT4 av_type;
     int result;
-    static char radius_msg[BUF_LEN];
+    int unit = auth_hook_unit;
+    char *radius_msg = rpending[unit].msg;
+    struct radius_ticket *ticket;
 
     radius_msg[0] = 0;
     *msgp = radius_msg;
@@ -269,7 +371,6 @@ radius_pap_auth(char *user,
     }
 
     send = NULL;
-    received = NULL;
 
     /* Hack... the "port" is the ppp interface number.  Should really be
        the tty */
@@ -293,25 +394,58 @@ radius_pap_auth(char *user,
     if (rstate.avp)
 	rc_avpair_insert(&send, NULL, rc_avpair_copy(rstate.avp));
 
-    if (rstate.authserver) {
-	result = rc_auth_using_server(rstate.authserver,
-				      rstate.client_port, send,
-				      &received, radius_msg, NULL);
-    } else {
-	result = rc_auth(rstate.client_port, send, &received, radius_msg, NULL);
+    ticket = radius_new_ticket(unit);
+    if (ticket == NULL) {
+	rc_avpair_free(send);
+	return 0;
     }
+    result = rc_auth_async(rstate.authserver, rstate.client_port, send,
+			   NULL, radius_pap_done, ticket);
+    if (result == OK_RC)
+	return AUTH_PENDING;
+
+    free(ticket);
+    rc_avpair_free(send);
+    return 0;
+}
+
+/**********************************************************************
+* %FUNCTION: radius_pap_done
+* %ARGUMENTS:
+*  result -- OK_RC if the server accepted the user
+*  received -- value pairs from the server
+*  msg -- Reply-Message from the server
+*  arg -- the request's ticket
+* %RETURNS:
+*  Nothing
+* %DESCRIPTION:
+* Called when the PAP authentication request completes.
+***********************************************************************/
+static void
+radius_pap_done(int result, VALUE_PAIR *received, char *msg, void *arg)
+{
+    struct radius_ticket *ticket = arg;
+    int unit = ticket->unit;
+    struct radius_pending *rp = &rpending[unit];
+
+    if (radius_ticket_stale(ticket)) {
+	rc_avpair_free(received);
+	free(ticket);
+	return;
+    }
+    free(ticket);
+
+    strlcpy(rp->msg, msg, sizeof(rp->msg));
 
     if (result == OK_RC) {
-	if (radius_setparams(received, radius_msg, NULL, NULL, NULL, NULL, 0) < 0) {
+	if (radius_setparams(received, rp->msg, NULL, NULL, NULL, NULL, 0) < 0) {
 	    result = ERROR_RC;
 	}
     }
 
-    /* free value pairs */
     rc_avpair_free(received);
-    rc_avpair_free(send);
 
-    return (result == OK_RC) ? 1 : 0;
+    pap_auth_complete(unit, result == OK_RC, rp->msg, NULL, NULL);
 }
 
 /**********************************************************************
@@ -326,9 +460,10 @@ radius_pap_auth(char *user,
 *  message -- space for a message to be returned to the peer
 *  message_space -- number of bytes available at *message.
 * %RETURNS:
-*  1 if the response is good, 0 if it is bad
+*  AUTH_PENDING if the request was sent, 0 if the response is bad
 * %DESCRIPTION:
 * Performs CHAP, MS-CHAP and MS-CHAPv2 authentication using RADIUS.
+* The result is passed to pppd by radius_chap_done.
 ***********************************************************************/
 static int
 radius_chap_verify(char *user, char *ourname, int id,
@@ -336,15 +471,18 @@ radius_chap_verify(char *user, char *ourname, int id,
 		   unsigned char *challenge, unsigned char *response,
 		   char *message, int message_space)
 {
-    VALUE_PAIR *send, *received;
+    VALUE_PAIR *send;
     UINT4 av_type;
-    static char radius_msg[BUF_LEN];
+    int unit = auth_hook_unit;
+    struct radius_pending *rp = &rpending[unit];
+    char *radius_msg = rp->msg;
+    struct radius_ticket *ticket;
     int result;
     int challenge_len, response_len;
     u_char cpassword[MAX_RESPONSE_LEN + 1];
 #ifdef MPPE
     /* Need the RADIUS secret and Request Authenticator to decode MPPE */
-    REQUEST_INFO request_info, *req_info = &request_info;
+    REQUEST_INFO *req_info = &rp->req_info;
 #else
     REQUEST_INFO *req_info = NULL;
 #endif
@@ -381,7 +519,7 @@ radius_chap_verify(char *user, char *ourname, int id,
 	}
     }
 
-    send = received = NULL;
+    send = NULL;
 
     av_type = PW_FRAMED;
     rc_avpair_add (&send, PW_SERVICE_TYPE, &av_type, 0, VENDOR_NONE);
@@ -464,22 +602,67 @@ radius_chap_verify(char *user, char *ourname, int id,
      * make authentication with RADIUS server
      */
 
-    if (rstate.authserver) {
-	result = rc_auth_using_server(rstate.authserver,
-				      rstate.client_port, send,
-				      &received, radius_msg, req_info);
-    } else {
-	result = rc_auth(rstate.client_port, send, &received, radius_msg,
-			 req_info);
+    ticket = radius_new_ticket(unit);
+    if (ticket == NULL) {
+	rc_avpair_free(send);
+	return 0;
+    }
+
+    /* Keep what radius_setparams needs once the answer arrives */
+    rp->digest = digest;
+    memcpy(rp->challenge, challenge, challenge_len);
+
+    result = rc_auth_async(rstate.authserver, rstate.client_port, send,
+			   req_info, radius_chap_done, ticket);
+    if (result == OK_RC)
+	return AUTH_PENDING;
+
+    free(ticket);
+    rc_avpair_free(send);
+    return 0;
+}
+
+/**********************************************************************
+* %FUNCTION: radius_chap_done
+* %ARGUMENTS:
+*  result -- OK_RC if the server accepted the response
+*  received -- value pairs from the server
+*  msg -- Reply-Message from the server
+*  arg -- the request's ticket
+* %RETURNS:
+*  Nothing
+* %DESCRIPTION:
+* Called when the CHAP authentication request completes.
+***********************************************************************/
+static void
+radius_chap_done(int result, VALUE_PAIR *received, char *msg, void *arg)
+{
+    struct radius_ticket *ticket = arg;
+    int unit = ticket->unit;
+    struct radius_pending *rp = &rpending[unit];
+#ifdef MPPE
+    REQUEST_INFO *req_info = &rp->req_info;
+#else
+    REQUEST_INFO *req_info = NULL;
+#endif
+
+    if (radius_ticket_stale(ticket)) {
+	rc_avpair_free(received);
+	free(ticket);
+	return;
     }
+    free(ticket);
 
-    strlcpy(message, radius_msg, message_space);
+    strlcpy(rp->msg, msg, sizeof(rp->msg));
+    strlcpy(rp->message, msg, sizeof(rp->message));
 
     if (result == OK_RC) {
 	if (!rstate.done_chap_once) {
-	    if (radius_setparams(received, radius_msg, req_info, digest,
-				 challenge, message, message_space) < 0) {
-		error("%s", radius_msg);
+	    if (radius_setparams(received, rp->msg, req_info,
+				 rp->digest, rp->challenge,
+				 rp->message,
+				 sizeof(rp->message)) < 0) {
+		error("%s", rp->msg);
 		result = ERROR_RC;
 	    } else {
 		rstate.done_chap_once = 1;
@@ -488,8 +671,8 @@ radius_chap_verify(char *user, char *ourname, int id,
     }
 
     rc_avpair_free(received);
-    rc_avpair_free (send);
-    return (result == OK_RC);
+
+    chap_verify_complete(unit, result == OK_RC, rp->message);
 }
 
 /**********************************************************************
@@ -939,20 +1122,20 @@ radius_acct_start(void)
     if (rstate.avp)
 	rc_avpair_insert(&send, NULL, rc_avpair_copy(rstate.avp));
 
-    if (rstate.acctserver) {
-	result = rc_acct_using_server(rstate.acctserver,
-				      rstate.client_port, send);
-    } else {
-	result = rc_acct(rstate.client_port, send);
-    }
-
-    rc_avpair_free(send);
+    result = rc_acct_async(rstate.acctserver, rstate.client_port, send,
+			   radius_acct_start_done, NULL);
 
     if (result != OK_RC) {
+	rc_avpair_free(send);
 	/* RADIUS server could be down so make this a warning */
 	syslog(LOG_WARNING,
 		"Accounting START failed for %s", rstate.user);
     } else {
+	/*
+	 * Count accounting as started while the request is outstanding,
+	 * so that a STOP still goes out if the link drops before the
+	 * server answers.
+	 */
 	rstate.accounting_started = 1;
 	/* Kick off periodic accounting reports */
 	if (rstate.acct_interim_interval) {
@@ -961,6 +1144,59 @@ radius_acct_start(void)
     }
 }
 
+/**********************************************************************
+* %FUNCTION: radius_acct_start_done
+* %ARGUMENTS:
+*  result -- OK_RC if the server acknowledged the request
+*  received -- value pairs from the server
+*  msg -- ignored
+*  arg -- ignored
+* %RETURNS:
+*  Nothing
+* %DESCRIPTION:
+*  Called when the "start" accounting request completes.  If no server
+*  answered, we don't send interim or "stop" records for the session.
+***********************************************************************/
+static void
+radius_acct_start_done(int result, VALUE_PAIR *received, char *msg, void *arg)
+{
+    rc_avpair_free(received);
+
+    if (result != OK_RC) {
+	/* RADIUS server could be down so make this a warning */
+	syslog(LOG_WARNING,
+		"Accounting START failed for %s", rstate.user);
+	if (rstate.accounting_started) {
+	    rstate.accounting_started = 0;
+	    if (rstate.acct_interim_interval)
+		UNTIMEOUT(radius_acct_interim, NULL);
+	}
+    }
+}
+
+/**********************************************************************
+* %FUNCTION: radius_acct_done
+* %ARGUMENTS:
+*  result -- OK_RC if the server acknowledged the request
+*  received -- value pairs from the server
+*  msg -- ignored
+*  arg -- format of the warning to log on failure
+* %RETURNS:
+*  Nothing
+* %DESCRIPTION:
+*  Called when an interim or "stop" accounting request completes.
+***********************************************************************/
+static void
+radius_acct_done(int result, VALUE_PAIR *received, char *msg, void *arg)
+{
+    rc_avpair_free(received);
+
+    if (result != OK_RC) {
+	/* RADIUS server could be down so make this a warning */
+	syslog(LOG_WARNING, (char *) arg, rstate.user);
+    }
+}
+
 /**********************************************************************
 * %FUNCTION: radius_acct_stop
 * %ARGUMENTS:
@@ -1094,19 +1330,15 @@ radius_acct_stop(void)
     if (rstate.avp)
 	rc_avpair_insert(&send, NULL, rc_avpair_copy(rstate.avp));
 
-    if (rstate.acctserver) {
-	result = rc_acct_using_server(rstate.acctserver,
-				      rstate.client_port, send);
-    } else {
-	result = rc_acct(rstate.client_port, send);
-    }
+    result = rc_acct_async(rstate.acctserver, rstate.client_port, send,
+			   radius_acct_done, "Accounting STOP failed for %s");
 
     if (result != OK_RC) {
 	/* RADIUS server could be down so make this a warning */
 	syslog(LOG_WARNING,
 		"Accounting STOP failed for %s", rstate.user);
+	rc_avpair_free(send);
     }
-    rc_avpair_free(send);
 }
 
 /**********************************************************************
@@ -1191,19 +1423,15 @@ radius_acct_interim(void *ignored)
     if (rstate.avp)
 	rc_avpair_insert(&send, NULL, rc_avpair_copy(rstate.avp));
 
-    if (rstate.acctserver) {
-	result = rc_acct_using_server(rstate.acctserver,
-				      rstate.client_port, send);
-    } else {
-	result = rc_acct(rstate.client_port, send);
-    }
+    result = rc_acct_async(rstate.acctserver, rstate.client_port, send,
+			   radius_acct_done, "Interim accounting failed for %s");
 
     if (result != OK_RC) {
 	/* RADIUS server could be down so make this a warning */
 	syslog(LOG_WARNING,
 		"Interim accounting failed for %s", rstate.user);
+	rc_avpair_free(send);
     }
-    rc_avpair_free(send);
 
     /* Schedule another one */
     TIMEOUT(radius_acct_interim, NULL, rstate.acct_interim_interval);
@@ -1241,6 +1469,41 @@ radius_ip_down(void *opaque, int arg)
     radius_acct_stop();
 }
 
+/**********************************************************************
+* %FUNCTION: radius_exit
+* %ARGUMENTS:
+*  opaque -- ignored
+*  arg -- ignored
+* %RETURNS:
+*  Nothing
+* %DESCRIPTION:
+*  Called when pppd exits.  Waits for outstanding requests (normally
+*  the "stop" accounting record) to be answered or to time out.
+***********************************************************************/
+static void
+radius_exit(void *opaque, int arg)
+{
+    rc_async_drain();
+}
+
+/**********************************************************************
+* %FUNCTION: radius_signal
+* %ARGUMENTS:
+*  opaque -- ignored
+*  sig -- the signal received
+* %RETURNS:
+*  Nothing
+* %DESCRIPTION:
+*  Called from pppd's signal handlers.  On SIGHUP, re-read the servers
+*  file next time we need it.
+***********************************************************************/
+static void
+radius_signal(void *opaque, int sig)
+{
+    if (sig == SIGHUP)
+	rc_servers_changed();
+}
+
 /**********************************************************************
 * %FUNCTION: radius_init
 * %ARGUMENTS:
@@ -306,6 +306,8 @@ typedef struct dict_attr
 	int               type;				/* string, int, etc. */
 	int               vendorcode;                   /* vendor code */
 	struct dict_attr *next;
+	struct dict_attr *hash_next;			/* by vendor/index */
+	struct dict_attr *name_next;			/* by name */
 } DICT_ATTR;
 
 typedef struct dict_value
@@ -314,6 +316,8 @@ typedef struct dict_value
 	char               name[NAME_LENGTH + 1];
 	int                value;
 	struct dict_value *next;
+	struct dict_value *hash_next;	/* by attribute name and value */
+	struct dict_value *name_next;	/* by name */
 } DICT_VALUE;
 
 typedef struct vendor_dict
@@ -363,6 +367,12 @@ typedef struct request_info
 	u_char		request_vector[AUTH_VECTOR_LEN];
 } REQUEST_INFO;
 
+/* Completion callbacks for asynchronous requests */
+typedef void RC_SEND_DONE __P((int result, SEND_DATA *data, char *msg,
+			       void *arg));
+typedef void RC_DONE __P((int result, VALUE_PAIR *received, char *msg,
+			  void *arg));
+
 #ifndef MIN
 #define MIN(a, b)     ((a) < (b) ? (a) : (b))
 #endif
@@ -410,6 +420,9 @@ int rc_acct __P((UINT4, VALUE_PAIR *));
 int rc_acct_using_server __P((SERVER *, UINT4, VALUE_PAIR *));
 int rc_acct_proxy __P((VALUE_PAIR *));
 int rc_check __P((char *, unsigned short, char *));
+int rc_auth_async __P((SERVER *, UINT4, VALUE_PAIR *, REQUEST_INFO *,
+		       RC_DONE *, void *));
+int rc_acct_async __P((SERVER *, UINT4, VALUE_PAIR *, RC_DONE *, void *));
 
 /*	clientid.c		*/
 
@@ -422,6 +435,7 @@ int rc_read_config __P((char *));
 char *rc_conf_str __P((char *));
 int rc_conf_int __P((char *));
 SERVER *rc_conf_srv __P((char *));
+void rc_servers_changed __P((void));
 int rc_find_server __P((char *, UINT4 *, char *));
 
 /*	dict.c			*/
@@ -440,11 +454,16 @@ UINT4 rc_get_ipaddr __P((char *));
 int rc_good_ipaddr __P((char *));
 const char *rc_ip_hostname __P((UINT4));
 UINT4 rc_own_ipaddress __P((void));
+UINT4 rc_own_bind_ipaddress __P((void));
 
 
 /*	sendserver.c		*/
 
 int rc_send_server __P((SEND_DATA *, char *, REQUEST_INFO *));
+int rc_send_server_async __P((SEND_DATA *, REQUEST_INFO *, RC_SEND_DONE *,
+			      void *));
+int rc_async_pending __P((void));
+void rc_async_drain __P((void));
 
 /*	util.c			*/
 
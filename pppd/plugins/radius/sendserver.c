@@ -17,9 +17,11 @@
 #include <includes.h>
 #include <radiusclient.h>
 #include <pathnames.h>
+#include <poll.h>
 
 static void rc_random_vector (unsigned char *);
 static int rc_check_reply (AUTH_HDR *, int, char *, unsigned char *, unsigned char);
+static int rc_reply_valid (AUTH_HDR *, int, char *, unsigned char *, unsigned char);
 
 /*
  * Function: rc_pack_list
@@ -183,34 +185,18 @@ static int rc_pack_list (VALUE_PAIR *vp, char *secret, AUTH_HDR *auth)
 }
 
 /*
- * Function: rc_send_server
+ * Function: rc_lookup_secret
  *
- * Purpose: send a request to a RADIUS server and wait for the reply
+ * Purpose: find the address of and shared secret for the server
+ *	    a request is to be sent to.
+ *
+ * Returns: OK_RC on success, ERROR_RC if the server is unknown.
  *
  */
 
-int rc_send_server (SEND_DATA *data, char *msg, REQUEST_INFO *info)
+static int rc_lookup_secret (SEND_DATA *data, UINT4 *auth_ipaddr, char *secret)
 {
-	int             sockfd;
-	struct sockaddr salocal;
-	struct sockaddr saremote;
-	struct sockaddr_in *sin;
-	struct timeval  authtime;
-	fd_set          readfds;
-	AUTH_HDR       *auth, *recv_auth;
-	UINT4           auth_ipaddr;
 	char           *server_name;	/* Name of server to query */
-	int             salen;
-	int             result;
-	int             total_length;
-	int             length;
-	int             retry_max;
-	int		secretlen;
-	char            secret[MAX_SECRET_LENGTH + 1];
-	unsigned char   vector[AUTH_VECTOR_LEN];
-	char            recv_buffer[BUFFER_LEN];
-	char            send_buffer[BUFFER_LEN];
-	int		retries;
 	VALUE_PAIR	*vp;
 
 	server_name = data->server;
@@ -221,23 +207,40 @@ int rc_send_server (SEND_DATA *data, char *msg, REQUEST_INFO *info)
 	    (vp->lvalue == PW_ADMINISTRATIVE))
 	{
 		strcpy(secret, MGMT_POLL_SECRET);
-		if ((auth_ipaddr = rc_get_ipaddr(server_name)) == 0)
+		if ((*auth_ipaddr = rc_get_ipaddr(server_name)) == 0)
 			return (ERROR_RC);
 	}
 	else
 	{
-		if (rc_find_server (server_name, &auth_ipaddr, secret) != 0)
+		if (rc_find_server (server_name, auth_ipaddr, secret) != 0)
 		{
 			return (ERROR_RC);
 		}
 	}
+	return (OK_RC);
+}
+
+/*
+ * Function: rc_open_socket
+ *
+ * Purpose: create a UDP socket bound to our configured address.
+ *
+ * Returns: the socket, or -1 on error.
+ *
+ */
+
+static int rc_open_socket (char *server_name)
+{
+	int             sockfd;
+	struct sockaddr salocal;
+	struct sockaddr_in *sin;
+	int             length;
 
 	sockfd = socket (AF_INET, SOCK_DGRAM, 0);
 	if (sockfd < 0)
 	{
-		memset (secret, '\0', sizeof (secret));
 		error("rc_send_server: socket: %s", strerror(errno));
-		return (ERROR_RC);
+		return -1;
 	}
 
 	length = sizeof (salocal);
@@ -250,16 +253,200 @@ int rc_send_server (SEND_DATA *data, char *msg, REQUEST_INFO *info)
 		   getsockname (sockfd, (struct sockaddr *) sin, &length) < 0)
 	{
 		close (sockfd);
-		memset (secret, '\0', sizeof (secret));
 		error("rc_send_server: bind: %s: %m", server_name);
-		return (ERROR_RC);
+		return -1;
 	}
+	return sockfd;
+}
 
-	retry_max = data->retries;	/* Max. numbers to try for reply */
-	retries = 0;			/* Init retry cnt for blocking call */
+/*
+ * Sockets.
+ *
+ * Requests go out on long-lived UDP sockets, one per server (more if
+ * all 256 identifiers on one are in use), which pppd's main loop
+ * watches.  Nobody else sends from our source port, so an identifier
+ * only has to be unique among our own outstanding requests on that
+ * socket; they're tracked here instead of in a shared sequence file.
+ */
+
+struct rc_sock {
+	int		fd;
+	UINT4		ipaddr;		/* server address */
+	unsigned short	port;		/* server port */
+	int		nbusy;		/* identifiers in use */
+	unsigned char	busy[256 / 8];	/* bitmap of identifiers in use */
+	struct rc_sock	*next;
+};
+
+static struct rc_sock *rc_socks;
+
+static void rc_sock_input (int, void *);
+static void rc_sock_deliver (struct rc_sock *, char *, int);
+
+/*
+ * Function: rc_sock_get
+ *
+ * Purpose: find a socket for talking to a server with an identifier
+ *	    free, opening a new one if need be.
+ *
+ * Returns: the socket, or NULL on error.
+ *
+ */
+
+static struct rc_sock *rc_sock_get (UINT4 ipaddr, unsigned short port,
+				    char *server_name)
+{
+	struct rc_sock *sp;
+	int		fd;
+
+	for (sp = rc_socks; sp != NULL; sp = sp->next)
+		if (sp->ipaddr == ipaddr && sp->port == port && sp->nbusy < 256)
+			return sp;
+
+	fd = rc_open_socket (server_name);
+	if (fd < 0)
+		return NULL;
+
+	sp = (struct rc_sock *) malloc (sizeof (struct rc_sock));
+	if (sp == NULL)
+	{
+		error("rc_send_server: out of memory");
+		close (fd);
+		return NULL;
+	}
+	memset (sp, 0, sizeof (*sp));
+	sp->fd = fd;
+	sp->ipaddr = ipaddr;
+	sp->port = port;
+
+	/* keep it out of scripts, and never block reading it */
+	fcntl (fd, F_SETFD, FD_CLOEXEC);
+	fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK);
+	add_fd_callback (fd, rc_sock_input, sp);
+
+	sp->next = rc_socks;
+	rc_socks = sp;
+	return sp;
+}
+
+/*
+ * Function: rc_sock_id_alloc
+ *
+ * Purpose: reserve an identifier on a socket, starting at hint.
+ *
+ * Returns: the identifier, or -1 if they are all in use.
+ *
+ */
+
+static int rc_sock_id_alloc (struct rc_sock *sp, unsigned char hint)
+{
+	int		i, id;
+
+	for (i = 0; i < 256; ++i)
+	{
+		id = (hint + i) & 255;
+		if ((sp->busy[id >> 3] & (1 << (id & 7))) == 0)
+		{
+			sp->busy[id >> 3] |= 1 << (id & 7);
+			sp->nbusy++;
+			return id;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Function: rc_sock_id_free
+ *
+ * Purpose: release an identifier reserved with rc_sock_id_alloc.
+ *
+ */
+
+static void rc_sock_id_free (struct rc_sock *sp, int id)
+{
+	if (sp->busy[id >> 3] & (1 << (id & 7)))
+	{
+		sp->busy[id >> 3] &= ~(1 << (id & 7));
+		sp->nbusy--;
+	}
+}
+
+/*
+ * Function: rc_sock_wait
+ *
+ * Purpose: wait up to timeout seconds for the reply to request id.
+ *	    Replies to other requests that turn up meanwhile are passed
+ *	    on to their owners.  A packet with our id but without a valid
+ *	    response authenticator is dropped and we keep waiting.
+ *
+ * Returns: the length of the reply, 0 on timeout, -1 on error.
+ *
+ */
+
+static int rc_sock_wait (struct rc_sock *sp, int id, char *buf, int timeout,
+			 char *secret, unsigned char *vector)
+{
+	struct sockaddr saremote;
+	struct pollfd	pfd;
+	time_t		deadline, now;
+	int             salen;
+	int             length;
+	int		n;
+
+	deadline = time (NULL) + timeout;
+	for (;;)
+	{
+		now = time (NULL);
+		pfd.fd = sp->fd;
+		pfd.events = POLLIN;
+		n = poll (&pfd, 1, (deadline > now)? (int) (deadline - now) * 1000: 0);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			error("rc_send_server: poll: %m");
+			return -1;
+		}
+		if (n == 0)
+			return 0;
+
+		salen = sizeof (saremote);
+		length = recvfrom (sp->fd, buf, BUFFER_LEN, 0, &saremote, &salen);
+		if (length < 0)
+		{
+			if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+				continue;
+			error("rc_send_server: recvfrom: %s:%d: %m",
+			      rc_ip_hostname (sp->ipaddr), sp->port);
+			return -1;
+		}
+		if (length >= AUTH_HDR_LEN && ((AUTH_HDR *) buf)->id == id)
+		{
+			if (rc_reply_valid ((AUTH_HDR *) buf, length, secret,
+					    vector, id) == OK_RC)
+				return length;
+			continue;
+		}
+		rc_sock_deliver (sp, buf, length);
+	}
+}
+
+/*
+ * Function: rc_build_packet
+ *
+ * Purpose: build the request described by data in auth, filling in
+ *	    the request authenticator and returning it in vector.
+ *
+ * Returns: length of the packet.
+ *
+ */
+
+static int rc_build_packet (SEND_DATA *data, char *secret, AUTH_HDR *auth,
+			    unsigned char *vector)
+{
+	int             total_length;
+	int		secretlen;
 
-	/* Build a request */
-	auth = (AUTH_HDR *) send_buffer;
 	auth->code = data->code;
 	auth->id = data->seq_nbr;
 
@@ -284,33 +471,115 @@ int rc_send_server (SEND_DATA *data, char *msg, REQUEST_INFO *info)
 
 		auth->length = htons ((unsigned short) total_length);
 	}
+	return total_length;
+}
 
-	sin = (struct sockaddr_in *) & saremote;
-	memset ((char *) sin, '\0', sizeof (saremote));
-	sin->sin_family = AF_INET;
-	sin->sin_addr.s_addr = htonl (auth_ipaddr);
-	sin->sin_port = htons ((unsigned short) data->svc_port);
+/*
+ * Function: rc_process_reply
+ *
+ * Purpose: decode the attributes of a reply that has passed
+ *	    rc_reply_valid into data->receive_pairs and collect any
+ *	    Reply-Message text in msg.
+ *
+ * Returns: OK_RC for an accept/ack, BADRESP_RC otherwise.
+ *
+ */
+
+static int rc_process_reply (SEND_DATA *data, AUTH_HDR *recv_auth, char *msg)
+{
+	int		result;
+	VALUE_PAIR	*vp;
+
+	data->receive_pairs = rc_avpair_gen(recv_auth);
+
+	*msg = '\0';
+	vp = data->receive_pairs;
+	while (vp)
+	{
+		if ((vp = rc_avpair_get(vp, PW_REPLY_MESSAGE)))
+		{
+			strcat(msg, vp->strvalue);
+			strcat(msg, "\n");
+			vp = vp->next;
+		}
+	}
+
+	if ((recv_auth->code == PW_ACCESS_ACCEPT) ||
+		(recv_auth->code == PW_PASSWORD_ACK) ||
+		(recv_auth->code == PW_ACCOUNTING_RESPONSE))
+	{
+		result = OK_RC;
+	}
+	else
+	{
+		result = BADRESP_RC;
+	}
+
+	return (result);
+}
+
+/*
+ * Function: rc_send_server
+ *
+ * Purpose: send a request to a RADIUS server and wait for the reply
+ *
+ */
+
+int rc_send_server (SEND_DATA *data, char *msg, REQUEST_INFO *info)
+{
+	struct rc_sock *sp;
+	struct sockaddr_in sin;
+	AUTH_HDR       *auth, *recv_auth;
+	UINT4           auth_ipaddr;
+	int             id;
+	int             result;
+	int             total_length;
+	int             length;
+	int             retry_max;
+	char            secret[MAX_SECRET_LENGTH + 1];
+	unsigned char   vector[AUTH_VECTOR_LEN];
+	char            recv_buffer[BUFFER_LEN];
+	char            send_buffer[BUFFER_LEN];
+	int		retries;
+
+	if (rc_lookup_secret (data, &auth_ipaddr, secret) != OK_RC)
+		return (ERROR_RC);
+
+	sp = rc_sock_get (auth_ipaddr, data->svc_port, data->server);
+	if (sp == NULL || (id = rc_sock_id_alloc (sp, data->seq_nbr)) < 0)
+	{
+		memset (secret, '\0', sizeof (secret));
+		return (ERROR_RC);
+	}
+	data->seq_nbr = id;
+
+	retry_max = data->retries;	/* Max. numbers to try for reply */
+	retries = 0;			/* Init retry cnt for blocking call */
+
+	/* Build a request */
+	auth = (AUTH_HDR *) send_buffer;
+	total_length = rc_build_packet (data, secret, auth, vector);
+
+	memset ((char *) &sin, '\0', sizeof (sin));
+	sin.sin_family = AF_INET;
+	sin.sin_addr.s_addr = htonl (auth_ipaddr);
+	sin.sin_port = htons ((unsigned short) data->svc_port);
 
 	for (;;)
 	{
-		sendto (sockfd, (char *) auth, (unsigned int) total_length, (int) 0,
-			(struct sockaddr *) sin, sizeof (struct sockaddr_in));
+		sendto (sp->fd, (char *) auth, (unsigned int) total_length, (int) 0,
+			(struct sockaddr *) &sin, sizeof (struct sockaddr_in));
 
-		authtime.tv_usec = 0L;
-		authtime.tv_sec = (long) data->timeout;
-		FD_ZERO (&readfds);
-		FD_SET (sockfd, &readfds);
-		if (select (sockfd + 1, &readfds, NULL, NULL, &authtime) < 0)
+		length = rc_sock_wait (sp, id, recv_buffer, data->timeout,
+				       secret, vector);
+		if (length > 0)
+			break;
+		if (length < 0)
 		{
-			if (errno == EINTR)
-				continue;
-			error("rc_send_server: select: %m");
+			rc_sock_id_free (sp, id);
 			memset (secret, '\0', sizeof (secret));
-			close (sockfd);
 			return (ERROR_RC);
 		}
-		if (FD_ISSET (sockfd, &readfds))
-			break;
 
 		/*
 		 * Timed out waiting for response.  Retry "retry_max" times
@@ -320,32 +589,17 @@ int rc_send_server (SEND_DATA *data, char *msg, REQUEST_INFO *info)
 		{
 			error("rc_send_server: no reply from RADIUS server %s:%u",
 			      rc_ip_hostname (auth_ipaddr), data->svc_port);
-			close (sockfd);
+			rc_sock_id_free (sp, id);
 			memset (secret, '\0', sizeof (secret));
 			return (TIMEOUT_RC);
 		}
 	}
-	salen = sizeof (saremote);
-	length = recvfrom (sockfd, (char *) recv_buffer,
-			   (int) sizeof (recv_buffer),
-			   (int) 0, &saremote, &salen);
-
-	if (length <= 0)
-	{
-		error("rc_send_server: recvfrom: %s:%d: %m", server_name,\
-		      data->svc_port);
-		close (sockfd);
-		memset (secret, '\0', sizeof (secret));
-		return (ERROR_RC);
-	}
 
 	recv_auth = (AUTH_HDR *)recv_buffer;
 
-	result = rc_check_reply (recv_auth, BUFFER_LEN, secret, vector, data->seq_nbr);
-
-	data->receive_pairs = rc_avpair_gen(recv_auth);
+	result = rc_process_reply (data, recv_auth, msg);
 
-	close (sockfd);
+	rc_sock_id_free (sp, id);
 	if (info)
 	{
 		memcpy(info->secret, secret, sizeof(info->secret));
@@ -354,32 +608,329 @@ int rc_send_server (SEND_DATA *data, char *msg, REQUEST_INFO *info)
 	}
 	memset (secret, '\0', sizeof (secret));
 
-	if (result != OK_RC) return (result);
+	return (result);
+}
 
-	*msg = '\0';
-	vp = data->receive_pairs;
-	while (vp)
+/*
+ * Asynchronous requests.
+ *
+ * rc_send_server_async sends a request and returns straight away; the
+ * reply is picked up when pppd's main loop finds the socket readable
+ * and retransmissions are driven by pppd timeouts, so a slow server no
+ * longer stops pppd from servicing the link.  Outstanding requests
+ * are kept on a list and matched to replies by socket and identifier.
+ */
+
+struct rc_request {
+	struct rc_sock	*sock;
+	SEND_DATA	data;
+	REQUEST_INFO	*info;
+	struct sockaddr_in saremote;
+	UINT4		auth_ipaddr;
+	int		total_length;
+	int		retries;
+	time_t		sent_time;	/* when last transmitted */
+	char		secret[MAX_SECRET_LENGTH + 1];
+	unsigned char	vector[AUTH_VECTOR_LEN];
+	char		send_buffer[BUFFER_LEN];
+	char		msg[BUFFER_LEN];
+	RC_SEND_DONE	*done;
+	void		*arg;
+	struct rc_request *next;
+};
+
+static struct rc_request *rc_requests;	/* outstanding requests */
+
+static void rc_async_timeout (void *);
+
+/*
+ * Function: rc_async_finish
+ *
+ * Purpose: retire an outstanding request and report its result.
+ *
+ */
+
+static void rc_async_finish (struct rc_request *req, int result)
+{
+	struct rc_request **rpp;
+
+	for (rpp = &rc_requests; *rpp != NULL; rpp = &(*rpp)->next)
+		if (*rpp == req) {
+			*rpp = req->next;
+			break;
+		}
+
+	rc_sock_id_free (req->sock, req->data.seq_nbr);
+	UNTIMEOUT (rc_async_timeout, req);
+
+	if (result == OK_RC || result == BADRESP_RC) {
+		if (req->info) {
+			memcpy(req->info->secret, req->secret,
+			       sizeof(req->info->secret));
+			memcpy(req->info->request_vector, req->vector,
+			       sizeof(req->info->request_vector));
+		}
+	}
+	memset (req->secret, '\0', sizeof (req->secret));
+
+	(*req->done)(result, &req->data, req->msg, req->arg);
+
+	free (req);
+}
+
+/*
+ * Function: rc_async_send
+ *
+ * Purpose: (re)transmit a request and arm its retransmission timer.
+ *
+ */
+
+static void rc_async_send (struct rc_request *req)
+{
+	sendto (req->sock->fd, req->send_buffer, (unsigned int) req->total_length,
+		0, (struct sockaddr *) &req->saremote, sizeof (req->saremote));
+	req->sent_time = time (NULL);
+	TIMEOUT (rc_async_timeout, req, req->data.timeout);
+}
+
+/*
+ * Function: rc_async_timeout
+ *
+ * Purpose: no reply within the timeout; retransmit or give up.
+ *
+ */
+
+static void rc_async_timeout (void *arg)
+{
+	struct rc_request *req = arg;
+
+	if (++req->retries >= req->data.retries)
 	{
-		if ((vp = rc_avpair_get(vp, PW_REPLY_MESSAGE)))
+		error("rc_send_server: no reply from RADIUS server %s:%u",
+		      rc_ip_hostname (req->auth_ipaddr), req->data.svc_port);
+		rc_async_finish (req, TIMEOUT_RC);
+		return;
+	}
+	rc_async_send (req);
+}
+
+/*
+ * Function: rc_sock_deliver
+ *
+ * Purpose: hand a reply to the asynchronous request it belongs to.
+ *	    A reply that fails the authenticator check is dropped, and
+ *	    the request stays outstanding until a good reply arrives or
+ *	    its retries run out.
+ *
+ */
+
+static void rc_sock_deliver (struct rc_sock *sp, char *buf, int length)
+{
+	struct rc_request *req;
+	AUTH_HDR	*recv_auth = (AUTH_HDR *) buf;
+	int		result;
+
+	if (length < AUTH_HDR_LEN)
+		return;
+	for (req = rc_requests; req != NULL; req = req->next)
+		if (req->sock == sp && req->data.seq_nbr == recv_auth->id)
+			break;
+	if (req == NULL)
+	{
+		/* a late reply to a request we've given up on */
+		dbglog("rc_send_server: dropped reply with id %d from %s:%d",
+		       recv_auth->id, rc_ip_hostname (sp->ipaddr), sp->port);
+		return;
+	}
+
+	if (rc_reply_valid (recv_auth, length, req->secret, req->vector,
+			    req->data.seq_nbr) != OK_RC)
+		return;
+
+	result = rc_process_reply (&req->data, recv_auth, req->msg);
+	rc_async_finish (req, result);
+}
+
+/*
+ * Function: rc_sock_input
+ *
+ * Purpose: called from pppd's main loop when replies may be waiting
+ *	    on one of our sockets.
+ *
+ */
+
+static void rc_sock_input (int fd, void *arg)
+{
+	struct rc_sock *sp = arg;
+	struct sockaddr saremote;
+	char            recv_buffer[BUFFER_LEN];
+	int             salen;
+	int             length;
+
+	for (;;)
+	{
+		salen = sizeof (saremote);
+		length = recvfrom (fd, (char *) recv_buffer,
+				   (int) sizeof (recv_buffer),
+				   (int) 0, &saremote, &salen);
+		if (length < 0)
 		{
-			strcat(msg, vp->strvalue);
-			strcat(msg, "\n");
-			vp = vp->next;
+			if (errno != EINTR && errno != EAGAIN
+			    && errno != EWOULDBLOCK)
+				error("rc_send_server: recvfrom: %s:%d: %m",
+				      rc_ip_hostname (sp->ipaddr), sp->port);
+			return;
 		}
+		rc_sock_deliver (sp, recv_buffer, length);
 	}
+}
 
-	if ((recv_auth->code == PW_ACCESS_ACCEPT) ||
-		(recv_auth->code == PW_PASSWORD_ACK) ||
-		(recv_auth->code == PW_ACCOUNTING_RESPONSE))
+/*
+ * Function: rc_send_server_async
+ *
+ * Purpose: start sending a request to a RADIUS server.  When a reply
+ *	    arrives, or the retries are used up, done(result, data, msg,
+ *	    arg) is called from pppd's main loop; data is a copy of
+ *	    *data with receive_pairs filled in, which done must free.
+ *	    The send_pairs in *data must remain valid until then.
+ *
+ * Returns: OK_RC if the request was sent (done will be called later),
+ *	    ERROR_RC otherwise (done will not be called).
+ *
+ */
+
+int rc_send_server_async (SEND_DATA *data, REQUEST_INFO *info,
+			  RC_SEND_DONE *done, void *arg)
+{
+	struct rc_request *req;
+	int		id;
+
+	req = (struct rc_request *) malloc (sizeof (struct rc_request));
+	if (req == NULL)
 	{
-		result = OK_RC;
+		error("rc_send_server_async: out of memory");
+		return (ERROR_RC);
 	}
-	else
+	memset (req, 0, sizeof (*req));
+	req->data = *data;
+	req->data.receive_pairs = NULL;
+	req->info = info;
+	req->done = done;
+	req->arg = arg;
+
+	if (rc_lookup_secret (&req->data, &req->auth_ipaddr, req->secret) != OK_RC)
 	{
-		result = BADRESP_RC;
+		free (req);
+		return (ERROR_RC);
 	}
 
-	return (result);
+	req->sock = rc_sock_get (req->auth_ipaddr, req->data.svc_port,
+				 req->data.server);
+	if (req->sock == NULL
+	    || (id = rc_sock_id_alloc (req->sock, req->data.seq_nbr)) < 0)
+	{
+		memset (req->secret, '\0', sizeof (req->secret));
+		free (req);
+		return (ERROR_RC);
+	}
+	req->data.seq_nbr = id;
+
+	req->total_length = rc_build_packet (&req->data, req->secret,
+					     (AUTH_HDR *) req->send_buffer,
+					     req->vector);
+
+	req->saremote.sin_family = AF_INET;
+	req->saremote.sin_addr.s_addr = htonl (req->auth_ipaddr);
+	req->saremote.sin_port = htons ((unsigned short) req->data.svc_port);
+
+	req->next = rc_requests;
+	rc_requests = req;
+	rc_async_send (req);
+
+	return (OK_RC);
+}
+
+/*
+ * Function: rc_async_pending
+ *
+ * Purpose: return the number of outstanding asynchronous requests.
+ *
+ */
+
+int rc_async_pending (void)
+{
+	struct rc_request *req;
+	int n = 0;
+
+	for (req = rc_requests; req != NULL; req = req->next)
+		++n;
+	return n;
+}
+
+/*
+ * Function: rc_async_drain
+ *
+ * Purpose: wait for all outstanding asynchronous requests to complete.
+ *	    Used when pppd is about to exit, so that accounting records
+ *	    already queued still get delivered.
+ *
+ */
+
+void rc_async_drain (void)
+{
+	struct rc_request *req;
+	struct rc_sock	*sp;
+	struct pollfd	*pfds = NULL;
+	int		nsocks, i, n;
+
+	while (rc_requests != NULL)
+	{
+		nsocks = 0;
+		for (sp = rc_socks; sp != NULL; sp = sp->next)
+			++nsocks;
+		free (pfds);
+		if ((pfds = malloc (nsocks * sizeof (*pfds) + 1)) == NULL)
+			break;
+		i = 0;
+		for (sp = rc_socks; sp != NULL; sp = sp->next, ++i)
+		{
+			pfds[i].fd = (sp->nbusy == 0)? -1: sp->fd;
+			pfds[i].events = POLLIN;
+			pfds[i].revents = 0;
+		}
+		/* pppd's timeouts don't run while we're in here,
+		   so wake up each second to do retransmissions */
+		n = poll (pfds, nsocks, 1000);
+		if (n < 0 && errno != EINTR)
+			break;
+		if (n > 0)
+		{
+			/* a reply's done routine may open new sockets,
+			   so look each one up again */
+			for (i = 0; i < nsocks; ++i)
+			{
+				if (pfds[i].revents == 0)
+					continue;
+				for (sp = rc_socks; sp != NULL; sp = sp->next)
+					if (sp->fd == pfds[i].fd)
+						break;
+				if (sp != NULL)
+					rc_sock_input (sp->fd, sp);
+			}
+		}
+		else
+		{
+			for (req = rc_requests; req != NULL; req = req->next)
+				if (time (NULL) - req->sent_time >= req->data.timeout)
+				{
+					UNTIMEOUT (rc_async_timeout, req);
+					rc_async_timeout (req);
+					/* the list may have changed */
+					break;
+				}
+		}
+	}
+	free (pfds);
 }
 
 /*
@@ -471,6 +1022,30 @@ static int rc_check_reply (AUTH_HDR *auth, int bufferlen, char *secret,
 
 }
 
+/*
+ * Function: rc_reply_valid
+ *
+ * Purpose: check that a packet of length bytes received for request
+ *	    seq_nbr is a genuine reply to it: it must not claim to be
+ *	    longer than what arrived, and must carry the right response
+ *	    authenticator.
+ *
+ * Returns:	OK_RC       -- if it is,
+ *		BADRESP_RC  -- if not; the caller drops the packet.
+ *
+ */
+
+static int rc_reply_valid (AUTH_HDR *auth, int length, char *secret,
+			   unsigned char *vector, unsigned char seq_nbr)
+{
+	if (length < AUTH_HDR_LEN || ntohs (auth->length) > length)
+	{
+		error("rc_reply_valid: received truncated RADIUS server response");
+		return (BADRESP_RC);
+	}
+	return rc_check_reply (auth, BUFFER_LEN, secret, vector, seq_nbr);
+}
+
 /*
  * Function: rc_random_vector
  *
@@ -482,6 +1057,7 @@ static int rc_check_reply (AUTH_HDR *auth, int bufferlen, char *secret,
 
 static void rc_random_vector (unsigned char *vector)
 {
+	static int	urandom_fd = -1;
 	int             randno;
 	int             i;
 	int		fd;
@@ -490,7 +1066,16 @@ static void rc_random_vector (unsigned char *vector)
    we use /dev/urandom here, as /dev/random might block and we don't
    need that much randomness. BTW, great idea, Ted!     -lf, 03/18/95	*/
 
-	if ((fd = open(_PATH_DEV_URANDOM, O_RDONLY)) >= 0)
+	/* kept open, so that sending a request doesn't touch the filesystem */
+	if (urandom_fd < 0)
+	{
+		urandom_fd = open(_PATH_DEV_URANDOM, O_RDONLY);
+		if (urandom_fd >= 0)
+			fcntl(urandom_fd, F_SETFD, FD_CLOEXEC);
+	}
+	fd = urandom_fd;
+
+	if (fd >= 0)
 	{
 		unsigned char *pos;
 		int readcount;
@@ -500,12 +1085,17 @@ static void rc_random_vector (unsigned char *vector)
 		while (i > 0)
 		{
 			readcount = read(fd, (char *)pos, i);
+			if (readcount <= 0)
+			{
+				if (readcount < 0 && errno == EINTR)
+					continue;
+				break;
+			}
 			pos += readcount;
 			i -= readcount;
 		}
-
-		close(fd);
-		return;
+		if (i == 0)
+			return;
 	} /* else fall through */
 
 	for (i = 0; i < AUTH_VECTOR_LEN;)
@@ -75,7 +75,9 @@
  * Limits.
  */
 
+#ifndef NUM_PPP
 #define NUM_PPP		1	/* One PPP interface supported (per process) */
+#endif
 #define MAXWORDLEN	1024	/* max length of word in file (incl null) */
 #define MAXARGS		1	/* max # args to a command */
 #define MAXNAMELEN	256	/* max length of hostname or name for auth */
@@ -219,6 +221,7 @@ extern u_char	outpacket_buf[]; /* Buffer for outgoing packets */
 extern int	devfd;		/* fd of underlying device */
 extern int	fd_ppp;		/* fd for talking PPP */
 extern int	phase;		/* Current state of link - see values below */
+extern int	cur_unit;	/* Unit whose link state the above are */
 extern int	baud_rate;	/* Current link speed in bits/sec */
 extern char	*progname;	/* Name of this program */
 extern int	redirect_stderr;/* Connector's stderr should go to file */
@@ -233,6 +236,8 @@ extern int	ngroups;	/* How many groups valid in groups */
 extern struct pppd_stats link_stats; /* byte/packet counts etc. for link */
 extern int	link_stats_valid; /* set if link_stats is valid */
 extern unsigned	link_connect_time; /* time the link was up for */
+extern unsigned	link_db_writes;	/* ppp database updates this session */
+extern unsigned	link_db_lock_waits; /* ppp database lock waits */
 extern int	using_pty;	/* using pty as device (notty or pty opt.) */
 extern int	log_to_fd;	/* logging to this fd as well as syslog */
 extern bool	log_default;	/* log_to_fd is default (stdout) */
@@ -324,6 +329,9 @@ extern char	*bundle_name;	/* bundle name for multilink */
 extern bool	dump_options;	/* print out option values */
 extern bool	dryrun;		/* check everything, print options, exit */
 extern int	child_wait;	/* # seconds to wait for children at end */
+extern int	db_hash_size;	/* # hash chains for a new ppp database */
+extern int	demand_queue_size; /* max bytes queued while dialling */
+extern int	demand_queue_age; /* max secs to hold frames while dialling */
 
 #ifdef MAXOCTETS
 extern unsigned int maxoctets;	     /* Maximum octetes per session (in bytes) */
@@ -493,6 +501,9 @@ void timeout __P((void (*func)(void *), void *arg, int s, int us));
 				/* Call func(arg) after s.us seconds */
 void untimeout __P((void (*func)(void *), void *arg));
 				/* Cancel call to func(arg) */
+void calltimeout __P((void));	/* Call any timeouts which are due */
+struct timeval *timeleft __P((struct timeval *));
+				/* Time until the next timeout is due */
 void record_child __P((int, char *, void (*) (void *), void *, int));
 pid_t safe_fork __P((int, int, int));	/* Fork & close stuff in child */
 int  device_script __P((char *cmd, int in, int out, int dont_wait));
@@ -507,6 +518,9 @@ void update_link_stats __P((int)); /* Get stats at link termination */
 void script_setenv __P((char *, char *, int));	/* set script env var */
 void script_unsetenv __P((char *));		/* unset script env var */
 void new_phase __P((int));	/* signal start of new phase */
+void select_unit __P((int));	/* switch to another unit's link state */
+int  open_unit __P((int));	/* bring up a link on another unit */
+void unit_input_ready __P((int)); /* a unit's channel has input */
 void add_notifier __P((struct notifier **, notify_func, void *));
 void remove_notifier __P((struct notifier **, notify_func, void *));
 void notify __P((struct notifier *, int));
@@ -514,8 +528,15 @@ int  ppp_send_config __P((int, int, u_int32_t, int, int));
 int  ppp_recv_config __P((int, int, u_int32_t, int, int));
 const char *protocol_name __P((int));
 void remove_pidfiles __P((void));
+void flush_db_entry __P((void));	/* write out changes to our db entry */
+
+/* Procedures exported from dblock.c. */
+int  open_lock_db __P((char *));	/* open the db for lock_db_key */
+void close_lock_db __P((void));
 void lock_db __P((void));
 void unlock_db __P((void));
+void lock_db_key __P((char *));	/* lock one key's part of the db */
+void unlock_db_key __P((char *));
 
 /* Procedures exported from tty.c. */
 void tty_init __P((void));
@@ -568,6 +589,9 @@ void auth_check_options __P((void));
 void auth_reset __P((int));	/* check what secrets we have */
 int  check_passwd __P((int, char *, int, char *, int, char **));
 				/* Check peer-supplied username/password */
+void pap_auth_complete __P((int, int, char *, struct wordlist *,
+			    struct wordlist *));
+				/* Result of a pending pap_auth_hook call */
 int  get_secret __P((int, char *, char *, char *, int *, int));
 				/* get "secret" for chap */
 int  get_srp_secret __P((int unit, char *client, char *server, char *secret,
@@ -605,6 +629,7 @@ int  str_to_epdisc __P((struct epdisc *, char *)); /* endpt disc. from str */
 /* Procedures exported from sys-*.c */
 void sys_init __P((void));	/* Do system-dependent initialization */
 void sys_cleanup __P((void));	/* Restore system state before exiting */
+void sys_select_unit __P((int, int)); /* Swap channel state between units */
 int  sys_check_options __P((void)); /* Check options specified */
 void sys_close __P((void));	/* Clean up in a child before execing */
 int  ppp_available __P((void));	/* Test whether ppp kernel support exists */
@@ -625,8 +650,13 @@ void setdtr __P((int, int));	/* Raise or lower port's DTR line */
 void output __P((int, u_char *, int)); /* Output a PPP packet */
 void wait_input __P((struct timeval *));
 				/* Wait for input, with timeout */
+int  get_time __P((struct timeval *));
+				/* Get current time, monotonic if possible */
 void add_fd __P((int));		/* Add fd to set to wait for */
+void add_fd_callback __P((int, void (*)(int, void *), void *));
+				/* Add fd with a callback for when readable */
 void remove_fd __P((int));	/* Remove fd from set to wait for */
+void run_fd_callbacks __P((void)); /* Call callbacks for ready fds */
 int  read_packet __P((u_char *)); /* Read PPP packet */
 int  get_loop_output __P((void)); /* Read pkts from loopback */
 void tty_send_config __P((int, u_int32_t, int, int));
@@ -646,7 +676,7 @@ int  get_ppp_stats __P((int, struct pppd_stats *));
 				/* Return link statistics */
 void netif_set_mtu __P((int, int)); /* Set PPP interface MTU */
 int  netif_get_mtu __P((int));      /* Get PPP interface MTU */
-int  sifvjcomp __P((int, int, int, int));
+int  sifvjcomp __P((int, int, int, int, int));
 				/* Configure VJ TCP header compression */
 int  sifup __P((int));		/* Configure i/f up for one protocol */
 int  sifnpmode __P((int u, int proto, enum NPmode mode));
@@ -728,6 +758,8 @@ extern int (*pap_check_hook) __P((void));
 extern int (*pap_auth_hook) __P((char *user, char *passwd, char **msgp,
 				 struct wordlist **paddrs,
 				 struct wordlist **popts));
+#define AUTH_PENDING	2	/* auth hook will give the result later */
+extern int auth_hook_unit;	/* unit an auth hook is being called for */
 extern void (*pap_logout_hook) __P((void));
 extern int (*pap_passwd_hook) __P((char *user, char *passwd));
 extern int (*allowed_address_hook) __P((u_int32_t addr));
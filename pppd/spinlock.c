@@ -368,8 +368,8 @@ int tdb_spinlock(TDB_CONTEXT *tdb, int list, int rw_type)
 {
 	tdb_rwlock_t *rwlocks;
 
-	if (!tdb->map_ptr) return -1;
-	rwlocks = (tdb_rwlock_t *)((char *)tdb->map_ptr + tdb->header.rwlocks);
+	if (!tdb->lock_ptr) return -1;
+	rwlocks = (tdb_rwlock_t *)tdb->lock_ptr;
 
 	switch(rw_type) {
 	case F_RDLCK:
@@ -391,8 +391,8 @@ int tdb_spinunlock(TDB_CONTEXT *tdb, int list, int rw_type)
 {
 	tdb_rwlock_t *rwlocks;
 
-	if (!tdb->map_ptr) return -1;
-	rwlocks = (tdb_rwlock_t *)((char *)tdb->map_ptr + tdb->header.rwlocks);
+	if (!tdb->lock_ptr) return -1;
+	rwlocks = (tdb_rwlock_t *)tdb->lock_ptr;
 
 	switch(rw_type) {
 	case F_RDLCK:
@@ -410,6 +410,12 @@ int tdb_spinunlock(TDB_CONTEXT *tdb, int list, int rw_type)
 	return 0;
 }
 
+/* there is no non-blocking form of these locks, so just wait */
+int tdb_spintrylock(TDB_CONTEXT *tdb, int list, int rw_type)
+{
+	return tdb_spinlock(tdb, list, rw_type);
+}
+
 int tdb_create_rwlocks(int fd, unsigned int hash_size)
 {
 	unsigned size, i;
@@ -441,19 +447,129 @@ int tdb_clear_spinlocks(TDB_CONTEXT *tdb)
 	unsigned i;
 
 	if (tdb->header.rwlocks == 0) return 0;
-	if (!tdb->map_ptr) return -1;
+	if (!tdb->lock_ptr) return -1;
 
 	/* We're mmapped here */
-	rwlocks = (tdb_rwlock_t *)((char *)tdb->map_ptr + tdb->header.rwlocks);
+	rwlocks = (tdb_rwlock_t *)tdb->lock_ptr;
 	for(i = 0; i < tdb->header.hash_size+1; i++) {
 		__spin_lock_init(&rwlocks[i].lock);
 		rwlocks[i].count = 0;
 	}
 	return 0;
 }
+#elif defined(USE_TDB_MUTEX)
+
+/*
+ * Linux robust mutexes.  These are futex based, so an uncontended
+ * lock or unlock is done entirely in user space, where an fcntl lock
+ * costs a system call each way.  Read locks are taken exclusively too;
+ * chain operations are short enough that this costs little.
+ */
+
+static int tdb_mutex_lock(pthread_mutex_t *m, int try)
+{
+	int ret;
+
+	ret = try? pthread_mutex_trylock(m): pthread_mutex_lock(m);
+	if (ret == EOWNERDEAD) {
+		/*
+		 * The previous holder died with the lock held.  The kernel
+		 * would just have dropped an fcntl lock in that case, so
+		 * we carry on in the same way.
+		 */
+		ret = pthread_mutex_consistent(m);
+	}
+	return ret;
+}
+
+/* lock a list in the database. list -1 is the alloc list */
+int tdb_spinlock(TDB_CONTEXT *tdb, int list, int rw_type)
+{
+	tdb_rwlock_t *rwlocks;
+
+	if (!tdb->lock_ptr) return -1;
+	rwlocks = (tdb_rwlock_t *)tdb->lock_ptr;
+
+	if (rw_type != F_RDLCK && rw_type != F_WRLCK)
+		return TDB_ERRCODE(TDB_ERR_LOCK, -1);
+	if (tdb_mutex_lock(&rwlocks[list+1].mutex, 0) != 0)
+		return TDB_ERRCODE(TDB_ERR_LOCK, -1);
+	return 0;
+}
+
+/* as tdb_spinlock, but fail rather than wait if the lock is held */
+int tdb_spintrylock(TDB_CONTEXT *tdb, int list, int rw_type)
+{
+	tdb_rwlock_t *rwlocks;
+
+	if (!tdb->lock_ptr) return -1;
+	rwlocks = (tdb_rwlock_t *)tdb->lock_ptr;
+
+	if (rw_type != F_RDLCK && rw_type != F_WRLCK)
+		return TDB_ERRCODE(TDB_ERR_LOCK, -1);
+	if (tdb_mutex_lock(&rwlocks[list+1].mutex, 1) != 0)
+		return TDB_ERRCODE(TDB_ERR_LOCK, -1);
+	return 0;
+}
+
+/* unlock the database. */
+int tdb_spinunlock(TDB_CONTEXT *tdb, int list, int rw_type)
+{
+	tdb_rwlock_t *rwlocks;
+
+	if (!tdb->lock_ptr) return -1;
+	rwlocks = (tdb_rwlock_t *)tdb->lock_ptr;
+
+	if (pthread_mutex_unlock(&rwlocks[list+1].mutex) != 0)
+		return TDB_ERRCODE(TDB_ERR_LOCK, -1);
+	return 0;
+}
+
+/* Reserve the space; tdb_clear_spinlocks initialises the mutexes in
+   place once the file is mapped. */
+int tdb_create_rwlocks(int fd, unsigned int hash_size)
+{
+	unsigned size;
+	char *zeros;
+
+	size = TDB_SPINLOCK_SIZE(hash_size);
+	zeros = calloc(size, 1);
+	if (!zeros)
+		return -1;
+	if (write(fd, zeros, size) != size) {
+		free(zeros);
+		return -1;
+	}
+	free(zeros);
+	return 0;
+}
+
+int tdb_clear_spinlocks(TDB_CONTEXT *tdb)
+{
+	tdb_rwlock_t *rwlocks;
+	pthread_mutexattr_t attr;
+	unsigned i;
+	int ret = 0;
+
+	if (tdb->header.rwlocks == 0) return 0;
+	if (!tdb->lock_ptr) return -1;
+
+	rwlocks = (tdb_rwlock_t *)tdb->lock_ptr;
+	if (pthread_mutexattr_init(&attr) != 0)
+		return -1;
+	if (pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) != 0
+	    || pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) != 0)
+		ret = -1;
+	for (i = 0; ret == 0 && i < tdb->header.hash_size+1; i++)
+		if (pthread_mutex_init(&rwlocks[i].mutex, &attr) != 0)
+			ret = -1;
+	pthread_mutexattr_destroy(&attr);
+	return ret;
+}
 #else
 int tdb_create_rwlocks(int fd, unsigned int hash_size) { return 0; }
 int tdb_spinlock(TDB_CONTEXT *tdb, int list, int rw_type) { return -1; }
+int tdb_spintrylock(TDB_CONTEXT *tdb, int list, int rw_type) { return -1; }
 int tdb_spinunlock(TDB_CONTEXT *tdb, int list, int rw_type) { return -1; }
 
 /* Non-spinlock version: remove spinlock pointer */
@@ -7,6 +7,11 @@
 
 #include "tdb.h"
 
+/* Chain lock types, as recorded in the header of files that have them */
+#define TDB_LOCK_NONE 0		/* fcntl locks only */
+#define TDB_LOCK_SPIN 1		/* spinlocks, see below */
+#define TDB_LOCK_MUTEX 2	/* process-shared robust pthread mutexes */
+
 #ifdef USE_SPINLOCKS
 
 #define RWLOCK_BIAS 0x1000UL
@@ -35,24 +40,50 @@ typedef struct {
 } tdb_rwlock_t;
 
 int tdb_spinlock(TDB_CONTEXT *tdb, int list, int rw_type);
+int tdb_spintrylock(TDB_CONTEXT *tdb, int list, int rw_type);
+int tdb_spinunlock(TDB_CONTEXT *tdb, int list, int rw_type);
+int tdb_create_rwlocks(int fd, unsigned int hash_size);
+int tdb_clear_spinlocks(TDB_CONTEXT *tdb);
+
+#define TDB_SPINLOCK_SIZE(hash_size) (((hash_size) + 1) * sizeof(tdb_rwlock_t))
+#define TDB_SPINLOCK_ALIGN 4
+#define TDB_LOCK_TYPE TDB_LOCK_SPIN
+
+#elif defined(USE_TDB_MUTEX)
+
+#include <pthread.h>
+
+/* Linux: a robust, process-shared mutex per chain, one per cache line */
+typedef union {
+	pthread_mutex_t mutex;
+	char pad[64];
+} tdb_rwlock_t;
+
+int tdb_spinlock(TDB_CONTEXT *tdb, int list, int rw_type);
+int tdb_spintrylock(TDB_CONTEXT *tdb, int list, int rw_type);
 int tdb_spinunlock(TDB_CONTEXT *tdb, int list, int rw_type);
 int tdb_create_rwlocks(int fd, unsigned int hash_size);
 int tdb_clear_spinlocks(TDB_CONTEXT *tdb);
 
 #define TDB_SPINLOCK_SIZE(hash_size) (((hash_size) + 1) * sizeof(tdb_rwlock_t))
+#define TDB_SPINLOCK_ALIGN 64
+#define TDB_LOCK_TYPE TDB_LOCK_MUTEX
 
-#else /* !USE_SPINLOCKS */
+#else /* !USE_SPINLOCKS && !USE_TDB_MUTEX */
 #if 0
 #define tdb_create_rwlocks(fd, hash_size) 0
 #define tdb_spinlock(tdb, list, rw_type) (-1)
 #define tdb_spinunlock(tdb, list, rw_type) (-1)
 #else
 int tdb_spinlock(TDB_CONTEXT *tdb, int list, int rw_type);
+int tdb_spintrylock(TDB_CONTEXT *tdb, int list, int rw_type);
 int tdb_spinunlock(TDB_CONTEXT *tdb, int list, int rw_type);
 int tdb_create_rwlocks(int fd, unsigned int hash_size);
 #endif
 int tdb_clear_spinlocks(TDB_CONTEXT *tdb);
 #define TDB_SPINLOCK_SIZE(hash_size) 0
+#define TDB_SPINLOCK_ALIGN 4
+#define TDB_LOCK_TYPE TDB_LOCK_NONE
 
 #endif
 
@@ -78,6 +78,7 @@
 #include <sys/stat.h>
 #include <sys/utsname.h>
 #include <sys/sysmacros.h>
+#include <sys/epoll.h>
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -188,8 +189,36 @@ int ppp_dev_fd = -1;		/* fd for /dev/ppp (new style driver) */
 
 static int chindex;		/* channel index (new style driver) */
 
+/*
+ * The set of fds that wait_input waits for.  We use epoll where the
+ * kernel supports it, which has no limit on the fd number and doesn't
+ * rescan the whole set on every wakeup; otherwise we fall back to select.
+ */
+static int epoll_fd = -1;	/* fd from epoll_create, or -1 for select */
 static fd_set in_fds;		/* set of fds that wait_input waits for */
 static int max_in_fd;		/* highest fd set in in_fds */
+static int n_select_fds;	/* # fds in in_fds that epoll refused */
+
+#define MAX_EPOLL_EVENTS	32
+
+/*
+ * Per-fd callbacks, indexed by fd.  Fds added with add_fd have a NULL
+ * func and are handled by the main loop polling get_input.  Each is
+ * run on the unit that added it.
+ */
+struct fd_callback {
+    void	(*func) __P((int, void *));
+    void	*arg;
+    int		unit;
+    int		active;
+    int		selected;	/* in in_fds rather than epoll_fd */
+};
+
+static struct fd_callback *fd_callbacks;
+static int n_fd_callbacks;	/* # entries allocated in fd_callbacks */
+
+static int ready_fds[MAX_EPOLL_EVENTS];	/* fds found ready by wait_input */
+static int n_ready_fds;
 
 static int has_proxy_arp       = 0;
 static int driver_version      = 0;
@@ -214,6 +243,26 @@ static int	dynaddr_set;		/* 1 if ip_dynaddr set */
 static int	looped;			/* 1 if using loop */
 static int	link_mtu;		/* mtu for the link (not bundle) */
 
+/*
+ * The channel and interface state of each unit.  The variables above
+ * hold the current unit's, and sys_select_unit swaps them.
+ */
+static struct sys_unit {
+    int		ppp_fd;
+    int		ppp_dev_fd;
+    int		chindex;
+    int		initfdflags;
+    int		if_is_up;
+    int		if6_is_up;
+    int		have_default_route;
+    int		has_proxy_arp;
+    u_int32_t	proxy_arp_addr;
+    char	proxy_arp_dev[16];
+    u_int32_t	our_old_addr;
+    int		looped;
+    int		link_mtu;
+} sys_units[NUM_PPP];
+
 static struct utsname utsname;	/* for the kernel version */
 static int kernel_version;
 #define KVERSION(j,n,p)	((j)*1000000 + (n)*1000 + (p))
@@ -311,6 +360,8 @@ static int modify_flags(int fd, int clear_bits, int set_bits)
 
 void sys_init(void)
 {
+    int i;
+
     /* Get an internet socket for doing socket ioctls. */
     sock_fd = socket(AF_INET, SOCK_DGRAM, 0);
     if (sock_fd < 0)
@@ -322,8 +373,22 @@ void sys_init(void)
 	sock6_fd = -errno;	/* save errno for later */
 #endif
 
+    for (i = 0; i < NUM_PPP; ++i) {
+	sys_units[i].ppp_fd = -1;
+	sys_units[i].ppp_dev_fd = -1;
+	sys_units[i].initfdflags = -1;
+    }
+
     FD_ZERO(&in_fds);
     max_in_fd = 0;
+
+#ifdef EPOLL_CLOEXEC
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    epoll_fd = epoll_create(MAX_EPOLL_EVENTS);
+#endif
+    if (epoll_fd < 0)
+	dbglog("epoll unavailable (%m), using select");
 }
 
 /********************************************************************
@@ -340,19 +405,58 @@ void sys_cleanup(void)
  */
     if (if_is_up) {
 	if_is_up = 0;
-	sifdown(0);
+	sifdown(cur_unit);
     }
     if (if6_is_up)
-	sif6down(0);
+	sif6down(cur_unit);
 
 /*
  * Delete any routes through the device.
  */
     if (have_default_route)
-	cifdefaultroute(0, 0, 0);
+	cifdefaultroute(cur_unit, 0, 0);
 
     if (has_proxy_arp)
-	cifproxyarp(0, proxy_arp_addr);
+	cifproxyarp(cur_unit, proxy_arp_addr);
+}
+
+/********************************************************************
+ *
+ * sys_select_unit - put away the channel and interface state of unit
+ * old and fetch that of unit new.
+ */
+void sys_select_unit(int old, int new)
+{
+    struct sys_unit *su = &sys_units[old];
+
+    su->ppp_fd = ppp_fd;
+    su->ppp_dev_fd = ppp_dev_fd;
+    su->chindex = chindex;
+    su->initfdflags = initfdflags;
+    su->if_is_up = if_is_up;
+    su->if6_is_up = if6_is_up;
+    su->have_default_route = have_default_route;
+    su->has_proxy_arp = has_proxy_arp;
+    su->proxy_arp_addr = proxy_arp_addr;
+    memcpy(su->proxy_arp_dev, proxy_arp_dev, sizeof(proxy_arp_dev));
+    su->our_old_addr = our_old_addr;
+    su->looped = looped;
+    su->link_mtu = link_mtu;
+
+    su = &sys_units[new];
+    ppp_fd = su->ppp_fd;
+    ppp_dev_fd = su->ppp_dev_fd;
+    chindex = su->chindex;
+    initfdflags = su->initfdflags;
+    if_is_up = su->if_is_up;
+    if6_is_up = su->if6_is_up;
+    have_default_route = su->have_default_route;
+    has_proxy_arp = su->has_proxy_arp;
+    proxy_arp_addr = su->proxy_arp_addr;
+    memcpy(proxy_arp_dev, su->proxy_arp_dev, sizeof(proxy_arp_dev));
+    our_old_addr = su->our_old_addr;
+    looped = su->looped;
+    link_mtu = su->link_mtu;
 }
 
 /********************************************************************
@@ -362,8 +466,13 @@ void sys_cleanup(void)
 void
 sys_close(void)
 {
+    int i;
+
     if (new_style_driver && ppp_dev_fd >= 0)
 	close(ppp_dev_fd);
+    for (i = 0; i < NUM_PPP; ++i)
+	if (i != cur_unit && new_style_driver && sys_units[i].ppp_dev_fd >= 0)
+	    close(sys_units[i].ppp_dev_fd);
     if (sock_fd >= 0)
 	close(sock_fd);
 #ifdef INET6
@@ -374,6 +483,10 @@ sys_close(void)
 	close(slave_fd);
     if (master_fd >= 0)
 	close(master_fd);
+    if (epoll_fd >= 0) {
+	close(epoll_fd);
+	epoll_fd = -1;
+    }
 }
 
 /********************************************************************
@@ -1068,6 +1181,31 @@ void output (int unit, unsigned char *p, int len)
     }
 }
 
+/********************************************************************
+ *
+ * get_time - get the current time for timeouts.  We use the
+ * monotonic clock where possible, so that stepping the system clock
+ * doesn't make timeouts fire early or not at all.
+ */
+int get_time(struct timeval *tv)
+{
+#ifdef CLOCK_MONOTONIC
+    static int monotonic_ok = 1;
+    struct timespec ts;
+
+    if (monotonic_ok) {
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+	    tv->tv_sec = ts.tv_sec;
+	    tv->tv_usec = ts.tv_nsec / 1000;
+	    return 0;
+	}
+	/* not supported by the kernel; don't keep trying */
+	monotonic_ok = 0;
+    }
+#endif
+    return gettimeofday(tv, NULL);
+}
+
 /********************************************************************
  *
  * wait_input - wait until there is data available,
@@ -1078,25 +1216,146 @@ void output (int unit, unsigned char *p, int len)
 void wait_input(struct timeval *timo)
 {
     fd_set ready, exc;
-    int n;
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int n, i, t;
+
+    n_ready_fds = 0;
+    if (epoll_fd >= 0 && n_select_fds == 0) {
+	t = -1;
+	if (timo != NULL)	/* round up so we don't spin on a short wait */
+	    t = timo->tv_sec * 1000 + (timo->tv_usec + 999) / 1000;
+	n = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS, t);
+	if (n < 0 && errno != EINTR)
+	    fatal("epoll_wait: %m");
+	for (i = 0; i < n; ++i)
+	    ready_fds[n_ready_fds++] = events[i].data.fd;
+	return;
+    }
 
+    /*
+     * Either there is no epoll, or some fds couldn't go in it; in
+     * the latter case the epoll fd itself is waited for with them.
+     */
     ready = in_fds;
     exc = in_fds;
-    n = select(max_in_fd + 1, &ready, NULL, &exc, timo);
+    t = max_in_fd;
+    if (epoll_fd >= 0) {
+	FD_SET(epoll_fd, &ready);
+	if (epoll_fd > t)
+	    t = epoll_fd;
+    }
+    n = select(t + 1, &ready, NULL, &exc, timo);
     if (n < 0 && errno != EINTR)
 	fatal("select: %m");
+    for (i = 0; n > 0 && i <= max_in_fd; ++i) {
+	if (i == epoll_fd || (!FD_ISSET(i, &ready) && !FD_ISSET(i, &exc)))
+	    continue;
+	--n;
+	if (i < n_fd_callbacks && n_ready_fds < MAX_EPOLL_EVENTS)
+	    ready_fds[n_ready_fds++] = i;
+    }
+    if (epoll_fd >= 0 && n > 0 && FD_ISSET(epoll_fd, &ready)) {
+	n = epoll_wait(epoll_fd, events, MAX_EPOLL_EVENTS - n_ready_fds, 0);
+	for (i = 0; i < n; ++i)
+	    ready_fds[n_ready_fds++] = events[i].data.fd;
+    }
 }
 
 /*
- * add_fd - add an fd to the set that wait_input waits for.
+ * run_fd_callbacks - call the callback for each fd that wait_input
+ * found ready, on the unit that added it, and tell the main loop
+ * which units have input on fds added with add_fd.  This is done
+ * outside wait_input so that the callbacks run with signals handled
+ * normally (not longjmp'd out of).
  */
-void add_fd(int fd)
+void run_fd_callbacks(void)
+{
+    int i, fd, unit = cur_unit;
+    struct fd_callback *fcb;
+
+    for (i = 0; i < n_ready_fds; ++i) {
+	fd = ready_fds[i];
+	if (fd < 0 || fd >= n_fd_callbacks)
+	    continue;
+	fcb = &fd_callbacks[fd];
+	/* it may have been removed by an earlier callback */
+	if (!fcb->active)
+	    continue;
+	if (fcb->func == NULL) {
+	    unit_input_ready(fcb->unit);
+	    continue;
+	}
+	select_unit(fcb->unit);
+	(*fcb->func)(fd, fcb->arg);
+    }
+    n_ready_fds = 0;
+    select_unit(unit);
+}
+
+/*
+ * add_fd_callback - add an fd to the set that wait_input waits for,
+ * arranging for func(fd, arg) to be called when it becomes readable.
+ */
+void add_fd_callback(int fd, void (*func)(int, void *), void *arg)
 {
+    struct epoll_event ev;
+    struct fd_callback *fcb;
+    int n;
+
+    if (fd < 0)
+	return;
+    if (fd >= n_fd_callbacks) {
+	n = n_fd_callbacks? n_fd_callbacks: 64;
+	while (n <= fd)
+	    n *= 2;
+	fcb = realloc(fd_callbacks, n * sizeof(*fcb));
+	if (fcb == NULL)
+	    novm("fd callback table");
+	memset(fcb + n_fd_callbacks, 0,
+	       (n - n_fd_callbacks) * sizeof(*fcb));
+	fd_callbacks = fcb;
+	n_fd_callbacks = n;
+    }
+    fcb = &fd_callbacks[fd];
+    fcb->func = func;
+    fcb->arg = arg;
+    fcb->unit = cur_unit;
+
+    if (epoll_fd >= 0) {
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN | EPOLLPRI;
+	ev.data.fd = fd;
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == 0) {
+	    fcb->active = 1;
+	    return;
+	}
+	/* a stale registration may survive if the fd was closed
+	   while dup'd; just replace it */
+	if (errno == EEXIST
+	    && epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) == 0) {
+	    fcb->active = 1;
+	    return;
+	}
+	/* regular files and some ttys can't be polled this way */
+	if (errno != EPERM)
+	    fatal("epoll_ctl add %d: %m", fd);
+	fcb->selected = 1;
+	++n_select_fds;
+    }
     if (fd >= FD_SETSIZE)
 	fatal("internal error: file descriptor too large (%d)", fd);
     FD_SET(fd, &in_fds);
     if (fd > max_in_fd)
 	max_in_fd = fd;
+    fcb->active = 1;
+}
+
+/*
+ * add_fd - add an fd to the set that wait_input waits for.
+ */
+void add_fd(int fd)
+{
+    add_fd_callback(fd, NULL, NULL);
 }
 
 /*
@@ -1104,7 +1363,26 @@ void add_fd(int fd)
  */
 void remove_fd(int fd)
 {
-    FD_CLR(fd, &in_fds);
+    struct epoll_event ev;
+    int selected = 0;
+
+    if (fd < 0)
+	return;
+    if (fd < n_fd_callbacks) {
+	if (!fd_callbacks[fd].active)
+	    return;
+	selected = fd_callbacks[fd].selected;
+	memset(&fd_callbacks[fd], 0, sizeof(fd_callbacks[fd]));
+    }
+    if (selected) {
+	FD_CLR(fd, &in_fds);
+	--n_select_fds;
+    } else if (epoll_fd >= 0) {
+	/* fails harmlessly if the fd has already been closed */
+	memset(&ev, 0, sizeof(ev));
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &ev);
+    } else if (fd < FD_SETSIZE)
+	FD_CLR(fd, &in_fds);
 }
 
 
@@ -2243,15 +2521,26 @@ void logwtmp (const char *line, const char *name, const char *host)
 
 /********************************************************************
  *
- * sifvjcomp - config tcp header compression
+ * sifvjcomp - config tcp header compression.  maxcid is the highest
+ * slot index to use for sending, rmaxcid the highest the peer may send.
+ * PPPIOCSMAXCID takes the receive index in the top 16 bits; if they
+ * are 0 the kernel uses 15.  slhc_init rejects more than 255 slots.
  */
 
-int sifvjcomp (int u, int vjcomp, int cidcomp, int maxcid)
+#define VJ_MAX_KERNEL_CID	254
+
+int sifvjcomp (int u, int vjcomp, int cidcomp, int maxcid, int rmaxcid)
 {
 	u_int x;
+	int cids;
 
 	if (vjcomp) {
-		if (ioctl(ppp_dev_fd, PPPIOCSMAXCID, (caddr_t) &maxcid) < 0) {
+		if (maxcid > VJ_MAX_KERNEL_CID)
+			maxcid = VJ_MAX_KERNEL_CID;
+		if (rmaxcid > VJ_MAX_KERNEL_CID)
+			rmaxcid = VJ_MAX_KERNEL_CID;
+		cids = (rmaxcid << 16) | maxcid;
+		if (ioctl(ppp_dev_fd, PPPIOCSMAXCID, (caddr_t) &cids) < 0) {
 			error("Couldn't set up TCP header compression: %m");
 			vjcomp = 0;
 		}
@@ -104,6 +104,7 @@
 #include <utmpx.h>
 #include <stropts.h>
 #include <sys/types.h>
+#include <sys/time.h>
 #include <sys/ioccom.h>
 #include <sys/stream.h>
 #include <sys/stropts.h>
@@ -134,6 +135,14 @@
 #include "ipcp.h"
 #include "ccp.h"
 
+/*
+ * The control stream, IP muxes and interface state below are one per
+ * process, opened in sys_init.
+ */
+#if NUM_PPP > 1
+#error "Only one PPP unit per process is supported on Solaris"
+#endif
+
 #if !defined(PPP_DRV_NAME)
 #define PPP_DRV_NAME	"ppp"
 #endif /* !defined(PPP_DRV_NAME) */
@@ -228,6 +237,12 @@ extern u_char	inpacket_buf[];	/* borrowed from main.c */
 static struct pollfd pollfds[MAX_POLLFDS];
 static int n_pollfds;
 
+/* Callbacks for the fds in pollfds[] (NULL for plain add_fd) */
+static struct {
+    void	(*func) __P((int, void *));
+    void	*arg;
+} pollfd_callbacks[MAX_POLLFDS];
+
 static int	link_mtu, link_mru;
 
 #define NMODULES	32
@@ -838,6 +853,16 @@ sys_cleanup()
 #endif /* defined(SOL2) */
 }
 
+/*
+ * sys_select_unit - switch to another unit's channel state.  There is
+ * only the one unit here; see the check on NUM_PPP above.
+ */
+void
+sys_select_unit(old, new)
+    int old, new;
+{
+}
+
 /*
  * sys_close - Clean up in a child process before execing.
  */
@@ -1359,6 +1384,21 @@ output(unit, p, len)
 }
 
 
+/*
+ * get_time - get the current time for timeouts.
+ */
+int
+get_time(tv)
+    struct timeval *tv;
+{
+    hrtime_t t;
+
+    t = gethrtime();
+    tv->tv_sec = t / NANOSEC;
+    tv->tv_usec = (t % NANOSEC) / 1000;
+    return 0;
+}
+
 /*
  * wait_input - wait until there is data available,
  * for the length of time specified by *timo (indefinite
@@ -1368,13 +1408,64 @@ void
 wait_input(timo)
     struct timeval *timo;
 {
-    int t;
+    int t, n;
 
+    for (n = 0; n < n_pollfds; ++n)
+	pollfds[n].revents = 0;
     t = timo == NULL? -1: timo->tv_sec * 1000 + timo->tv_usec / 1000;
     if (poll(pollfds, n_pollfds, t) < 0 && errno != EINTR)
 	fatal("poll: %m");
 }
 
+/*
+ * run_fd_callbacks - call the callback for each fd that wait_input
+ * found ready.
+ */
+void
+run_fd_callbacks()
+{
+    int n, fd;
+
+    for (n = 0; n < n_pollfds; ++n) {
+	if (pollfds[n].revents == 0 || pollfd_callbacks[n].func == NULL)
+	    continue;
+	pollfds[n].revents = 0;
+	fd = pollfds[n].fd;
+	(*pollfd_callbacks[n].func)(fd, pollfd_callbacks[n].arg);
+	/* the callback may have removed entries; resynchronize */
+	while (n >= 0 && (n >= n_pollfds || pollfds[n].fd != fd))
+	    --n;
+    }
+}
+
+/*
+ * add_fd_callback - add an fd to the set that wait_input waits for,
+ * arranging for func(fd, arg) to be called when it becomes readable.
+ */
+void add_fd_callback(fd, func, arg)
+    int fd;
+    void (*func) __P((int, void *));
+    void *arg;
+{
+    int n;
+
+    for (n = 0; n < n_pollfds; ++n)
+	if (pollfds[n].fd == fd)
+	    break;
+    if (n == n_pollfds) {
+	if (n_pollfds >= MAX_POLLFDS) {
+	    error("Too many inputs!");
+	    return;
+	}
+	pollfds[n].fd = fd;
+	pollfds[n].events = POLLIN | POLLPRI | POLLHUP;
+	pollfds[n].revents = 0;
+	++n_pollfds;
+    }
+    pollfd_callbacks[n].func = func;
+    pollfd_callbacks[n].arg = arg;
+}
+
 /*
  * add_fd - add an fd to the set that wait_input waits for.
  */
@@ -1386,12 +1477,7 @@ void add_fd(fd)
     for (n = 0; n < n_pollfds; ++n)
 	if (pollfds[n].fd == fd)
 	    return;
-    if (n_pollfds < MAX_POLLFDS) {
-	pollfds[n_pollfds].fd = fd;
-	pollfds[n_pollfds].events = POLLIN | POLLPRI | POLLHUP;
-	++n_pollfds;
-    } else
-	error("Too many inputs!");
+    add_fd_callback(fd, NULL, NULL);
 }
 
 /*
@@ -1404,8 +1490,10 @@ void remove_fd(fd)
 
     for (n = 0; n < n_pollfds; ++n) {
 	if (pollfds[n].fd == fd) {
-	    while (++n < n_pollfds)
+	    while (++n < n_pollfds) {
 		pollfds[n-1] = pollfds[n];
+		pollfd_callbacks[n-1] = pollfd_callbacks[n];
+	    }
 	    --n_pollfds;
 	    break;
 	}
@@ -1734,15 +1822,15 @@ ccp_fatal_error(unit)
  * sifvjcomp - config tcp header compression
  */
 int
-sifvjcomp(u, vjcomp, xcidcomp, xmaxcid)
-    int u, vjcomp, xcidcomp, xmaxcid;
+sifvjcomp(u, vjcomp, xcidcomp, xmaxcid, rmaxcid)
+    int u, vjcomp, xcidcomp, xmaxcid, rmaxcid;
 {
     int cf[2];
     char maxcid[2];
 
     if (vjcomp) {
-	maxcid[0] = xcidcomp;
-	maxcid[1] = 15;		/* XXX should be rmaxcid */
+	maxcid[0] = xmaxcid;
+	maxcid[1] = rmaxcid;
 	if (strioctl(pppfd, PPPIO_VJINIT, maxcid, sizeof(maxcid), 0) < 0) {
 	    error("Couldn't initialize VJ compression: %m");
 	}
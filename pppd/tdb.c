@@ -61,12 +61,16 @@
 
 #define TDB_MAGIC_FOOD "TDB file\n"
 #define TDB_VERSION (0x26011967 + 6)
+#define TDB_VERSION_JENKINS (0x26011967 + 7) /* older code can't read these */
+#define TDB_VERSION_OK(v) ((v) == TDB_VERSION || (v) == TDB_VERSION_JENKINS)
 #define TDB_MAGIC (0x26011999U)
 #define TDB_FREE_MAGIC (~TDB_MAGIC)
 #define TDB_DEAD_MAGIC (0xFEE1DEAD)
 #define TDB_ALIGNMENT 4
 #define MIN_REC_SIZE (2*sizeof(struct list_struct) + TDB_ALIGNMENT)
 #define DEFAULT_HASH_SIZE 131
+#define TDB_HASH_DEFAULT 0	/* default_tdb_hash; also older databases */
+#define TDB_HASH_JENKINS 1	/* jenkins_tdb_hash */
 #define TDB_PAGE_SIZE 0x2000
 #define FREELIST_TOP (sizeof(struct tdb_header))
 #define TDB_ALIGN(x,a) (((x) + (a)-1) & ~((a)-1))
@@ -74,7 +78,10 @@
 #define TDB_DEAD(r) ((r)->magic == TDB_DEAD_MAGIC)
 #define TDB_BAD_MAGIC(r) ((r)->magic != TDB_MAGIC && !TDB_DEAD(r))
 #define TDB_HASH_TOP(hash) (FREELIST_TOP + (BUCKET(hash)+1)*sizeof(tdb_off))
-#define TDB_DATA_START(hash_size) (TDB_HASH_TOP(hash_size-1) + TDB_SPINLOCK_SIZE(hash_size))
+#define TDB_SPINLOCK_TOP(hash_size) \
+	TDB_ALIGN(FREELIST_TOP + ((hash_size)+1)*sizeof(tdb_off), TDB_SPINLOCK_ALIGN)
+#define TDB_DATA_START(hash_size) \
+	(TDB_SPINLOCK_TOP(hash_size) + TDB_SPINLOCK_SIZE(hash_size) - sizeof(tdb_off))
 
 
 /* NB assumes there is a local variable called "tdb" that is the
@@ -149,6 +156,47 @@ static void tdb_mmap(TDB_CONTEXT *tdb)
 #endif
 }
 
+/* The chain locks get their own mapping, made once at open, because
+   the main mapping moves whenever the file grows and some lock types
+   (robust mutexes) must stay at the same address while they are
+   held. */
+static int tdb_map_locks(TDB_CONTEXT *tdb)
+{
+	if (tdb->header.rwlocks == 0 || tdb->read_only)
+		return 0;
+#ifdef HAVE_MMAP
+	tdb->lock_map_size = tdb->header.rwlocks
+		+ TDB_SPINLOCK_SIZE(tdb->header.hash_size);
+	if (tdb->map_size < tdb->lock_map_size) {
+		TDB_LOG((tdb, 0, "tdb_map_locks: file too short for locks\n"));
+		return -1;
+	}
+	tdb->lock_map = mmap(NULL, tdb->lock_map_size, PROT_READ|PROT_WRITE,
+			     MAP_SHARED|MAP_FILE, tdb->fd, 0);
+	if (tdb->lock_map == MAP_FAILED) {
+		TDB_LOG((tdb, 0, "tdb_map_locks failed for size %d (%s)\n", 
+			 tdb->lock_map_size, strerror(errno)));
+		tdb->lock_map = NULL;
+		return -1;
+	}
+	tdb->lock_ptr = (char *)tdb->lock_map + tdb->header.rwlocks;
+	return 0;
+#else
+	TDB_LOG((tdb, 0, "tdb_map_locks: spinlocks need mmap\n"));
+	return -1;
+#endif
+}
+
+static void tdb_unmap_locks(TDB_CONTEXT *tdb)
+{
+#ifdef HAVE_MMAP
+	if (tdb->lock_map)
+		munmap(tdb->lock_map, tdb->lock_map_size);
+#endif
+	tdb->lock_map = NULL;
+	tdb->lock_ptr = NULL;
+}
+
 /* Endian conversion: we only ever deal with 4 byte quantities */
 static void *convert(void *buf, u32 size)
 {
@@ -252,8 +300,10 @@ static int tdb_brlock(TDB_CONTEXT *tdb, tdb_off offset,
 	return 0;
 }
 
-/* lock a list in the database. list -1 is the alloc list */
-static int tdb_lock(TDB_CONTEXT *tdb, int list, int ltype)
+/* lock a list in the database. list -1 is the alloc list.
+   op is F_SETLKW to wait for the lock or F_SETLK to fail at once if
+   another process holds it */
+static int _tdb_lock(TDB_CONTEXT *tdb, int list, int ltype, int op)
 {
 	if (list < -1 || list >= (int)tdb->header.hash_size) {
 		TDB_LOG((tdb, 0,"tdb_lock: invalid list %d for ltype=%d\n", 
@@ -267,13 +317,17 @@ static int tdb_lock(TDB_CONTEXT *tdb, int list, int ltype)
 	   and simply bump the count for future ones */
 	if (tdb->locked[list+1].count == 0) {
 		if (!tdb->read_only && tdb->header.rwlocks) {
-			if (tdb_spinlock(tdb, list, ltype)) {
+			if (op == F_SETLK) {
+				if (tdb_spintrylock(tdb, list, ltype))
+					return -1;
+			} else if (tdb_spinlock(tdb, list, ltype)) {
 				TDB_LOG((tdb, 0, "tdb_lock spinlock failed on list %d ltype=%d\n", 
 					   list, ltype));
 				return -1;
 			}
-		} else if (tdb_brlock(tdb,FREELIST_TOP+4*list,ltype,F_SETLKW, 0)) {
-			TDB_LOG((tdb, 0,"tdb_lock failed on list %d ltype=%d (%s)\n", 
+		} else if (tdb_brlock(tdb,FREELIST_TOP+4*list,ltype,op, 0)) {
+			if (op == F_SETLKW)
+				TDB_LOG((tdb, 0,"tdb_lock failed on list %d ltype=%d (%s)\n", 
 					   list, ltype, strerror(errno)));
 			return -1;
 		}
@@ -283,6 +337,11 @@ static int tdb_lock(TDB_CONTEXT *tdb, int list, int ltype)
 	return 0;
 }
 
+static int tdb_lock(TDB_CONTEXT *tdb, int list, int ltype)
+{
+	return _tdb_lock(tdb, list, ltype, F_SETLKW);
+}
+
 /* unlock the database: returns void because it's too late for errors. */
 	/* changed to return int it may be interesting to know there
 	   has been an error  --simo */
@@ -932,6 +991,14 @@ static int tdb_new_database(TDB_CONTEXT *tdb, int hash_size)
 	/* Fill in the header */
 	newdb->version = TDB_VERSION;
 	newdb->hash_size = hash_size;
+	/* Record the hash function, unless the caller supplies its own.
+	   Jenkins-hashed files get their own version number, so that
+	   code which only knows the default hash refuses to open them
+	   rather than missing every key. */
+	if (tdb->hash_fn == NULL) {
+		newdb->version = TDB_VERSION_JENKINS;
+		newdb->hash_type = TDB_HASH_JENKINS;
+	}
 	if (tdb->flags & TDB_INTERNAL) {
 		tdb->map_size = size;
 		tdb->map_ptr = (char *)newdb;
@@ -940,6 +1007,13 @@ static int tdb_new_database(TDB_CONTEXT *tdb, int hash_size)
 		CONVERT(*newdb);
 		return 0;
 	}
+	/* The chain locks, if any, follow the hash table.  Record what
+	   they are, so that code built with other locks can tell. */
+	if (TDB_SPINLOCK_SIZE(hash_size) != 0) {
+		newdb->rwlocks = TDB_SPINLOCK_TOP(hash_size);
+		newdb->lock_type = TDB_LOCK_TYPE;
+		newdb->lock_size = TDB_SPINLOCK_SIZE(0);
+	}
 	if (lseek(tdb->fd, 0, SEEK_SET) == -1)
 		goto fail;
 
@@ -953,6 +1027,9 @@ static int tdb_new_database(TDB_CONTEXT *tdb, int hash_size)
 	memcpy(newdb->magic_food, TDB_MAGIC_FOOD, strlen(TDB_MAGIC_FOOD)+1);
 	if (write(tdb->fd, newdb, size) != size)
 		ret = -1;
+	else if (TDB_SPINLOCK_SIZE(hash_size) != 0
+		 && lseek(tdb->fd, TDB_SPINLOCK_TOP(hash_size), SEEK_SET) == -1)
+		ret = -1;
 	else
 		ret = tdb_create_rwlocks(tdb->fd, hash_size);
 
@@ -1656,6 +1733,25 @@ static u32 default_tdb_hash(TDB_DATA *key)
 	return (1103515243 * value + 12345);  
 }
 
+/* Bob Jenkins' one-at-a-time hash, which mixes every byte of the key
+   into every bit of the result; keys that differ only slightly (such
+   as "pppd1234" and "pppd1235") spread well over the chains */
+static u32 jenkins_tdb_hash(TDB_DATA *key)
+{
+	u32 value = 0x9e3779b9;
+	size_t i;
+
+	for (i = 0; i < key->dsize; i++) {
+		value += (unsigned char)key->dptr[i];
+		value += value << 10;
+		value ^= value >> 6;
+	}
+	value += value << 3;
+	value ^= value >> 11;
+	value += value << 15;
+	return value;
+}
+
 /* open the database, creating it if necessary 
 
    The open_flags and mode are passed straight to the open call on the
@@ -1680,7 +1776,7 @@ TDB_CONTEXT *tdb_open_ex(const char *name, int hash_size, int tdb_flags,
 {
 	TDB_CONTEXT *tdb;
 	struct stat st;
-	int rev = 0, locked = 0;
+	int rev = 0, locked = 0, created = 0;
 	unsigned char *vp;
 	u32 vertest;
 
@@ -1695,7 +1791,7 @@ TDB_CONTEXT *tdb_open_ex(const char *name, int hash_size, int tdb_flags,
 	tdb->flags = tdb_flags;
 	tdb->open_flags = open_flags;
 	tdb->log_fn = log_fn;
-	tdb->hash_fn = hash_fn ? hash_fn : default_tdb_hash;
+	tdb->hash_fn = hash_fn;	/* or chosen from the header below */
 
 	if ((open_flags & O_ACCMODE) == O_WRONLY) {
 		TDB_LOG((tdb, 0, "tdb_open_ex: can't open tdb %s write-only\n",
@@ -1751,19 +1847,20 @@ TDB_CONTEXT *tdb_open_ex(const char *name, int hash_size, int tdb_flags,
 
 	if (read(tdb->fd, &tdb->header, sizeof(tdb->header)) != sizeof(tdb->header)
 	    || strcmp(tdb->header.magic_food, TDB_MAGIC_FOOD) != 0
-	    || (tdb->header.version != TDB_VERSION
-		&& !(rev = (tdb->header.version==TDB_BYTEREV(TDB_VERSION))))) {
+	    || (!TDB_VERSION_OK(tdb->header.version)
+		&& !(rev = TDB_VERSION_OK(TDB_BYTEREV(tdb->header.version))))) {
 		/* its not a valid database - possibly initialise it */
 		if (!(open_flags & O_CREAT) || tdb_new_database(tdb, hash_size) == -1) {
 			errno = EIO; /* ie bad format or something */
 			goto fail;
 		}
 		rev = (tdb->flags & TDB_CONVERT);
+		created = 1;
 	}
 	vp = (unsigned char *)&tdb->header.version;
 	vertest = (((u32)vp[0]) << 24) | (((u32)vp[1]) << 16) |
 		  (((u32)vp[2]) << 8) | (u32)vp[3];
-	tdb->flags |= (vertest==TDB_VERSION) ? TDB_BIGENDIAN : 0;
+	tdb->flags |= TDB_VERSION_OK(vertest) ? TDB_BIGENDIAN : 0;
 	if (!rev)
 		tdb->flags &= ~TDB_CONVERT;
 	else {
@@ -1799,6 +1896,43 @@ TDB_CONTEXT *tdb_open_ex(const char *name, int hash_size, int tdb_flags,
 		goto fail;
 	}
 	tdb_mmap(tdb);
+	/* Chain locks of another kind (or size) can't be used here, and
+	   taking fcntl locks instead would not exclude the processes
+	   that do use them.  Nor can a read-only opener take them, as
+	   locking writes to the lock area, so it would read chains that
+	   are half way through being changed. */
+	if (tdb->header.rwlocks != 0 && tdb->read_only) {
+		TDB_LOG((tdb, 0, "tdb_open_ex: %s has chain locks, which "
+			 "can't be taken read-only\n", name));
+		errno = EACCES;
+		goto fail;
+	}
+	if (tdb->header.rwlocks != 0
+	    && (tdb->header.lock_type != TDB_LOCK_TYPE
+		|| tdb->header.lock_size != TDB_SPINLOCK_SIZE(0))) {
+		TDB_LOG((tdb, 0, "tdb_open_ex: %s has chain locks of type %u "
+			 "size %u, which this tdb can't use\n", name,
+			 tdb->header.lock_type, tdb->header.lock_size));
+		errno = EIO;
+		goto fail;
+	}
+	if (tdb_map_locks(tdb) == -1) {
+		errno = EIO;
+		goto fail;
+	}
+	/* The chain locks live in the file, so after a crash or reboot
+	   they can be left held by processes that are gone.  Whoever
+	   opens the file first starts them afresh, as CLEAR_IF_FIRST
+	   does for the whole database; everyone else holds ACTIVE_LOCK
+	   below to show that theirs are in use. */
+	if (tdb->header.rwlocks != 0 && !locked
+	    && !(tdb->flags & TDB_NOLOCK))
+		locked = (tdb_brlock(tdb, ACTIVE_LOCK, F_WRLCK, F_SETLK, 0) == 0);
+	if (created && !locked && !tdb->read_only
+	    && tdb_clear_spinlocks(tdb) != 0) {
+		TDB_LOG((tdb, 0, "tdb_open_ex: failed to initialise spinlocks\n"));
+		goto fail;
+	}
 	if (locked) {
 		if (!tdb->read_only)
 			if (tdb_clear_spinlocks(tdb) != 0) {
@@ -1819,7 +1953,7 @@ TDB_CONTEXT *tdb_open_ex(const char *name, int hash_size, int tdb_flags,
 	   we didn't get the initial exclusive lock as we need to let all other
 	   users know we're using it. */
 
-	if (tdb_flags & TDB_CLEAR_IF_FIRST) {
+	if ((tdb_flags & TDB_CLEAR_IF_FIRST) || tdb->header.rwlocks != 0) {
 		/* leave this lock in place to indicate it's in use */
 		if (tdb_brlock(tdb, ACTIVE_LOCK, F_RDLCK, F_SETLKW, 0) == -1)
 			goto fail;
@@ -1830,6 +1964,21 @@ TDB_CONTEXT *tdb_open_ex(const char *name, int hash_size, int tdb_flags,
 	/* Internal (memory-only) databases skip all the code above to
 	 * do with disk files, and resume here by releasing their
 	 * global lock and hooking into the active list. */
+	if (tdb->hash_fn == NULL) {
+		if (tdb->header.hash_type == TDB_HASH_DEFAULT
+		    && tdb->header.version == TDB_VERSION)
+			tdb->hash_fn = default_tdb_hash;
+		else if (tdb->header.hash_type == TDB_HASH_JENKINS
+			 && tdb->header.version == TDB_VERSION_JENKINS)
+			tdb->hash_fn = jenkins_tdb_hash;
+		else {
+			TDB_LOG((tdb, 0, "tdb_open_ex: %s uses unknown hash %u"
+				 " for version %x\n", name,
+				 tdb->header.hash_type, tdb->header.version));
+			errno = EIO;
+			goto fail;
+		}
+	}
 	if (tdb_brlock(tdb, GLOBAL_LOCK, F_UNLCK, F_SETLKW, 0) == -1)
 		goto fail;
 	tdb->next = tdbs;
@@ -1848,6 +1997,7 @@ TDB_CONTEXT *tdb_open_ex(const char *name, int hash_size, int tdb_flags,
 		else
 			tdb_munmap(tdb);
 	}
+	tdb_unmap_locks(tdb);
 	SAFE_FREE(tdb->name);
 	if (tdb->fd != -1)
 		if (close(tdb->fd) != 0)
@@ -1875,6 +2025,7 @@ int tdb_close(TDB_CONTEXT *tdb)
 		else
 			tdb_munmap(tdb);
 	}
+	tdb_unmap_locks(tdb);
 	SAFE_FREE(tdb->name);
 	if (tdb->fd != -1)
 		ret = close(tdb->fd);
@@ -1931,6 +2082,14 @@ int tdb_chainlock(TDB_CONTEXT *tdb, TDB_DATA key)
 	return tdb_lock(tdb, BUCKET(tdb->hash_fn(&key)), F_WRLCK);
 }
 
+/* as tdb_chainlock, but return -1 rather than waiting if another
+   process has the chain locked.  Spinlocks (but not mutexes) are
+   always waited for. */
+int tdb_chainlock_nonblock(TDB_CONTEXT *tdb, TDB_DATA key)
+{
+	return _tdb_lock(tdb, BUCKET(tdb->hash_fn(&key)), F_WRLCK, F_SETLK);
+}
+
 int tdb_chainunlock(TDB_CONTEXT *tdb, TDB_DATA key)
 {
 	return tdb_unlock(tdb, BUCKET(tdb->hash_fn(&key)), F_WRLCK);
@@ -1947,6 +2106,41 @@ int tdb_chainunlock_read(TDB_CONTEXT *tdb, TDB_DATA key)
 }
 
 
+/* count the records on each hash chain */
+int tdb_chainstats(TDB_CONTEXT *tdb, struct tdb_chainstats *st)
+{
+	struct list_struct rec;
+	tdb_off rec_ptr;
+	u32 i, n;
+
+	memset(st, 0, sizeof(*st));
+	st->chains = tdb->header.hash_size;
+	for (i = 0; i < tdb->header.hash_size; i++) {
+		if (tdb_lock(tdb, i, F_RDLCK) != 0)
+			return -1;
+		n = 0;
+		if (ofs_read(tdb, TDB_HASH_TOP(i), &rec_ptr) == -1)
+			goto fail;
+		while (rec_ptr) {
+			if (rec_read(tdb, rec_ptr, &rec) == -1)
+				goto fail;
+			n++;
+			rec_ptr = rec.next;
+		}
+		tdb_unlock(tdb, i, F_RDLCK);
+		st->records += n;
+		if (n == 0)
+			st->empty++;
+		if (n > st->longest)
+			st->longest = n;
+	}
+	return 0;
+
+ fail:
+	tdb_unlock(tdb, i, F_RDLCK);
+	return -1;
+}
+
 /* register a loging function */
 void tdb_logging_function(TDB_CONTEXT *tdb, void (*fn)(TDB_CONTEXT *, int , const char *, ...))
 {
@@ -1981,7 +2175,8 @@ int tdb_reopen(TDB_CONTEXT *tdb)
 		goto fail;
 	}
 	tdb_mmap(tdb);
-	if ((tdb->flags & TDB_CLEAR_IF_FIRST) && (tdb_brlock(tdb, ACTIVE_LOCK, F_RDLCK, F_SETLKW, 0) == -1)) {
+	if (((tdb->flags & TDB_CLEAR_IF_FIRST) || tdb->header.rwlocks != 0)
+	    && (tdb_brlock(tdb, ACTIVE_LOCK, F_RDLCK, F_SETLKW, 0) == -1)) {
 		TDB_LOG((tdb, 0, "tdb_reopen: failed to obtain active lock\n"));
 		goto fail;
 	}
@@ -82,7 +82,10 @@ struct tdb_header {
 	u32 version; /* version of the code */
 	u32 hash_size; /* number of hash entries */
 	tdb_off rwlocks;
-	tdb_off reserved[31];
+	u32 hash_type; /* which hash function keys are hashed with */
+	u32 lock_type; /* what the chain locks at rwlocks are */
+	u32 lock_size; /* and how many bytes each one takes */
+	tdb_off reserved[28];
 };
 
 struct tdb_lock_type {
@@ -114,6 +117,9 @@ typedef struct tdb_context {
 	void (*log_fn)(struct tdb_context *tdb, int level, const char *, ...) PRINTF_ATTRIBUTE(3,4); /* logging function */
 	u32 (*hash_fn)(TDB_DATA *key);
 	int open_flags; /* flags used in the open - needed by reopen */
+	void *lock_map; /* separate, fixed mapping of the chain locks */
+	tdb_len lock_map_size;
+	void *lock_ptr; /* the chain locks within lock_map */
 } TDB_CONTEXT;
 
 typedef int (*tdb_traverse_func)(TDB_CONTEXT *, TDB_DATA, TDB_DATA, void *);
@@ -149,8 +155,18 @@ void tdb_unlockall(TDB_CONTEXT *tdb);
 /* Low level locking functions: use with care */
 void tdb_set_lock_alarm(sig_atomic_t *palarm);
 int tdb_chainlock(TDB_CONTEXT *tdb, TDB_DATA key);
+int tdb_chainlock_nonblock(TDB_CONTEXT *tdb, TDB_DATA key);
 int tdb_chainunlock(TDB_CONTEXT *tdb, TDB_DATA key);
 
+/* chain length statistics, from tdb_chainstats */
+struct tdb_chainstats {
+	u32 chains;	/* number of hash chains */
+	u32 records;	/* records on all chains, including deleted ones */
+	u32 empty;	/* chains with no records */
+	u32 longest;	/* records on the longest chain */
+};
+int tdb_chainstats(TDB_CONTEXT *tdb, struct tdb_chainstats *st);
+
 /* Debug functions. Not used in production. */
 void tdb_dump_all(TDB_CONTEXT *tdb);
 int tdb_printfreelist(TDB_CONTEXT *tdb);
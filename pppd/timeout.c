@@ -0,0 +1,363 @@
+/*
+ * timeout.c - scheduling calls to routines at later times.
+ *
+ * Copyright (c) 1984-2000 Carnegie Mellon University. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * 3. The name "Carnegie Mellon University" must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission. For permission or any legal
+ *    details, please contact
+ *      Office of Technology Transfer
+ *      Carnegie Mellon University
+ *      5000 Forbes Avenue
+ *      Pittsburgh, PA  15213-3890
+ *      (412) 268-4387, fax: (412) 268-7395
+ *      tech-transfer@andrew.cmu.edu
+ *
+ * 4. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by Computing Services
+ *     at Carnegie Mellon University (http://www.cmu.edu/computing/)."
+ *
+ * CARNEGIE MELLON UNIVERSITY DISCLAIMS ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL CARNEGIE MELLON UNIVERSITY BE LIABLE
+ * FOR ANY SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ * Copyright (c) 1999-2004 Paul Mackerras. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. The name(s) of the authors of this software must not be used to
+ *    endorse or promote products derived from this software without
+ *    prior written permission.
+ *
+ * 3. Redistributions of any form whatsoever must retain the following
+ *    acknowledgment:
+ *    "This product includes software developed by Paul Mackerras
+ *     <paulus@samba.org>".
+ *
+ * THE AUTHORS OF THIS SOFTWARE DISCLAIM ALL WARRANTIES WITH REGARD TO
+ * THIS SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS, IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+ * AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#include "pppd.h"
+
+/*
+ * Pending timeouts are kept in a 4-ary min-heap ordered by expiry time
+ * (and by order of scheduling for equal times), so that scheduling and
+ * cancelling a timeout costs O(log n) rather than a walk of a sorted
+ * list.  Each callout is also on a hash chain keyed by (func, arg) so
+ * that untimeout can find it without scanning; there are as many
+ * chains as heap slots, so they stay short however many timeouts are
+ * pending.  Callout structures are
+ * allocated in blocks and recycled through a free list.  Times come
+ * from get_time(), which is monotonic where the system supports it, so
+ * changes to the wall clock don't make timeouts fire early or late.
+ * Each routine is called on the unit that was current when it was
+ * scheduled.
+ */
+struct	callout {
+    struct timeval	c_time;		/* time at which to call routine */
+    u_int32_t		c_seq;		/* order in which it was scheduled */
+    void		*c_arg;		/* argument to routine */
+    void		(*c_func) __P((void *)); /* routine */
+    int			c_index;	/* position in callout heap */
+    int			c_unit;		/* unit to run it on */
+    struct		callout *c_next; /* hash chain or free list */
+};
+
+#define CALLOUT_HEAP_D		4	/* children per heap node */
+#define CALLOUT_BLOCK		32	/* # callouts allocated at a time */
+
+/* Fibonacci hashing: the top callout_hash_bits bits of the product */
+#define CALLOUT_HASH(func, arg)	\
+	((u_int32_t) ((((unsigned long)(func) >> 4)			\
+		       ^ ((unsigned long)(arg) >> 2)) * 0x9e3779b1U)	\
+	 >> (32 - callout_hash_bits))
+
+#define CALLOUT_BEFORE(a, b)					\
+	((a)->c_time.tv_sec < (b)->c_time.tv_sec		\
+	 || ((a)->c_time.tv_sec == (b)->c_time.tv_sec		\
+	     && ((a)->c_time.tv_usec < (b)->c_time.tv_usec	\
+		 || ((a)->c_time.tv_usec == (b)->c_time.tv_usec	\
+		     && (int32_t)((a)->c_seq - (b)->c_seq) < 0))))
+
+static struct callout **callout;	/* Callout heap; callout[0] is next */
+static int n_callouts;			/* # entries in use in callout heap */
+static int max_callouts;		/* # entries allocated */
+static struct callout **callout_hash;	/* 1 << callout_hash_bits chains */
+static int callout_hash_bits;
+static struct callout *callout_free;	/* recycled callouts */
+static u_int32_t callout_seq;
+static struct timeval timenow;		/* Current time */
+
+static void callout_place __P((struct callout *, int));
+static void callout_delete __P((struct callout *));
+static void callout_rehash __P((int));
+
+/*
+ * callout_place - put p in the heap at or above/below position i,
+ * restoring the heap ordering.
+ */
+static void
+callout_place(p, i)
+    struct callout *p;
+    int i;
+{
+    int parent, child, c, best;
+
+    /* sift up */
+    while (i > 0) {
+	parent = (i - 1) / CALLOUT_HEAP_D;
+	if (!CALLOUT_BEFORE(p, callout[parent]))
+	    break;
+	callout[i] = callout[parent];
+	callout[i]->c_index = i;
+	i = parent;
+    }
+
+    /* sift down */
+    for (;;) {
+	child = i * CALLOUT_HEAP_D + 1;
+	if (child >= n_callouts)
+	    break;
+	best = child;
+	for (c = child + 1; c < child + CALLOUT_HEAP_D && c < n_callouts; ++c)
+	    if (CALLOUT_BEFORE(callout[c], callout[best]))
+		best = c;
+	if (!CALLOUT_BEFORE(callout[best], p))
+	    break;
+	callout[i] = callout[best];
+	callout[i]->c_index = i;
+	i = best;
+    }
+
+    callout[i] = p;
+    p->c_index = i;
+}
+
+/*
+ * callout_delete - remove p from the heap and its hash chain,
+ * and put it on the free list.
+ */
+static void
+callout_delete(p)
+    struct callout *p;
+{
+    struct callout **cpp, *last;
+
+    for (cpp = &callout_hash[CALLOUT_HASH(p->c_func, p->c_arg)]; *cpp != NULL;
+	 cpp = &(*cpp)->c_next) {
+	if (*cpp == p) {
+	    *cpp = p->c_next;
+	    break;
+	}
+    }
+
+    last = callout[--n_callouts];
+    if (last != p)
+	callout_place(last, p->c_index);
+
+    p->c_func = NULL;
+    p->c_next = callout_free;
+    callout_free = p;
+}
+
+/*
+ * callout_rehash - make 1 << bits hash chains and put every pending
+ * callout on the right one.
+ */
+static void
+callout_rehash(bits)
+    int bits;
+{
+    struct callout *p;
+    int i, h;
+
+    free(callout_hash);
+    callout_hash = (struct callout **) calloc(1 << bits, sizeof(*callout_hash));
+    if (callout_hash == NULL)
+	fatal("Out of memory in timeout()!");
+    callout_hash_bits = bits;
+    for (i = 0; i < n_callouts; ++i) {
+	p = callout[i];
+	h = CALLOUT_HASH(p->c_func, p->c_arg);
+	p->c_next = callout_hash[h];
+	callout_hash[h] = p;
+    }
+}
+
+/*
+ * timeout - Schedule a timeout.
+ */
+void
+timeout(func, arg, secs, usecs)
+    void (*func) __P((void *));
+    void *arg;
+    int secs, usecs;
+{
+    struct callout *newp, **heap;
+    int i, h;
+
+    /*
+     * Allocate timeout.
+     */
+    if (callout_free == NULL) {
+	newp = (struct callout *) malloc(CALLOUT_BLOCK * sizeof(struct callout));
+	if (newp == NULL)
+	    fatal("Out of memory in timeout()!");
+	for (i = 0; i < CALLOUT_BLOCK; ++i) {
+	    newp[i].c_next = callout_free;
+	    callout_free = &newp[i];
+	}
+    }
+    if (n_callouts >= max_callouts) {
+	i = max_callouts? max_callouts * 2: CALLOUT_BLOCK;
+	heap = (struct callout **) realloc(callout, i * sizeof(*heap));
+	if (heap == NULL)
+	    fatal("Out of memory in timeout()!");
+	callout = heap;
+	max_callouts = i;
+	for (h = callout_hash_bits; (1 << h) < max_callouts; ++h)
+	    ;
+	callout_rehash(h);
+    }
+    newp = callout_free;
+    callout_free = newp->c_next;
+
+    newp->c_arg = arg;
+    newp->c_func = func;
+    newp->c_seq = callout_seq++;
+    newp->c_unit = cur_unit;
+    get_time(&timenow);
+    newp->c_time.tv_sec = timenow.tv_sec + secs;
+    newp->c_time.tv_usec = timenow.tv_usec + usecs;
+    if (newp->c_time.tv_usec >= 1000000) {
+	newp->c_time.tv_sec += newp->c_time.tv_usec / 1000000;
+	newp->c_time.tv_usec %= 1000000;
+    }
+
+    /*
+     * Link it into its hash chain and the heap.
+     */
+    h = CALLOUT_HASH(func, arg);
+    newp->c_next = callout_hash[h];
+    callout_hash[h] = newp;
+    callout_place(newp, n_callouts++);
+}
+
+
+/*
+ * untimeout - Unschedule a timeout.
+ */
+void
+untimeout(func, arg)
+    void (*func) __P((void *));
+    void *arg;
+{
+    struct callout *p, *first;
+
+    /*
+     * Find first matching timeout and remove it.
+     */
+    first = NULL;
+    for (p = callout_hash[CALLOUT_HASH(func, arg)]; p != NULL; p = p->c_next)
+	if (p->c_func == func && p->c_arg == arg
+	    && (first == NULL || CALLOUT_BEFORE(p, first)))
+	    first = p;
+    if (first != NULL)
+	callout_delete(first);
+}
+
+
+/*
+ * calltimeout - Call any timeout routines which are now due.
+ */
+void
+calltimeout()
+{
+    struct callout *p;
+    void (*func) __P((void *));
+    void *arg;
+    int unit = cur_unit;
+
+    if (n_callouts == 0)
+	return;
+    if (get_time(&timenow) < 0)
+	fatal("Failed to get time of day: %m");
+
+    /*
+     * timeout() updates timenow, so a routine which schedules
+     * another timeout doesn't make us use a stale time here.
+     */
+    while (n_callouts > 0) {
+	p = callout[0];
+	if (!(p->c_time.tv_sec < timenow.tv_sec
+	      || (p->c_time.tv_sec == timenow.tv_sec
+		  && p->c_time.tv_usec <= timenow.tv_usec)))
+	    break;		/* no, it's not time yet */
+
+	func = p->c_func;
+	arg = p->c_arg;
+	select_unit(p->c_unit);
+	callout_delete(p);
+	(*func)(arg);
+    }
+    select_unit(unit);
+}
+
+
+/*
+ * timeleft - return the length of time until the next timeout is due.
+ */
+struct timeval *
+timeleft(tvp)
+    struct timeval *tvp;
+{
+    if (n_callouts == 0)
+	return NULL;
+
+    get_time(&timenow);
+    tvp->tv_sec = callout[0]->c_time.tv_sec - timenow.tv_sec;
+    tvp->tv_usec = callout[0]->c_time.tv_usec - timenow.tv_usec;
+    if (tvp->tv_usec < 0) {
+	tvp->tv_usec += 1000000;
+	tvp->tv_sec -= 1;
+    }
+    if (tvp->tv_sec < 0)
+	tvp->tv_sec = tvp->tv_usec = 0;
+
+    return tvp;
+}
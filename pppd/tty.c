@@ -70,6 +70,10 @@
 
 #define RCSID	"$Id: tty.c,v 1.27 2008/07/01 12:27:56 paulus Exp $"
 
+#ifdef USE_SPLICE
+#define _GNU_SOURCE		/* for splice() */
+#endif
+
 #include <stdio.h>
 #include <ctype.h>
 #include <stdlib.h>
@@ -93,6 +97,10 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#ifdef USE_SPLICE
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
 
 #include "pppd.h"
 #include "fsm.h"
@@ -116,11 +124,43 @@ static int start_charshunt __P((int, int));
 static void stop_charshunt __P((void *, int));
 static void charshunt_done __P((void *));
 static void charshunt __P((int, int, char *));
+#ifdef USE_SPLICE
+struct shunt_dir;
+static int charshunt_splice __P((int, int, FILE *, sigset_t *));
+static void shunt_init __P((struct shunt_dir *, int, int, int));
+static int shunt_copy_mode __P((struct shunt_dir *));
+static int shunt_read __P((struct shunt_dir *));
+static int shunt_write __P((struct shunt_dir *, int));
+#endif
+static void record_start __P((FILE *, struct timeval *));
 static int record_write __P((FILE *, int code, u_char *buf, int nb,
 			     struct timeval *));
+static int record_flush __P((FILE *));
+static void record_term __P((int));
 static int open_socket __P((char *));
 static void maybe_relock __P((void *, int));
 
+/*
+ * Format of the record file.  Each session starts with a start record,
+ * and every record is a RECORD_HDRLEN-byte header (type, flags, data
+ * length, and the time since the session started as seconds and
+ * microseconds, all big-endian) followed by the data.  The start
+ * record's data is RECORD_MAGIC, the format version, two reserved
+ * bytes and the wall-clock time of the start as seconds and
+ * microseconds.  Types 1 to 4 are as in the original format, which
+ * pppdump still reads.
+ */
+#define RECORD_HDRLEN	12
+#define RECORD_START	8	/* start of session */
+#define RECORD_MAGIC	"pRec"
+#define RECORD_VERSION	2
+#define RECORD_BUFSIZE	65536	/* stdio buffer for the record file */
+#define RECORD_FLUSH_MS	100	/* flush after this long with no traffic */
+
+static int record_dirty;	/* record file has unflushed data */
+static struct timeval record_flushed; /* when we last flushed it */
+static volatile sig_atomic_t charshunt_quit; /* got SIGTERM or SIGINT */
+
 static int pty_master;		/* fd for master side of pty */
 static int pty_slave;		/* fd for slave side of pty */
 static int real_ttyfd;		/* fd for actual serial port (not pty) */
@@ -988,7 +1028,9 @@ charshunt(ifd, ofd, record_file)
     struct timeval lasttime;
     FILE *recordf = NULL;
     int ilevel, olevel, max_level;
-    struct timeval levelt, tout, *top;
+    struct timeval levelt;
+    struct timespec tout, *top;
+    sigset_t mask, waitmask;
     extern u_char inpacket_buf[];
 
     /*
@@ -1049,6 +1091,23 @@ charshunt(ifd, ofd, record_file)
 	recordf = fopen(record_file, "a");
 	if (recordf == NULL)
 	    error("Couldn't create record file %s: %m", record_file);
+	else
+	    setvbuf(recordf, NULL, _IOFBF, RECORD_BUFSIZE);
+    }
+
+    /*
+     * The record file is buffered, so we catch SIGTERM and SIGINT
+     * to flush it before exiting.  They are only let through while
+     * we wait in pselect, so we can't miss one just before waiting.
+     */
+    sigprocmask(SIG_BLOCK, NULL, &waitmask);
+    if (recordf != NULL) {
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGINT);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	signal(SIGTERM, record_term);
+	signal(SIGINT, record_term);
     }
 
     /* set all the fds to non-blocking mode */
@@ -1067,6 +1126,17 @@ charshunt(ifd, ofd, record_file)
 	    warn("couldn't set stdout to nonblock: %m");
     }
 
+#ifdef USE_SPLICE
+    /*
+     * Relay the data with splice() and epoll if we can.  If we are
+     * recording, the data has to come up into user space, but the
+     * same loop does the waiting, rate limiting and record flushing;
+     * the select loop below is only for fds epoll won't take.
+     */
+    if (charshunt_splice(ifd, ofd, recordf, &waitmask))
+	exit(0);
+#endif
+
     nibuf = nobuf = 0;
     ibufp = obufp = NULL;
     pty_readable = stdin_readable = 1;
@@ -1081,20 +1151,15 @@ charshunt(ifd, ofd, record_file)
 	max_level = PPP_MRU + PPP_HDRLEN + 1;
 
     nfds = (ofd > pty_master? ofd: pty_master) + 1;
-    if (recordf != NULL) {
-	gettimeofday(&lasttime, NULL);
-	putc(7, recordf);	/* put start marker */
-	putc(lasttime.tv_sec >> 24, recordf);
-	putc(lasttime.tv_sec >> 16, recordf);
-	putc(lasttime.tv_sec >> 8, recordf);
-	putc(lasttime.tv_sec, recordf);
-	lasttime.tv_usec = 0;
-    }
+    if (recordf != NULL)
+	record_start(recordf, &lasttime);
 
     while (nibuf != 0 || nobuf != 0 || pty_readable || stdin_readable) {
+	if (charshunt_quit)
+	    break;
 	top = 0;
 	tout.tv_sec = 0;
-	tout.tv_usec = 10000;
+	tout.tv_nsec = 10000000;
 	FD_ZERO(&ready);
 	FD_ZERO(&writey);
 	if (nibuf != 0) {
@@ -1111,11 +1176,20 @@ charshunt(ifd, ofd, record_file)
 		FD_SET(ofd, &writey);
 	} else if (pty_readable)
 	    FD_SET(pty_master, &ready);
-	if (select(nfds, &ready, &writey, NULL, top) < 0) {
+	if (recordf != NULL && record_dirty && top == NULL) {
+	    /* flush the record file once things go quiet */
+	    tout.tv_nsec = RECORD_FLUSH_MS * 1000000;
+	    top = &tout;
+	}
+	n = pselect(nfds, &ready, &writey, NULL, top, &waitmask);
+	if (n < 0) {
 	    if (errno != EINTR)
 		fatal("select");
 	    continue;
 	}
+	if (n == 0 && recordf != NULL && record_dirty)
+	    if (!record_flush(recordf))
+		recordf = NULL;
 	if (max_data_rate) {
 	    double dt;
 	    int nbt;
@@ -1221,9 +1295,426 @@ charshunt(ifd, ofd, record_file)
 	    }
 	}
     }
+    if (recordf != NULL)
+	record_flush(recordf);
     exit(0);
 }
 
+#ifdef USE_SPLICE
+/*
+ * The splicing character shunt.  Each direction moves data from its
+ * `from' fd to its `to' fd through a pipe with splice(), so it is
+ * never copied into our address space.  If splice() can't be used on
+ * one of the fds (older kernels can't splice to or from a tty), that
+ * direction falls back to read() and write() through a buffer.  The
+ * fds are watched with edge-triggered epoll, so we only note that an
+ * fd may be ready and carry on until an operation gets EAGAIN.
+ * With max_data_rate set, each direction has a token bucket holding
+ * up to max_level bytes of credit.  A direction which has run out
+ * waits until it has earned enough for a reasonable burst (or for all
+ * it has to send), and a timerfd wakes us up when that will be.
+ * When recording, both directions copy, so that what is read can be
+ * written to the record file, and we wake up RECORD_FLUSH_MS after
+ * the last record to flush it, as charshunt does.
+ */
+#define SHUNT_CHUNK	65536	/* max bytes moved per operation */
+#define RECORD_CHUNK	65535	/* max bytes in one record */
+
+#define shunt_can_read(d)	((d)->nbuf == 0 && (d)->open && (d)->rdready)
+#define shunt_can_write(d, burst) \
+	((d)->nbuf != 0 && (d)->wrready && (d)->level >= MIN((d)->nbuf, (burst)))
+
+struct shunt_dir {
+    int from, to;		/* source and destination fds */
+    int pipe[2];		/* pipe to splice through; -1 if copying */
+    u_char *buf, *bufp;		/* buffer when copying */
+    int nbuf;			/* # bytes in the pipe or buffer */
+    int maxread;		/* max bytes to read at once */
+    int open;			/* still reading from `from' */
+    int rdready;		/* `from' may have data for us */
+    int wrready;		/* `to' may accept more data */
+    int level;			/* bytes we may send before being limited */
+};
+
+/*
+ * charshunt_splice - run the character shunt using splice, with
+ * the same end-of-file and error handling as charshunt, recording
+ * to recordf if it isn't NULL.  Signals in waitmask are let through
+ * only while we wait.  Returns 0 if it couldn't be set up (for
+ * example because one of the fds is a regular file, which epoll won't
+ * accept), in which case no data has been moved and charshunt carries
+ * on as before.
+ */
+static int
+charshunt_splice(ifd, ofd, recordf, waitmask)
+    int ifd, ofd;
+    FILE *recordf;
+    sigset_t *waitmask;
+{
+    struct shunt_dir in, out;	/* ifd -> pty master, pty master -> ofd */
+    struct shunt_dir *d;
+    struct epoll_event ev, events[4];
+    struct itimerspec its;
+    struct timeval levelt, now, lasttime;
+    int epfd, tfd, i, n, nev, max_level, burst, wait_us, w;
+    u_int64_t expiries;
+
+    if ((epfd = epoll_create(4)) < 0)
+	return 0;
+    tfd = -1;
+    if (max_data_rate
+	&& (tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK)) < 0) {
+	close(epfd);
+	return 0;
+    }
+    memset(&ev, 0, sizeof(ev));
+    /* ifd and ofd are the same fd when we're relaying to a tty */
+    ev.events = EPOLLIN | EPOLLET;
+    if (ofd == ifd)
+	ev.events |= EPOLLOUT;
+    ev.data.fd = ifd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, ifd, &ev) < 0)
+	goto nosplice;
+    if (ofd != ifd) {
+	ev.events = EPOLLOUT | EPOLLET;
+	ev.data.fd = ofd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, ofd, &ev) < 0)
+	    goto nosplice;
+    }
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+    ev.data.fd = pty_master;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, pty_master, &ev) < 0)
+	goto nosplice;
+    if (tfd >= 0) {
+	ev.events = EPOLLIN;
+	ev.data.fd = tfd;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev) < 0)
+	    goto nosplice;
+    }
+
+    if (max_data_rate) {
+	max_level = max_data_rate / 10;
+	if (max_level < 100)
+	    max_level = 100;
+    } else
+	max_level = SHUNT_CHUNK;
+    burst = max_level / 10;
+    shunt_init(&in, ifd, pty_master, recordf != NULL);
+    shunt_init(&out, pty_master, ofd, recordf != NULL);
+    in.level = out.level = max_level;
+    gettimeofday(&levelt, NULL);
+    if (recordf != NULL)
+	record_start(recordf, &lasttime);
+
+    while (in.nbuf != 0 || out.nbuf != 0 || in.open || out.open) {
+	if (charshunt_quit)
+	    break;
+	if (max_data_rate) {
+	    gettimeofday(&now, NULL);
+	    n = (int)((now.tv_sec - levelt.tv_sec
+		       + (now.tv_usec - levelt.tv_usec) / 1e6) * max_data_rate);
+	    if (n < 0 || n > max_level)
+		n = max_level;
+	    if (n > 0) {
+		in.level = MIN(in.level + n, max_level);
+		out.level = MIN(out.level + n, max_level);
+		levelt = now;
+	    }
+	} else
+	    in.level = out.level = max_level;
+
+	/* standard input (or the tty) -> pty master */
+	if (shunt_can_read(&in)) {
+	    n = shunt_read(&in);
+	    if (n < 0 && errno == EIO)
+		n = 0;
+	    if (n < 0) {
+		if (errno == EAGAIN)
+		    in.rdready = 0;
+		else if (errno != EINTR) {
+		    error("Error reading standard input: %m");
+		    break;
+		}
+	    } else if (n == 0) {
+		/* end of file from stdin */
+		in.open = 0;
+		if (recordf)
+		    if (!record_write(recordf, 4, NULL, 0, &lasttime))
+			recordf = NULL;
+	    } else {
+		in.nbuf = n;
+		if (recordf)
+		    if (!record_write(recordf, 2, in.buf, n, &lasttime))
+			recordf = NULL;
+	    }
+	}
+	if (shunt_can_write(&in, burst)) {
+	    n = shunt_write(&in, MIN(in.nbuf, in.level));
+	    if (n < 0) {
+		if (errno == EIO) {
+		    in.open = 0;
+		    in.nbuf = 0;
+		} else if (errno == EAGAIN)
+		    in.wrready = 0;
+		else if (errno != EINTR) {
+		    error("Error writing pseudo-tty master: %m");
+		    break;
+		}
+	    } else {
+		in.nbuf -= n;
+		in.level -= n;
+	    }
+	}
+
+	/* pty master -> standard output (or the tty) */
+	if (shunt_can_read(&out)) {
+	    n = shunt_read(&out);
+	    if (n < 0 && errno == EIO)
+		n = 0;
+	    if (n < 0) {
+		if (errno == EAGAIN)
+		    out.rdready = 0;
+		else if (errno != EINTR) {
+		    error("Error reading pseudo-tty master: %m");
+		    break;
+		}
+	    } else if (n == 0) {
+		/* end of file from the pty - slave side has closed */
+		out.open = 0;
+		in.open = 0;	/* pty is not writable now */
+		in.nbuf = 0;
+		close(ofd);
+		if (recordf)
+		    if (!record_write(recordf, 3, NULL, 0, &lasttime))
+			recordf = NULL;
+	    } else {
+		out.nbuf = n;
+		if (recordf)
+		    if (!record_write(recordf, 1, out.buf, n, &lasttime))
+			recordf = NULL;
+	    }
+	}
+	if (shunt_can_write(&out, burst)) {
+	    n = shunt_write(&out, MIN(out.nbuf, out.level));
+	    if (n < 0) {
+		if (errno == EIO) {
+		    out.open = 0;
+		    out.nbuf = 0;
+		} else if (errno == EAGAIN)
+		    out.wrready = 0;
+		else if (errno != EINTR) {
+		    error("Error writing standard output: %m");
+		    break;
+		}
+	    } else {
+		out.nbuf -= n;
+		out.level -= n;
+	    }
+	}
+
+	/* keep going while either direction can make progress */
+	if (shunt_can_read(&in) || shunt_can_write(&in, burst)
+	    || shunt_can_read(&out) || shunt_can_write(&out, burst))
+	    continue;
+	if (in.nbuf == 0 && out.nbuf == 0 && !in.open && !out.open)
+	    break;
+
+	/*
+	 * If a direction is only held up by the rate limit,
+	 * arrange to be woken when it can send a burst.
+	 */
+	wait_us = 0;
+	for (i = 0; i < 2; ++i) {
+	    d = (i == 0)? &in: &out;
+	    if (d->nbuf == 0 || !d->wrready)
+		continue;
+	    w = (int)((MIN(d->nbuf, burst) - d->level) * 1e6
+		      / max_data_rate);
+	    if (w < 1000)
+		w = 1000;
+	    if (wait_us == 0 || w < wait_us)
+		wait_us = w;
+	}
+	if (wait_us != 0) {
+	    memset(&its, 0, sizeof(its));
+	    its.it_value.tv_sec = wait_us / 1000000;
+	    its.it_value.tv_nsec = (wait_us % 1000000) * 1000;
+	    timerfd_settime(tfd, 0, &its, NULL);
+	}
+
+	/* flush the record file once things go quiet */
+	nev = epoll_pwait(epfd, events, 4, (recordf != NULL && record_dirty)?
+			  RECORD_FLUSH_MS: -1, waitmask);
+	if (nev < 0) {
+	    if (errno != EINTR)
+		fatal("epoll_wait: %m");
+	    continue;
+	}
+	if (nev == 0 && recordf != NULL && record_dirty)
+	    if (!record_flush(recordf))
+		recordf = NULL;
+	for (i = 0; i < nev; ++i) {
+	    n = events[i].data.fd;
+	    if (n == tfd) {
+		if (read(tfd, &expiries, sizeof(expiries)) < 0
+		    && errno != EAGAIN && errno != EINTR)
+		    fatal("Error reading timerfd: %m");
+		continue;
+	    }
+	    if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+		if (n == in.from)
+		    in.rdready = 1;
+		if (n == out.from)
+		    out.rdready = 1;
+	    }
+	    if (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+		if (n == in.to)
+		    in.wrready = 1;
+		if (n == out.to)
+		    out.wrready = 1;
+	    }
+	}
+    }
+    if (recordf != NULL)
+	record_flush(recordf);
+    return 1;
+
+ nosplice:
+    if (tfd >= 0)
+	close(tfd);
+    close(epfd);
+    return 0;
+}
+
+/*
+ * shunt_init - set up one direction of the splicing shunt, copying
+ * rather than splicing if we are recording what passes through.
+ */
+static void
+shunt_init(d, from, to, recording)
+    struct shunt_dir *d;
+    int from, to, recording;
+{
+    d->from = from;
+    d->to = to;
+    d->buf = d->bufp = NULL;
+    d->nbuf = 0;
+    d->maxread = recording? RECORD_CHUNK: SHUNT_CHUNK;
+    d->open = d->rdready = d->wrready = 1;
+    if (recording || pipe(d->pipe) < 0) {
+	d->pipe[0] = d->pipe[1] = -1;
+	shunt_copy_mode(d);
+    }
+}
+
+/*
+ * shunt_copy_mode - switch a direction of the shunt from splicing
+ * to copying, moving anything left in the pipe into the buffer.
+ * Returns 0 (with errno set) if the pipe can't be emptied.
+ */
+static int
+shunt_copy_mode(d)
+    struct shunt_dir *d;
+{
+    int n;
+
+    d->buf = d->bufp = malloc(SHUNT_CHUNK);
+    if (d->buf == NULL)
+	novm("character shunt buffer");
+    if (d->pipe[0] >= 0) {
+	for (n = 0; n < d->nbuf; ) {
+	    int r = read(d->pipe[0], d->buf + n, d->nbuf - n);
+	    if (r <= 0)
+		return 0;
+	    n += r;
+	}
+	close(d->pipe[0]);
+	close(d->pipe[1]);
+	d->pipe[0] = d->pipe[1] = -1;
+    }
+    return 1;
+}
+
+/*
+ * shunt_read - get data for one direction of the shunt, which must
+ * have none buffered.  Returns as for read().
+ */
+static int
+shunt_read(d)
+    struct shunt_dir *d;
+{
+    int n;
+
+    if (d->pipe[0] >= 0) {
+	n = splice(d->from, NULL, d->pipe[1], NULL, SHUNT_CHUNK,
+		   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (n >= 0 || errno != EINVAL)
+	    return n;
+	/* can't splice from this fd, copy from now on */
+	if (!shunt_copy_mode(d))
+	    return -1;
+    }
+    d->bufp = d->buf;
+    return read(d->from, d->buf, d->maxread);
+}
+
+/*
+ * shunt_write - send up to `max' bytes of the data buffered for one
+ * direction of the shunt.  Returns as for write().
+ */
+static int
+shunt_write(d, max)
+    struct shunt_dir *d;
+    int max;
+{
+    int n;
+
+    if (d->pipe[0] >= 0) {
+	n = splice(d->pipe[0], NULL, d->to, NULL, max,
+		   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (n >= 0 || errno != EINVAL)
+	    return n;
+	/* can't splice to this fd, copy from now on */
+	if (!shunt_copy_mode(d))
+	    return -1;
+    }
+    n = write(d->to, d->bufp, max);
+    if (n > 0)
+	d->bufp += n;
+    return n;
+}
+#endif /* USE_SPLICE */
+
+/*
+ * record_start - write the record which starts a session in the
+ * record file, and note the time it started in *tp.
+ */
+static void
+record_start(f, tp)
+    FILE *f;
+    struct timeval *tp;
+{
+    struct timeval now;
+    u_char data[16], *p;
+
+    gettimeofday(&now, NULL);
+    memcpy(data, RECORD_MAGIC, 4);
+    p = data + 4;
+    PUTSHORT(RECORD_VERSION, p);
+    PUTSHORT(0, p);
+    PUTLONG(now.tv_sec, p);
+    PUTLONG(now.tv_usec, p);
+    get_time(tp);
+    record_write(f, RECORD_START, data, sizeof(data), tp);
+    record_flush(f);
+}
+
+/*
+ * record_write - append a record to the record file, stamped with
+ * the time since *tp, the start of the session.  The data is left in
+ * the stdio buffer; record_flush pushes it out.  Returns 0 if the
+ * record file can't be written any more.
+ */
 static int
 record_write(f, code, buf, nb, tp)
     FILE *f;
@@ -1233,34 +1724,58 @@ record_write(f, code, buf, nb, tp)
     struct timeval *tp;
 {
     struct timeval now;
-    int diff;
+    u_char hdr[RECORD_HDRLEN], *p;
 
-    gettimeofday(&now, NULL);
-    now.tv_usec /= 100000;	/* actually 1/10 s, not usec now */
-    diff = (now.tv_sec - tp->tv_sec) * 10 + (now.tv_usec - tp->tv_usec);
-    if (diff > 0) {
-	if (diff > 255) {
-	    putc(5, f);
-	    putc(diff >> 24, f);
-	    putc(diff >> 16, f);
-	    putc(diff >> 8, f);
-	    putc(diff, f);
-	} else {
-	    putc(6, f);
-	    putc(diff, f);
-	}
-	*tp = now;
+    get_time(&now);
+    if (now.tv_usec < tp->tv_usec) {
+	now.tv_usec += 1000000;
+	--now.tv_sec;
     }
-    putc(code, f);
-    if (buf != NULL) {
-	putc(nb >> 8, f);
-	putc(nb, f);
+    p = hdr;
+    PUTCHAR(code, p);
+    PUTCHAR(0, p);
+    PUTSHORT(nb, p);
+    PUTLONG(now.tv_sec - tp->tv_sec, p);
+    PUTLONG(now.tv_usec - tp->tv_usec, p);
+    fwrite(hdr, RECORD_HDRLEN, 1, f);
+    if (nb > 0)
 	fwrite(buf, nb, 1, f);
-    }
-    fflush(f);
+    record_dirty = 1;
+
+    /* don't let a busy link keep the data in the buffer for a second */
+    if ((now.tv_sec - record_flushed.tv_sec) * 1000000
+	+ now.tv_usec - record_flushed.tv_usec >= 1000000)
+	return record_flush(f);
     if (ferror(f)) {
 	error("Error writing record file: %m");
 	return 0;
     }
     return 1;
 }
+
+/*
+ * record_flush - write out anything buffered for the record file.
+ */
+static int
+record_flush(f)
+    FILE *f;
+{
+    get_time(&record_flushed);
+    record_dirty = 0;
+    if (fflush(f) == EOF || ferror(f)) {
+	error("Error writing record file: %m");
+	return 0;
+    }
+    return 1;
+}
+
+/*
+ * record_term - catch SIGTERM and SIGINT in the character shunt
+ * so that the record file can be flushed before we exit.
+ */
+static void
+record_term(sig)
+    int sig;
+{
+    charshunt_quit = 1;
+}
@@ -115,6 +115,7 @@ static void upap_rauthack __P((upap_state *, u_char *, int, int));
 static void upap_rauthnak __P((upap_state *, u_char *, int, int));
 static void upap_sauthreq __P((upap_state *));
 static void upap_sresp __P((upap_state *, int, int, char *, int));
+static void upap_rauthdone __P((upap_state *, int, int, char *, char *, int));
 
 
 /*
@@ -275,7 +276,8 @@ upap_lowerdown(unit)
 
     if (u->us_clientstate == UPAPCS_AUTHREQ)	/* Timeout pending? */
 	UNTIMEOUT(upap_timeout, u);		/* Cancel timeout */
-    if (u->us_serverstate == UPAPSS_LISTEN && u->us_reqtimeout > 0)
+    if ((u->us_serverstate == UPAPSS_LISTEN
+	 || u->us_serverstate == UPAPSS_VERIFY) && u->us_reqtimeout > 0)
 	UNTIMEOUT(upap_reqtimeout, u);
 
     u->us_clientstate = UPAPCS_INITIAL;
@@ -376,10 +378,8 @@ upap_rauthreq(u, inp, id, len)
 {
     u_char ruserlen, rpasswdlen;
     char *ruser, *rpasswd;
-    char rhostname[256];
     int retcode;
     char *msg;
-    int msglen;
 
     if (u->us_serverstate < UPAPSS_LISTEN)
 	return;
@@ -396,6 +396,10 @@ upap_rauthreq(u, inp, id, len)
 	upap_sresp(u, UPAP_AUTHNAK, id, "", 0);	/* return auth-nak */
 	return;
     }
+    if (u->us_serverstate == UPAPSS_VERIFY) {
+	/* Still checking the first one; we'll answer when we know. */
+	return;
+    }
 
     /*
      * Parse user/passwd.
@@ -426,6 +430,55 @@ upap_rauthreq(u, inp, id, len)
 			   rpasswdlen, &msg);
     BZERO(rpasswd, rpasswdlen);
 
+    if (retcode == 0) {
+	/*
+	 * A plugin will tell us the result later,
+	 * via upap_verify_complete.
+	 */
+	u->us_serverstate = UPAPSS_VERIFY;
+	u->us_vid = id;
+	BCOPY(ruser, u->us_vname, ruserlen);
+	u->us_vnamelen = ruserlen;
+	return;
+    }
+
+    upap_rauthdone(u, retcode, id, msg, ruser, ruserlen);
+}
+
+
+/*
+ * upap_verify_complete - A plugin has finished checking an auth-req
+ * for which check_passwd returned 0.
+ */
+void
+upap_verify_complete(unit, retcode, msg)
+    int unit;
+    int retcode;
+    char *msg;
+{
+    upap_state *u = &upap[unit];
+
+    if (u->us_serverstate != UPAPSS_VERIFY)
+	return;			/* link went down meanwhile */
+    upap_rauthdone(u, retcode, u->us_vid, msg, u->us_vname, u->us_vnamelen);
+}
+
+
+/*
+ * upap_rauthdone - Send the response to an auth-req and update our state.
+ */
+static void
+upap_rauthdone(u, retcode, id, msg, ruser, ruserlen)
+    upap_state *u;
+    int retcode;
+    int id;
+    char *msg;
+    char *ruser;
+    int ruserlen;
+{
+    char rhostname[256];
+    int msglen;
+
     /*
      * Check remote number authorization.  A plugin may have filled in
      * the remote number or added an allowed number, and rather than
@@ -72,6 +72,9 @@ typedef struct upap_state {
     int us_transmits;		/* Number of auth-reqs sent */
     int us_maxtransmits;	/* Maximum number of auth-reqs to send */
     int us_reqtimeout;		/* Time to wait for auth-req from peer */
+    u_char us_vid;		/* Id of auth-req being verified */
+    char us_vname[MAXNAMELEN];	/* Peer name from auth-req being verified */
+    int us_vnamelen;		/* Peer name length */
 } upap_state;
 
 
@@ -94,6 +97,7 @@ typedef struct upap_state {
 #define UPAPSS_LISTEN	3	/* Listening for an Authenticate */
 #define UPAPSS_OPEN	4	/* We've sent an Ack */
 #define UPAPSS_BADAUTH	5	/* We've sent a Nak */
+#define UPAPSS_VERIFY	6	/* A plugin is checking the auth-req */
 
 
 /*
@@ -106,5 +110,6 @@ extern upap_state upap[];
 
 void upap_authwithpeer __P((int, char *, char *));
 void upap_authpeer __P((int));
+void upap_verify_complete __P((int, int, char *));
 
 extern struct protent pap_protent;
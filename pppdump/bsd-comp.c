@@ -71,6 +71,10 @@
  *	    things up, this makes it more likely that the transmitter
  *	    and receiver will agree when the dictionary is cleared when
  *	    compression is not going well.
+ *
+ *  The dictionary is laid out as in the kernel module: a linearly
+ *  probed hash table for (prefix,suffix) -> code and a table indexed
+ *  by code for code -> (prefix,suffix).
  */
 
 /*
@@ -78,8 +82,8 @@
  */
 struct bsd_db {
     int	    totlen;			/* length of this structure */
-    u_int   hsize;			/* size of the hash table */
-    u_char  hshift;			/* used in hash function */
+    u_int   hsize;			/* size of the hash table, 2^n */
+    u_char  hshift;			/* 32 - n, used in hash function */
     u_char  n_bits;			/* current bits/code */
     u_char  maxbits;
     u_char  debug;
@@ -100,25 +104,18 @@ struct bsd_db {
     u_int   uncomp_bytes;		/* uncompressed bytes */
     u_int   comp_count;			/* compressed packets */
     u_int   comp_bytes;			/* compressed bytes */
-    u_short *lens;			/* array of lengths of codes */
-    struct bsd_dict {
-	union {				/* hash value */
-	    u_int32_t	fcode;
-	    struct {
-#ifdef BSD_LITTLE_ENDIAN
-		u_short prefix;		/* preceding code */
-		u_char	suffix;		/* last character of new code */
-		u_char	pad;
-#else
-		u_char	pad;
-		u_char	suffix;		/* last character of new code */
-		u_short prefix;		/* preceding code */
-#endif
-	    } hs;
-	} f;
-	u_short codem1;			/* output of hash table -1 */
-	u_short cptr;			/* map code to hash table entry */
-    } dict[1];
+    struct bsd_hent {			/* (prefix,suffix) -> code */
+	u_int32_t fcode;		/* BSD_KEY(prefix,suffix) */
+	u_short	codem1;			/* output of hash table -1 */
+	u_short	pad;
+    } *hash;
+    struct bsd_code {			/* code -> (prefix,suffix) */
+	u_short	prefix;			/* preceding code */
+	u_char	suffix;			/* last character of this code */
+	u_char	pad;
+	u_short	hslot;			/* hash table entry for this code */
+	u_short	len;			/* length of string */
+    } codes[1];
 };
 
 #define BSD_OVHD	2		/* BSD compress overhead/packet */
@@ -159,10 +156,10 @@ struct compressor ppp_bsd_compress = {
 #define MAXCODE(b)	((1 << (b)) - 1)
 #define BADCODEM1	MAXCODE(BSD_MAX_BITS)
 
-#define BSD_HASH(prefix,suffix,hshift)	((((u_int32_t)(suffix)) << (hshift)) \
-					 ^ (u_int32_t)(prefix))
 #define BSD_KEY(prefix,suffix)		((((u_int32_t)(suffix)) << 16) \
 					 + (u_int32_t)(prefix))
+#define BSD_HASH(fcode,hshift)		((u_int32_t)((fcode) * 0x9e3779b1U) \
+					 >> (hshift))
 
 #define CHECK_GAP	10000		/* Ratio check interval */
 
@@ -286,7 +283,7 @@ bsd_alloc(options, opt_len, decomp)
     u_char *options;
     int opt_len, decomp;
 {
-    int bits;
+    int bits, hbits;
     u_int newlen, hsize, hshift, maxmaxcode;
     struct bsd_db *db;
 
@@ -295,51 +292,22 @@ bsd_alloc(options, opt_len, decomp)
 	return NULL;
 
     bits = BSD_NBITS(options[2]);
-    switch (bits) {
-    case 9:			/* needs 82152 for both directions */
-    case 10:			/* needs 84144 */
-    case 11:			/* needs 88240 */
-    case 12:			/* needs 96432 */
-	hsize = 5003;
-	hshift = 4;
-	break;
-    case 13:			/* needs 176784 */
-	hsize = 9001;
-	hshift = 5;
-	break;
-    case 14:			/* needs 353744 */
-	hsize = 18013;
-	hshift = 6;
-	break;
-    case 15:			/* needs 691440 */
-	hsize = 35023;
-	hshift = 7;
-	break;
-    case 16:			/* needs 1366160--far too much, */
-	/* hsize = 69001; */	/* and 69001 is too big for cptr */
-	/* hshift = 8; */	/* in struct bsd_db */
-	/* break; */
-    default:
+    if (bits < BSD_MIN_BITS || bits > BSD_MAX_BITS)
 	return NULL;
-    }
 
+    /* Unlike the kernel module, keep the hash table at most half full. */
     maxmaxcode = MAXCODE(bits);
-    newlen = sizeof(*db) + (hsize-1) * (sizeof(db->dict[0]));
+    hbits = (bits < 12)? 13: bits + 1;
+    hsize = 1 << hbits;
+    hshift = 32 - hbits;
+    newlen = sizeof(*db) + maxmaxcode * sizeof(db->codes[0])
+	+ hsize * sizeof(db->hash[0]);
     db = (struct bsd_db *) malloc(newlen);
     if (!db)
 	return NULL;
-    memset(db, 0, sizeof(*db) - sizeof(db->dict));
-
-    if (!decomp) {
-	db->lens = NULL;
-    } else {
-	db->lens = (u_short *) malloc((maxmaxcode+1) * sizeof(db->lens[0]));
-	if (!db->lens) {
-	    free(db);
-	    return NULL;
-	}
-    }
+    memset(db, 0, sizeof(*db) - sizeof(db->codes));
 
+    db->hash = (struct bsd_hent *) &db->codes[maxmaxcode + 1];
     db->totlen = newlen;
     db->hsize = hsize;
     db->hshift = hshift;
@@ -353,11 +321,7 @@ static void
 bsd_free(state)
     void *state;
 {
-    struct bsd_db *db = (struct bsd_db *) state;
-
-    if (db->lens)
-	free(db->lens);
-    free(db);
+    free(state);
 }
 
 static void *
@@ -382,20 +346,16 @@ bsd_init(db, options, opt_len, unit, hdrlen, mru, debug, decomp)
     if (opt_len < CILEN_BSD_COMPRESS
 	|| options[0] != CI_BSD_COMPRESS || options[1] != CILEN_BSD_COMPRESS
 	|| BSD_VERSION(options[2]) != BSD_CURRENT_VERSION
-	|| BSD_NBITS(options[2]) != db->maxbits
-	|| (decomp && db->lens == NULL))
+	|| BSD_NBITS(options[2]) != db->maxbits)
 	return 0;
 
-    if (decomp) {
-	i = LAST+1;
-	while (i != 0)
-	    db->lens[--i] = 1;
-    }
+    memset(db->codes, 0, (db->maxmaxcode + 1) * sizeof(db->codes[0]));
+    i = LAST+1;
+    while (i != 0)
+	db->codes[--i].len = 1;
     i = db->hsize;
-    while (i != 0) {
-	db->dict[--i].codem1 = BADCODEM1;
-	db->dict[i].cptr = 0;
-    }
+    while (i != 0)
+	db->hash[--i].codem1 = BADCODEM1;
 
     db->unit = unit;
     db->hdrlen = hdrlen;
@@ -431,12 +391,13 @@ bsd_incomp(state, dmsg, mlen)
 {
     struct bsd_db *db = (struct bsd_db *) state;
     u_int hshift = db->hshift;
+    u_int hmask = db->hsize - 1;
     u_int max_ent = db->max_ent;
     u_int n_bits = db->n_bits;
-    struct bsd_dict *dictp;
+    struct bsd_hent *hp;
     u_int32_t fcode;
     u_char c;
-    long hval, disp;
+    u_int hval;
     int slen, ilen;
     u_int bitno = 7;
     u_char *rptr;
@@ -446,7 +407,6 @@ bsd_incomp(state, dmsg, mlen)
     ent = rptr[0];		/* get the protocol */
     if (ent == 0) {
 	++rptr;
-	--mlen;
 	ent = rptr[0];
     }
     if ((ent & 1) == 0 || ent < 0x21 || ent > 0xf9)
@@ -460,36 +420,26 @@ bsd_incomp(state, dmsg, mlen)
     for (; slen > 0; --slen) {
 	c = *rptr++;
 	fcode = BSD_KEY(ent, c);
-	hval = BSD_HASH(ent, c, hshift);
-	dictp = &db->dict[hval];
-
-	/* validate and then check the entry */
-	if (dictp->codem1 >= max_ent)
-	    goto nomatch;
-	if (dictp->f.fcode == fcode) {
-	    ent = dictp->codem1+1;
-	    continue;   /* found (prefix,suffix) */
-	}
+	hval = BSD_HASH(fcode, hshift);
 
-	/* continue probing until a match or invalid entry */
-	disp = (hval == 0) ? 1 : hval;
-	do {
-	    hval += disp;
-	    if (hval >= db->hsize)
-		hval -= db->hsize;
-	    dictp = &db->dict[hval];
-	    if (dictp->codem1 >= max_ent)
+	/* probe until a match or an invalid entry */
+	for (;;) {
+	    hp = &db->hash[hval];
+	    if (hp->codem1 >= max_ent)
 		goto nomatch;
-	} while (dictp->f.fcode != fcode);
-	ent = dictp->codem1+1;
-	continue;	/* finally found (prefix,suffix) */
+	    if (hp->fcode == fcode)
+		break;
+	    hval = (hval + 1) & hmask;
+	}
+	ent = hp->codem1+1;
+	continue;	/* found (prefix,suffix) */
 
     nomatch:		/* output (count) the prefix */
 	bitno += n_bits;
 
 	/* code -> hashtable */
 	if (max_ent < db->maxmaxcode) {
-	    struct bsd_dict *dictp2;
+	    struct bsd_code *cp;
 	    /* expand code size if needed */
 	    if (max_ent >= MAXCODE(n_bits))
 		db->n_bits = ++n_bits;
@@ -497,15 +447,17 @@ bsd_incomp(state, dmsg, mlen)
 	    /* Invalidate previous hash table entry
 	     * assigned this code, and then take it over.
 	     */
-	    dictp2 = &db->dict[max_ent+1];
-	    if (db->dict[dictp2->cptr].codem1 == max_ent)
-		db->dict[dictp2->cptr].codem1 = BADCODEM1;
-	    dictp2->cptr = hval;
-	    dictp->codem1 = max_ent;
-	    dictp->f.fcode = fcode;
+	    cp = &db->codes[max_ent+1];
+	    if (db->hash[cp->hslot].codem1 == max_ent)
+		db->hash[cp->hslot].codem1 = BADCODEM1;
+	    cp->hslot = hval;
+	    cp->prefix = ent;
+	    cp->suffix = c;
+	    cp->len = db->codes[ent].len + 1;
+	    hp->codem1 = max_ent;
+	    hp->fcode = fcode;
 
 	    db->max_ent = ++max_ent;
-	    db->lens[max_ent] = db->lens[ent]+1;
 	}
 	ent = c;
     }
@@ -555,7 +507,7 @@ bsd_decompress(state, cmsg, inlen, dmp, outlenp)
     u_int bitno = 32;		/* 1st valid bit in accm */
     u_int n_bits = db->n_bits;
     u_int tgtbitno = 32-n_bits;	/* bitno when we have a code */
-    struct bsd_dict *dictp;
+    struct bsd_code *cp;
     int explen, seq, len;
     u_int incode, oldcode, finchar;
     u_char *p, *rptr, *wptr;
@@ -635,7 +587,7 @@ bsd_decompress(state, cmsg, inlen, dmp, outlenp)
 	    extra = 0;
 	}
 
-	codelen = db->lens[finchar];
+	codelen = db->codes[finchar].len;
 	explen += codelen + extra;
 	if (explen > db->mru + 1) {
 	    if (db->debug)
@@ -648,25 +600,25 @@ bsd_decompress(state, cmsg, inlen, dmp, outlenp)
 	 */
 	p = (wptr += codelen);
 	while (finchar > LAST) {
-	    dictp = &db->dict[db->dict[finchar].cptr];
+	    cp = &db->codes[finchar];
 #ifdef DEBUG
 	    --codelen;
 	    if (codelen <= 0) {
 		printf("bsd_decomp%d: fell off end of chain ", db->unit);
 		printf("0x%x at 0x%x by 0x%x, max_ent=0x%x\n",
-		       incode, finchar, db->dict[finchar].cptr, max_ent);
+		       incode, finchar, cp->prefix, max_ent);
 		return DECOMP_FATALERROR;
 	    }
-	    if (dictp->codem1 != finchar-1) {
+	    if (db->hash[cp->hslot].codem1 != finchar-1) {
 		printf("bsd_decomp%d: bad code chain 0x%x finchar=0x%x ",
 		       db->unit, incode, finchar);
-		printf("oldcode=0x%x cptr=0x%x codem1=0x%x\n", oldcode,
-		       db->dict[finchar].cptr, dictp->codem1);
+		printf("oldcode=0x%x hslot=0x%x codem1=0x%x\n", oldcode,
+		       cp->hslot, db->hash[cp->hslot].codem1);
 		return DECOMP_FATALERROR;
 	    }
 #endif
-	    *--p = dictp->f.hs.suffix;
-	    finchar = dictp->f.hs.prefix;
+	    *--p = cp->suffix;
+	    finchar = cp->prefix;
 	}
 	*--p = finchar;
 
@@ -687,39 +639,34 @@ bsd_decompress(state, cmsg, inlen, dmp, outlenp)
 	 * with uncompressed packets.
 	 */
 	if (oldcode != CLEAR && max_ent < db->maxmaxcode) {
-	    struct bsd_dict *dictp2;
+	    struct bsd_hent *hp;
 	    u_int32_t fcode;
-	    int hval, disp;
+	    u_int hval;
 
 	    fcode = BSD_KEY(oldcode,finchar);
-	    hval = BSD_HASH(oldcode,finchar,db->hshift);
-	    dictp = &db->dict[hval];
+	    hval = BSD_HASH(fcode,db->hshift);
 
 	    /* look for a free hash table entry */
-	    if (dictp->codem1 < max_ent) {
-		disp = (hval == 0) ? 1 : hval;
-		do {
-		    hval += disp;
-		    if (hval >= db->hsize)
-			hval -= db->hsize;
-		    dictp = &db->dict[hval];
-		} while (dictp->codem1 < max_ent);
-	    }
+	    while (db->hash[hval].codem1 < max_ent)
+		hval = (hval + 1) & (db->hsize - 1);
+	    hp = &db->hash[hval];
 
 	    /*
 	     * Invalidate previous hash table entry
 	     * assigned this code, and then take it over
 	     */
-	    dictp2 = &db->dict[max_ent+1];
-	    if (db->dict[dictp2->cptr].codem1 == max_ent) {
-		db->dict[dictp2->cptr].codem1 = BADCODEM1;
+	    cp = &db->codes[max_ent+1];
+	    if (db->hash[cp->hslot].codem1 == max_ent) {
+		db->hash[cp->hslot].codem1 = BADCODEM1;
 	    }
-	    dictp2->cptr = hval;
-	    dictp->codem1 = max_ent;
-	    dictp->f.fcode = fcode;
+	    cp->hslot = hval;
+	    cp->prefix = oldcode;
+	    cp->suffix = finchar;
+	    cp->len = db->codes[oldcode].len + 1;
+	    hp->codem1 = max_ent;
+	    hp->fcode = fcode;
 
 	    db->max_ent = ++max_ent;
-	    db->lens[max_ent] = db->lens[oldcode]+1;
 
 	    /* Expand code size if needed. */
 	    if (max_ent >= MAXCODE(n_bits) && max_ent < db->maxmaxcode) {
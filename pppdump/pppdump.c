@@ -35,11 +35,23 @@
  */
 #include <stdio.h>
 #include <unistd.h>
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
 #include <time.h>
+#include <fcntl.h>
+#include <sys/time.h>
 #include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef USE_PTHREADS
+#include <pthread.h>
+#endif
 #include "ppp_defs.h"
 #include "ppp-comp.h"
+#include "pcapng.h"
+#include "pppfcs.h"
 
 int hexmode;
 int pppmode;
@@ -47,28 +59,149 @@ int reverse;
 int decompress;
 int mru = 1500;
 int abs_times;
-time_t start_time;
-int start_time_tenths;
-int tot_sent, tot_rcvd;
+int nthreads = 1;
+int summary;			/* -s: just gather statistics */
+int filtering;			/* -f: only print some frames */
+int frames_only;		/* leave out time, start and end records */
+int pcapng_out;			/* -w: write the packets in pcapng format */
+FILE *outfile;
+
+/*
+ * Record files written by newer versions of pppd start each session
+ * with a RECORD_START record; from there on every record has a
+ * RECORD_HDRLEN-byte header with its type, length and the time since
+ * the start of the session in microseconds.  Older files have a
+ * start marker (7), data records with just a 2-byte length, and
+ * separate records for the time in tenths of a second (5 and 6).
+ */
+#define RECORD_START	8
+#define RECORD_HDRLEN	12
+#define RECORD_MAGIC	"pRec"
+#define RECORD_VERSION	2
+
+/*
+ * A regular record file is mapped into memory.  Anything else (a
+ * pipe or tty) is read a piece at a time as it arrives: next_record
+ * calls rb_fill to bring in a whole record before it returns it.
+ * rgetc is getc for either.
+ */
+struct rbuf {
+    unsigned char *p, *end;
+    FILE *f;			/* where to read more from, or NULL */
+    unsigned char *buf;		/* buffer for reading f */
+    int size;
+    struct obuf *out;		/* written out before waiting for input */
+};
+
+#define RBUF_SIZE	(2 * 65536)	/* >= the longest record */
+
+#define rgetc(rb)	((rb)->p < (rb)->end? *(rb)->p++: EOF)
+
+/*
+ * Output is collected in memory, so that pieces of a file decoded
+ * in parallel can be written out in order, and so that we don't
+ * pay for a printf on every byte.
+ */
+struct obuf {
+    char *buf;
+    int len, size;
+};
+
+#define OBUF_FLUSH	65536	/* write out after this much */
+
+#define ob_putc(ob, c)	((ob)->len < (ob)->size? \
+			 ((ob)->buf[(ob)->len++] = (c)): ob_putc_slow(ob, c))
+
+static char hexdig[] = "0123456789abcdef";
+
+/*
+ * Where we are in the record file, apart from the packets being
+ * collected: enough to carry on from any record boundary.
+ */
+struct dstate {
+    int rec_version;		/* format of the current session */
+    struct timeval rec_start;	/* wall-clock time the session started */
+    struct timeval rec_last;	/* time of the previous record */
+    time_t start_time;
+    int start_time_tenths;
+    int tot_sent, tot_rcvd;
+    int session;		/* counts start records */
+};
+
+struct pkt {
+    int	cnt;
+    int	esc;
+    int	flags;
+    struct compressor *comp;
+    void *state;
+    unsigned char buf[8192];
+};
+
+/* Values for flags */
+#define CCP_ISUP	1
+#define CCP_ERROR	2
+#define CCP_FATALERROR	4
+#define CCP_ERR		(CCP_ERROR | CCP_FATALERROR)
+#define CCP_DECOMP_RUN	8
+
+/*
+ * Everything needed to dump (part of) a record file.
+ */
+struct dumper {
+    struct dstate st;
+    struct obuf out;
+    int quiet;			/* just track st, don't print anything */
+    int flush;			/* write out to outfile as we go */
+    int time_shown;		/* printed the time of this record */
+    struct pkt spkt, rpkt;
+    unsigned char dbuf[8192];
+};
 
 extern int optind;
 extern char *optarg;
 
-void dumplog();
-void dumpppp();
+void dump_file();
+unsigned char *map_file();
+void rb_fill();
+void init_dumper();
+int dumplog();
+int dumpppp();
+void dump_packet();
+int next_record();
 void show_time();
+void show_time2();
 void handle_ccp();
+int frame_proto();
+void parse_filter();
+int filter_match();
+void show_frame_time();
+void count_frame();
+void write_pcapng();
+void print_summary();
+int ob_putc_slow();
+void ob_reserve();
+void ob_write();
+void ob_printf __P((struct obuf *, char *, ...));
+void ob_flush();
+#ifdef USE_PTHREADS
+int split_file();
+void scan_hdlc();
+void dump_parallel();
+void *dump_worker();
+#endif
 
 int
 main(ac, av)
     int ac;
     char **av;
 {
-    int i;
+    int i, n;
     char *p;
     FILE *f;
+    unsigned char hdr[PCAPNG_HDR_MAX];
 
-    while ((i = getopt(ac, av, "hprdm:a")) != -1) {
+    outfile = stdout;
+    while ((i = getopt(ac, av, "hprdm:aj:sf:w:")) != -1) {
 	switch (i) {
 	case 'h':
 	    hexmode = 1;
@@ -88,342 +221,1176 @@ main(ac, av)
 	case 'a':
 	    abs_times = 1;
 	    break;
+	case 'j':
+	    nthreads = atoi(optarg);
+	    break;
+	case 's':
+	    summary = 1;
+	    pppmode = frames_only = 1;
+	    break;
+	case 'f':
+	    parse_filter(optarg);
+	    filtering = 1;
+	    pppmode = frames_only = 1;
+	    break;
+	case 'w':
+	    if (strcmp(optarg, "-") != 0
+		&& (outfile = fopen(optarg, "w")) == NULL) {
+		perror(optarg);
+		exit(1);
+	    }
+	    pcapng_out = 1;
+	    pppmode = frames_only = 1;
+	    break;
 	default:
-	    fprintf(stderr, "Usage: %s [-h | -p[d]] [-r] [-m mru] [-a] [file ...]\n", av[0]);
+	    fprintf(stderr, "Usage: %s [-h | -p[d]] [-r] [-m mru] [-a] [-j threads] [-s] [-f filter] [-w pcapng-file] [file ...]\n", av[0]);
 	    exit(1);
 	}
     }
-    if (optind >= ac)
-	dumplog(stdin);
-    else {
+    pppfcs_init();
+    if (pcapng_out) {
+	n = pcapng_header(hdr, "pppdump", NULL, PCAPNG_SNAPLEN);
+	fwrite(hdr, 1, n, outfile);
+    }
+    if (optind >= ac) {
+	i = pppmode;
+	pppmode = frames_only;
+	dump_file(stdin);
+	pppmode = i;
+    } else {
 	for (i = optind; i < ac; ++i) {
 	    p = av[i];
 	    if ((f = fopen(p, "r")) == NULL) {
 		perror(p);
 		exit(1);
 	    }
-	    if (pppmode)
-		dumpppp(f);
-	    else
-		dumplog(f);
+	    dump_file(f);
 	    fclose(f);
 	}
     }
+    if (pcapng_out && fclose(outfile) == EOF) {
+	perror("pppdump");
+	exit(1);
+    }
+    if (summary)
+	print_summary();
     exit(0);
 }
 
+/*
+ * dump_file - print out the contents of a record file.
+ */
 void
-dumplog(f)
+dump_file(f)
+    FILE *f;
+{
+    unsigned char *base;
+    size_t len;
+    int stop;
+    struct dumper *d;
+    struct rbuf rb;
+
+    base = map_file(f, &len);
+#ifdef USE_PTHREADS
+    /* a pipe or tty can only be read in order, so -j is ignored */
+    if (base != NULL && nthreads > 1 && !decompress && !summary)
+	dump_parallel(base, len);
+    else
+#endif
+    {
+	d = malloc(sizeof(*d));
+	if (d == NULL) {
+	    perror("pppdump");
+	    exit(1);
+	}
+	init_dumper(d, NULL);
+	d->flush = 1;
+	memset(&rb, 0, sizeof(rb));
+	if (base != NULL) {
+	    rb.p = base;
+	    rb.end = base + len;
+	} else {
+	    rb.f = f;
+	    rb.size = RBUF_SIZE;
+	    rb.buf = malloc(rb.size);
+	    if (rb.buf == NULL) {
+		perror("pppdump");
+		exit(1);
+	    }
+	    rb.p = rb.end = rb.buf;
+	    rb.out = &d->out;
+	}
+	stop = pppmode? dumpppp(d, &rb): dumplog(d, &rb);
+	ob_flush(&d->out);
+	free(d->out.buf);
+	free(d);
+	free(rb.buf);
+	if (stop) {
+	    if (summary)
+		print_summary();
+	    exit(0);
+	}
+    }
+    if (base != NULL)
+	munmap(base, len);
+}
+
+/*
+ * map_file - map a record file into memory if it's a regular file.
+ * Returns NULL if it isn't, or can't be mapped.
+ */
+unsigned char *
+map_file(f, lenp)
     FILE *f;
+    size_t *lenp;
+{
+    struct stat sbuf;
+    unsigned char *p;
+
+    if (fstat(fileno(f), &sbuf) != 0 || !S_ISREG(sbuf.st_mode)
+	|| sbuf.st_size == 0)
+	return NULL;
+    p = mmap(NULL, sbuf.st_size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+    if (p == MAP_FAILED)
+	return NULL;
+#ifdef MADV_SEQUENTIAL
+    madvise(p, sbuf.st_size, MADV_SEQUENTIAL);
+#endif
+    *lenp = sbuf.st_size;
+    return p;
+}
+
+/*
+ * rb_fill - for a record file that isn't mapped, get at least n bytes
+ * from rb->p on into memory, unless the file ends first.  The output
+ * so far is written out before we wait for more input, as a live
+ * record file from a pipe should be printed as it comes.
+ */
+void
+rb_fill(rb, n)
+    struct rbuf *rb;
+    int n;
+{
+    int len, r;
+
+    if (rb->f == NULL || rb->end - rb->p >= n)
+	return;
+    len = rb->end - rb->p;
+    memmove(rb->buf, rb->p, len);
+    rb->p = rb->buf;
+    while (len < n) {
+	if (rb->out != NULL) {
+	    ob_flush(rb->out);
+	    fflush(outfile);
+	}
+	r = read(fileno(rb->f), rb->buf + len, rb->size - len);
+	if (r < 0 && errno == EINTR)
+	    continue;
+	if (r <= 0)
+	    break;
+	len += r;
+    }
+    rb->end = rb->buf + len;
+}
+
+/*
+ * init_dumper - set up to dump a file, or a piece of one starting
+ * in state *st.
+ */
+void
+init_dumper(d, st)
+    struct dumper *d;
+    struct dstate *st;
+{
+    memset(d, 0, sizeof(*d));
+    if (st != NULL)
+	d->st = *st;
+    else
+	d->st.rec_version = 1;
+}
+
+int
+ob_putc_slow(ob, c)
+    struct obuf *ob;
+    int c;
+{
+    ob_reserve(ob, 1);
+    return ob->buf[ob->len++] = c;
+}
+
+/*
+ * ob_reserve - make sure there's room in an output buffer for
+ * n more bytes (and then some).
+ */
+void
+ob_reserve(ob, n)
+    struct obuf *ob;
+    int n;
+{
+    if (ob->len + n + 256 > ob->size) {
+	ob->size = ob->size * 2 + n + 256;
+	ob->buf = realloc(ob->buf, ob->size);
+	if (ob->buf == NULL) {
+	    perror("pppdump");
+	    exit(1);
+	}
+    }
+}
+
+/*
+ * ob_write - append n bytes to an output buffer.
+ */
+void
+ob_write(ob, s, n)
+    struct obuf *ob;
+    char *s;
+    int n;
+{
+    ob_reserve(ob, n);
+    memcpy(ob->buf + ob->len, s, n);
+    ob->len += n;
+}
+
+void
+ob_printf(struct obuf *ob, char *fmt, ...)
+{
+    va_list args;
+    int n;
+
+    for (;;) {
+	va_start(args, fmt);
+	n = vsnprintf(ob->buf + ob->len, ob->size - ob->len, fmt, args);
+	va_end(args);
+	if (n < ob->size - ob->len)
+	    break;
+	ob_reserve(ob, n);
+    }
+    ob->len += n;
+}
+
+/*
+ * ob_flush - write out and empty an output buffer.
+ */
+void
+ob_flush(ob)
+    struct obuf *ob;
+{
+    if (ob->len > 0)
+	fwrite(ob->buf, 1, ob->len, outfile);
+    ob->len = 0;
+}
+
+int
+dumplog(d, rb)
+    struct dumper *d;
+    struct rbuf *rb;
 {
     int c, n, k, col;
     int nb, c2;
     unsigned char buf[16];
+    struct obuf *ob = &d->out;
 
-    while ((c = getc(f)) != EOF) {
+    while ((c = next_record(d, rb, &n)) != EOF) {
 	switch (c) {
 	case 1:
 	case 2:
 	    if (reverse)
 		c = 3 - c;
-	    printf("%s %c", c==1? "sent": "rcvd", hexmode? ' ': '"');
+	    ob_printf(ob, "%s %c", c==1? "sent": "rcvd", hexmode? ' ': '"');
 	    col = 6;
-	    n = getc(f);
-	    n = (n << 8) + getc(f);
-	    *(c==1? &tot_sent: &tot_rcvd) += n;
+	    *(c==1? &d->st.tot_sent: &d->st.tot_rcvd) += n;
 	    nb = 0;
 	    for (; n > 0; --n) {
-		c = getc(f);
+		c = rgetc(rb);
 		if (c == EOF) {
-		    printf("\nEOF\n");
-		    exit(0);
+		    ob_printf(ob, "\nEOF\n");
+		    return 1;
 		}
 		if (hexmode) {
 		    if (nb >= 16) {
-			printf("  ");
+			ob_write(ob, "  ", 2);
 			for (k = 0; k < nb; ++k) {
 			    c2 = buf[k];
-			    putchar((' ' <= c2 && c2 <= '~')? c2: '.');
+			    ob_putc(ob, (' ' <= c2 && c2 <= '~')? c2: '.');
 			}
-			printf("\n      ");
+			ob_write(ob, "\n      ", 7);
 			nb = 0;
 		    }
 		    buf[nb++] = c;
-		    printf(" %.2x", c);
+		    ob_putc(ob, ' ');
+		    ob_putc(ob, hexdig[c >> 4]);
+		    ob_putc(ob, hexdig[c & 0xf]);
 		} else {
 		    k = (' ' <= c && c <= '~')? (c != '\\' && c != '"')? 1: 2: 3;
 		    if ((col += k) >= 78) {
-			printf("\n      ");
+			ob_write(ob, "\n      ", 7);
 			col = 6 + k;
 		    }
 		    switch (k) {
 		    case 1:
-			putchar(c);
+			ob_putc(ob, c);
 			break;
 		    case 2:
-			printf("\\%c", c);
+			ob_putc(ob, '\\');
+			ob_putc(ob, c);
 			break;
 		    case 3:
-			printf("\\%.2x", c);
+			ob_putc(ob, '\\');
+			ob_putc(ob, hexdig[c >> 4]);
+			ob_putc(ob, hexdig[c & 0xf]);
 			break;
 		    }
 		}
 	    }
 	    if (hexmode) {
 		for (k = nb; k < 16; ++k)
-		    printf("   ");
-		printf("  ");
+		    ob_write(ob, "   ", 3);
+		ob_write(ob, "  ", 2);
 		for (k = 0; k < nb; ++k) {
 		    c2 = buf[k];
-		    putchar((' ' <= c2 && c2 <= '~')? c2: '.');
+		    ob_putc(ob, (' ' <= c2 && c2 <= '~')? c2: '.');
 		}
 	    } else
-		putchar('"');
-	    printf("\n");
+		ob_putc(ob, '"');
+	    ob_putc(ob, '\n');
 	    break;
 	case 3:
 	case 4:
-	    printf("end %s\n", c==3? "send": "recv");
-	    break;
-	case 5:
-	case 6:
-	case 7:
-	    show_time(f, c);
+	    ob_printf(ob, "end %s\n", c==3? "send": "recv");
 	    break;
 	default:
-	    printf("?%.2x\n", c);
-	}
-    }
-}
-
-/*
- * FCS lookup table as calculated by genfcstab.
- */
-static u_short fcstab[256] = {
-	0x0000,	0x1189,	0x2312,	0x329b,	0x4624,	0x57ad,	0x6536,	0x74bf,
-	0x8c48,	0x9dc1,	0xaf5a,	0xbed3,	0xca6c,	0xdbe5,	0xe97e,	0xf8f7,
-	0x1081,	0x0108,	0x3393,	0x221a,	0x56a5,	0x472c,	0x75b7,	0x643e,
-	0x9cc9,	0x8d40,	0xbfdb,	0xae52,	0xdaed,	0xcb64,	0xf9ff,	0xe876,
-	0x2102,	0x308b,	0x0210,	0x1399,	0x6726,	0x76af,	0x4434,	0x55bd,
-	0xad4a,	0xbcc3,	0x8e58,	0x9fd1,	0xeb6e,	0xfae7,	0xc87c,	0xd9f5,
-	0x3183,	0x200a,	0x1291,	0x0318,	0x77a7,	0x662e,	0x54b5,	0x453c,
-	0xbdcb,	0xac42,	0x9ed9,	0x8f50,	0xfbef,	0xea66,	0xd8fd,	0xc974,
-	0x4204,	0x538d,	0x6116,	0x709f,	0x0420,	0x15a9,	0x2732,	0x36bb,
-	0xce4c,	0xdfc5,	0xed5e,	0xfcd7,	0x8868,	0x99e1,	0xab7a,	0xbaf3,
-	0x5285,	0x430c,	0x7197,	0x601e,	0x14a1,	0x0528,	0x37b3,	0x263a,
-	0xdecd,	0xcf44,	0xfddf,	0xec56,	0x98e9,	0x8960,	0xbbfb,	0xaa72,
-	0x6306,	0x728f,	0x4014,	0x519d,	0x2522,	0x34ab,	0x0630,	0x17b9,
-	0xef4e,	0xfec7,	0xcc5c,	0xddd5,	0xa96a,	0xb8e3,	0x8a78,	0x9bf1,
-	0x7387,	0x620e,	0x5095,	0x411c,	0x35a3,	0x242a,	0x16b1,	0x0738,
-	0xffcf,	0xee46,	0xdcdd,	0xcd54,	0xb9eb,	0xa862,	0x9af9,	0x8b70,
-	0x8408,	0x9581,	0xa71a,	0xb693,	0xc22c,	0xd3a5,	0xe13e,	0xf0b7,
-	0x0840,	0x19c9,	0x2b52,	0x3adb,	0x4e64,	0x5fed,	0x6d76,	0x7cff,
-	0x9489,	0x8500,	0xb79b,	0xa612,	0xd2ad,	0xc324,	0xf1bf,	0xe036,
-	0x18c1,	0x0948,	0x3bd3,	0x2a5a,	0x5ee5,	0x4f6c,	0x7df7,	0x6c7e,
-	0xa50a,	0xb483,	0x8618,	0x9791,	0xe32e,	0xf2a7,	0xc03c,	0xd1b5,
-	0x2942,	0x38cb,	0x0a50,	0x1bd9,	0x6f66,	0x7eef,	0x4c74,	0x5dfd,
-	0xb58b,	0xa402,	0x9699,	0x8710,	0xf3af,	0xe226,	0xd0bd,	0xc134,
-	0x39c3,	0x284a,	0x1ad1,	0x0b58,	0x7fe7,	0x6e6e,	0x5cf5,	0x4d7c,
-	0xc60c,	0xd785,	0xe51e,	0xf497,	0x8028,	0x91a1,	0xa33a,	0xb2b3,
-	0x4a44,	0x5bcd,	0x6956,	0x78df,	0x0c60,	0x1de9,	0x2f72,	0x3efb,
-	0xd68d,	0xc704,	0xf59f,	0xe416,	0x90a9,	0x8120,	0xb3bb,	0xa232,
-	0x5ac5,	0x4b4c,	0x79d7,	0x685e,	0x1ce1,	0x0d68,	0x3ff3,	0x2e7a,
-	0xe70e,	0xf687,	0xc41c,	0xd595,	0xa12a,	0xb0a3,	0x8238,	0x93b1,
-	0x6b46,	0x7acf,	0x4854,	0x59dd,	0x2d62,	0x3ceb,	0x0e70,	0x1ff9,
-	0xf78f,	0xe606,	0xd49d,	0xc514,	0xb1ab,	0xa022,	0x92b9,	0x8330,
-	0x7bc7,	0x6a4e,	0x58d5,	0x495c,	0x3de3,	0x2c6a,	0x1ef1,	0x0f78
-};
-
-struct pkt {
-    int	cnt;
-    int	esc;
-    int	flags;
-    struct compressor *comp;
-    void *state;
-    unsigned char buf[8192];
-} spkt, rpkt;
-
-/* Values for flags */
-#define CCP_ISUP	1
-#define CCP_ERROR	2
-#define CCP_FATALERROR	4
-#define CCP_ERR		(CCP_ERROR | CCP_FATALERROR)
-#define CCP_DECOMP_RUN	8
+	    ob_printf(ob, "?%.2x\n", c);
+	    rb->p += (n < rb->end - rb->p)? n: rb->end - rb->p;
+	}
+	if (d->flush && ob->len >= OBUF_FLUSH)
+	    ob_flush(ob);
+    }
+    return 0;
+}
 
-unsigned char dbuf[8192];
+/*
+ * hdlc_special[c] is set for the bytes which need attention when
+ * collecting the bytes of a record into packets.
+ */
+static unsigned char hdlc_special[256] = {
+    ['~'] = 1, ['}'] = 1
+};
 
-void
-dumpppp(f)
-    FILE *f;
+int
+dumpppp(d, rb)
+    struct dumper *d;
+    struct rbuf *rb;
 {
-    int c, n, k;
-    int nb, nl, dn, proto, rv;
-    char *dir, *q;
-    unsigned char *p, *r, *endp;
-    unsigned char *d;
-    unsigned short fcs;
+    int c, n;
+    int run, truncated;
+    char *dir;
+    unsigned char *p, *q, *lim;
     struct pkt *pkt;
+    struct obuf *ob = &d->out;
 
-    spkt.cnt = rpkt.cnt = 0;
-    spkt.esc = rpkt.esc = 0;
-    while ((c = getc(f)) != EOF) {
+    while ((c = next_record(d, rb, &n)) != EOF) {
 	switch (c) {
 	case 1:
 	case 2:
 	    if (reverse)
 		c = 3 - c;
 	    dir = c==1? "sent": "rcvd";
-	    pkt = c==1? &spkt: &rpkt;
-	    n = getc(f);
-	    n = (n << 8) + getc(f);
-	    *(c==1? &tot_sent: &tot_rcvd) += n;
-	    for (; n > 0; --n) {
-		c = getc(f);
-		switch (c) {
-		case EOF:
-		    printf("\nEOF\n");
-		    if (spkt.cnt > 0)
-			printf("[%d bytes in incomplete send packet]\n",
-			       spkt.cnt);
-		    if (rpkt.cnt > 0)
-			printf("[%d bytes in incomplete recv packet]\n",
-			       rpkt.cnt);
-		    exit(0);
-		case '~':
-		    if (pkt->cnt > 0) {
-			q = dir;
-			if (pkt->esc) {
-			    printf("%s aborted packet:\n     ", dir);
-			    q = "    ";
-			}
-			nb = pkt->cnt;
-			p = pkt->buf;
-			pkt->cnt = 0;
-			pkt->esc = 0;
-			if (nb <= 2) {
-			    printf("%s short packet [%d bytes]:", q, nb);
-			    for (k = 0; k < nb; ++k)
-				printf(" %.2x", p[k]);
-			    printf("\n");
-			    break;
-			}
-			fcs = PPP_INITFCS;
-			for (k = 0; k < nb; ++k)
-			    fcs = PPP_FCS(fcs, p[k]);
-			fcs &= 0xFFFF;
-			nb -= 2;
-			endp = p + nb;
-			r = p;
-			if (r[0] == 0xff && r[1] == 3)
-			    r += 2;
-			if ((r[0] & 1) == 0)
-			    ++r;
-			++r;
-			if (endp - r > mru)
-			    printf("     ERROR: length (%d) > MRU (%d)\n",
-				   endp - r, mru);
-			if (decompress && fcs == PPP_GOODFCS) {
-			    /* See if this is a CCP or compressed packet */
-			    d = dbuf;
-			    r = p;
-			    if (r[0] == 0xff && r[1] == 3) {
-				*d++ = *r++;
-				*d++ = *r++;
-			    }
-			    proto = r[0];
-			    if ((proto & 1) == 0)
-				proto = (proto << 8) + r[1];
-			    if (proto == PPP_CCP) {
-				handle_ccp(pkt, r + 2, endp - r - 2);
-			    } else if (proto == PPP_COMP) {
-				if ((pkt->flags & CCP_ISUP)
-				    && (pkt->flags & CCP_DECOMP_RUN)
-				    && pkt->state
-				    && (pkt->flags & CCP_ERR) == 0) {
-				    rv = pkt->comp->decompress(pkt->state, r,
-							endp - r, d, &dn);
-				    switch (rv) {
-				    case DECOMP_OK:
-					p = dbuf;
-					nb = d + dn - p;
-					if ((d[0] & 1) == 0)
-					    --dn;
-					--dn;
-					if (dn > mru)
-					    printf("     ERROR: decompressed length (%d) > MRU (%d)\n", dn, mru);
-					break;
-				    case DECOMP_ERROR:
-					printf("     DECOMPRESSION ERROR\n");
-					pkt->flags |= CCP_ERROR;
-					break;
-				    case DECOMP_FATALERROR:
-					printf("     FATAL DECOMPRESSION ERROR\n");
-					pkt->flags |= CCP_FATALERROR;
-					break;
-				    }
-				}
-			    } else if (pkt->state
-				       && (pkt->flags & CCP_DECOMP_RUN)) {
-				pkt->comp->incomp(pkt->state, r, endp - r);
-			    }
-			}
-			do {
-			    nl = nb < 16? nb: 16;
-			    printf("%s ", q);
-			    for (k = 0; k < nl; ++k)
-				printf(" %.2x", p[k]);
-			    for (; k < 16; ++k)
-				printf("   ");
-			    printf("  ");
-			    for (k = 0; k < nl; ++k) {
-				c = p[k];
-				putchar((' ' <= c && c <= '~')? c: '.');
-			    }
-			    printf("\n");
-			    q = "    ";
-			    p += nl;
-			    nb -= nl;
-			} while (nb > 0);
-			if (fcs != PPP_GOODFCS)
-			    printf("     BAD FCS: (residue = %x)\n", fcs);
-		    }
-		    break;
-		case '}':
-		    if (!pkt->esc) {
-			pkt->esc = 1;
-			break;
-		    }
-		    /* else fall through */
-		default:
-		    if (pkt->esc) {
-			c ^= 0x20;
-			pkt->esc = 0;
-		    }
-		    pkt->buf[pkt->cnt++] = c;
+	    pkt = c==1? &d->spkt: &d->rpkt;
+	    *(c==1? &d->st.tot_sent: &d->st.tot_rcvd) += n;
+	    d->time_shown = 0;
+	    p = rb->p;
+	    lim = p + (n > 0? n: 0);
+	    truncated = n > rb->end - p;
+	    if (truncated)
+		lim = rb->end;
+	    while (p < lim) {
+		/* copy bytes up to the next flag or escape in one go */
+		for (q = p; q < lim && !hdlc_special[*q]; ++q)
+		    ;
+		if (q > p && pkt->esc) {
+		    if (pkt->cnt < sizeof(pkt->buf))
+			pkt->buf[pkt->cnt++] = *p ^ 0x20;
+		    pkt->esc = 0;
+		    ++p;
+		}
+		run = q - p;
+		if (run > sizeof(pkt->buf) - pkt->cnt)
+		    run = sizeof(pkt->buf) - pkt->cnt;
+		memcpy(pkt->buf + pkt->cnt, p, run);
+		pkt->cnt += run;
+		if (q >= lim)
 		    break;
+		p = q + 1;
+		if (*q == '~') {
+		    if (pkt->cnt > 0)
+			dump_packet(d, pkt, dir);
+		} else if (!pkt->esc) {
+		    pkt->esc = 1;
+		} else {
+		    if (pkt->cnt < sizeof(pkt->buf))
+			pkt->buf[pkt->cnt++] = *q ^ 0x20;
+		    pkt->esc = 0;
 		}
 	    }
+	    rb->p = lim;
+	    if (truncated && pcapng_out)
+		return 1;
+	    if (truncated) {
+		ob_printf(ob, "\nEOF\n");
+		if (d->spkt.cnt > 0)
+		    ob_printf(ob, "[%d bytes in incomplete send packet]\n",
+			      d->spkt.cnt);
+		if (d->rpkt.cnt > 0)
+		    ob_printf(ob, "[%d bytes in incomplete recv packet]\n",
+			      d->rpkt.cnt);
+		return 1;
+	    }
 	    break;
 	case 3:
 	case 4:
 	    if (reverse)
 		c = 7 - c;
 	    dir = c==3? "send": "recv";
-	    pkt = c==3? &spkt: &rpkt;
-	    printf("end %s", dir);
+	    pkt = c==3? &d->spkt: &d->rpkt;
+	    if (frames_only)
+		break;
+	    ob_printf(ob, "end %s", dir);
 	    if (pkt->cnt > 0)
-		printf("  [%d bytes in incomplete packet]", pkt->cnt);
-	    printf("\n");
-	    break;
-	case 5:
-	case 6:
-	case 7:
-	    show_time(f, c);
+		ob_printf(ob, "  [%d bytes in incomplete packet]", pkt->cnt);
+	    ob_putc(ob, '\n');
 	    break;
 	default:
-	    printf("?%.2x\n", c);
+	    if (!frames_only)
+		ob_printf(ob, "?%.2x\n", c);
+	    rb->p += (n < rb->end - rb->p)? n: rb->end - rb->p;
 	}
+	if (d->flush && ob->len >= OBUF_FLUSH)
+	    ob_flush(ob);
+    }
+    return 0;
+}
+
+/*
+ * dump_packet - print out a packet which has been ended by a flag.
+ */
+void
+dump_packet(d, pkt, dir)
+    struct dumper *d;
+    struct pkt *pkt;
+    char *dir;
+{
+    int c, k, nb, nl, dn, proto, rv;
+    int sent, aborted, toolong, dtoolong, derr, fcslen;
+    char *q, *l;
+    unsigned char *p, *r, *endp;
+    unsigned char *dp;
+    unsigned short fcs;
+    struct obuf *ob = &d->out;
+
+    sent = pkt == &d->spkt;
+    aborted = pkt->esc;
+    nb = pkt->cnt;
+    p = pkt->buf;
+    pkt->cnt = 0;
+    pkt->esc = 0;
+
+    /*
+     * Unless we're decompressing, the protocol can't change, so
+     * frames that the filter doesn't want can be dropped right away.
+     */
+    proto = nb > 2? frame_proto(p): -1;
+    if (filtering && !decompress && !filter_match(d, sent, proto))
+	return;
+
+    fcs = PPP_GOODFCS;
+    toolong = dtoolong = derr = 0;
+    if (nb > 2) {
+	fcs = pppfcs16(PPP_INITFCS, p, nb);
+	fcslen = PPP_FCSLEN;
+	if (fcs != PPP_GOODFCS && nb > PPP_FCS32LEN
+	    && pppfcs32(PPP_INITFCS32, p, nb) == PPP_GOODFCS32) {
+	    /* the link has negotiated the 32-bit FCS */
+	    fcs = PPP_GOODFCS;
+	    fcslen = PPP_FCS32LEN;
+	}
+	nb -= fcslen;
+	endp = p + nb;
+	r = p;
+	if (r[0] == 0xff && r[1] == 3)
+	    r += 2;
+	if ((r[0] & 1) == 0)
+	    ++r;
+	++r;
+	if (endp - r > mru)
+	    toolong = endp - r;
+	if (decompress && fcs == PPP_GOODFCS) {
+	    /* See if this is a CCP or compressed packet */
+	    dp = d->dbuf;
+	    r = p;
+	    if (r[0] == 0xff && r[1] == 3) {
+		*dp++ = *r++;
+		*dp++ = *r++;
+	    }
+	    if (proto == PPP_CCP) {
+		handle_ccp(pkt, r + 2, endp - r - 2);
+	    } else if (proto == PPP_COMP) {
+		if ((pkt->flags & CCP_ISUP)
+		    && (pkt->flags & CCP_DECOMP_RUN)
+		    && pkt->state
+		    && (pkt->flags & CCP_ERR) == 0) {
+		    rv = pkt->comp->decompress(pkt->state, r,
+					       endp - r, dp, &dn);
+		    switch (rv) {
+		    case DECOMP_OK:
+			p = d->dbuf;
+			nb = dp + dn - p;
+			if ((dp[0] & 1) == 0)
+			    --dn;
+			--dn;
+			if (dn > mru)
+			    dtoolong = dn;
+			proto = frame_proto(p);
+			break;
+		    case DECOMP_ERROR:
+			pkt->flags |= CCP_ERROR;
+			derr = rv;
+			break;
+		    case DECOMP_FATALERROR:
+			pkt->flags |= CCP_FATALERROR;
+			derr = rv;
+			break;
+		    }
+		}
+	    } else if (pkt->state
+		       && (pkt->flags & CCP_DECOMP_RUN)) {
+		pkt->comp->incomp(pkt->state, r, endp - r);
+	    }
+	}
+    }
+    if (filtering && decompress && !filter_match(d, sent, proto))
+	return;
+    if (pcapng_out) {
+	if (proto >= 0 && !aborted && fcs == PPP_GOODFCS)
+	    write_pcapng(d, sent, p, nb);
+	if (!summary)
+	    return;
+    }
+    if (summary) {
+	count_frame(d, sent, proto, p, nb, aborted, fcs != PPP_GOODFCS,
+		    toolong || dtoolong);
+	return;
+    }
+
+    if (filtering)
+	show_frame_time(d);
+    q = dir;
+    if (aborted) {
+	ob_printf(ob, "%s aborted packet:\n     ", dir);
+	q = "    ";
+    }
+    if (proto < 0) {
+	ob_printf(ob, "%s short packet [%d bytes]:", q, nb);
+	for (k = 0; k < nb; ++k)
+	    ob_printf(ob, " %.2x", p[k]);
+	ob_putc(ob, '\n');
+	return;
     }
+    if (toolong)
+	ob_printf(ob, "     ERROR: length (%d) > MRU (%d)\n", toolong, mru);
+    if (dtoolong)
+	ob_printf(ob, "     ERROR: decompressed length (%d) > MRU (%d)\n",
+		  dtoolong, mru);
+    if (derr == DECOMP_ERROR)
+	ob_printf(ob, "     DECOMPRESSION ERROR\n");
+    else if (derr == DECOMP_FATALERROR)
+	ob_printf(ob, "     FATAL DECOMPRESSION ERROR\n");
+    do {
+	nl = nb < 16? nb: 16;
+	ob_reserve(ob, 128);		/* room for a whole line */
+	l = ob->buf + ob->len;
+	while (*q)
+	    *l++ = *q++;
+	*l++ = ' ';
+	for (k = 0; k < nl; ++k) {
+	    *l++ = ' ';
+	    *l++ = hexdig[p[k] >> 4];
+	    *l++ = hexdig[p[k] & 0xf];
+	}
+	for (; k < 16; ++k) {
+	    *l++ = ' ';
+	    *l++ = ' ';
+	    *l++ = ' ';
+	}
+	*l++ = ' ';
+	*l++ = ' ';
+	for (k = 0; k < nl; ++k) {
+	    c = p[k];
+	    *l++ = (' ' <= c && c <= '~')? c: '.';
+	}
+	*l++ = '\n';
+	ob->len = l - ob->buf;
+	q = "    ";
+	p += nl;
+	nb -= nl;
+    } while (nb > 0);
+    if (fcs != PPP_GOODFCS)
+	ob_printf(ob, "     BAD FCS: (residue = %x)\n", fcs);
+}
+
+/*
+ * Protocol names, for -f and for the summary.
+ */
+struct protoname {
+    char *name;
+    int proto;
+};
+
+static struct protoname protonames[] = {
+    { "IP",	PPP_IP },
+    { "IPv6",	PPP_IPV6 },
+    { "VJC",	PPP_VJC_COMP },
+    { "VJUC",	PPP_VJC_UNCOMP },
+    { "IPX",	PPP_IPX },
+    { "AT",	PPP_AT },
+    { "MP",	0x3d },
+    { "COMP",	PPP_COMP },
+    { "IPCP",	PPP_IPCP },
+    { "IPv6CP",	PPP_IPV6CP },
+    { "IPXCP",	PPP_IPXCP },
+    { "ATCP",	PPP_ATCP },
+    { "CCP",	PPP_CCP },
+    { "ECP",	PPP_ECP },
+    { "LCP",	PPP_LCP },
+    { "PAP",	PPP_PAP },
+    { "LQR",	PPP_LQR },
+    { "CHAP",	PPP_CHAP },
+    { "CBCP",	PPP_CBCP },
+    { "EAP",	PPP_EAP },
+    { NULL,	0 }
+};
+
+char *
+proto_name(proto)
+    int proto;
+{
+    struct protoname *pn;
+    static char buf[8];
+
+    for (pn = protonames; pn->name != NULL; ++pn)
+	if (pn->proto == proto)
+	    return pn->name;
+    snprintf(buf, sizeof(buf), "0x%.4x", proto);
+    return buf;
+}
+
+/*
+ * frame_proto - get the protocol number of a frame which has at
+ * least 3 bytes in it.
+ */
+int
+frame_proto(p)
+    unsigned char *p;
+{
+    int proto;
+
+    if (p[0] == 0xff && p[1] == 3)
+	p += 2;
+    proto = p[0];
+    if ((proto & 1) == 0)
+	proto = (proto << 8) + p[1];
+    return proto;
+}
+
+/*
+ * The filter given with -f.  The terms are ANDed together, except
+ * that the frame only has to match one of the protocols listed.
+ */
+#define MAXFILTPROTO	32
+
+struct filter {
+    int dirs;			/* 1 = sent, 2 = rcvd, 0 = both */
+    int nprotos;
+    int protos[MAXFILTPROTO];
+    double after;		/* seconds from the start of the session */
+    double before;		/* < 0 if none */
+} filt = { 0, 0, { 0 }, 0, -1 };
+
+void
+parse_filter(expr)
+    char *expr;
+{
+    char *w, *arg, *end, *s;
+    struct protoname *pn;
+    double v;
+    long n;
+
+    s = strdup(expr);
+    if (s == NULL) {
+	perror("pppdump");
+	exit(1);
+    }
+    for (w = strtok(s, " \t"); w != NULL; w = strtok(NULL, " \t")) {
+	if (strcmp(w, "sent") == 0) {
+	    filt.dirs |= 1;
+	    continue;
+	}
+	if (strcmp(w, "rcvd") == 0) {
+	    filt.dirs |= 2;
+	    continue;
+	}
+	if (strcmp(w, "proto") != 0 && strcmp(w, "after") != 0
+	    && strcmp(w, "before") != 0) {
+	    fprintf(stderr, "pppdump: unknown filter term '%s'\n", w);
+	    exit(1);
+	}
+	if ((arg = strtok(NULL, " \t")) == NULL) {
+	    fprintf(stderr, "pppdump: filter term '%s' needs a value\n", w);
+	    exit(1);
+	}
+	if (w[0] == 'p') {
+	    for (pn = protonames; pn->name != NULL; ++pn)
+		if (strcasecmp(pn->name, arg) == 0)
+		    break;
+	    if (pn->name != NULL)
+		n = pn->proto;
+	    else {
+		n = strtol(arg, &end, 0);
+		if (*end != 0 || n <= 0 || n > 0xffff) {
+		    fprintf(stderr, "pppdump: unknown protocol '%s'\n", arg);
+		    exit(1);
+		}
+	    }
+	    if (filt.nprotos >= MAXFILTPROTO) {
+		fprintf(stderr, "pppdump: too many protocols in filter\n");
+		exit(1);
+	    }
+	    filt.protos[filt.nprotos++] = n;
+	} else {
+	    v = strtod(arg, &end);
+	    if (*end != 0 || v < 0) {
+		fprintf(stderr, "pppdump: bad time '%s' in filter\n", arg);
+		exit(1);
+	    }
+	    if (w[0] == 'a')
+		filt.after = v;
+	    else
+		filt.before = v;
+	}
+    }
+    free(s);
+}
+
+/*
+ * filter_match - see if a frame is wanted.  Short frames have
+ * proto < 0 and only pass if no protocol was asked for.
+ */
+int
+filter_match(d, sent, proto)
+    struct dumper *d;
+    int sent, proto;
+{
+    int i;
+    double t;
+
+    if (filt.dirs != 0 && (filt.dirs & (sent? 1: 2)) == 0)
+	return 0;
+    if (filt.nprotos > 0) {
+	for (i = 0; i < filt.nprotos; ++i)
+	    if (filt.protos[i] == proto)
+		break;
+	if (i >= filt.nprotos)
+	    return 0;
+    }
+    if (filt.after > 0 || filt.before >= 0) {
+	t = d->st.rec_last.tv_sec + d->st.rec_last.tv_usec / 1e6;
+	if (t < filt.after || (filt.before >= 0 && t >= filt.before))
+	    return 0;
+    }
+    return 1;
+}
+
+/*
+ * show_frame_time - with a filter, time records are left out (they
+ * mostly belong to frames which weren't wanted), so the first frame
+ * printed from each record gets its time since the session started.
+ */
+void
+show_frame_time(d)
+    struct dumper *d;
+{
+    time_t t;
+    long us;
+    struct tm tm;
+
+    if (d->time_shown)
+	return;
+    d->time_shown = 1;
+    if (abs_times) {
+	us = d->st.rec_start.tv_usec + d->st.rec_last.tv_usec;
+	t = d->st.rec_start.tv_sec + d->st.rec_last.tv_sec + us / 1000000;
+	localtime_r(&t, &tm);
+	ob_printf(&d->out, "time  %.2d:%.2d:%.2d.%.6ld\n", tm.tm_hour,
+		  tm.tm_min, tm.tm_sec, us % 1000000);
+    } else
+	ob_printf(&d->out, "at    %.6fs\n",
+		  d->st.rec_last.tv_sec + d->st.rec_last.tv_usec / 1e6);
+}
+
+/*
+ * write_pcapng - add a packet to the output in pcapng format, with
+ * the time of the record it ended in.
+ */
+void
+write_pcapng(d, sent, p, nb)
+    struct dumper *d;
+    int sent;
+    unsigned char *p;
+    int nb;
+{
+    struct timeval tv;
+    struct obuf *ob = &d->out;
+
+    tv.tv_sec = d->st.rec_start.tv_sec + d->st.rec_last.tv_sec;
+    tv.tv_usec = d->st.rec_start.tv_usec + d->st.rec_last.tv_usec;
+    if (tv.tv_usec >= 1000000) {
+	++tv.tv_sec;
+	tv.tv_usec -= 1000000;
+    }
+    ob_reserve(ob, PCAPNG_PKT_SPACE(nb));
+    ob->len += pcapng_packet((unsigned char *) ob->buf + ob->len, &tv, sent,
+			     p, nb, PCAPNG_SNAPLEN);
+}
+
+/*
+ * Statistics gathered for -s.  Files are read serially in this mode,
+ * so these can just be global.  Arrays indexed by direction have the
+ * received count first, then the sent count.
+ */
+#define NGAPS		8	/* < 10us, < 100us, ... < 10s, longer */
+#define NRATES		7	/* idle, < 100B/s, ... < 1MB/s, faster */
+#define MAXEVENTS	10000
+
+struct protostats {
+    int proto;
+    unsigned long frames[2];
+    unsigned long bytes[2];
+};
+
+struct linkstats {
+    unsigned long frames, bytes;
+    unsigned long badfcs, aborted, runts, toolong;
+    unsigned long gaps[NGAPS];
+    int seen;			/* last is valid */
+    int session;
+    struct timeval last;	/* time of the last frame */
+};
+
+struct cpevent {
+    int session;
+    int sent;
+    int proto;
+    int code, id;
+    struct timeval start;	/* when the session started */
+    struct timeval when;	/* time since then */
+};
+
+struct summary {
+    struct linkstats link[2];
+    struct protostats *protos;
+    int nprotos, maxprotos;
+    struct cpevent *events;
+    int nevents, maxevents;
+    unsigned long lost_events;
+    unsigned long echoes;
+    int tp_valid;		/* counting bytes for second tp_sec */
+    int tp_session;
+    long tp_sec;
+    unsigned long tp_bytes;
+    unsigned long rates[NRATES];
+} sum;
+
+static char *gap_names[NGAPS] = {
+    "< 10us", "< 100us", "< 1ms", "< 10ms", "< 100ms", "< 1s", "< 10s",
+    ">= 10s"
+};
+
+static char *rate_names[NRATES] = {
+    "idle", "< 100", "< 1k", "< 10k", "< 100k", "< 1M", ">= 1M"
+};
+
+static char *cp_codes[] = {
+    NULL, "Conf-Req", "Conf-Ack", "Conf-Nak", "Conf-Rej", "Term-Req",
+    "Term-Ack", "Code-Rej", "Proto-Rej", "Echo-Req", "Echo-Rep",
+    "Disc-Req", "Ident", "Time-Rem", "Reset-Req", "Reset-Ack"
+};
+
+static char *pap_codes[] = {
+    NULL, "Auth-Req", "Auth-Ack", "Auth-Nak"
+};
+
+static char *chap_codes[] = {
+    NULL, "Challenge", "Response", "Success", "Failure"
+};
+
+static char *eap_codes[] = {
+    NULL, "Request", "Response", "Success", "Failure"
+};
+
+#define NCODES(a)	(sizeof(a) / sizeof((a)[0]))
+
+void
+add_rate(bytes, secs)
+    unsigned long bytes;
+    long secs;
+{
+    int k;
+    unsigned long lim;
+
+    k = 0;
+    if (bytes > 0)
+	for (k = 1, lim = 100; k < NRATES - 1 && bytes >= lim; ++k)
+	    lim *= 10;
+    sum.rates[k] += secs;
+}
+
+struct protostats *
+proto_stats(proto)
+    int proto;
+{
+    int i;
+    struct protostats *ps;
+
+    for (i = 0; i < sum.nprotos; ++i)
+	if (sum.protos[i].proto == proto)
+	    return &sum.protos[i];
+    if (sum.nprotos >= sum.maxprotos) {
+	sum.maxprotos = sum.maxprotos? sum.maxprotos * 2: 32;
+	sum.protos = realloc(sum.protos,
+			     sum.maxprotos * sizeof(struct protostats));
+	if (sum.protos == NULL) {
+	    perror("pppdump");
+	    exit(1);
+	}
+    }
+    ps = &sum.protos[sum.nprotos++];
+    memset(ps, 0, sizeof(*ps));
+    ps->proto = proto;
+    return ps;
+}
+
+/*
+ * count_frame - add a frame to the statistics for -s.
+ */
+void
+count_frame(d, sent, proto, p, nb, aborted, badfcs, toolong)
+    struct dumper *d;
+    int sent, proto;
+    unsigned char *p;
+    int nb, aborted, badfcs, toolong;
+{
+    struct linkstats *ls = &sum.link[sent];
+    struct timeval *t = &d->st.rec_last;
+    struct protostats *ps;
+    struct cpevent *ev;
+    double gap, lim;
+    int k;
+
+    ++ls->frames;
+    ls->bytes += nb;
+    if (aborted)
+	++ls->aborted;
+    if (proto < 0)
+	++ls->runts;
+    else if (badfcs)
+	++ls->badfcs;
+    if (toolong)
+	++ls->toolong;
+
+    if (ls->seen && ls->session == d->st.session) {
+	gap = (t->tv_sec - ls->last.tv_sec)
+	    + (t->tv_usec - ls->last.tv_usec) / 1e6;
+	for (k = 0, lim = 1e-5; k < NGAPS - 1 && gap >= lim; ++k)
+	    lim *= 10;
+	++ls->gaps[k];
+    }
+    ls->seen = 1;
+    ls->session = d->st.session;
+    ls->last = *t;
+
+    /* bytes per second over both directions, idle seconds included */
+    if (sum.tp_valid && (sum.tp_session != d->st.session
+			 || t->tv_sec < sum.tp_sec)) {
+	add_rate(sum.tp_bytes, 1);
+	sum.tp_valid = 0;
+    }
+    if (!sum.tp_valid) {
+	sum.tp_valid = 1;
+	sum.tp_session = d->st.session;
+	sum.tp_sec = t->tv_sec;
+	sum.tp_bytes = 0;
+    } else if (t->tv_sec != sum.tp_sec) {
+	add_rate(sum.tp_bytes, 1);
+	add_rate(0, t->tv_sec - sum.tp_sec - 1);
+	sum.tp_sec = t->tv_sec;
+	sum.tp_bytes = 0;
+    }
+    sum.tp_bytes += nb;
+
+    if (proto < 0 || badfcs || aborted)
+	return;
+    ps = proto_stats(proto);
+    ++ps->frames[sent];
+    ps->bytes[sent] += nb;
+
+    /* keep the negotiation packets for the timeline */
+    if ((proto & 0x8000) == 0 || proto == PPP_LQR)
+	return;
+    if (p[0] == 0xff && p[1] == 3) {
+	p += 2;
+	nb -= 2;
+    }
+    k = (proto & 0xff00)? 2: 1;
+    if (nb < k + 2)
+	return;
+    if (proto == PPP_LCP && p[k] >= 9 && p[k] <= 11) {	/* echo, discard */
+	++sum.echoes;
+	return;
+    }
+    if (sum.nevents >= sum.maxevents) {
+	if (sum.maxevents >= MAXEVENTS) {
+	    ++sum.lost_events;
+	    return;
+	}
+	sum.maxevents = sum.maxevents? sum.maxevents * 2: 256;
+	sum.events = realloc(sum.events,
+			     sum.maxevents * sizeof(struct cpevent));
+	if (sum.events == NULL) {
+	    perror("pppdump");
+	    exit(1);
+	}
+    }
+    ev = &sum.events[sum.nevents++];
+    ev->session = d->st.session;
+    ev->sent = sent;
+    ev->proto = proto;
+    ev->code = p[k];
+    ev->id = p[k+1];
+    ev->start = d->st.rec_start;
+    ev->when = *t;
+}
+
+char *
+code_name(proto, code)
+    int proto, code;
+{
+    char **names;
+    int n;
+    static char buf[16];
+
+    switch (proto) {
+    case PPP_PAP:
+	names = pap_codes;
+	n = NCODES(pap_codes);
+	break;
+    case PPP_CHAP:
+	names = chap_codes;
+	n = NCODES(chap_codes);
+	break;
+    case PPP_EAP:
+	names = eap_codes;
+	n = NCODES(eap_codes);
+	break;
+    default:
+	names = cp_codes;
+	n = NCODES(cp_codes);
+    }
+    if (code > 0 && code < n)
+	return names[code];
+    snprintf(buf, sizeof(buf), "code %d", code);
+    return buf;
+}
+
+int
+proto_cmp(a, b)
+    const void *a, *b;
+{
+    return ((struct protostats *)a)->proto - ((struct protostats *)b)->proto;
+}
+
+/*
+ * print_summary - print out what was gathered by count_frame.
+ */
+void
+print_summary()
+{
+    int i, k, session;
+    time_t t;
+    long us;
+    struct tm tm;
+    struct linkstats *s = &sum.link[1], *r = &sum.link[0];
+    struct protostats *ps;
+    struct cpevent *ev;
+    char tbuf[32];
+
+    if (sum.tp_valid) {
+	add_rate(sum.tp_bytes, 1);
+	sum.tp_valid = 0;
+    }
+
+    printf("%-24s %12s %12s\n", "Frames", "sent", "rcvd");
+    printf("  %-22s %12lu %12lu\n", "total", s->frames, r->frames);
+    printf("  %-22s %12lu %12lu\n", "bytes", s->bytes, r->bytes);
+    printf("  %-22s %12lu %12lu\n", "bad FCS", s->badfcs, r->badfcs);
+    printf("  %-22s %12lu %12lu\n", "aborted", s->aborted, r->aborted);
+    printf("  %-22s %12lu %12lu\n", "short", s->runts, r->runts);
+    printf("  %-22s %12lu %12lu\n", "longer than MRU", s->toolong,
+	   r->toolong);
+
+    printf("\n%-10s %12s %12s %12s %12s\n", "Protocol", "sent frames",
+	   "sent bytes", "rcvd frames", "rcvd bytes");
+    qsort(sum.protos, sum.nprotos, sizeof(struct protostats), proto_cmp);
+    for (i = 0; i < sum.nprotos; ++i) {
+	ps = &sum.protos[i];
+	printf("  %-8s %12lu %12lu %12lu %12lu\n", proto_name(ps->proto),
+	       ps->frames[1], ps->bytes[1], ps->frames[0], ps->bytes[0]);
+    }
+
+    printf("\nNegotiation\n");
+    session = -1;
+    for (i = 0; i < sum.nevents; ++i) {
+	ev = &sum.events[i];
+	if (ev->session != session) {
+	    session = ev->session;
+	    t = ev->start.tv_sec;
+	    if (t != 0)
+		printf("  session %d, started %s", session,
+		       ctime_r(&t, tbuf));
+	    else
+		printf("  session %d\n", session);
+	}
+	if (abs_times) {
+	    us = ev->start.tv_usec + ev->when.tv_usec;
+	    t = ev->start.tv_sec + ev->when.tv_sec + us / 1000000;
+	    localtime_r(&t, &tm);
+	    printf("    %.2d:%.2d:%.2d.%.6ld", tm.tm_hour, tm.tm_min,
+		   tm.tm_sec, us % 1000000);
+	} else
+	    printf("    %15.6f", ev->when.tv_sec + ev->when.tv_usec / 1e6);
+	printf("  %s %-6s %-9s id %d\n", ev->sent? "sent": "rcvd",
+	       proto_name(ev->proto), code_name(ev->proto, ev->code), ev->id);
+    }
+    if (sum.lost_events > 0)
+	printf("  [%lu more not kept]\n", sum.lost_events);
+    if (sum.echoes > 0)
+	printf("  [%lu LCP echo and discard packets]\n", sum.echoes);
+
+    printf("\n%-24s %12s %12s\n", "Gaps between frames", "sent", "rcvd");
+    for (k = 0; k < NGAPS; ++k)
+	printf("  %-22s %12lu %12lu\n", gap_names[k], s->gaps[k], r->gaps[k]);
+
+    printf("\n%-24s %12s\n", "Bytes per second", "seconds");
+    for (k = 0; k < NRATES; ++k)
+	printf("  %-22s %12lu\n", rate_names[k], sum.rates[k]);
 }
 
 extern struct compressor ppp_bsd_compress, ppp_deflate;
@@ -495,39 +1462,386 @@ handle_ccp(cp, dp, len)
     }
 }
 
+/*
+ * next_record - read the header of the next record from a record
+ * file, dealing with start and time records on the way.  Returns the
+ * record type, or EOF.  *lenp is set to the length of the data that
+ * follows the header, which the caller has to read or skip.
+ */
+int
+next_record(d, rb, lenp)
+    struct dumper *d;
+    struct rbuf *rb;
+    int *lenp;
+{
+    int c;
+    unsigned char *hdr, *data;
+    struct timeval t;
+    char tbuf[32];
+
+    for (;;) {
+	*lenp = 0;
+	rb_fill(rb, RECORD_HDRLEN + 16);
+	if ((c = rgetc(rb)) == EOF)
+	    return EOF;
+	switch (c) {
+	case 7:
+	    d->st.rec_version = 1;
+	    show_time(d, rb, c);
+	    continue;
+	case RECORD_START:
+	    break;
+	default:
+	    if (d->st.rec_version == 2)
+		break;
+	    if (c == 5 || c == 6) {
+		show_time(d, rb, c);
+		continue;
+	    }
+	    if (c == 1 || c == 2) {
+		*lenp = rgetc(rb);
+		*lenp = (*lenp << 8) + rgetc(rb);
+		rb_fill(rb, *lenp);
+	    }
+	    return c;
+	}
+
+	hdr = rb->p - 1;
+	if (rb->end - hdr < RECORD_HDRLEN) {
+	    rb->p = rb->end;
+	    return EOF;
+	}
+	rb->p = hdr + RECORD_HDRLEN;
+	*lenp = (hdr[2] << 8) + hdr[3];
+	t.tv_sec = (hdr[4] << 24) + (hdr[5] << 16) + (hdr[6] << 8) + hdr[7];
+	t.tv_usec = (hdr[8] << 24) + (hdr[9] << 16) + (hdr[10] << 8) + hdr[11];
+	if (c != RECORD_START) {
+	    if (t.tv_sec != d->st.rec_last.tv_sec
+		|| t.tv_usec != d->st.rec_last.tv_usec)
+		show_time2(d, &t);
+	    d->st.rec_last = t;
+	    rb_fill(rb, *lenp);
+	    return c;
+	}
+	data = rb->p;
+	if (*lenp != 16 || rb->end - data < 16
+	    || memcmp(data, RECORD_MAGIC, 4) != 0
+	    || (data[4] << 8) + data[5] != RECORD_VERSION) {
+	    if (*lenp == 16 && rb->end - data >= 16)
+		rb->p += 16;
+	    *lenp = 0;
+	    return c;
+	}
+	rb->p += 16;
+	d->st.rec_version = 2;
+	d->st.rec_start.tv_sec = (data[8] << 24) + (data[9] << 16)
+	    + (data[10] << 8) + data[11];
+	d->st.rec_start.tv_usec = (data[12] << 24) + (data[13] << 16)
+	    + (data[14] << 8) + data[15];
+	d->st.rec_last.tv_sec = d->st.rec_last.tv_usec = 0;
+	++d->st.session;
+	if (!d->quiet && !summary && !pcapng_out)
+	    ob_printf(&d->out, "start %s", ctime_r(&d->st.rec_start.tv_sec,
+						    tbuf));
+	d->st.tot_sent = d->st.tot_rcvd = 0;
+    }
+}
+
 void
-show_time(f, c)
-    FILE *f;
+show_time(d, rb, c)
+    struct dumper *d;
+    struct rbuf *rb;
     int c;
 {
     time_t t;
     int n;
-    struct tm *tm;
+    struct tm tm;
+    char tbuf[32];
 
     if (c == 7) {
-	t = getc(f);
-	t = (t << 8) + getc(f);
-	t = (t << 8) + getc(f);
-	t = (t << 8) + getc(f);
-	printf("start %s", ctime(&t));
-	start_time = t;
-	start_time_tenths = 0;
-	tot_sent = tot_rcvd = 0;
+	t = rgetc(rb);
+	t = (t << 8) + rgetc(rb);
+	t = (t << 8) + rgetc(rb);
+	t = (t << 8) + rgetc(rb);
+	if (!d->quiet && !summary && !pcapng_out)
+	    ob_printf(&d->out, "start %s", ctime_r(&t, tbuf));
+	d->st.start_time = t;
+	d->st.start_time_tenths = 0;
+	d->st.tot_sent = d->st.tot_rcvd = 0;
+	/* for -s and -f, which go by the time since the start */
+	d->st.rec_start.tv_sec = t;
+	d->st.rec_start.tv_usec = 0;
+	d->st.rec_last.tv_sec = d->st.rec_last.tv_usec = 0;
+	++d->st.session;
     } else {
-	n = getc(f);
+	n = rgetc(rb);
 	if (c == 5) {
 	    for (c = 3; c > 0; --c)
-		n = (n << 8) + getc(f);
+		n = (n << 8) + rgetc(rb);
+	}
+	d->st.rec_last.tv_sec += n / 10;
+	d->st.rec_last.tv_usec += (n % 10) * 100000;
+	if (d->st.rec_last.tv_usec >= 1000000) {
+	    ++d->st.rec_last.tv_sec;
+	    d->st.rec_last.tv_usec -= 1000000;
 	}
 	if (abs_times) {
-	    n += start_time_tenths;
-	    start_time += n / 10;
-	    start_time_tenths = n % 10;
-	    tm = localtime(&start_time);
-	    printf("time  %.2d:%.2d:%.2d.%d", tm->tm_hour, tm->tm_min,
-		   tm->tm_sec, start_time_tenths);
-	    printf("  (sent %d, rcvd %d)\n", tot_sent, tot_rcvd);
-	} else
-	    printf("time  %.1fs\n", (double) n / 10);
+	    n += d->st.start_time_tenths;
+	    d->st.start_time += n / 10;
+	    d->st.start_time_tenths = n % 10;
+	    if (d->quiet || frames_only)
+		return;
+	    localtime_r(&d->st.start_time, &tm);
+	    ob_printf(&d->out, "time  %.2d:%.2d:%.2d.%d", tm.tm_hour,
+		      tm.tm_min, tm.tm_sec, d->st.start_time_tenths);
+	    ob_printf(&d->out, "  (sent %d, rcvd %d)\n", d->st.tot_sent,
+		      d->st.tot_rcvd);
+	} else if (!d->quiet && !frames_only)
+	    ob_printf(&d->out, "time  %.1fs\n", (double) n / 10);
+    }
+}
+
+/*
+ * show_time2 - print the time of a record in the new format, which
+ * is *tp since the start of the session.
+ */
+void
+show_time2(d, tp)
+    struct dumper *d;
+    struct timeval *tp;
+{
+    time_t t;
+    long us;
+    struct tm tm;
+
+    if (d->quiet || frames_only)
+	return;
+    if (abs_times) {
+	us = d->st.rec_start.tv_usec + tp->tv_usec;
+	t = d->st.rec_start.tv_sec + tp->tv_sec + us / 1000000;
+	localtime_r(&t, &tm);
+	ob_printf(&d->out, "time  %.2d:%.2d:%.2d.%.6ld", tm.tm_hour,
+		  tm.tm_min, tm.tm_sec, us % 1000000);
+	ob_printf(&d->out, "  (sent %d, rcvd %d)\n", d->st.tot_sent,
+		  d->st.tot_rcvd);
+    } else
+	ob_printf(&d->out, "time  %.6fs\n",
+		  (tp->tv_sec - d->st.rec_last.tv_sec)
+		  + (tp->tv_usec - d->st.rec_last.tv_usec) / 1e6);
+}
+
+#ifdef USE_PTHREADS
+/*
+ * With -j, a file is split at record boundaries into chunks which are
+ * decoded by a pool of threads, each into its own output buffer; the
+ * main thread writes the buffers out in order.  A chunk only starts
+ * where neither direction has a partial packet collected, and carries
+ * the dstate at its start, so each chunk's output is exactly what the
+ * serial code would have printed for it.  Decompression has to see
+ * every packet in order, so -d always runs serially.
+ */
+#define CHUNK_MIN	(1 << 20)	/* don't split finer than this */
+
+struct chunk {
+    unsigned char *start, *end;
+    struct dstate st;		/* state at the start of the chunk */
+    struct obuf out;
+    int stop;			/* ended mid-record */
+    int done;
+};
+
+static struct chunk *chunks;
+static int nchunks, next_chunk, chunks_written;
+static pthread_mutex_t chunk_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t chunk_cond = PTHREAD_COND_INITIALIZER;
+
+/*
+ * HDLC collection state for one direction, as far as split_file
+ * needs to know it.
+ */
+struct hdlc_scan {
+    int have;			/* some bytes collected */
+    int esc;			/* saw an escape */
+};
+
+/*
+ * dump_parallel - dump a file using nthreads threads.
+ */
+void
+dump_parallel(base, len)
+    unsigned char *base;
+    size_t len;
+{
+    pthread_t *tids;
+    int i, stop;
+
+    nchunks = split_file(base, len);
+    next_chunk = chunks_written = 0;
+    tids = malloc(nthreads * sizeof(pthread_t));
+    if (tids == NULL) {
+	perror("pppdump");
+	exit(1);
+    }
+    for (i = 0; i < nthreads; ++i)
+	if (pthread_create(&tids[i], NULL, dump_worker, NULL) != 0) {
+	    perror("pppdump: pthread_create");
+	    exit(1);
+	}
+
+    stop = 0;
+    for (i = 0; i < nchunks && !stop; ++i) {
+	pthread_mutex_lock(&chunk_lock);
+	while (!chunks[i].done)
+	    pthread_cond_wait(&chunk_cond, &chunk_lock);
+	pthread_mutex_unlock(&chunk_lock);
+	ob_flush(&chunks[i].out);
+	free(chunks[i].out.buf);
+	stop = chunks[i].stop;
+	pthread_mutex_lock(&chunk_lock);
+	++chunks_written;
+	pthread_cond_broadcast(&chunk_cond);
+	pthread_mutex_unlock(&chunk_lock);
+    }
+    if (stop)
+	exit(0);
+    for (i = 0; i < nthreads; ++i)
+	pthread_join(tids[i], NULL);
+    free(tids);
+    free(chunks);
+}
+
+/*
+ * dump_worker - decode chunks until there are none left.  Workers
+ * don't get more than 2 * nthreads chunks ahead of the output.
+ */
+void *
+dump_worker(arg)
+    void *arg;
+{
+    struct dumper *d;
+    struct rbuf rb;
+    struct chunk *ch;
+    int stop;
+
+    d = malloc(sizeof(*d));
+    if (d == NULL) {
+	perror("pppdump");
+	exit(1);
+    }
+    pthread_mutex_lock(&chunk_lock);
+    for (;;) {
+	while (next_chunk < nchunks
+	       && next_chunk >= chunks_written + 2 * nthreads)
+	    pthread_cond_wait(&chunk_cond, &chunk_lock);
+	if (next_chunk >= nchunks)
+	    break;
+	ch = &chunks[next_chunk++];
+	pthread_mutex_unlock(&chunk_lock);
+
+	init_dumper(d, &ch->st);
+	memset(&rb, 0, sizeof(rb));
+	rb.p = ch->start;
+	rb.end = ch->end;
+	stop = pppmode? dumpppp(d, &rb): dumplog(d, &rb);
+
+	pthread_mutex_lock(&chunk_lock);
+	ch->out = d->out;
+	ch->stop = stop;
+	ch->done = 1;
+	pthread_cond_broadcast(&chunk_cond);
+    }
+    pthread_mutex_unlock(&chunk_lock);
+    free(d);
+    return NULL;
+}
+
+/*
+ * split_file - find where to split a file into chunks, by running
+ * through the records without printing anything.  Fills in chunks[]
+ * and returns the number of chunks.
+ */
+int
+split_file(base, len)
+    unsigned char *base;
+    size_t len;
+{
+    struct dumper *d;
+    struct rbuf rb;
+    struct hdlc_scan hs[2];
+    unsigned char *start, *lim;
+    size_t target;
+    int c, n, max, rlen;
+
+    target = len / (nthreads * 4);
+    if (target < CHUNK_MIN)
+	target = CHUNK_MIN;
+    max = len / target + 2;
+    chunks = calloc(max, sizeof(struct chunk));
+    d = malloc(sizeof(*d));
+    if (chunks == NULL || d == NULL) {
+	perror("pppdump");
+	exit(1);
+    }
+    init_dumper(d, NULL);
+    d->quiet = 1;
+    memset(hs, 0, sizeof(hs));
+    memset(&rb, 0, sizeof(rb));
+    rb.p = base;
+    rb.end = base + len;
+
+    n = 0;
+    start = base;
+    chunks[0].start = base;
+    chunks[0].st = d->st;
+    for (;;) {
+	if (rb.p - start >= target && n < max - 1
+	    && !hs[0].have && !hs[0].esc && !hs[1].have && !hs[1].esc) {
+	    chunks[n++].end = rb.p;
+	    start = rb.p;
+	    chunks[n].start = start;
+	    chunks[n].st = d->st;
+	}
+	if ((c = next_record(d, &rb, &rlen)) == EOF)
+	    break;
+	lim = rb.p + (rlen > 0? rlen: 0);
+	if (lim > rb.end)
+	    lim = rb.end;
+	if (c == 1 || c == 2) {
+	    if (reverse)
+		c = 3 - c;
+	    *(c==1? &d->st.tot_sent: &d->st.tot_rcvd) += rlen;
+	    if (pppmode)
+		scan_hdlc(&hs[c-1], rb.p, lim);
+	}
+	rb.p = lim;
+    }
+    chunks[n++].end = rb.end;
+    free(d);
+    return n;
+}
+
+/*
+ * scan_hdlc - follow the HDLC collection state of dumpppp through
+ * the bytes from p to lim.
+ */
+void
+scan_hdlc(hs, p, lim)
+    struct hdlc_scan *hs;
+    unsigned char *p, *lim;
+{
+    for (; p < lim; ++p) {
+	if (!hdlc_special[*p]) {
+	    hs->have = 1;
+	    hs->esc = 0;
+	} else if (*p == '~') {
+	    if (hs->have)
+		hs->have = hs->esc = 0;
+	} else if (!hs->esc) {
+	    hs->esc = 1;
+	} else {
+	    hs->have = 1;
+	    hs->esc = 0;
+	}
     }
 }
+#endif /* USE_PTHREADS */
@@ -1,6 +1,6 @@
 /*
  * print PPP statistics:
- * 	pppstats [-a|-d] [-v|-r|-z] [-c count] [-w wait] [interface]
+ * 	pppstats [-a|-d] [-v|-r|-z|-s] [-c count] [-w wait] [interface]
  *
  *   -a Show absolute values rather than deltas
  *   -d Show data rate (kB/s) rather than bytes
@@ -83,7 +83,15 @@ static const char rcsid[] = "$Id: pppstats.c,v 1.29 2002/10/27 12:56:26 fcusack
 
 #endif	/* STREAMS */
 
+#ifndef PPPIO_GETBYPSTAT
+struct bypstat {		/* only the STREAMS modules keep these */
+    unsigned int byp_bytes;
+    unsigned int byp_packets;
+};
+#endif
+
 int	vflag, rflag, zflag;	/* select type of display */
+int	sflag;			/* show per-slot VJ statistics */
 int	aflag;			/* print absolute values, not deltas */
 int	dflag;			/* print data rates, not bytes */
 int	interval, count;
@@ -111,14 +119,16 @@ static void usage __P((void));
 static void catchalarm __P((int));
 static void get_ppp_stats __P((struct ppp_stats *));
 static void get_ppp_cstats __P((struct ppp_comp_stats *));
+static int get_ppp_bstats __P((struct bypstat *));
 static void intpr __P((void));
+static void slotpr __P((void));
 
 int main __P((int, char *argv[]));
 
 static void
 usage()
 {
-    fprintf(stderr, "Usage: %s [-a|-d] [-v|-r|-z] [-c count] [-w wait] [interface]\n",
+    fprintf(stderr, "Usage: %s [-a|-d] [-v|-r|-z|-s] [-c count] [-w wait] [interface]\n",
 	    progname);
     exit(1);
 }
@@ -268,11 +278,71 @@ get_ppp_cstats(csp)
     }
 }
 
+/*
+ * get_ppp_bstats - get the count of packets which bypassed the
+ * compressor.  Returns 0 if the kernel doesn't keep it.
+ */
+static int
+get_ppp_bstats(bsp)
+    struct bypstat *bsp;
+{
+    return strioctl(s, PPPIO_GETBYPSTAT, bsp, 0, sizeof(*bsp)) >= 0;
+}
+
+/*
+ * slotpr - print how often each VJ transmit slot has been found by
+ * a packet (hits) and taken for a new TCP conversation (misses).
+ * Lots of misses mean more slots are needed (see vj-max-slots).
+ */
+static void
+slotpr()
+{
+    struct vjslotstat vs[256];
+    struct strioctl str;
+    int i, n;
+
+    str.ic_cmd = PPPIO_GETVJSLOTS;
+    str.ic_timout = 0;
+    str.ic_len = 0;
+    str.ic_dp = (char *) vs;
+    if (ioctl(s, I_STR, &str) == -1) {
+	fprintf(stderr, "%s: ", progname);
+	if (errno == EINVAL)
+	    fprintf(stderr, "kernel support missing\n");
+	else
+	    perror("couldn't get VJ slot statistics");
+	exit(1);
+    }
+    n = str.ic_len / sizeof(struct vjslotstat);
+    printf("%4.4s %10.10s %10.10s\n", "SLOT", "HITS", "MISSES");
+    for (i = 0; i < n; ++i)
+	if (vs[i].vjss_hits != 0 || vs[i].vjss_misses != 0)
+	    printf("%4d %10u %10u\n", i, vs[i].vjss_hits, vs[i].vjss_misses);
+}
+
 #endif /* STREAMS */
 
+#ifndef STREAMS
+static int
+get_ppp_bstats(bsp)
+    struct bypstat *bsp;
+{
+    return 0;
+}
+
+static void
+slotpr()
+{
+    fprintf(stderr, "%s: per-slot VJ statistics are not available here\n",
+	    progname);
+    exit(1);
+}
+#endif
+
 #define MAX0(a)		((int)(a) > 0? (a): 0)
 #define V(offset)	MAX0(cur.offset - old.offset)
 #define W(offset)	MAX0(ccs.offset - ocs.offset)
+#define B(offset)	MAX0(cbs.offset - obs.offset)
 
 #define RATIO(c, i, u)	((c) == 0? 1.0: (u) / ((double)(c) + (i)))
 #define CRATE(x)	RATIO(W(x.comp_bytes), W(x.inc_bytes), W(x.unc_bytes))
@@ -294,14 +364,19 @@ intpr()
     int ratef = 0;
     struct ppp_stats cur, old;
     struct ppp_comp_stats ccs, ocs;
+    struct bypstat cbs, obs;
+    int bypass = 0;
 
     memset(&old, 0, sizeof(old));
     memset(&ocs, 0, sizeof(ocs));
+    memset(&obs, 0, sizeof(obs));
 
     while (1) {
 	get_ppp_stats(&cur);
 	if (zflag || rflag)
 	    get_ppp_cstats(&ccs);
+	if (zflag && vflag)
+	    bypass = get_ppp_bstats(&cbs);
 
 	(void)signal(SIGALRM, catchalarm);
 	signalled = 0;
@@ -310,10 +385,15 @@ intpr()
 	if ((line % 20) == 0) {
 	    if (zflag) {
 		printf("IN:  COMPRESSED  INCOMPRESSIBLE   COMP | ");
-		printf("OUT: COMPRESSED  INCOMPRESSIBLE   COMP\n");
+		printf("OUT: COMPRESSED  INCOMPRESSIBLE   COMP");
+		if (bypass)
+		    printf("   BYPASSED");
+		putchar('\n');
 		bunit = dflag? "KB/S": "BYTE";
 		printf("    %s   PACK     %s   PACK  RATIO | ", bunit, bunit);
 		printf("    %s   PACK     %s   PACK  RATIO", bunit, bunit);
+		if (bypass)
+		    printf("    %s   PACK", bunit);
 	    } else {
 		printf("%8.8s %6.6s %6.6s",
 		       "IN", "PACK", "VJCOMP");
@@ -351,6 +431,10 @@ intpr()
 		       KBPS(W(c.inc_bytes)),
 		       W(c.inc_packets),
 		       ccs.c.ratio / 256.0);
+		if (bypass)
+		    printf(" %8.3f %6u",
+			   KBPS(B(byp_bytes)),
+			   B(byp_packets));
 	    } else {
 		printf("%8u %6u %8u %6u %6.2f",
 		       W(d.comp_bytes),
@@ -364,6 +448,10 @@ intpr()
 		       W(c.inc_bytes),
 		       W(c.inc_packets),
 		       ccs.c.ratio / 256.0);
+		if (bypass)
+		    printf(" %8u %6u",
+			   B(byp_bytes),
+			   B(byp_packets));
 	    }
 	
 	} else {
@@ -437,6 +525,7 @@ intpr()
 	if (!aflag) {
 	    old = cur;
 	    ocs = ccs;
+	    obs = cbs;
 	    ratef = dflag;
 	}
     }
@@ -458,7 +547,7 @@ main(argc, argv)
     else
 	++progname;
 
-    while ((c = getopt(argc, argv, "advrzc:w:")) != -1) {
+    while ((c = getopt(argc, argv, "advrszc:w:")) != -1) {
 	switch (c) {
 	case 'a':
 	    ++aflag;
@@ -472,6 +561,9 @@ main(argc, argv)
 	case 'r':
 	    ++rflag;
 	    break;
+	case 's':
+	    ++sflag;
+	    break;
 	case 'z':
 	    ++zflag;
 	    break;
@@ -552,6 +644,9 @@ main(argc, argv)
 
 #endif	/* STREAMS */
 
-    intpr();
+    if (sflag)
+	slotpr();
+    else
+	intpr();
     exit(0);
 }
@@ -128,6 +128,32 @@ typedef struct memreq {
 
 #endif
 
+/*
+ * Adaptive compression bypass.  For each of a few protocols we keep
+ * an average of how well recent packets compressed (output/input
+ * bytes << 8).  When that shows a protocol isn't compressing (e.g.
+ * encrypted traffic), its packets are sent without going through
+ * the compressor, which only adds them to its history the way the
+ * peer's incomp routine will.  Every so often one is compressed as a
+ * sample; if it still doesn't compress, the bypass run doubles in
+ * length, up to BYP_MAXRUN packets.
+ */
+#define BYP_NPROTO	4	/* protocols tracked */
+#define BYP_SHIFT	3	/* new ratio has weight 1/8 in average */
+#define BYP_THRESH	240	/* bypass when average ratio is above this
+				   (saving less than about 6%) */
+#define BYP_MINRUN	16	/* packets bypassed after first poor sample */
+#define BYP_MAXRUN	1024
+
+struct comp_bypass {
+    int		proto;		/* protocol, 0 if unused */
+    int		ratio;		/* average output/input << 8 */
+    int		skip;		/* packets left to send without compressing */
+    int		run;		/* skip for next poor sample */
+};
+
+int ppp_comp_bypass = 1;	/* use adaptive bypass if compressor can */
+
 typedef struct comp_state {
     int		flags;
     int		mru;
@@ -140,12 +166,17 @@ typedef struct comp_state {
     struct vjcompress vj_comp;
     int		vj_last_ierrors;
     struct pppstat stats;
+    struct comp_bypass bypass[BYP_NPROTO];
+    struct bypstat bypstats;
 #ifdef __osf__
     memreq_t	memreq;
     thread_t	thread;
 #endif
 } comp_state_t;
 
+static struct comp_bypass *comp_bypass_find __P((comp_state_t *, int));
+static void comp_bypass_update __P((struct comp_bypass *, int, int));
+
 
 #ifdef __osf__
 extern task_t first_task;
@@ -204,7 +235,7 @@ MOD_OPEN(ppp_comp_open)
 	cp->mtu = PPP_MTU;
 	cp->xstate = NULL;
 	cp->rstate = NULL;
-	vj_compress_init(&cp->vj_comp, -1);
+	vj_compress_init(&cp->vj_comp, -1, -1);
 #ifdef __osf__
 	if (!(thread = kernel_thread_w_arg(first_task, ppp_comp_alloc, (void *)cp)))
 		OPEN_ERROR(ENOSR);
@@ -227,6 +258,7 @@ MOD_CLOSE(ppp_comp_close)
 	    (*cp->xcomp->comp_free)(cp->xstate);
 	if (cp->rstate != NULL)
 	    (*cp->rcomp->decomp_free)(cp->rstate);
+	vj_compress_free(&cp->vj_comp);
 #ifdef __osf__
 	if (!cp->thread)
 	    printf("ppp_comp_close: NULL thread!\n");
@@ -324,12 +356,13 @@ ppp_comp_wput(q, mp)
 {
     struct iocblk *iop;
     comp_state_t *cp;
-    int error, len, n;
+    int error, len, n, i;
     int flags, mask;
     mblk_t *np;
     struct compressor **comp;
     struct ppp_stats *psp;
     struct ppp_comp_stats *csp;
+    struct vjslotstat *vsp;
     unsigned char *opt_data;
     int nxslots, nrslots;
 
@@ -393,8 +426,11 @@ ppp_comp_wput(q, mp)
 	    nrslots = mp->b_cont->b_rptr[1] + 1;
 	    if (nxslots > MAX_STATES || nrslots > MAX_STATES)
 		break;
-	    vj_compress_init(&cp->vj_comp, nxslots);
 	    cp->vj_last_ierrors = cp->stats.ppp_ierrors;
+	    if (vj_compress_init(&cp->vj_comp, nxslots - 1, nrslots - 1) < 0) {
+		error = ENOSR;
+		break;
+	    }
 	    error = 0;
 	    iop->ioc_count = 0;
 	    break;
@@ -519,6 +555,41 @@ ppp_comp_wput(q, mp)
 	    error = 0;
 	    break;
 
+	case PPPIO_GETBYPSTAT:
+	    np = allocb(sizeof(struct bypstat), BPRI_HI);
+	    if (np == 0) {
+		error = ENOSR;
+		break;
+	    }
+	    if (mp->b_cont != 0)
+		freemsg(mp->b_cont);
+	    mp->b_cont = np;
+	    *(struct bypstat *) np->b_wptr = cp->bypstats;
+	    np->b_wptr += sizeof(struct bypstat);
+	    iop->ioc_count = sizeof(struct bypstat);
+	    error = 0;
+	    break;
+
+	case PPPIO_GETVJSLOTS:
+	    n = cp->vj_comp.xslots * sizeof(struct vjslotstat);
+	    np = allocb(n, BPRI_HI);
+	    if (np == 0) {
+		error = ENOSR;
+		break;
+	    }
+	    if (mp->b_cont != 0)
+		freemsg(mp->b_cont);
+	    mp->b_cont = np;
+	    vsp = (struct vjslotstat *) np->b_wptr;
+	    np->b_wptr += n;
+	    iop->ioc_count = n;
+	    for (i = 0; i < cp->vj_comp.xslots; ++i, ++vsp) {
+		vsp->vjss_hits = cp->vj_comp.tstate[i].cs_hits;
+		vsp->vjss_misses = cp->vj_comp.tstate[i].cs_misses;
+	    }
+	    error = 0;
+	    break;
+
 	case PPPIO_GETCSTAT:
 	    np = allocb(sizeof(struct ppp_comp_stats), BPRI_HI);
 	    if (np == 0) {
@@ -608,9 +679,10 @@ ppp_comp_wsrv(q)
 {
     mblk_t *mp, *cmp = NULL;
     comp_state_t *cp;
-    int len, proto, type, hlen, code;
+    int len, proto, type, hlen, code, olen;
     struct ip *ip;
     unsigned char *vjhdr, *dp;
+    struct comp_bypass *bp;
 
     cp = (comp_state_t *) q->q_ptr;
     if (cp == 0) {
@@ -697,8 +769,21 @@ ppp_comp_wsrv(q)
 	else if (proto != PPP_LCP && (cp->flags & CCP_COMP_RUN)
 		 && cp->xstate != NULL) {
 	    len = msgdsize(mp);
-	    (*cp->xcomp->compress)(cp->xstate, &cmp, mp, len,
+	    cmp = NULL;
+	    bp = NULL;
+	    if (ppp_comp_bypass && cp->xcomp->comp_incomp != NULL)
+		bp = comp_bypass_find(cp, proto);
+	    if (bp != NULL && bp->skip > 0) {
+		--bp->skip;
+		(*cp->xcomp->comp_incomp)(cp->xstate, mp);
+		cp->bypstats.byp_bytes += len;
+		cp->bypstats.byp_packets++;
+	    } else {
+		olen = (*cp->xcomp->compress)(cp->xstate, &cmp, mp, len,
 			(cp->flags & CCP_ISUP? cp->mtu + PPP_HDRLEN: 0));
+		if (bp != NULL)
+		    comp_bypass_update(bp, olen, len);
+	    }
 	    if (cmp != NULL) {
 #ifdef PRIOQ
 		cmp->b_band=mp->b_band;
@@ -1076,8 +1161,10 @@ ppp_comp_ccp(q, mp, rcvd)
 		if (cp->xstate != NULL
 		    && (*cp->xcomp->comp_init)
 		        (cp->xstate, dp + CCP_HDRLEN, clen - CCP_HDRLEN,
-			 cp->unit, 0, ((cp->flags & DBGLOG) != 0)))
+			 cp->unit, 0, ((cp->flags & DBGLOG) != 0))) {
 		    cp->flags |= CCP_COMP_RUN;
+		    bzero((caddr_t) cp->bypass, sizeof(cp->bypass));
+		}
 	    } else {
 		if (cp->rstate != NULL
 		    && (*cp->rcomp->decomp_init)
@@ -1121,6 +1208,53 @@ dump_msg(mp)
 }
 #endif
 
+/*
+ * comp_bypass_find - return the bypass record for a protocol,
+ * or NULL if all the records are taken by other protocols.
+ */
+static struct comp_bypass *
+comp_bypass_find(cp, proto)
+    comp_state_t *cp;
+    int proto;
+{
+    struct comp_bypass *bp;
+
+    for (bp = cp->bypass; bp < &cp->bypass[BYP_NPROTO]; ++bp) {
+	if (bp->proto == proto)
+	    return bp;
+	if (bp->proto == 0) {
+	    bp->proto = proto;
+	    bp->run = BYP_MINRUN;
+	    return bp;
+	}
+    }
+    return NULL;
+}
+
+/*
+ * comp_bypass_update - note that a packet of len bytes compressed to
+ * olen bytes (olen >= len if it was sent uncompressed), and decide
+ * whether to bypass the compressor for the next few.
+ */
+static void
+comp_bypass_update(bp, olen, len)
+    struct comp_bypass *bp;
+    int olen, len;
+{
+    int ratio;
+
+    if (len <= 0)
+	return;
+    ratio = olen >= len? 256: (olen << 8) / len;
+    bp->ratio += (ratio - bp->ratio) >> BYP_SHIFT;
+    if (bp->ratio > BYP_THRESH) {
+	bp->skip = bp->run;
+	if (bp->run < BYP_MAXRUN)
+	    bp->run <<= 1;
+    } else
+	bp->run = BYP_MINRUN;
+}
+
 static int
 msg_byte(mp, i)
     mblk_t *mp;
@@ -45,6 +45,9 @@
 #include <sys/sunddi.h>
 
 extern struct streamtab ppp_compinfo;
+#if !defined(DO_DEFLATE) || DO_DEFLATE
+extern void z_pool_drain(void);
+#endif
 
 static struct fmodsw fsw = {
     "ppp_comp",
@@ -78,7 +81,14 @@ _init(void)
 int
 _fini(void)
 {
-    return mod_remove(&modlinkage);
+    int error;
+
+    error = mod_remove(&modlinkage);
+#if !defined(DO_DEFLATE) || DO_DEFLATE
+    if (error == 0)
+	z_pool_drain();		/* zlib memory kept by deflate.c */
+#endif
+    return error;
 }
 
 int
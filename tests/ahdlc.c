@@ -0,0 +1,274 @@
+/*
+ * ahdlc.c - push frames through ppp_ahdlc's encoder and byte streams
+ * through its decoder, and check that what comes out is bit for bit
+ * what the module produced before it learnt to copy clean runs: the
+ * output is digested and compared with digests taken from that
+ * version.  The frames and streams are chosen to exercise everything
+ * the fast paths must leave alone: random transmit and receive ACCMs,
+ * LCP frames that must use the default map, data heavy in flags,
+ * escapes and control characters, mblk chains split at random with
+ * M_CTL blocks among them, an MRU that frames overrun, and corrupted
+ * input.  A second pass checks that frames come back out of the
+ * decoder as they went into the encoder.
+ */
+
+#include "../modules/ppp_ahdlc.c"
+
+static queue_t rq, wq, rsink, wsink;
+static u_int32_t seed;
+static int failed;
+
+#define CHECK(c, msg) \
+    do { if (!(c)) { printf("ahdlc: %s\n", msg); ++failed; } } while (0)
+
+static u_int32_t
+rnd()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+/*
+ * Make a message holding buf in nc+1 blocks, cut at random places,
+ * each block starting a little way into its buffer.  If ctl is set,
+ * some blocks are M_CTL, which the encoder must skip.
+ */
+static mblk_t *
+mkchain(buf, len, ctl)
+    u_char *buf;
+    int len, ctl;
+{
+    mblk_t *head = NULL, **tp = &head, *mp;
+    int cuts[5], nc, c, a, b, t, pos, end;
+
+    nc = rnd() % 5;
+    for (c = 0; c < nc; ++c)
+	cuts[c] = len? rnd() % (len + 1): 0;
+    for (a = 0; a < nc; ++a)
+	for (b = a + 1; b < nc; ++b)
+	    if (cuts[b] < cuts[a]) {
+		t = cuts[a];
+		cuts[a] = cuts[b];
+		cuts[b] = t;
+	    }
+    for (pos = 0, c = 0; c <= nc; ++c, pos = end) {
+	end = c == nc? len: cuts[c];
+	mp = allocb(end - pos + 8, BPRI_MED);
+	mp->b_rptr = mp->b_wptr = mp->b_rptr + rnd() % 4;
+	memcpy(mp->b_wptr, buf + pos, end - pos);
+	mp->b_wptr += end - pos;
+	if (ctl && rnd() % 10 == 0)
+	    mp->b_datap->db_type = M_CTL;
+	*tp = mp;
+	tp = &mp->b_cont;
+    }
+    return head;
+}
+
+static void
+send_ioctl(cmd, data, len)
+    int cmd, len;
+    void *data;
+{
+    struct iocblk *iop;
+    mblk_t *mp;
+
+    mp = allocb(sizeof(struct iocblk), BPRI_HI);
+    mp->b_datap->db_type = M_IOCTL;
+    iop = (struct iocblk *) mp->b_wptr;
+    bzero(iop, sizeof(*iop));
+    iop->ioc_cmd = cmd;
+    iop->ioc_count = len;
+    mp->b_wptr += sizeof(*iop);
+    mp->b_cont = allocb(len, BPRI_HI);
+    memcpy(mp->b_cont->b_wptr, data, len);
+    mp->b_cont->b_wptr += len;
+    ahdlc_wput(&wq, mp);
+    freemsg(getq(&rsink));	/* the M_IOCACK */
+}
+
+static void
+set_mru(mru)
+    int mru;
+{
+    mblk_t *mp;
+
+    mp = allocb(4, BPRI_HI);
+    mp->b_datap->db_type = M_CTL;
+    *mp->b_wptr = PPPCTL_MRU;
+    ((unsigned short *) mp->b_wptr)[1] = mru;
+    mp->b_wptr += 4;
+    ahdlc_wput(&wq, mp);
+}
+
+/* Fold everything that arrived at q into sum, and free it. */
+static u_int32_t
+drain(q, sum, buf, lenp)
+    queue_t *q;
+    u_int32_t sum;
+    u_char *buf;
+    int *lenp;
+{
+    mblk_t *mp, *bp;
+    u_char *p;
+
+    if (lenp != NULL)
+	*lenp = 0;
+    while ((mp = getq(q)) != NULL) {
+	sum = sum * 31 + mp->b_datap->db_type;
+	for (bp = mp; bp != NULL; bp = bp->b_cont)
+	    for (p = bp->b_rptr; p < bp->b_wptr; ++p) {
+		sum = sum * 31 + *p;
+		if (lenp != NULL && *lenp < 2 * 3000)
+		    buf[(*lenp)++] = *p;
+	    }
+	freemsg(mp);
+    }
+    return sum;
+}
+
+static void
+fill(buf, n)
+    u_char *buf;
+    int n;
+{
+    u_int32_t r;
+    int i, bias = rnd() % 4;
+
+    for (i = 0; i < n; ++i) {
+	r = rnd();
+	switch (bias) {
+	case 0:
+	    buf[i] = r;
+	    break;
+	case 1:		/* text with a few escapes and flags */
+	    buf[i] = r % 16 == 0? 0x7d + (r >> 8) % 2: 0x20 + (r >> 8) % 90;
+	    break;
+	case 2:		/* mostly bytes that need attention */
+	    buf[i] = r % 5 == 0? PPP_FLAG: r % 7 == 0? PPP_ESCAPE:
+		r % 3 == 0? (r >> 8) & 0x1f: r >> 9;
+	    break;
+	default:
+	    buf[i] = r % 2? 0x41: r >> 8;
+	}
+    }
+    if (n >= 5 && rnd() % 4 == 0) {
+	buf[0] = PPP_ALLSTATIONS;
+	buf[1] = PPP_UI;
+	buf[2] = PPP_LCP >> 8;
+	buf[3] = PPP_LCP & 0xff;
+	buf[4] = rnd() % 10;
+    }
+}
+
+static u_int32_t
+run(niter)
+    int niter;
+{
+    static u_char buf[3000], enc[2 * 3000];
+    u_int32_t sum = 0, xaccm[8], raccm;
+    int i, k, n, en, mode;
+
+    for (i = 0; i < niter; ++i) {
+	if (rnd() % 20 == 0) {
+	    mode = rnd() % 4;
+	    bzero(xaccm, sizeof(xaccm));
+	    xaccm[0] = mode == 0? 0: mode == 1? ~0: rnd();
+	    if (rnd() % 5 == 0)
+		xaccm[rnd() % 8] |= rnd();
+	    send_ioctl(PPPIO_XACCM, xaccm, sizeof(xaccm));
+	    raccm = mode == 0? 0: mode == 1? ~0: rnd();
+	    send_ioctl(PPPIO_RACCM, &raccm, sizeof(raccm));
+	    set_mru(20 + rnd() % 1500);
+	}
+	lbolt += rnd() % 3;
+
+	n = rnd() % 3000;
+	fill(buf, n);
+	ahdlc_wput(&wq, mkchain(buf, n, 1));
+	sum = drain(&wsink, sum, enc, &en);
+
+	/* decode what was sent, or the raw data, sometimes damaged */
+	if (en == 0 || rnd() % 2 == 0) {
+	    memcpy(enc, buf, n);
+	    en = n;
+	}
+	if (en > 0 && rnd() % 10 == 0)
+	    enc[rnd() % en] ^= 1 << (rnd() % 8);
+	ahdlc_rput(&rq, mkchain(enc, en, 0));
+	sum = drain(&rsink, sum, NULL, NULL);
+    }
+    k = 0;
+    send_ioctl(PPPIO_GCLEAN, &k, sizeof(k));
+    return sum * 31 + ((ahdlc_state_t *) wq.q_ptr)->flags;
+}
+
+/*
+ * With the default maps, frames that fit the MRU come back intact.
+ */
+static void
+roundtrip(niter)
+    int niter;
+{
+    static u_char buf[PPP_MRU + PPP_HDRLEN];
+    u_int32_t xaccm[8], raccm;
+    mblk_t *mp;
+    int i, n, bad = 0;
+
+    bzero(xaccm, sizeof(xaccm));
+    xaccm[0] = ~0;
+    send_ioctl(PPPIO_XACCM, xaccm, sizeof(xaccm));
+    raccm = ~0;
+    send_ioctl(PPPIO_RACCM, &raccm, sizeof(raccm));
+    set_mru(PPP_MRU);
+    for (i = 0; i < niter; ++i) {
+	n = PPP_HDRLEN + rnd() % (PPP_MRU + 1);
+	fill(buf, n);
+	lbolt += 2000;		/* each frame starts with a flag */
+	ahdlc_wput(&wq, mkchain(buf, n, 0));
+	mp = getq(&wsink);
+	pullupmsg(mp, -1);
+	/* the closing flag of the last frame is the opening one here */
+	ahdlc_rput(&rq, mp);
+	mp = getq(&rsink);
+	if (mp == NULL || mp->b_datap->db_type != M_DATA
+	    || msgdsize(mp) != n || !pullupmsg(mp, -1)
+	    || memcmp(mp->b_rptr, buf, n) != 0)
+	    ++bad;
+	freemsg(mp);
+	drain(&rsink, 0, NULL, NULL);
+    }
+    CHECK(bad == 0, "frames not decoded as they were sent");
+}
+
+/* Digest of the output of the byte-at-a-time module */
+#define DIGEST	0x36b44067
+
+int
+main()
+{
+    static struct qinit sink_init;
+    u_int32_t sum;
+
+    rq.q_isread = 1;
+    rq.q_other = &wq;
+    wq.q_other = &rq;
+    rq.q_next = &rsink;
+    wq.q_next = &wsink;
+    rsink.q_qinfo = wsink.q_qinfo = &sink_init;
+    ahdlc_open(&rq, NULL, 0, MODOPEN, NULL);
+
+    seed = 1;
+    sum = run(20000);
+    if (sum != DIGEST) {
+	printf("ahdlc: digest %08x want %08x\n", sum, DIGEST);
+	++failed;
+    }
+    roundtrip(2000);
+
+    ahdlc_close(&rq, 0, NULL);
+    if (failed)
+	return 1;
+    printf("ahdlc: ok\n");
+    return 0;
+}
@@ -0,0 +1,297 @@
+/*
+ * bsdcomp.c - send a mix of text, header-like and random packets
+ * through the BSD-Compress module at each code size from 9 to 15
+ * bits.  Every compressed packet must come back intact from both the
+ * module's decompressor and pppdump's copy of it, and the compressed
+ * output must match a digest taken from the module as it was before
+ * its dictionary moved to linear probing: the dictionary is private
+ * to each end, but the codes on the wire are not.  Each end's state
+ * must also be two allocations, the codes and the hash table, so that
+ * neither is large.
+ *
+ * "bsdcomp -b" prints compress and decompress throughput instead.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/stream.h>
+#include <sys/kmem.h>
+#include <net/ppp_defs.h>
+#define PACKETPTR	mblk_t *
+#include <net/ppp-comp.h>
+
+extern struct compressor ppp_bsd_compress;
+
+void *dump_bsd_alloc __P((u_char *, int));
+int dump_bsd_decompress __P((void *, u_char *, int, u_char *, int *));
+void dump_bsd_incomp __P((void *, u_char *, int));
+void dump_bsd_free __P((void *));
+
+#define NPK	4000	/* different packets */
+#define NRUN	20000	/* packets sent at each code size */
+
+static u_char pkts[NPK][PPP_MRU + PPP_HDRLEN];
+static int lens[NPK];
+static u_int32_t seed;
+
+static char *words[] = {
+    "GET ", "/index.html ", "HTTP/1.1\r\n", "Host: www.example.com\r\n",
+    "Content-Type: text/html\r\n", "<div class=\"", "the ", "and ",
+    "compression ", "packet ", "</a>", "Received: from ", "Subject: ",
+    "\r\n\r\n", "<p>", "0123",
+};
+
+static u_int32_t
+rnd()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+/*
+ * Half the packets are text, three in ten look like TCP/IP headers
+ * followed by mostly zeroes, and the rest are random.
+ */
+static void
+gen()
+{
+    u_char *p;
+    char *w;
+    int i, k, n, kind;
+
+    seed = 11;
+    for (i = 0; i < NPK; ++i) {
+	p = pkts[i];
+	n = 60 + rnd() % 1440;
+	kind = rnd() % 10;
+	p[0] = PPP_ALLSTATIONS;
+	p[1] = PPP_UI;
+	p[2] = 0;
+	p[3] = PPP_IP;
+	if (kind < 5) {
+	    for (k = PPP_HDRLEN; k < n; )
+		for (w = words[rnd() % 16]; *w && k < n; )
+		    p[k++] = *w++;
+	} else if (kind < 8) {
+	    for (k = PPP_HDRLEN; k < n; ++k)
+		p[k] = k < 44? k * 7 + (i & 0xf): (k & 0x1f)? 0: rnd();
+	} else {
+	    for (k = PPP_HDRLEN; k < n; ++k)
+		p[k] = rnd();
+	}
+	lens[i] = n;
+    }
+}
+
+/* Make a message holding buf, in two blocks if split is non-zero. */
+static mblk_t *
+mkmsg(buf, len, split)
+    u_char *buf;
+    int len, split;
+{
+    mblk_t *mp;
+    int n = split? split: len;
+
+    mp = allocb(n, BPRI_MED);
+    memcpy(mp->b_wptr, buf, n);
+    mp->b_wptr += n;
+    if (split) {
+	mp->b_cont = allocb(len - split, BPRI_MED);
+	memcpy(mp->b_cont->b_wptr, buf + split, len - split);
+	mp->b_cont->b_wptr += len - split;
+    }
+    return mp;
+}
+
+static int
+flatten(mp, buf)
+    mblk_t *mp;
+    u_char *buf;
+{
+    int n = 0;
+
+    for (; mp != NULL; mp = mp->b_cont) {
+	memcpy(buf + n, mp->b_rptr, mp->b_wptr - mp->b_rptr);
+	n += mp->b_wptr - mp->b_rptr;
+    }
+    return n;
+}
+
+static double
+now()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/*
+ * Send NRUN packets through a compressor with the given code size,
+ * checking what the decompressors make of them.  Returns a digest
+ * of the compressed output, and the number of bad packets in *bad.
+ */
+static u_int32_t
+run(bits, bad)
+    int bits, *bad;
+{
+    u_char opt[3], out[2 * PPP_MRU], dec[2 * PPP_MRU], *pk;
+    void *xs, *rs, *ds;
+    mblk_t *mp, *cmp, *dmp;
+    u_int32_t sum = 0;
+    unsigned long calls;
+    int i, k, n, olen, dlen, r;
+
+    opt[0] = CI_BSD_COMPRESS;
+    opt[1] = CILEN_BSD_COMPRESS;
+    opt[2] = BSD_MAKE_OPT(BSD_CURRENT_VERSION, bits);
+    calls = kmem_calls;
+    xs = (*ppp_bsd_compress.comp_alloc)(opt, 3);
+    rs = (*ppp_bsd_compress.decomp_alloc)(opt, 3);
+    ds = dump_bsd_alloc(opt, 3);
+    *bad = 0;
+    if (xs == NULL || rs == NULL || ds == NULL || kmem_calls - calls != 4) {
+	printf("bsdcomp: %d bits: allocation failed or not in two pieces\n",
+	       bits);
+	*bad = 1;
+	return 0;
+    }
+    (*ppp_bsd_compress.comp_init)(xs, opt, 3, 0, 0, 0);
+    (*ppp_bsd_compress.decomp_init)(rs, opt, 3, 0, 0, PPP_MRU, 0);
+
+    for (i = 0; i < NRUN; ++i) {
+	pk = pkts[i % NPK];
+	n = lens[i % NPK];
+	mp = mkmsg(pk, n, (i & 7) == 0? n / 2: 0);
+	cmp = NULL;
+	(*ppp_bsd_compress.compress)(xs, &cmp, mp, n, n);
+	if (cmp == NULL) {
+	    /* sent as it is; the decompressors must still learn it */
+	    sum = sum * 31 + 0xffff;
+	    (*ppp_bsd_compress.incomp)(rs, mp);
+	    dump_bsd_incomp(ds, pk + 2, n - 2);
+	    freemsg(mp);
+	    continue;
+	}
+	freemsg(mp);
+	olen = flatten(cmp, out);
+	for (k = 0; k < olen; ++k)
+	    sum = sum * 31 + out[k];
+
+	mp = mkmsg(out, olen, (i & 3) == 1? olen / 3 + 6: 0);
+	dmp = NULL;
+	r = (*ppp_bsd_compress.decompress)(rs, mp, &dmp);
+	if (r != DECOMP_OK || flatten(dmp, dec) != n || memcmp(dec, pk, n) != 0)
+	    ++*bad;
+	freemsg(dmp);
+	freemsg(mp);
+
+	/* pppdump's copy is given the packet after address and control */
+	r = dump_bsd_decompress(ds, out + 2, olen - 2, dec, &dlen);
+	if (r != DECOMP_OK || dlen < n - PPP_HDRLEN
+	    || memcmp(dec + dlen - (n - PPP_HDRLEN), pk + PPP_HDRLEN,
+		      n - PPP_HDRLEN) != 0)
+	    ++*bad;
+	freemsg(cmp);
+    }
+
+    (*ppp_bsd_compress.comp_free)(xs);
+    (*ppp_bsd_compress.decomp_free)(rs);
+    dump_bsd_free(ds);
+    return sum;
+}
+
+/*
+ * Time compressing and then decompressing every packet once, best
+ * of ten tries, at each code size.
+ */
+static void
+bench()
+{
+    static mblk_t *in[NPK], *cmp[NPK];
+    u_char opt[3];
+    void *xs, *rs;
+    mblk_t *dmp;
+    double t0, tc, td, best_c, best_d, mb;
+    int bits, try, i;
+
+    mb = 0;
+    for (i = 0; i < NPK; ++i) {
+	in[i] = mkmsg(pkts[i], lens[i], 0);
+	mb += lens[i] / 1e6;
+    }
+    for (bits = BSD_MIN_BITS; bits <= BSD_MAX_BITS; ++bits) {
+	opt[0] = CI_BSD_COMPRESS;
+	opt[1] = CILEN_BSD_COMPRESS;
+	opt[2] = BSD_MAKE_OPT(BSD_CURRENT_VERSION, bits);
+	xs = (*ppp_bsd_compress.comp_alloc)(opt, 3);
+	rs = (*ppp_bsd_compress.decomp_alloc)(opt, 3);
+	best_c = best_d = 1e9;
+	for (try = 0; try < 10; ++try) {
+	    (*ppp_bsd_compress.comp_init)(xs, opt, 3, 0, 0, 0);
+	    (*ppp_bsd_compress.decomp_init)(rs, opt, 3, 0, 0, PPP_MRU, 0);
+	    t0 = now();
+	    for (i = 0; i < NPK; ++i) {
+		cmp[i] = NULL;
+		(*ppp_bsd_compress.compress)(xs, &cmp[i], in[i],
+					     lens[i], lens[i]);
+	    }
+	    tc = now() - t0;
+	    t0 = now();
+	    for (i = 0; i < NPK; ++i) {
+		if (cmp[i] == NULL) {
+		    (*ppp_bsd_compress.incomp)(rs, in[i]);
+		    continue;
+		}
+		dmp = NULL;
+		(*ppp_bsd_compress.decompress)(rs, cmp[i], &dmp);
+		freemsg(dmp);
+	    }
+	    td = now() - t0;
+	    for (i = 0; i < NPK; ++i)
+		freemsg(cmp[i]);
+	    if (tc < best_c)
+		best_c = tc;
+	    if (td < best_d)
+		best_d = td;
+	}
+	printf("bsdcomp: %2d bits: compress %6.1f MB/s, decompress %6.1f MB/s, %lu bytes per end\n",
+	       bits, mb / best_c, mb / best_d, kmem_bytes / 2);
+	(*ppp_bsd_compress.comp_free)(xs);
+	(*ppp_bsd_compress.decomp_free)(rs);
+    }
+}
+
+/* Digests of the output of the module with the double-hashed dictionary */
+static u_int32_t digests[BSD_MAX_BITS + 1] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0xee33fc03, 0x0ab4768e, 0x0099459c, 0x695ba245,
+    0x59a9523b, 0xc2f05050, 0x201dae30,
+};
+
+int
+main(argc, argv)
+    int argc;
+    char **argv;
+{
+    u_int32_t sum;
+    int bits, bad, failed = 0;
+
+    gen();
+    if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+	bench();
+	return 0;
+    }
+    for (bits = BSD_MIN_BITS; bits <= BSD_MAX_BITS; ++bits) {
+	sum = run(bits, &bad);
+	if (bad || sum != digests[bits]) {
+	    printf("bsdcomp: %d bits: digest %08x want %08x, %d bad\n",
+		   bits, sum, digests[bits], bad);
+	    ++failed;
+	}
+    }
+    if (failed)
+	return 1;
+    printf("bsdcomp: ok\n");
+    return 0;
+}
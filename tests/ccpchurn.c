@@ -0,0 +1,161 @@
+/*
+ * ccpchurn.c - bring Deflate up and down on many links over and over,
+ * as CCP renegotiation does, and count how often the module goes to
+ * the kernel allocator.  While the free lists can hold every link's
+ * memory, only the first round should allocate; with more links than
+ * that the count is bounded by deflate_pool_max.  Each state sends a
+ * packet before it is freed, so a compressor or decompressor built
+ * from recycled memory must still work, and once the lists are
+ * drained nothing may be left allocated.
+ *
+ * "ccpchurn -b" prints the time per link up/down and the allocator
+ * calls for each case instead.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/stream.h>
+#include <sys/kmem.h>
+#include <net/ppp_defs.h>
+#define PACKETPTR	mblk_t *
+#include <net/ppp-comp.h>
+
+extern struct compressor ppp_deflate;
+extern void z_pool_drain __P((void));
+
+static int failed;
+
+#define CHECK(c, msg) \
+    do { if (!(c)) { printf("ccpchurn: %s\n", msg); ++failed; } } while (0)
+
+static u_char opt[CILEN_DEFLATE] = {
+    CI_DEFLATE, CILEN_DEFLATE, DEFLATE_MAKE_OPT(15), DEFLATE_CHK_SEQUENCE
+};
+
+/* Send one packet from xs to rs and check it arrives intact. */
+static int
+exchange(xs, rs, seq)
+    void *xs, *rs;
+    int seq;
+{
+    static char text[] = "GET /index.html HTTP/1.1\r\nHost: www.example.com\r\n";
+    mblk_t *mp, *cmp, *dmp;
+    int i, len = 600, ok;
+
+    mp = allocb(PPP_HDRLEN + len, BPRI_MED);
+    mp->b_wptr[0] = PPP_ALLSTATIONS;
+    mp->b_wptr[1] = PPP_UI;
+    mp->b_wptr[2] = 0;
+    mp->b_wptr[3] = PPP_IP;
+    for (i = 0; i < len; ++i)
+	mp->b_wptr[PPP_HDRLEN + i] = text[(i + seq) % (sizeof(text) - 1)];
+    mp->b_wptr += PPP_HDRLEN + len;
+
+    cmp = dmp = NULL;
+    (*ppp_deflate.compress)(xs, &cmp, mp, PPP_HDRLEN + len,
+			    PPP_HDRLEN + len);
+    ok = cmp != NULL
+	&& (*ppp_deflate.decompress)(rs, cmp, &dmp) == DECOMP_OK
+	&& dmp != NULL && pullupmsg(dmp, -1)
+	&& msgdsize(dmp) == PPP_HDRLEN + len
+	&& memcmp(dmp->b_rptr, mp->b_rptr, PPP_HDRLEN + len) == 0;
+    freemsg(mp);
+    freemsg(cmp);
+    freemsg(dmp);
+    return ok;
+}
+
+/*
+ * Run links links through rounds rounds of CCP up and down.  Returns
+ * the number of kernel allocations, and in *first how many the first
+ * round made.
+ */
+static unsigned long
+churn(links, rounds, first, usp)
+    int links, rounds;
+    unsigned long *first;
+    double *usp;
+{
+    void **xs, **rs;
+    struct timeval t0, t1;
+    unsigned long calls;
+    int i, r, bad = 0;
+
+    xs = calloc(links, sizeof(void *));
+    rs = calloc(links, sizeof(void *));
+    calls = kmem_calls;
+    gettimeofday(&t0, NULL);
+    for (r = 0; r < rounds; ++r) {
+	for (i = 0; i < links; ++i) {
+	    xs[i] = (*ppp_deflate.comp_alloc)(opt, sizeof(opt));
+	    rs[i] = (*ppp_deflate.decomp_alloc)(opt, sizeof(opt));
+	    if (xs[i] == NULL || rs[i] == NULL) {
+		CHECK(0, "allocation failed");
+		return 0;
+	    }
+	    (*ppp_deflate.comp_init)(xs[i], opt, sizeof(opt), i, 0, 0);
+	    (*ppp_deflate.decomp_init)(rs[i], opt, sizeof(opt), i, 0,
+				       PPP_MRU, 0);
+	}
+	for (i = 0; i < links; ++i) {
+	    if (usp == NULL && !exchange(xs[i], rs[i], r + i))
+		++bad;
+	    (*ppp_deflate.comp_free)(xs[i]);
+	    (*ppp_deflate.decomp_free)(rs[i]);
+	}
+	if (r == 0)
+	    *first = kmem_calls - calls;
+    }
+    gettimeofday(&t1, NULL);
+    if (usp != NULL)
+	*usp = ((t1.tv_sec - t0.tv_sec) * 1e6 + t1.tv_usec - t0.tv_usec)
+	    / links / rounds;
+    CHECK(bad == 0, "packet damaged by a recycled state");
+    free(xs);
+    free(rs);
+    return kmem_calls - calls;
+}
+
+static struct test {
+    int links, rounds;
+    int pooled;		/* all fit on the free lists */
+} tests[] = {
+    { 1, 2000, 1 },
+    { 10, 200, 1 },
+    { 100, 20, 0 },
+};
+
+int
+main(argc, argv)
+    int argc;
+    char **argv;
+{
+    struct test *t;
+    unsigned long calls, first;
+    double us;
+    int bench;
+
+    bench = argc > 1 && strcmp(argv[1], "-b") == 0;
+    for (t = tests; t < tests + sizeof(tests) / sizeof(tests[0]); ++t) {
+	calls = churn(t->links, t->rounds, &first, bench? &us: NULL);
+	z_pool_drain();
+	if (bench)
+	    printf("ccpchurn: %3d links x %4d rounds: %6.2f us per link up/down, %lu allocations\n",
+		   t->links, t->rounds, us, calls);
+	if (t->pooled && calls != first) {
+	    printf("ccpchurn: %d links: %lu allocations after the first round\n",
+		   t->links, calls - first);
+	    ++failed;
+	}
+	if (!t->pooled && calls >= first * t->rounds) {
+	    printf("ccpchurn: %d links: no memory reused\n", t->links);
+	    ++failed;
+	}
+	CHECK(kmem_bytes == 0, "memory left allocated after draining");
+    }
+    if (failed)
+	return 1;
+    if (!bench)
+	printf("ccpchurn: ok\n");
+    return 0;
+}
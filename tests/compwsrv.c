@@ -0,0 +1,161 @@
+/*
+ * compwsrv.c - run ppp_comp's write service routine over a queue
+ * of packets in which compressed and bypassed packets alternate,
+ * and check that every packet goes down exactly once and that a
+ * Deflate decompressor fed the output stays in step.
+ */
+
+#include "../modules/ppp_comp.c"
+
+static queue_t rq, wq, rsink, wsink;
+static int failed;
+
+#define CHECK(c, msg) \
+    do { if (!(c)) { printf("compwsrv: %s\n", msg); ++failed; } } while (0)
+
+static mblk_t *
+mkpacket(proto, data, len)
+    int proto, len;
+    u_char *data;
+{
+    mblk_t *mp = allocb(PPP_HDRLEN + len, BPRI_MED);
+
+    mp->b_wptr[0] = PPP_ALLSTATIONS;
+    mp->b_wptr[1] = PPP_UI;
+    mp->b_wptr[2] = proto >> 8;
+    mp->b_wptr[3] = proto;
+    memcpy(mp->b_wptr + PPP_HDRLEN, data, len);
+    mp->b_wptr += PPP_HDRLEN + len;
+    return mp;
+}
+
+static void
+fill(buf, len, seed, random_data)
+    u_char *buf;
+    int len, seed, random_data;
+{
+    static char text[] = "GET /index.html HTTP/1.1\r\nHost: www.example.com\r\n";
+    int i;
+
+    srandom(seed);
+    for (i = 0; i < len; ++i)
+	buf[i] = random_data? random(): text[(i + seed) % (sizeof(text) - 1)];
+}
+
+/*
+ * Queue npk packets, alternating text on PPP_IP with random data on
+ * PPP_IPV6, run the service routine once and check what came out.
+ */
+static void
+run(cp, rstate, npk, base)
+    comp_state_t *cp;
+    void *rstate;
+    int npk, base;
+{
+    u_char data[1400], out[PPP_HDRLEN + 1500];
+    mblk_t *mp, *dmp, *sent[64];
+    int i, j, n, len, proto, rv;
+
+    for (i = 0; i < npk; ++i) {
+	proto = (i & 1)? PPP_IPV6: PPP_IP;
+	len = 200 + (base + i) % 1000;
+	fill(data, len, base + i, proto == PPP_IPV6);
+	putq(&wq, mkpacket(proto, data, len));
+    }
+    ppp_comp_wsrv(&wq);
+
+    for (i = 0; i < npk; ++i) {
+	sent[i] = mp = getq(&wsink);
+	if (mp == NULL) {
+	    CHECK(0, "packet lost");
+	    return;
+	}
+	for (j = 0; j < i; ++j)
+	    CHECK(sent[j] != mp, "message sent twice");
+    }
+    CHECK(getq(&wsink) == NULL, "extra message sent");
+
+    for (i = 0; i < npk; ++i) {
+	mp = sent[i];
+	proto = (i & 1)? PPP_IPV6: PPP_IP;
+	len = 200 + (base + i) % 1000;
+	fill(data, len, base + i, proto == PPP_IPV6);
+	if (PPP_PROTOCOL(mp->b_rptr) == PPP_COMP) {
+	    dmp = NULL;
+	    rv = (*cp->xcomp->decompress)(rstate, mp, &dmp);
+	    CHECK(rv == DECOMP_OK && dmp != NULL, "decompress failed");
+	    if (dmp != NULL) {
+		pullupmsg(dmp, -1);
+		n = dmp->b_wptr - dmp->b_rptr;
+		CHECK(n == PPP_HDRLEN + len
+		      && PPP_PROTOCOL(dmp->b_rptr) == proto
+		      && memcmp(dmp->b_rptr + PPP_HDRLEN, data, len) == 0,
+		      "decompressed packet differs");
+		freemsg(dmp);
+	    }
+	} else {
+	    pullupmsg(mp, -1);
+	    n = mp->b_wptr - mp->b_rptr;
+	    memcpy(out, mp->b_rptr, n);
+	    CHECK(n == PPP_HDRLEN + len && PPP_PROTOCOL(out) == proto
+		  && memcmp(out + PPP_HDRLEN, data, len) == 0,
+		  "uncompressed packet differs");
+	    (*cp->xcomp->incomp)(rstate, mp);
+	}
+	freemsg(mp);
+    }
+}
+
+int
+main(argc, argv)
+    int argc;
+    char **argv;
+{
+    static struct qinit sink_init;
+    u_char opt[CILEN_DEFLATE];
+    comp_state_t *cp;
+    void *rstate;
+    int i;
+
+    opt[0] = CI_DEFLATE;
+    opt[1] = CILEN_DEFLATE;
+    opt[2] = DEFLATE_MAKE_OPT(15);
+    opt[3] = DEFLATE_CHK_SEQUENCE;
+
+    cp = (comp_state_t *) calloc(1, sizeof(*cp));
+    cp->flags = CCP_ISUP | CCP_COMP_RUN;
+    cp->mtu = cp->mru = 1500;
+    cp->xcomp = &ppp_deflate;
+    cp->xstate = (*cp->xcomp->comp_alloc)(opt, sizeof(opt));
+    (*cp->xcomp->comp_init)(cp->xstate, opt, sizeof(opt), 0, 0, 0);
+    rstate = (*cp->xcomp->decomp_alloc)(opt, sizeof(opt));
+    (*cp->xcomp->decomp_init)(rstate, opt, sizeof(opt), 0, 0, 1500, 0);
+
+    rq.q_isread = 1;
+    rq.q_other = &wq;
+    wq.q_other = &rq;
+    rq.q_ptr = wq.q_ptr = cp;
+    rq.q_next = &rsink;
+    wq.q_next = &wsink;
+    rsink.q_qinfo = wsink.q_qinfo = &sink_init;
+
+    /* Bypass PPP_IPV6 from the start, so every other packet skips. */
+    cp->bypass[0].proto = PPP_IPV6;
+    cp->bypass[0].ratio = 1 << 8;
+    cp->bypass[0].run = BYP_MINRUN;
+    cp->bypass[0].skip = 1000;
+    run(cp, rstate, 32, 0);
+    CHECK(cp->bypstats.byp_packets == 16, "wrong number of packets bypassed");
+
+    /* Then let the policy find the random data on its own. */
+    bzero(cp->bypass, sizeof(cp->bypass));
+    bzero(&cp->bypstats, sizeof(cp->bypstats));
+    for (i = 0; i < 200; ++i)
+	run(cp, rstate, 16, 1000 + i * 16);
+    CHECK(cp->bypstats.byp_packets > 0, "policy never bypassed");
+
+    if (failed == 0)
+	printf("compwsrv: ok, %u of %d packets bypassed\n",
+	       cp->bypstats.byp_packets, 200 * 16);
+    return failed != 0;
+}
@@ -0,0 +1,303 @@
+/*
+ * dicthash.c - read the shipped RADIUS dictionary with the Microsoft
+ * and Ascend ones, decode a typical Access-Accept with rc_avpair_gen
+ * and check that every attribute comes out with the right name, type
+ * and value.  Names are looked up in any case, standard attributes
+ * win over vendor ones of the same name, and where a code or name is
+ * defined twice the later definition is the one found.
+ *
+ * "dicthash -b" times rc_avpair_gen on the Access-Accept, and name
+ * lookups as rc_avpair_parse does them, instead.
+ */
+
+#include <includes.h>
+#include <radiusclient.h>
+#include <stdarg.h>
+
+#define DICTDIR	"../pppd/plugins/radius/etc"
+
+static char dictname[] = "dicthash.dict";
+static int failed;
+
+#define CHECK(c, msg) \
+    do { if (!(c)) { printf("dicthash: %s\n", msg); ++failed; } } while (0)
+
+char *
+rc_conf_str(optname)
+    char *optname;
+{
+    return NULL;
+}
+
+UINT4
+rc_get_ipaddr(host)
+    char *host;
+{
+    return 0;
+}
+
+void
+rc_str2tm(valstr, tm)
+    char *valstr;
+    struct tm *tm;
+{
+}
+
+void
+error(char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    printf("dicthash: ");
+    vprintf(fmt, ap);
+    printf("\n");
+    va_end(ap);
+    ++failed;
+}
+
+void dbglog(char *fmt, ...) { }
+void info(char *fmt, ...) { }
+void warn(char *fmt, ...) { }
+
+void
+novm(msg)
+    char *msg;
+{
+    abort();
+}
+
+/* What a NAS typically gets back for a PPP user with MPPE */
+static struct reply {
+    char *name;
+    int attribute, vendor;
+    char *str;		/* NULL for integers and addresses */
+    UINT4 lvalue;
+} reply[] = {
+    { "Service-Type", PW_SERVICE_TYPE, VENDOR_NONE, NULL, PW_FRAMED },
+    { "Framed-Protocol", PW_FRAMED_PROTOCOL, VENDOR_NONE, NULL, PW_PPP },
+    { "Framed-IP-Address", PW_FRAMED_IP_ADDRESS, VENDOR_NONE, NULL, 0x0a000105 },
+    { "Framed-IP-Netmask", PW_FRAMED_IP_NETMASK, VENDOR_NONE, NULL, 0xffffffff },
+    { "Framed-MTU", PW_FRAMED_MTU, VENDOR_NONE, NULL, 1400 },
+    { "Framed-Compression", PW_FRAMED_COMPRESSION, VENDOR_NONE, NULL, 1 },
+    { "Session-Timeout", PW_SESSION_TIMEOUT, VENDOR_NONE, NULL, 86400 },
+    { "Idle-Timeout", PW_IDLE_TIMEOUT, VENDOR_NONE, NULL, 1800 },
+    { "Acct-Interim-Interval", 85, VENDOR_NONE, NULL, 600 },
+    { "Class", PW_CLASS, VENDOR_NONE, "dsl-residential-0042", 0 },
+    { "Filter-Id", PW_FILTER_ID, VENDOR_NONE, "std.ppp", 0 },
+    { "Framed-Route", PW_FRAMED_ROUTE, VENDOR_NONE, "10.1.0.0/16 0.0.0.0 1", 0 },
+    { "Framed-Route", PW_FRAMED_ROUTE, VENDOR_NONE, "10.2.0.0/16 0.0.0.0 1", 0 },
+    { "Reply-Message", PW_REPLY_MESSAGE, VENDOR_NONE, "Welcome", 0 },
+    { "Ascend-Assign-IP-Global-Pool", 146, VENDOR_NONE, "pool-east", 0 },
+    { "MS-CHAP2-Success", 26, VENDOR_MICROSOFT,
+      "\001S=0123456789ABCDEF0123456789ABCDEF01234567", 0 },
+    { "MS-MPPE-Recv-Key", 17, VENDOR_MICROSOFT,
+      "\200\001abcdefghijklmnopqrstuvwxyz01234", 0 },
+    { "MS-MPPE-Send-Key", 16, VENDOR_MICROSOFT,
+      "\200\002ABCDEFGHIJKLMNOPQRSTUVWXYZ56789", 0 },
+    { "MS-MPPE-Encryption-Policy", 7, VENDOR_MICROSOFT, "\0\0\0\001", 0 },
+    { "MS-MPPE-Encryption-Types", 8, VENDOR_MICROSOFT, "\0\0\0\006", 0 },
+    { "MS-Primary-DNS-Server", 28, VENDOR_MICROSOFT, NULL, 0x0a000001 },
+    { "MS-Secondary-DNS-Server", 29, VENDOR_MICROSOFT, NULL, 0x0a000002 },
+};
+
+#define NREPLY	(sizeof(reply) / sizeof(reply[0]))
+
+/*
+ * The shipped dictionary INCLUDEs its Microsoft part from /etc, so
+ * make a copy that takes it, and the Ascend one, from the source tree.
+ */
+static int
+mkdict()
+{
+    char line[512];
+    FILE *in, *out;
+
+    if ((in = fopen(DICTDIR "/dictionary", "r")) == NULL
+	|| (out = fopen(dictname, "w")) == NULL)
+	return 0;
+    while (fgets(line, sizeof(line), in) != NULL)
+	if (strncmp(line, "INCLUDE", 7) != 0)
+	    fputs(line, out);
+    fprintf(out, "INCLUDE %s/dictionary.microsoft\n", DICTDIR);
+    fprintf(out, "INCLUDE %s/dictionary.ascend\n", DICTDIR);
+    fprintf(out, "ATTRIBUTE\tReply-Message\t200\tstring\tMicrosoft\n");
+    fclose(in);
+    fclose(out);
+    return 1;
+}
+
+static u_char *
+put(p, attribute, data, len)
+    u_char *p;
+    int attribute, len;
+    u_char *data;
+{
+    *p++ = attribute;
+    *p++ = len + 2;
+    memcpy(p, data, len);
+    return p + len;
+}
+
+/* Build the Access-Accept, with each vendor attribute in its own VSA. */
+static int
+mkreply(buf)
+    u_char *buf;
+{
+    AUTH_HDR *auth = (AUTH_HDR *) buf;
+    u_char *p = auth->data, vsa[256];
+    UINT4 lvalue;
+    struct reply *r;
+    int len;
+
+    auth->code = PW_ACCESS_ACCEPT;
+    auth->id = 1;
+    memset(auth->vector, 0, AUTH_VECTOR_LEN);
+    for (r = reply; r < reply + NREPLY; ++r) {
+	lvalue = htonl(r->lvalue);
+	len = r->str == NULL? 4: strlen(r->str);
+	if (r->str != NULL && r->str[0] == 0)
+	    len = 4;		/* the binary encryption policy and types */
+	if (r->vendor == VENDOR_NONE) {
+	    p = put(p, r->attribute, r->str? (u_char *) r->str:
+		    (u_char *) &lvalue, len);
+	    continue;
+	}
+	vsa[0] = 0;
+	vsa[1] = r->vendor >> 16;
+	vsa[2] = r->vendor >> 8;
+	vsa[3] = r->vendor;
+	put(vsa + 4, r->attribute, r->str? (u_char *) r->str:
+	    (u_char *) &lvalue, len);
+	p = put(p, PW_VENDOR_SPECIFIC, vsa, len + 6);
+    }
+    len = p - buf;
+    auth->length = htons((u_short) len);
+    return len;
+}
+
+static void
+check(auth)
+    AUTH_HDR *auth;
+{
+    VALUE_PAIR *vp, *pair;
+    DICT_ATTR *attr;
+    DICT_VALUE *val;
+    struct reply *r;
+    char upper[NAME_LENGTH + 1];
+    int i, bad = 0;
+
+    vp = rc_avpair_gen(auth);
+    for (r = reply, pair = vp; r < reply + NREPLY; ++r, pair = pair->next) {
+	if (pair == NULL) {
+	    CHECK(0, "attributes missing from the decoded reply");
+	    break;
+	}
+	if (strcmp(pair->name, r->name) != 0
+	    || pair->attribute != r->attribute || pair->vendorcode != r->vendor
+	    || (r->str == NULL && pair->lvalue != r->lvalue)
+	    || (r->str != NULL && r->str[0] != 0
+		&& strcmp((char *) pair->strvalue, r->str) != 0)) {
+	    printf("dicthash: %s decoded as %s\n", r->name, pair->name);
+	    ++failed;
+	}
+    }
+    rc_avpair_free(vp);
+
+    for (r = reply; r < reply + NREPLY; ++r) {
+	for (i = 0; r->name[i] != 0; ++i)
+	    upper[i] = toupper((unsigned char) r->name[i]);
+	upper[i] = 0;
+	attr = rc_dict_findattr(upper);
+	if (attr == NULL || attr->value != r->attribute
+	    || attr->vendorcode != r->vendor)
+	    ++bad;
+	attr = rc_dict_getattr(r->attribute, r->vendor);
+	if (attr == NULL || strcmp(attr->name, r->name) != 0)
+	    ++bad;
+    }
+    CHECK(bad == 0, "attribute lookups differ from the dictionary");
+
+    /* mkdict gives Microsoft a Reply-Message of its own */
+    attr = rc_dict_findattr("Reply-Message");
+    CHECK(attr != NULL && attr->vendorcode == VENDOR_NONE,
+	  "vendor attribute found before the standard one");
+    attr = rc_dict_getattr(PW_REPLY_MESSAGE, VENDOR_MICROSOFT);
+    CHECK(attr != NULL && strcmp(attr->name, "MS-RAS-Version") == 0,
+	  "standard and vendor attribute codes mixed up");
+    CHECK(rc_dict_getattr(PW_USER_NAME, 9999) == NULL,
+	  "attribute found for an unknown vendor");
+    attr = rc_dict_getattr(8, VENDOR_MICROSOFT);
+    CHECK(attr != NULL && strcmp(attr->name, "MS-MPPE-Encryption-Types") == 0,
+	  "later attribute definition not the one found");
+
+    val = rc_dict_getval(PW_PPP, "Framed-Protocol");
+    CHECK(val != NULL && strcmp(val->name, "PPP") == 0,
+	  "Framed-Protocol value 1 not found");
+    val = rc_dict_findval("framed-user");
+    CHECK(val != NULL && val->value == PW_FRAMED
+	  && strcmp(val->attrname, "Service-Type") == 0,
+	  "value name not found in another case");
+    /* the Ascend dictionary renames Outbound-User */
+    val = rc_dict_getval(5, "Service-Type");
+    CHECK(val != NULL && strcmp(val->name, "Dialout-Framed-User") == 0,
+	  "later value definition not the one found");
+}
+
+static double
+now()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void
+bench(auth)
+    AUTH_HDR *auth;
+{
+    volatile int sink = 0;
+    double t0, t;
+    struct reply *r;
+    int i, n = 200000;
+
+    t0 = now();
+    for (i = 0; i < n; ++i)
+	rc_avpair_free(rc_avpair_gen(auth));
+    t = now() - t0;
+    printf("dicthash: rc_avpair_gen %6.2f us per Access-Accept, %5.0f ns per attribute\n",
+	   t * 1e6 / n, t * 1e9 / n / NREPLY);
+
+    t0 = now();
+    for (i = 0; i < n; ++i)
+	for (r = reply; r < reply + NREPLY; ++r)
+	    sink += rc_dict_findattr(r->name)->value;
+    t = now() - t0;
+    printf("dicthash: rc_dict_findattr %5.0f ns per name\n",
+	   t * 1e9 / n / NREPLY);
+}
+
+int
+main(argc, argv)
+    int argc;
+    char **argv;
+{
+    static u_char buf[BUFFER_LEN];
+
+    if (!mkdict() || rc_read_dictionary(dictname) != 0) {
+	printf("dicthash: couldn't read the dictionary\n");
+	return 1;
+    }
+    unlink(dictname);
+    mkreply(buf);
+    if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+	bench((AUTH_HDR *) buf);
+	return 0;
+    }
+    check((AUTH_HDR *) buf);
+    if (failed)
+	return 1;
+    printf("dicthash: ok\n");
+    return 0;
+}
@@ -0,0 +1,217 @@
+/*
+ * dictimage.c - check that the RADIUS client falls back to the text
+ * dictionary when the precompiled image is damaged: counts or offsets
+ * that point outside it, hash chain indices out of range or looping,
+ * and strings without their terminating NUL.
+ */
+
+#include <includes.h>
+#include <radiusclient.h>
+#include <stdarg.h>
+#include <sys/wait.h>
+
+/* Offsets of some fields in struct dict_image (see dict.c) */
+#define IMG_NATTRS	8
+#define IMG_FILES	11
+#define IMG_ATTRS	12
+#define IMG_ATTR_BY_CODE 15
+#define IMG_ATTR_CODE_NEXT 19
+
+static char dictname[] = "dictimage.dict";
+static char imagename[] = "dictimage.img";
+static char *image;
+static int nerrors;
+
+char *
+rc_conf_str(optname)
+    char *optname;
+{
+    return strcmp(optname, "dictionary_image") == 0? image: NULL;
+}
+
+void
+error(char *fmt, ...)
+{
+    ++nerrors;
+}
+
+void dbglog(char *fmt, ...) { }
+void info(char *fmt, ...) { }
+void warn(char *fmt, ...) { }
+
+void
+novm(msg)
+    char *msg;
+{
+    abort();
+}
+
+static UINT4 *
+header(buf)
+    char *buf;
+{
+    return (UINT4 *) buf;
+}
+
+static void
+damage_count(buf)
+    char *buf;
+{
+    header(buf)[IMG_NATTRS] = 0x10000000;
+}
+
+static void
+damage_offset(buf)
+    char *buf;
+{
+    header(buf)[IMG_ATTRS] = 0xfffffff0;
+}
+
+static void
+damage_alignment(buf)
+    char *buf;
+{
+    header(buf)[IMG_ATTRS] += 1;
+}
+
+static void
+damage_head(buf)
+    char *buf;
+{
+    UINT4 *h = header(buf);
+
+    ((UINT4 *) (buf + h[IMG_ATTR_BY_CODE]))[0] = h[IMG_NATTRS] + 1;
+}
+
+static void
+damage_loop(buf)
+    char *buf;
+{
+    UINT4 *h = header(buf);
+
+    /* entry 1 links to itself */
+    ((UINT4 *) (buf + h[IMG_ATTR_CODE_NEXT]))[1] = 2;
+}
+
+static void
+damage_name(buf)
+    char *buf;
+{
+    DICT_ATTR *attr = (DICT_ATTR *) (buf + header(buf)[IMG_ATTRS]);
+
+    memset(attr->name, 'A', sizeof(attr->name));
+}
+
+static void
+damage_path(buf)
+    char *buf;
+{
+    memset(buf + header(buf)[IMG_FILES], 'A', PATH_MAX);
+}
+
+static struct damage {
+    char *what;
+    void (*fn) __P((char *));
+} damages[] = {
+    { "count", damage_count },
+    { "offset", damage_offset },
+    { "alignment", damage_alignment },
+    { "chain head", damage_head },
+    { "chain loop", damage_loop },
+    { "attribute name", damage_name },
+    { "file path", damage_path },
+};
+
+static char *
+readfile(name, lenp)
+    char *name;
+    int *lenp;
+{
+    struct stat st;
+    char *buf;
+    int fd;
+
+    if ((fd = open(name, O_RDONLY)) < 0 || fstat(fd, &st) < 0)
+	return NULL;
+    buf = malloc(st.st_size);
+    if (read(fd, buf, st.st_size) != st.st_size)
+	return NULL;
+    close(fd);
+    *lenp = st.st_size;
+    return buf;
+}
+
+/*
+ * Write a damaged copy of the image, then read the dictionary in a
+ * child process (it is global state) and see what it found.
+ */
+static int
+try(good, len, d)
+    char *good;
+    int len;
+    struct damage *d;
+{
+    char *buf = malloc(len);
+    DICT_ATTR *attr;
+    int fd, status;
+
+    memcpy(buf, good, len);
+    (*d->fn)(buf);
+    fd = open(imagename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    write(fd, buf, len);
+    close(fd);
+    free(buf);
+
+    if (fork() == 0) {
+	if (rc_read_dictionary(dictname) != 0)
+	    _exit(1);
+	attr = rc_dict_findattr("Framed-Protocol");
+	if (attr == NULL || attr->value != PW_FRAMED_PROTOCOL
+	    || nerrors != 1)	/* the image is reported as corrupt */
+	    _exit(1);
+	_exit(0);
+    }
+    wait(&status);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+	printf("dictimage: damaged %s not handled\n", d->what);
+	return 0;
+    }
+    return 1;
+}
+
+int
+main()
+{
+    FILE *f;
+    char *good;
+    int i, len, ok;
+
+    f = fopen(dictname, "w");
+    fprintf(f, "ATTRIBUTE\tUser-Name\t1\tstring\n");
+    fprintf(f, "ATTRIBUTE\tFramed-Protocol\t7\tinteger\n");
+    fprintf(f, "ATTRIBUTE\tReply-Message\t18\tstring\n");
+    fprintf(f, "VALUE\tFramed-Protocol\tPPP\t1\n");
+    fprintf(f, "VENDOR\tMicrosoft\t311\n");
+    fprintf(f, "ATTRIBUTE\tMS-CHAP-Challenge\t11\tstring\tMicrosoft\n");
+    fclose(f);
+
+    /* reading the text dictionary writes out the image */
+    image = imagename;
+    unlink(imagename);
+    if (rc_read_dictionary(dictname) != 0
+	|| (good = readfile(imagename, &len)) == NULL) {
+	printf("dictimage: couldn't make an image\n");
+	return 1;
+    }
+
+    ok = 1;
+    for (i = 0; i < sizeof(damages) / sizeof(damages[0]); ++i)
+	ok &= try(good, len, &damages[i]);
+
+    unlink(dictname);
+    unlink(imagename);
+    if (!ok)
+	return 1;
+    printf("dictimage: ok\n");
+    return 0;
+}
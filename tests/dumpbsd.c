@@ -0,0 +1,51 @@
+/*
+ * dumpbsd.c - pppdump's copy of the BSD-Compress decompressor, built
+ * under another name so that bsdcomp can link it alongside the kernel
+ * module's.  The two have different compressor structures, so bsdcomp
+ * calls this one through the functions below.
+ */
+
+#define ppp_bsd_compress pppdump_bsd_compress
+#include "../pppdump/bsd-comp.c"
+
+void *
+dump_bsd_alloc(options, opt_len)
+    u_char *options;
+    int opt_len;
+{
+    void *state;
+
+    state = (*ppp_bsd_compress.decomp_alloc)(options, opt_len);
+    if (state != NULL
+	&& !(*ppp_bsd_compress.decomp_init)(state, options, opt_len,
+					    0, 0, 1500, 0)) {
+	(*ppp_bsd_compress.decomp_free)(state);
+	state = NULL;
+    }
+    return state;
+}
+
+int
+dump_bsd_decompress(state, cmp, inlen, dmsg, outlenp)
+    void *state;
+    u_char *cmp, *dmsg;
+    int inlen, *outlenp;
+{
+    return (*ppp_bsd_compress.decompress)(state, cmp, inlen, dmsg, outlenp);
+}
+
+void
+dump_bsd_incomp(state, dmsg, len)
+    void *state;
+    u_char *dmsg;
+    int len;
+{
+    (*ppp_bsd_compress.incomp)(state, dmsg, len);
+}
+
+void
+dump_bsd_free(state)
+    void *state;
+{
+    (*ppp_bsd_compress.decomp_free)(state);
+}
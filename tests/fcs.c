@@ -0,0 +1,192 @@
+/*
+ * fcs.c - check pppfcs16 and pppfcs32 against the standard check
+ * values and against a bit-at-a-time reference, at every length up
+ * to 600 bytes from each of 16 alignments and at random lengths up
+ * to 64k, which is where FCS-32 takes its carry-less multiply path
+ * on CPUs that have one.  Frames with their FCS appended must leave
+ * the good FCS residue.
+ *
+ * "fcs -b" prints the throughput of each on 1500-byte frames instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <net/ppp_defs.h>
+#include "pppfcs.h"
+
+#define BUFLEN	70000
+
+static u_char buf[BUFLEN];
+static u_int32_t seed;
+static int failed;
+
+#define CHECK(c, msg) \
+    do { if (!(c)) { printf("fcs: %s\n", msg); ++failed; } } while (0)
+
+static u_int32_t
+rnd()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static u_int
+ref16(fcs, p, len)
+    u_int fcs;
+    const u_char *p;
+    int len;
+{
+    int j;
+
+    while (len-- > 0) {
+	fcs ^= *p++;
+	for (j = 0; j < 8; ++j)
+	    fcs = (fcs & 1)? (fcs >> 1) ^ 0x8408: fcs >> 1;
+    }
+    return fcs;
+}
+
+static u_int32_t
+ref32(fcs, p, len)
+    u_int32_t fcs;
+    const u_char *p;
+    int len;
+{
+    int j;
+
+    while (len-- > 0) {
+	fcs ^= *p++;
+	for (j = 0; j < 8; ++j)
+	    fcs = (fcs & 1)? (fcs >> 1) ^ 0xedb88320: fcs >> 1;
+    }
+    return fcs;
+}
+
+static void
+check()
+{
+    static u_char digits[] = "123456789";
+    u_char frame[PPP_MRU + PPP_FCS32LEN];
+    u_int32_t fcs;
+    u_int fcs16;
+    int len, off, i, bad;
+
+    /* the usual check values: CRC-16/X.25 and CRC-32 */
+    CHECK((pppfcs16(PPP_INITFCS, digits, 9) ^ 0xffff) == 0x906e,
+	  "FCS-16 of \"123456789\" is wrong");
+    CHECK((pppfcs32(PPP_INITFCS32, digits, 9) ^ 0xffffffff) == 0xcbf43926,
+	  "FCS-32 of \"123456789\" is wrong");
+
+    bad = 0;
+    for (len = 0; len < 600; ++len) {
+	for (off = 0; off < 16; ++off) {
+	    fcs = rnd();
+	    if (pppfcs16(fcs & 0xffff, buf + off, len)
+		!= ref16(fcs & 0xffff, buf + off, len))
+		++bad;
+	    if (pppfcs32(fcs, buf + off, len) != ref32(fcs, buf + off, len))
+		++bad;
+	}
+    }
+    for (i = 0; i < 2000; ++i) {
+	len = rnd() % 65536;
+	off = rnd() % 64;
+	fcs = rnd();
+	if (pppfcs16(fcs & 0xffff, buf + off, len)
+	    != ref16(fcs & 0xffff, buf + off, len))
+	    ++bad;
+	if (pppfcs32(fcs, buf + off, len) != ref32(fcs, buf + off, len))
+	    ++bad;
+    }
+    CHECK(bad == 0, "differs from the bitwise reference");
+
+    /* the same as going a byte at a time */
+    fcs16 = PPP_INITFCS;
+    for (i = 0; i < PPP_MRU; ++i)
+	fcs16 = PPP_FCS16(fcs16, buf[i]);
+    CHECK(fcs16 == pppfcs16(PPP_INITFCS, buf, PPP_MRU),
+	  "PPP_FCS16 differs from pppfcs16");
+
+    /* a frame followed by its FCS, least significant byte first */
+    memcpy(frame, buf, PPP_MRU);
+    fcs16 = pppfcs16(PPP_INITFCS, frame, PPP_MRU) ^ 0xffff;
+    frame[PPP_MRU] = fcs16;
+    frame[PPP_MRU + 1] = fcs16 >> 8;
+    CHECK(pppfcs16(PPP_INITFCS, frame, PPP_MRU + 2) == PPP_GOODFCS,
+	  "FCS-16 residue is wrong");
+    fcs = pppfcs32(PPP_INITFCS32, frame, PPP_MRU) ^ 0xffffffff;
+    for (i = 0; i < PPP_FCS32LEN; ++i)
+	frame[PPP_MRU + i] = fcs >> (8 * i);
+    CHECK(pppfcs32(PPP_INITFCS32, frame, PPP_MRU + PPP_FCS32LEN)
+	  == PPP_GOODFCS32, "FCS-32 residue is wrong");
+
+    /* and checking a frame in pieces gives the same answer */
+    fcs = pppfcs32(PPP_INITFCS32, frame, 700);
+    fcs = pppfcs32(fcs, frame + 700, PPP_MRU + PPP_FCS32LEN - 700);
+    CHECK(fcs == PPP_GOODFCS32, "FCS-32 in two pieces is wrong");
+}
+
+static double
+now()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void
+bench()
+{
+    volatile u_int32_t sink = 0;
+    u_int fcs;
+    double t0, mb;
+    int i, j, n = 200000;
+
+    mb = (double) n * PPP_MRU / 1e6;
+    t0 = now();
+    for (i = 0; i < n / 10; ++i)
+	sink += ref16(PPP_INITFCS, buf, PPP_MRU);
+    printf("fcs: bitwise FCS-16 %8.0f MB/s\n", mb / 10 / (now() - t0));
+    t0 = now();
+    for (i = 0; i < n; ++i) {
+	fcs = PPP_INITFCS;
+	for (j = 0; j < PPP_MRU; ++j)
+	    fcs = PPP_FCS16(fcs, buf[j]);
+	sink += fcs;
+    }
+    printf("fcs: PPP_FCS16      %8.0f MB/s\n", mb / (now() - t0));
+    t0 = now();
+    for (i = 0; i < n; ++i)
+	sink += pppfcs16(PPP_INITFCS, buf, PPP_MRU);
+    printf("fcs: pppfcs16       %8.0f MB/s\n", mb / (now() - t0));
+    t0 = now();
+    for (i = 0; i < n; ++i)
+	sink += pppfcs32(PPP_INITFCS32, buf, PPP_MRU);
+    printf("fcs: pppfcs32       %8.0f MB/s\n", mb / (now() - t0));
+}
+
+int
+main(argc, argv)
+    int argc;
+    char **argv;
+{
+    int i;
+
+    seed = 1;
+    for (i = 0; i < BUFLEN; ++i)
+	buf[i] = rnd();
+    pppfcs_init();
+    if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+	bench();
+	return 0;
+    }
+    check();
+    if (failed)
+	return 1;
+    printf("fcs: ok\n");
+    return 0;
+}
@@ -0,0 +1,307 @@
+/*
+ * mpjoin.c - many processes join multilink bundles at once, the way
+ * mp_join_bundle does: under lock_db_key on the bundle ID, look the
+ * bundle up in the ppp database, attach to its unit if it exists and
+ * make it otherwise.  Every member must end up in exactly one bundle,
+ * each bundle must have been made once, and its link list must name
+ * each member once.  The lock waits counted in link_db_lock_waits
+ * are reported.
+ *
+ * "mpjoin -b nproc" instead gives each process a bundle of its own
+ * and times the joins with the per-bundle locks and with the single
+ * lock_db lock they replaced.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "pppd.h"
+#include "tdb.h"
+
+#define MAXPROC	256
+#define HOLD_US	1000	/* bundle_attach etc. under the lock */
+
+TDB_CONTEXT *pppdb;
+
+static char dbname[] = "mpjoin.tdb";
+static char lockname[] = "mpjoin-locks.tdb";
+
+struct result {
+    int id;
+    int pid;
+    int unit;		/* ppp unit of the bundle it joined */
+    int created;	/* it made the bundle */
+    unsigned waits;	/* link_db_lock_waits */
+};
+
+void
+flush_db_entry()
+{
+}
+
+static int
+store(key, val)
+    char *key, *val;
+{
+    TDB_DATA k, d;
+
+    k.dptr = key;
+    k.dsize = strlen(key);
+    d.dptr = val;
+    d.dsize = strlen(val) + 1;
+    return tdb_store(pppdb, k, d, TDB_REPLACE);
+}
+
+/* fetch a string; the caller frees it */
+static char *
+fetch(key)
+    char *key;
+{
+    TDB_DATA k, d;
+
+    k.dptr = key;
+    k.dsize = strlen(key);
+    d = tdb_fetch(pppdb, k);
+    if (d.dptr != NULL && d.dsize > 0)
+	d.dptr[d.dsize-1] = 0;
+    return d.dptr;
+}
+
+/*
+ * Wait for the parent to let everyone go, then join bundle b,
+ * and write what happened to fd res.
+ */
+static void
+member(id, b, perkey, start, res)
+    int id, b, perkey, start, res;
+{
+    struct result r;
+    char db_key[32], bundle_id[32], blinks_id[48], entry[32], ifname[32];
+    char *pid, *rec, *p, *links, c;
+    int unit;
+
+    pppdb = tdb_open(dbname, 0, 0, O_RDWR, 0);
+    if (pppdb == NULL || (perkey && !open_lock_db(lockname)))
+	_exit(1);
+    sprintf(db_key, "pppd%d", getpid());
+    sprintf(bundle_id, "BUNDLE=\"peer%d\"", b);
+    sprintf(blinks_id, "BUNDLE_LINKS=%s", bundle_id + 7);
+    sprintf(entry, "%s;", db_key);
+    read(start, &c, 1);
+
+    lock_db_key(bundle_id);
+    unit = -1;
+    if ((pid = fetch(bundle_id)) != NULL) {
+	if ((rec = fetch(pid)) != NULL) {
+	    if ((p = strstr(rec, "IFNAME=ppp")) != NULL)
+		unit = atoi(p + 10);
+	    free(rec);
+	}
+	free(pid);
+    }
+    usleep(HOLD_US);
+    r.created = unit < 0;
+    if (unit >= 0) {
+	/* attach, as make_bundle_links(1) does */
+	if ((p = fetch(blinks_id)) == NULL
+	    || (links = malloc(strlen(p) + strlen(entry) + 1)) == NULL)
+	    _exit(1);
+	sprintf(links, "%s%s", p, entry);
+	if (store(blinks_id, links) != 0)
+	    _exit(1);
+	free(links);
+	free(p);
+    } else {
+	unit = id;
+	sprintf(ifname, "IFNAME=ppp%d", unit);
+	if (store(db_key, ifname) != 0
+	    || store(bundle_id, db_key) != 0 || store(blinks_id, entry) != 0)
+	    _exit(1);
+    }
+    unlock_db_key(bundle_id);
+
+    r.id = id;
+    r.pid = getpid();
+    r.unit = unit;
+    r.waits = link_db_lock_waits;
+    if (write(res, &r, sizeof(r)) != sizeof(r))
+	_exit(1);
+    close_lock_db();
+    tdb_close(pppdb);
+    _exit(0);
+}
+
+/*
+ * Start nproc members on nbundles bundles, let them all go at once,
+ * and collect their results in r.  Returns the time the joins took,
+ * or -1 if a member failed.
+ */
+static double
+run(nproc, nbundles, perkey, r)
+    int nproc, nbundles, perkey;
+    struct result *r;
+{
+    struct timeval t0, t1;
+    int start[2], res[2], i, status, ok = 1;
+
+    unlink(dbname);
+    unlink(lockname);
+    pppdb = tdb_open(dbname, 0, 0, O_RDWR | O_CREAT, 0644);
+    if (pppdb == NULL || pipe(start) < 0 || pipe(res) < 0)
+	return -1;
+    tdb_close(pppdb);
+    pppdb = NULL;
+    /* make the lock database before they all try to */
+    if (perkey && open_lock_db(lockname))
+	close_lock_db();
+
+    for (i = 0; i < nproc; ++i) {
+	if (fork() == 0) {
+	    close(start[1]);
+	    close(res[0]);
+	    member(i, i % nbundles, perkey, start[0], res[1]);
+	}
+    }
+    close(start[0]);
+    close(res[1]);
+    usleep(100000);		/* let them all open the databases */
+    gettimeofday(&t0, NULL);
+    close(start[1]);
+    for (i = 0; i < nproc; ++i)
+	if (read(res[0], &r[i], sizeof(r[i])) != sizeof(r[i]))
+	    ok = 0;
+    gettimeofday(&t1, NULL);
+    close(res[0]);
+    for (i = 0; i < nproc; ++i)
+	if (wait(&status) < 0 || !WIFEXITED(status)
+	    || WEXITSTATUS(status) != 0)
+	    ok = 0;
+    if (!ok)
+	return -1;
+    return (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1e6;
+}
+
+/*
+ * Check that each bundle was made by one member, that every member
+ * joined the unit of its bundle's maker, and that the bundle's link
+ * list has each member on it once.
+ */
+static int
+check(nproc, nbundles, r)
+    int nproc, nbundles;
+    struct result *r;
+{
+    char bundle_id[32], blinks_id[48], entry[32], *links, *p;
+    int b, i, maker, n, bad = 0;
+
+    pppdb = tdb_open(dbname, 0, 0, O_RDWR, 0);
+    if (pppdb == NULL)
+	return 0;
+    for (b = 0; b < nbundles; ++b) {
+	maker = -1;
+	n = 0;
+	for (i = 0; i < nproc; ++i)
+	    if (r[i].id % nbundles == b && r[i].created) {
+		maker = r[i].id;
+		++n;
+	    }
+	if (n != 1) {
+	    printf("mpjoin: bundle %d made %d times\n", b, n);
+	    ++bad;
+	    continue;
+	}
+	sprintf(bundle_id, "BUNDLE=\"peer%d\"", b);
+	sprintf(blinks_id, "BUNDLE_LINKS=%s", bundle_id + 7);
+	if ((links = fetch(blinks_id)) == NULL) {
+	    printf("mpjoin: bundle %d has no link list\n", b);
+	    ++bad;
+	    continue;
+	}
+	n = 0;
+	for (p = links; (p = strchr(p, ';')) != NULL; ++p)
+	    ++n;
+	for (i = 0; i < nproc; ++i) {
+	    if (r[i].id % nbundles != b)
+		continue;
+	    --n;
+	    sprintf(entry, "pppd%d;", r[i].pid);
+	    if (r[i].unit != maker || (p = strstr(links, entry)) == NULL
+		|| strstr(p + 1, entry) != NULL) {
+		printf("mpjoin: member %d of bundle %d joined ppp%d\n",
+		       r[i].id, b, r[i].unit);
+		++bad;
+	    }
+	}
+	if (n != 0) {
+	    printf("mpjoin: bundle %d link list is %s\n", b, links);
+	    ++bad;
+	}
+	free(links);
+    }
+    tdb_close(pppdb);
+    return bad == 0;
+}
+
+static unsigned
+waits(nproc, r)
+    int nproc;
+    struct result *r;
+{
+    unsigned n = 0;
+    int i;
+
+    for (i = 0; i < nproc; ++i)
+	n += r[i].waits;
+    return n;
+}
+
+int
+main(argc, argv)
+    int argc;
+    char **argv;
+{
+    static struct result r[MAXPROC];
+    int nproc = 32, nbundles = 4, ok;
+    double t, tglobal;
+
+    if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+	nproc = argc > 2? atoi(argv[2]): 16;
+	if (nproc < 1 || nproc > MAXPROC)
+	    nproc = MAXPROC;
+	t = run(nproc, nproc, 1, r);
+	tglobal = run(nproc, nproc, 0, r);
+	unlink(dbname);
+	unlink(lockname);
+	if (t < 0 || tglobal < 0) {
+	    printf("mpjoin: a member failed\n");
+	    return 1;
+	}
+	printf("mpjoin: %d processes on their own bundles: %.1f ms with"
+	       " per-bundle locks, %.1f ms with one lock\n",
+	       nproc, t * 1e3, tglobal * 1e3);
+	return 0;
+    }
+
+    t = run(nproc, nbundles, 1, r);
+    ok = t >= 0 && check(nproc, nbundles, r);
+    unlink(dbname);
+    unlink(lockname);
+    if (t < 0)
+	printf("mpjoin: a member failed\n");
+    if (!ok)
+	return 1;
+    printf("mpjoin: %d processes joined %d bundles, waiting %u times"
+	   " for a bundle lock\n", nproc, nbundles, waits(nproc, r));
+    if (waits(nproc, r) == 0) {
+	printf("mpjoin: no lock waits counted\n");
+	return 1;
+    }
+    printf("mpjoin: ok\n");
+    return 0;
+}
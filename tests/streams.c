@@ -0,0 +1,331 @@
+/*
+ * streams.c - user-space STREAMS routines for the module tests.
+ *
+ * A queue with no put procedure acts as a sink: messages sent to it
+ * are kept on its list in order, for the test to inspect with getq.
+ */
+
+#include <sys/types.h>
+#include <stdarg.h>
+#include <sys/stream.h>
+#include <sys/ddi.h>
+
+unsigned long kmem_calls, kmem_bytes;
+clock_t lbolt;
+
+mblk_t *
+allocb(size, pri)
+    int size, pri;
+{
+    mblk_t *mp;
+
+    mp = calloc(1, sizeof(*mp));
+    if (mp == NULL)
+	return NULL;
+    mp->b_datap = calloc(1, sizeof(dblk_t));
+    mp->b_datap->db_base = malloc(size > 0? size: 1);
+    mp->b_datap->db_lim = mp->b_datap->db_base + size;
+    mp->b_datap->db_ref = 1;
+    mp->b_rptr = mp->b_wptr = mp->b_datap->db_base;
+    return mp;
+}
+
+void
+freeb(mp)
+    mblk_t *mp;
+{
+    if (--mp->b_datap->db_ref == 0) {
+	free(mp->b_datap->db_base);
+	free(mp->b_datap);
+    }
+    free(mp);
+}
+
+void
+freemsg(mp)
+    mblk_t *mp;
+{
+    mblk_t *np;
+
+    for (; mp != NULL; mp = np) {
+	np = mp->b_cont;
+	freeb(mp);
+    }
+}
+
+int
+msgdsize(mp)
+    mblk_t *mp;
+{
+    int n = 0;
+
+    for (; mp != NULL; mp = mp->b_cont)
+	if (mp->b_datap->db_type == M_DATA)
+	    n += mp->b_wptr - mp->b_rptr;
+    return n;
+}
+
+mblk_t *
+copymsg(mp)
+    mblk_t *mp;
+{
+    mblk_t *head = NULL, **np = &head, *cp;
+    int n;
+
+    for (; mp != NULL; mp = mp->b_cont) {
+	n = mp->b_datap->db_lim - mp->b_datap->db_base;
+	if ((cp = allocb(n, BPRI_MED)) == NULL) {
+	    freemsg(head);
+	    return NULL;
+	}
+	cp->b_datap->db_type = mp->b_datap->db_type;
+	cp->b_rptr = cp->b_datap->db_base + (mp->b_rptr - mp->b_datap->db_base);
+	cp->b_wptr = cp->b_datap->db_base + (mp->b_wptr - mp->b_datap->db_base);
+	memcpy(cp->b_rptr, mp->b_rptr, mp->b_wptr - mp->b_rptr);
+	cp->b_band = mp->b_band;
+	*np = cp;
+	np = &cp->b_cont;
+    }
+    return head;
+}
+
+mblk_t *
+dupmsg(mp)
+    mblk_t *mp;
+{
+    mblk_t *head = NULL, **np = &head, *cp;
+
+    for (; mp != NULL; mp = mp->b_cont) {
+	cp = calloc(1, sizeof(*cp));
+	*cp = *mp;
+	cp->b_cont = cp->b_next = cp->b_prev = NULL;
+	++mp->b_datap->db_ref;
+	*np = cp;
+	np = &cp->b_cont;
+    }
+    return head;
+}
+
+int
+pullupmsg(mp, len)
+    mblk_t *mp;
+    int len;
+{
+    mblk_t *np;
+    unsigned char *buf;
+    int n, tot;
+
+    tot = msgdsize(mp);
+    if (len < 0)
+	len = tot;
+    if (len > tot)
+	return 0;
+    if (mp->b_wptr - mp->b_rptr >= len && mp->b_datap->db_ref == 1)
+	return 1;
+    buf = malloc(tot > 0? tot: 1);
+    for (n = 0, np = mp; np != NULL; np = np->b_cont) {
+	memcpy(buf + n, np->b_rptr, np->b_wptr - np->b_rptr);
+	n += np->b_wptr - np->b_rptr;
+    }
+    freemsg(mp->b_cont);
+    mp->b_cont = NULL;
+    if (--mp->b_datap->db_ref == 0)
+	free(mp->b_datap->db_base);
+    else
+	mp->b_datap = calloc(1, sizeof(dblk_t));
+    mp->b_datap->db_ref = 1;
+    mp->b_datap->db_type = M_DATA;
+    mp->b_datap->db_base = mp->b_rptr = buf;
+    mp->b_datap->db_lim = mp->b_wptr = buf + tot;
+    return 1;
+}
+
+mblk_t *
+msgpullup(mp, len)
+    mblk_t *mp;
+    int len;
+{
+    mblk_t *np = copymsg(mp);
+
+    if (np != NULL && !pullupmsg(np, len)) {
+	freemsg(np);
+	np = NULL;
+    }
+    return np;
+}
+
+int
+adjmsg(mp, len)
+    mblk_t *mp;
+    int len;
+{
+    mblk_t *np;
+    int n;
+
+    if (len >= 0) {
+	for (np = mp; np != NULL && len > 0; np = np->b_cont) {
+	    n = np->b_wptr - np->b_rptr;
+	    if (n > len)
+		n = len;
+	    np->b_rptr += n;
+	    len -= n;
+	}
+    } else {
+	len = -len;
+	while (len > 0) {
+	    mblk_t *last = NULL;
+	    for (np = mp; np != NULL; np = np->b_cont)
+		if (np->b_wptr > np->b_rptr)
+		    last = np;
+	    if (last == NULL)
+		break;
+	    n = last->b_wptr - last->b_rptr;
+	    if (n > len)
+		n = len;
+	    last->b_wptr -= n;
+	    len -= n;
+	}
+    }
+    return len == 0;
+}
+
+mblk_t *
+getq(q)
+    queue_t *q;
+{
+    mblk_t *mp = q->q_first;
+
+    if (mp != NULL) {
+	q->q_first = mp->b_next;
+	if (q->q_first == NULL)
+	    q->q_last = NULL;
+	mp->b_next = NULL;
+    }
+    return mp;
+}
+
+int
+putq(q, mp)
+    queue_t *q;
+    mblk_t *mp;
+{
+    mp->b_next = NULL;
+    if (q->q_last != NULL)
+	q->q_last->b_next = mp;
+    else
+	q->q_first = mp;
+    q->q_last = mp;
+    return 1;
+}
+
+int
+putbq(q, mp)
+    queue_t *q;
+    mblk_t *mp;
+{
+    mp->b_next = q->q_first;
+    q->q_first = mp;
+    if (q->q_last == NULL)
+	q->q_last = mp;
+    return 1;
+}
+
+/* Hand a message to q: its put procedure, or its list if it is a sink. */
+static void
+putq_or_call(q, mp)
+    queue_t *q;
+    mblk_t *mp;
+{
+    if (q->q_qinfo != NULL && q->q_qinfo->qi_putp != NULL)
+	(*q->q_qinfo->qi_putp)(q, mp);
+    else
+	putq(q, mp);
+}
+
+void
+putnext(q, mp)
+    queue_t *q;
+    mblk_t *mp;
+{
+    putq_or_call(q->q_next, mp);
+}
+
+void
+qreply(q, mp)
+    queue_t *q;
+    mblk_t *mp;
+{
+    putnext(OTHERQ(q), mp);
+}
+
+int
+putctl1(q, type, param)
+    queue_t *q;
+    int type, param;
+{
+    mblk_t *mp;
+
+    if ((mp = allocb(1, BPRI_HI)) == NULL)
+	return 0;
+    mp->b_datap->db_type = type;
+    *mp->b_wptr++ = param;
+    putq_or_call(q, mp);
+    return 1;
+}
+
+int
+canput(q)
+    queue_t *q;
+{
+    return !q->q_full;
+}
+
+int
+bcanputnext(q, band)
+    queue_t *q;
+    int band;
+{
+    return canput(q->q_next);
+}
+
+void
+flushq(q, flag)
+    queue_t *q;
+    int flag;
+{
+    mblk_t *mp;
+
+    while ((mp = getq(q)) != NULL)
+	freemsg(mp);
+}
+
+void
+qenable(q)
+    queue_t *q;
+{
+}
+
+void
+cmn_err(level, fmt)
+    int level;
+    char *fmt;
+{
+}
+
+int
+drv_getparm(parm, valuep)
+    unsigned int parm;
+    void *valuep;
+{
+    if (parm != LBOLT)
+	return -1;
+    *(clock_t *) valuep = lbolt;
+    return 0;
+}
+
+clock_t
+drv_usectohz(usec)
+    clock_t usec;
+{
+    return (usec + 999) / 1000;
+}
@@ -0,0 +1 @@
+/* Empty stand-in for tests/; see stream.h. */
@@ -0,0 +1,18 @@
+/*
+ * Stand-in for tests/; see stream.h.  The clock only moves when a
+ * test advances lbolt, one tick per millisecond.
+ */
+
+#ifndef _TESTS_SYS_DDI_H
+#define _TESTS_SYS_DDI_H
+
+#include <sys/types.h>
+
+#define LBOLT		4
+
+extern clock_t lbolt;
+
+int drv_getparm __P((unsigned int, void *));
+clock_t drv_usectohz __P((clock_t));
+
+#endif /* _TESTS_SYS_DDI_H */
@@ -0,0 +1,16 @@
+/*
+ * User-space kmem_alloc for tests/; counts calls and live bytes.
+ */
+#ifndef _TESTS_SYS_KMEM_H
+#define _TESTS_SYS_KMEM_H
+
+#include <stdlib.h>
+
+extern unsigned long kmem_calls, kmem_bytes;
+
+#define KM_SLEEP	0
+#define KM_NOSLEEP	1
+#define kmem_alloc(n, f)	(++kmem_calls, kmem_bytes += (n), malloc(n))
+#define kmem_free(p, n)		(kmem_bytes -= (n), free(p))
+
+#endif /* _TESTS_SYS_KMEM_H */
@@ -0,0 +1,138 @@
+/*
+ * Minimal user-space stand-in for the STREAMS interfaces used by
+ * the PPP modules, so that they can be run by the programs in tests/.
+ * Only what the modules touch is provided, and queues are simple
+ * lists with no flow control unless a test asks for it.
+ */
+#ifndef _TESTS_SYS_STREAM_H
+#define _TESTS_SYS_STREAM_H
+
+#include <sys/types.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+
+typedef struct datab {
+    unsigned char *db_base;
+    unsigned char *db_lim;
+    unsigned char db_type;
+    unsigned char db_ref;
+} dblk_t;
+
+typedef struct msgb {
+    struct msgb *b_next;
+    struct msgb *b_prev;
+    struct msgb *b_cont;
+    unsigned char *b_rptr;
+    unsigned char *b_wptr;
+    dblk_t *b_datap;
+    unsigned char b_band;
+} mblk_t;
+
+struct module_info {
+    unsigned short mi_idnum;
+    char *mi_idname;
+    long mi_minpsz;
+    long mi_maxpsz;
+    unsigned long mi_hiwat;
+    unsigned long mi_lowat;
+};
+
+struct queue;
+struct qinit {
+    int (*qi_putp)();
+    int (*qi_srvp)();
+    int (*qi_qopen)();
+    int (*qi_qclose)();
+    int (*qi_qadmin)();
+    struct module_info *qi_minfo;
+    void *qi_mstat;
+};
+
+struct streamtab {
+    struct qinit *st_rdinit;
+    struct qinit *st_wrinit;
+    struct qinit *st_muxrinit;
+    struct qinit *st_muxwinit;
+};
+
+typedef struct queue {
+    struct qinit *q_qinfo;
+    struct queue *q_next;
+    struct queue *q_other;	/* the other queue of the pair */
+    int q_isread;
+    void *q_ptr;
+    mblk_t *q_first;
+    mblk_t *q_last;
+    int q_full;			/* canput() fails while set */
+} queue_t;
+
+struct iocblk {
+    int ioc_cmd;
+    int ioc_count;
+    int ioc_error;
+    int ioc_rval;
+};
+
+typedef int cred_t;
+typedef int kmutex_t;
+#ifdef SVR4
+typedef unsigned char uchar_t;	/* <sys/types.h> has these on SVR4 */
+typedef unsigned short ushort_t;
+#endif
+
+#define MODOPEN		1	/* sflag when opened as a module */
+
+#define INFPSZ		(-1)
+#define BPRI_MED	1
+#define BPRI_HI		2
+
+#define M_DATA		0x00
+#define M_PROTO		0x01
+#define M_CTL		0x0d
+#define M_IOCTL		0x0e
+#define M_FLUSH		0x86
+#define M_IOCACK	0x81
+#define M_IOCNAK	0x82
+#define M_ERROR		0x8a
+#define M_HANGUP	0x89
+#define FLUSHR		0x01
+#define FLUSHW		0x02
+#define FLUSHRW		0x03
+#define FLUSHDATA	0
+
+#define RD(q)		((q)->q_isread? (q): (q)->q_other)
+#define WR(q)		((q)->q_isread? (q)->q_other: (q))
+#define OTHERQ(q)	((q)->q_other)
+
+#define mutex_enter(m)	(void)0
+#define mutex_exit(m)	(void)0
+#define mutex_init(m, n, t, a)	(void)0
+#define mutex_destroy(m)	(void)0
+
+mblk_t *allocb __P((int, int));
+void freemsg __P((mblk_t *));
+void freeb __P((mblk_t *));
+mblk_t *dupmsg __P((mblk_t *));
+mblk_t *copymsg __P((mblk_t *));
+int pullupmsg __P((mblk_t *, int));
+mblk_t *msgpullup __P((mblk_t *, int));
+int msgdsize __P((mblk_t *));
+int adjmsg __P((mblk_t *, int));
+mblk_t *getq __P((queue_t *));
+int putq __P((queue_t *, mblk_t *));
+int putbq __P((queue_t *, mblk_t *));
+void putnext __P((queue_t *, mblk_t *));
+void qreply __P((queue_t *, mblk_t *));
+int putctl1 __P((queue_t *, int, int));
+int canput __P((queue_t *));
+int bcanputnext __P((queue_t *, int));
+void flushq __P((queue_t *, int));
+void qenable __P((queue_t *));
+void cmn_err __P((int, char *, ...));
+#define CE_CONT		0
+#define CE_NOTE		1
+#define CE_WARN		2
+
+#endif /* _TESTS_SYS_STREAM_H */
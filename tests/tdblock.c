@@ -0,0 +1,267 @@
+/*
+ * tdblock.c - several processes increment counters in one tdb, each
+ * under its chain lock, and no increment may be lost.  This is built
+ * twice: tdblock with the mutex chain locks that pppd uses by default
+ * on Linux, and tdblock-fcntl with fcntl locks only.  The mutex build
+ * also checks that nothing opens a file whose chain locks it can't
+ * take: not the fcntl build, and not a read-only opener.  Then it
+ * leaves a chain lock held by a process that is gone, as a crash or
+ * reboot would, and checks that the next opener starts the locks
+ * afresh rather than waiting for ever.
+ *
+ * "tdblock -b nproc niter" prints how long the run took; "make bench"
+ * compares the two builds.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include "tdb.h"
+
+#define NKEYS	4	/* counters, so that chains are shared too */
+
+static char dbname[] = "tdblock.tdb";
+
+static TDB_DATA
+keyof(k, buf)
+    int k;
+    char *buf;
+{
+    TDB_DATA key;
+
+    sprintf(buf, "counter%d", k);
+    key.dptr = buf;
+    key.dsize = strlen(buf);
+    return key;
+}
+
+static int
+fetch(tdb, key)
+    TDB_CONTEXT *tdb;
+    TDB_DATA key;
+{
+    TDB_DATA d;
+    int n = 0;
+
+    d = tdb_fetch(tdb, key);
+    if (d.dptr != NULL) {
+	if (d.dsize == sizeof(n))
+	    memcpy(&n, d.dptr, sizeof(n));
+	free(d.dptr);
+    }
+    return n;
+}
+
+/*
+ * Each process does niter read-modify-writes, spread over the
+ * counters, then exits with 0 if all its locks and stores worked.
+ */
+static void
+worker(id, niter)
+    int id, niter;
+{
+    TDB_CONTEXT *tdb;
+    TDB_DATA key, d;
+    char buf[32];
+    int i, n;
+
+    tdb = tdb_open(dbname, 0, 0, O_RDWR, 0);
+    if (tdb == NULL)
+	_exit(1);
+    for (i = 0; i < niter; ++i) {
+	key = keyof((i + id) % NKEYS, buf);
+	if (tdb_chainlock(tdb, key) != 0)
+	    _exit(1);
+	n = fetch(tdb, key) + 1;
+	d.dptr = (char *) &n;
+	d.dsize = sizeof(n);
+	if (tdb_store(tdb, key, d, TDB_REPLACE) != 0)
+	    _exit(1);
+	tdb_chainunlock(tdb, key);
+    }
+    tdb_close(tdb);
+    _exit(0);
+}
+
+static int
+contend(nproc, niter, bench)
+    int nproc, niter, bench;
+{
+    TDB_CONTEXT *tdb;
+    struct timeval t0, t1;
+    char buf[32];
+    int i, k, status, total, ok = 1;
+
+    unlink(dbname);
+    tdb = tdb_open(dbname, 0, 0, O_RDWR | O_CREAT, 0644);
+    if (tdb == NULL) {
+	printf("tdblock: couldn't create %s: %s\n", dbname, strerror(errno));
+	return 0;
+    }
+    /* a process may only have a file open once */
+    tdb_close(tdb);
+
+    gettimeofday(&t0, NULL);
+    for (i = 0; i < nproc; ++i)
+	if (fork() == 0)
+	    worker(i, niter);
+    for (i = 0; i < nproc; ++i)
+	if (wait(&status) < 0 || !WIFEXITED(status)
+	    || WEXITSTATUS(status) != 0)
+	    ok = 0;
+    gettimeofday(&t1, NULL);
+
+    tdb = tdb_open(dbname, 0, 0, O_RDWR, 0);
+    total = 0;
+    for (k = 0; tdb != NULL && k < NKEYS; ++k)
+	total += fetch(tdb, keyof(k, buf));
+    if (tdb != NULL)
+	tdb_close(tdb);
+    if (!ok || total != nproc * niter) {
+	printf("tdblock: %d of %d updates made\n", total, nproc * niter);
+	return 0;
+    }
+    if (bench)
+	printf("tdblock: %s locks, %d processes x %d updates: %.3f s\n",
+#ifdef USE_TDB_MUTEX
+	       "mutex",
+#else
+	       "fcntl",
+#endif
+	       nproc, niter,
+	       (t1.tv_sec - t0.tv_sec) + (t1.tv_usec - t0.tv_usec) / 1e6);
+    return 1;
+}
+
+/*
+ * With -x, we are the fcntl build looking at the mutex build's file:
+ * opening it at all must fail, without taking any lock on it.
+ */
+static int
+foreign()
+{
+    if (tdb_open(dbname, 0, 0, O_RDWR, 0) != NULL || errno != EIO) {
+	printf("tdblock: fcntl build opened a file with mutex locks\n");
+	return 1;
+    }
+    if (tdb_open(dbname, 0, 0, O_RDONLY, 0) != NULL) {
+	printf("tdblock: fcntl build read a file with mutex locks\n");
+	return 1;
+    }
+    return 0;
+}
+
+#ifdef USE_TDB_MUTEX
+static void
+timedout(sig)
+    int sig;
+{
+    printf("tdblock: chain lock left by a dead process never freed\n");
+    fflush(stdout);
+    _exit(1);
+}
+
+/*
+ * A child takes a chain lock, and we copy the file while it holds it.
+ * Putting the copy back after the child has gone leaves the lock
+ * owned by a process that no longer exists, which the kernel's robust
+ * mutex cleanup never saw.  The next open must start the locks afresh.
+ */
+static int
+stale()
+{
+    TDB_CONTEXT *tdb;
+    TDB_DATA key;
+    struct stat st;
+    char buf[32], *image = NULL;
+    int fd, p[2], q[2], status, ok = 0;
+
+    if (tdb_open(dbname, 0, 0, O_RDONLY, 0) != NULL || errno != EACCES) {
+	printf("tdblock: opened a file with mutex locks read-only\n");
+	return 0;
+    }
+    if (pipe(p) < 0 || pipe(q) < 0)
+	return 0;
+    if (fork() == 0) {
+	tdb = tdb_open(dbname, 0, 0, O_RDWR, 0);
+	if (tdb == NULL || tdb_chainlock(tdb, keyof(0, buf)) != 0)
+	    _exit(1);
+	write(p[1], "", 1);
+	read(q[0], buf, 1);
+	_exit(0);
+    }
+    if (read(p[0], buf, 1) == 1 && (fd = open(dbname, O_RDWR)) >= 0) {
+	if (fstat(fd, &st) == 0 && (image = malloc(st.st_size)) != NULL
+	    && read(fd, image, st.st_size) == st.st_size)
+	    ok = 1;
+	write(q[1], "", 1);
+	if (wait(&status) < 0 || !WIFEXITED(status)
+	    || WEXITSTATUS(status) != 0)
+	    ok = 0;
+	if (ok && pwrite(fd, image, st.st_size, 0) != st.st_size)
+	    ok = 0;
+	close(fd);
+    }
+    close(p[0]);
+    close(p[1]);
+    close(q[0]);
+    close(q[1]);
+    free(image);
+    if (!ok) {
+	printf("tdblock: couldn't leave a chain lock held\n");
+	return 0;
+    }
+
+    signal(SIGALRM, timedout);
+    alarm(10);
+    tdb = tdb_open(dbname, 0, 0, O_RDWR, 0);
+    key = keyof(0, buf);
+    if (tdb == NULL || tdb_chainlock(tdb, key) != 0) {
+	printf("tdblock: couldn't reopen after a dead lock holder\n");
+	return 0;
+    }
+    alarm(0);
+    tdb_chainunlock(tdb, key);
+    tdb_close(tdb);
+    return 1;
+}
+#endif
+
+int
+main(argc, argv)
+    int argc;
+    char **argv;
+{
+    int bench = 0, nproc = 4, niter = 2000;
+
+    if (argc > 1 && strcmp(argv[1], "-x") == 0)
+	return foreign();
+    if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+	bench = 1;
+	--argc;
+	++argv;
+    }
+    if (argc > 1)
+	nproc = atoi(argv[1]);
+    if (argc > 2)
+	niter = atoi(argv[2]);
+
+    if (!contend(nproc, niter, bench))
+	return 1;
+#ifdef USE_TDB_MUTEX
+    if (!bench && (system("./tdblock-fcntl -x") != 0 || !stale()))
+	return 1;
+#endif
+    unlink(dbname);
+    if (!bench)
+	printf("tdblock: ok\n");
+    return 0;
+}
@@ -0,0 +1,348 @@
+/*
+ * timeouts.c - check pppd's timeout heap against the sorted list it
+ * replaced, kept here as the reference.  Random schedules, cancels
+ * and clock advances go to both, and the routines must be called in
+ * the same order, with timeleft agreeing in between.  Some routines
+ * schedule themselves again, as the protocol timers do.  Many timers
+ * share a (func, arg) pair, so untimeout must cancel the first due.
+ * Each routine must run on the unit it was scheduled from, with the
+ * caller's unit current again afterwards.
+ *
+ * "timeouts -b" times scheduling, cancelling and running timers with
+ * each instead, for ten up to a million pending timeouts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include "pppd.h"
+
+#define NKEYS	64
+#define NUNITS	4	/* key k is scheduled from unit k % NUNITS */
+#define NLOG	200000
+
+static struct timeval clock_now;	/* what get_time says */
+static u_int32_t seed;
+static int keys[NKEYS];
+static int heap_log[NLOG], ref_log[NLOG];
+static int n_heap_log, n_ref_log;
+static int wrong_unit;		/* routines run on the wrong unit */
+
+int cur_unit;
+
+void
+select_unit(unit)
+    int unit;
+{
+    cur_unit = unit;
+}
+
+int
+get_time(tv)
+    struct timeval *tv;
+{
+    *tv = clock_now;
+    return 0;
+}
+
+void
+fatal(char *fmt, ...)
+{
+    printf("timeouts: fatal: %s\n", fmt);
+    exit(1);
+}
+
+static u_int32_t
+rnd()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+/*
+ * The sorted list of callouts that pppd used before, with the clock
+ * above.
+ */
+struct ref_callout {
+    struct timeval	c_time;
+    void		*c_arg;
+    void		(*c_func) __P((void *));
+    struct ref_callout	*c_next;
+};
+
+static struct ref_callout *ref_callout;
+
+static void
+ref_timeout(func, arg, secs, usecs)
+    void (*func) __P((void *));
+    void *arg;
+    int secs, usecs;
+{
+    struct ref_callout *newp, *p, **pp;
+
+    newp = (struct ref_callout *) malloc(sizeof(*newp));
+    newp->c_arg = arg;
+    newp->c_func = func;
+    newp->c_time.tv_sec = clock_now.tv_sec + secs;
+    newp->c_time.tv_usec = clock_now.tv_usec + usecs;
+    if (newp->c_time.tv_usec >= 1000000) {
+	newp->c_time.tv_sec += newp->c_time.tv_usec / 1000000;
+	newp->c_time.tv_usec %= 1000000;
+    }
+    for (pp = &ref_callout; (p = *pp) != NULL; pp = &p->c_next)
+	if (newp->c_time.tv_sec < p->c_time.tv_sec
+	    || (newp->c_time.tv_sec == p->c_time.tv_sec
+		&& newp->c_time.tv_usec < p->c_time.tv_usec))
+	    break;
+    newp->c_next = p;
+    *pp = newp;
+}
+
+static void
+ref_untimeout(func, arg)
+    void (*func) __P((void *));
+    void *arg;
+{
+    struct ref_callout **copp, *freep;
+
+    for (copp = &ref_callout; (freep = *copp) != NULL; copp = &freep->c_next)
+	if (freep->c_func == func && freep->c_arg == arg) {
+	    *copp = freep->c_next;
+	    free(freep);
+	    break;
+	}
+}
+
+static void
+ref_calltimeout()
+{
+    struct ref_callout *p;
+
+    while ((p = ref_callout) != NULL) {
+	if (!(p->c_time.tv_sec < clock_now.tv_sec
+	      || (p->c_time.tv_sec == clock_now.tv_sec
+		  && p->c_time.tv_usec <= clock_now.tv_usec)))
+	    break;
+	ref_callout = p->c_next;
+	(*p->c_func)(p->c_arg);
+	free(p);
+    }
+}
+
+static struct timeval *
+ref_timeleft(tvp)
+    struct timeval *tvp;
+{
+    if (ref_callout == NULL)
+	return NULL;
+    tvp->tv_sec = ref_callout->c_time.tv_sec - clock_now.tv_sec;
+    tvp->tv_usec = ref_callout->c_time.tv_usec - clock_now.tv_usec;
+    if (tvp->tv_usec < 0) {
+	tvp->tv_usec += 1000000;
+	tvp->tv_sec -= 1;
+    }
+    if (tvp->tv_sec < 0)
+	tvp->tv_sec = tvp->tv_usec = 0;
+    return tvp;
+}
+
+/* Every seventh key's routine usually schedules itself again. */
+static void
+heap_fire(arg)
+    void *arg;
+{
+    int k = (int *) arg - keys;
+
+    if (cur_unit != k % NUNITS)
+	++wrong_unit;
+    if (n_heap_log < NLOG)
+	heap_log[n_heap_log++] = k;
+    if (k % 7 == 0 && n_heap_log % 3 != 0)
+	timeout(heap_fire, arg, 1, 0);
+}
+
+static void
+ref_fire(arg)
+    void *arg;
+{
+    int k = (int *) arg - keys;
+
+    if (n_ref_log < NLOG)
+	ref_log[n_ref_log++] = k;
+    if (k % 7 == 0 && n_ref_log % 3 != 0)
+	ref_timeout(ref_fire, arg, 1, 0);
+}
+
+static void
+advance(usecs)
+    long usecs;
+{
+    clock_now.tv_usec += usecs;
+    clock_now.tv_sec += clock_now.tv_usec / 1000000;
+    clock_now.tv_usec %= 1000000;
+}
+
+static int
+check(nops)
+    int nops;
+{
+    struct timeval tv1, tv2, *p1, *p2;
+    int i, k, secs, usecs, bad = 0;
+
+    for (i = 0; i < nops && !bad; ++i) {
+	k = rnd() % NKEYS;
+	switch (rnd() % 8) {
+	case 0: case 1: case 2: case 3:
+	    /* coarse times, so that many fall due together */
+	    secs = rnd() % 6;
+	    usecs = (rnd() % 4 == 0)? 0: (rnd() % 4) * 250000;
+	    cur_unit = k % NUNITS;
+	    timeout(heap_fire, &keys[k], secs, usecs);
+	    cur_unit = 0;
+	    ref_timeout(ref_fire, &keys[k], secs, usecs);
+	    break;
+	case 4: case 5:
+	    untimeout(heap_fire, &keys[k]);
+	    ref_untimeout(ref_fire, &keys[k]);
+	    break;
+	default:
+	    advance(rnd() % 1500000);
+	    calltimeout();
+	    ref_calltimeout();
+	    if (n_heap_log != n_ref_log
+		|| memcmp(heap_log, ref_log, n_heap_log * sizeof(int)) != 0) {
+		printf("timeouts: routines called in a different order\n");
+		++bad;
+	    }
+	    if (wrong_unit || cur_unit != 0) {
+		printf("timeouts: routines run on the wrong unit\n");
+		++bad;
+	    }
+	    break;
+	}
+	p1 = timeleft(&tv1);
+	p2 = ref_timeleft(&tv2);
+	if ((p1 == NULL) != (p2 == NULL)
+	    || (p1 != NULL && (tv1.tv_sec != tv2.tv_sec
+			       || tv1.tv_usec != tv2.tv_usec))) {
+	    printf("timeouts: timeleft differs\n");
+	    ++bad;
+	}
+	if (n_heap_log >= NLOG / 2)
+	    n_heap_log = n_ref_log = 0;
+    }
+    return !bad;
+}
+
+static double
+now()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void
+nop(arg)
+    void *arg;
+{
+}
+
+/*
+ * Schedule n timeouts at random times, cancel half of them, then run
+ * the rest.  Returns microseconds per timeout.  The heap is checked
+ * to be empty afterwards, so that a million timeouts are known to
+ * have all run.
+ */
+static double
+time_heap(n, args)
+    int n;
+    int *args;
+{
+    double t0 = now();
+    struct timeval tv;
+    int i;
+
+    for (i = 0; i < n; ++i)
+	timeout(nop, &args[i], rnd() % 100, rnd() % 1000000);
+    for (i = 0; i < n; i += 2)
+	untimeout(nop, &args[i]);
+    advance(100 * 1000000L);
+    calltimeout();
+    t0 = (now() - t0) * 1e6 / n;
+    if (timeleft(&tv) != NULL) {
+	printf("timeouts: %d timeouts left over\n", n);
+	exit(1);
+    }
+    return t0;
+}
+
+static double
+time_ref(n, args)
+    int n;
+    int *args;
+{
+    double t0 = now();
+    int i;
+
+    for (i = 0; i < n; ++i)
+	ref_timeout(nop, &args[i], rnd() % 100, rnd() % 1000000);
+    for (i = 0; i < n; i += 2)
+	ref_untimeout(nop, &args[i]);
+    advance(100 * 1000000L);
+    ref_calltimeout();
+    return (now() - t0) * 1e6 / n;
+}
+
+/*
+ * Beyond LIST_MAX pending timeouts only the heap is timed: the list
+ * takes time quadratic in the number pending.
+ */
+#define LIST_MAX	10000
+
+static void
+bench()
+{
+    static int sizes[] = { 10, 100, 1000, 10000, 100000, 1000000 };
+    int *args, i, r, reps;
+    double th, tr;
+
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+	args = calloc(sizes[i], sizeof(int));
+	reps = sizes[i] < 100000? 100000 / sizes[i]: 2;
+	th = tr = 0;
+	for (r = 0; r < reps; ++r) {
+	    th += time_heap(sizes[i], args);
+	    if (sizes[i] <= LIST_MAX)
+		tr += time_ref(sizes[i], args);
+	}
+	if (sizes[i] <= LIST_MAX)
+	    printf("timeouts: %7d pending: heap %6.3f us, list %7.3f us per timeout\n",
+		   sizes[i], th / reps, tr / reps);
+	else
+	    printf("timeouts: %7d pending: heap %6.3f us per timeout\n",
+		   sizes[i], th / reps);
+	free(args);
+    }
+}
+
+int
+main(argc, argv)
+    int argc;
+    char **argv;
+{
+    seed = 1;
+    clock_now.tv_sec = 1000;
+    if (argc > 1 && strcmp(argv[1], "-b") == 0) {
+	bench();
+	return 0;
+    }
+    if (!check(200000))
+	return 1;
+    printf("timeouts: ok\n");
+    return 0;
+}
@@ -0,0 +1,188 @@
+/*
+ * vjcomp.c - drive interleaved TCP flows through the VJ compressor
+ * and decompressor.  Each run checks that every packet comes back
+ * out of the decompressor as it went in, and that the compressor's
+ * output matches a digest taken from the original linear-search
+ * compressor, so that looking states up by hash has not changed
+ * which slot a packet uses or which state gets evicted.  Every tenth
+ * packet has TCP options but is passed with a short length, which
+ * the compressor must send as TYPE_IP after rotating its lru list.
+ * The decompressor must also refuse a connection number beyond the
+ * receive slots it was set up with.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <netinet/in_systm.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <net/ppp_defs.h>
+#include <net/vjcompress.h>
+
+struct flow {
+    u_int32_t src, dst;
+    u_short sport, dport;
+    u_int32_t seq, ack;
+    u_short id;
+};
+
+static struct vjcompress xc, rc;
+static u_int32_t seed;
+
+static u_int32_t
+rnd()
+{
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+/*
+ * Send npk packets spread over nflows flows through a compressor with
+ * nslots slots.  Returns a digest of the compressed output and sets
+ * *bad to the number of packets that didn't come back intact.
+ */
+static u_int32_t
+run(nflows, npk, nslots, bad)
+    int nflows, npk, nslots, *bad;
+{
+    struct flow *flows, *fl;
+    u_char buf[200], orig[200], *vjhdr, *hdr;
+    struct ip *ip = (struct ip *) buf;
+    struct tcphdr *th = (struct tcphdr *) (buf + 20);
+    u_int32_t sum = 0;
+    u_int hlen;
+    int i, k, dlen, len, type, vlen;
+
+    flows = calloc(nflows, sizeof(*flows));
+    seed = 1;
+    for (i = 0; i < nflows; ++i) {
+	flows[i].src = htonl(0x0a000000 + i);
+	flows[i].dst = htonl(0xc0a80001);
+	flows[i].sport = htons(1024 + i);
+	flows[i].dport = htons(80);
+	flows[i].seq = rnd();
+	flows[i].ack = rnd();
+	flows[i].id = rnd();
+    }
+    if (vj_compress_init(&xc, nslots - 1, -1) < 0
+	|| vj_compress_init(&rc, -1, nslots - 1) < 0)
+	*bad = 1;
+    else
+	*bad = 0;
+
+    for (i = 0; i < npk; ++i) {
+	/* most packets belong to a few busy flows */
+	if (rnd() % 100 < 70)
+	    fl = &flows[rnd() % (nflows < 4? nflows: 4)];
+	else
+	    fl = &flows[rnd() % nflows];
+	dlen = (rnd() % 3)? 100: 0;
+	len = 40 + dlen;
+
+	memset(buf, 0, sizeof(buf));
+	ip->ip_v = 4;
+	ip->ip_hl = 5;
+	ip->ip_len = htons(len);
+	ip->ip_id = htons(fl->id++);
+	ip->ip_ttl = 64;
+	ip->ip_p = IPPROTO_TCP;
+	ip->ip_src.s_addr = fl->src;
+	ip->ip_dst.s_addr = fl->dst;
+	th->th_sport = fl->sport;
+	th->th_dport = fl->dport;
+	th->th_seq = htonl(fl->seq);
+	th->th_ack = htonl(fl->ack);
+	th->th_off = 5;
+	th->th_flags = TH_ACK;
+	th->th_win = htons(8192);
+	th->th_sum = htons(i);
+	for (k = 0; k < dlen; ++k)
+	    buf[40 + k] = rnd();
+	fl->seq += dlen;
+	if (rnd() & 1)
+	    fl->ack += 1460;
+
+	if (rnd() % 10 == 0) {
+	    th->th_off = 8;
+	    type = vj_compress_tcp(ip, 45, &xc, 1, &vjhdr);
+	    sum = sum * 31 + type;
+	    continue;
+	}
+
+	memcpy(orig, buf, len);
+	type = vj_compress_tcp(ip, len, &xc, 1, &vjhdr);
+	sum = sum * 31 + type;
+	if (type == TYPE_COMPRESSED_TCP) {
+	    vlen = len - (vjhdr - buf);
+	    for (k = 0; k < vlen; ++k)
+		sum = sum * 31 + vjhdr[k];
+	    k = vj_uncompress_tcp(vjhdr, vlen, vlen, &rc, &hdr, &hlen);
+	    /* the checksum field is carried; ip_sum is recomputed */
+	    if (k < 0 || hlen != 40 || memcmp(hdr, orig, 10) != 0
+		|| memcmp(hdr + 12, orig + 12, 28) != 0
+		|| memcmp(vjhdr + k, orig + 40, dlen) != 0)
+		++*bad;
+	} else {
+	    for (k = 0; k < len; ++k)
+		sum = sum * 31 + buf[k];
+	    if (type == TYPE_UNCOMPRESSED_TCP
+		&& (!vj_uncompress_uncomp(buf, len, &rc)
+		    || memcmp(buf, orig, len) != 0))
+		++*bad;
+	}
+    }
+    free(flows);
+    return sum;
+}
+
+static struct test {
+    int nflows, npk, nslots;
+    u_int32_t digest;	/* from the linear-search compressor, if known */
+} tests[] = {
+    { 8, 50000, 16, 0x7c3822ba },
+    { 50, 100000, 16, 0x0206eb03 },
+    { 200, 100000, 16, 0xba251824 },
+    { 200, 100000, 255, 0 },	/* more slots than it had */
+};
+
+int
+main()
+{
+    struct test *t;
+    u_int32_t sum;
+    u_char cid[4], *hdr;
+    u_int hlen;
+    int bad, failed = 0;
+
+    for (t = tests; t < tests + sizeof(tests) / sizeof(tests[0]); ++t) {
+	sum = run(t->nflows, t->npk, t->nslots, &bad);
+	if (bad || (t->digest != 0 && sum != t->digest)) {
+	    printf("vjcomp: %d flows, %d slots: digest %08x want %08x, %d bad\n",
+		   t->nflows, t->nslots, sum, t->digest, bad);
+	    ++failed;
+	}
+    }
+
+    /* rc has 255 receive slots from the last run, then 16 */
+    cid[0] = NEW_C;
+    cid[1] = 200;
+    cid[2] = cid[3] = 0;
+    if (vj_uncompress_tcp(cid, 4, 4, &rc, &hdr, &hlen) < 0) {
+	printf("vjcomp: connection 200 refused with 255 receive slots\n");
+	++failed;
+    }
+    vj_compress_init(&rc, -1, -1);
+    if (vj_uncompress_tcp(cid, 4, 4, &rc, &hdr, &hlen) >= 0) {
+	printf("vjcomp: connection 200 taken with 16 receive slots\n");
+	++failed;
+    }
+    vj_compress_free(&xc);
+    vj_compress_free(&rc);
+    if (failed)
+	return 1;
+    printf("vjcomp: ok\n");
+    return 0;
+}